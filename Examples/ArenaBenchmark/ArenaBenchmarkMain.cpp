@@ -0,0 +1,374 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// ArenaBenchmark, Compares building a procedural scene on the heap and in a SceneArena
+
+#include <osg/ArgumentParser>
+#include <osg/Group>
+#include <osg/MatrixTransform>
+#include <osg/Geode>
+#include <osg/Geometry>
+#include <osg/StateSet>
+#include <osg/Material>
+#include <osg/NodeVisitor>
+#include <osg/Timer>
+#include <osg/Notify>
+#include "SceneArena.h"
+#include "TimingStats.h"
+#include <cstdlib>
+#include <set>
+#include <vector>
+#include <string>
+
+using std::endl;
+
+
+// Heap allocations by other work, interleaved with construction, as
+//   in an application that rebuilds its scene while it runs. Freeing
+//   half of them afterwards leaves the heap scene among holes.
+class HeapChurn
+{
+public:
+    ~HeapChurn()
+    {
+        unsigned int idx;
+        for (idx=0; idx<_blocks.size(); idx++)
+            delete[] _blocks[ idx ];
+    }
+
+    void step()
+    {
+        _blocks.push_back( new char[ 16 + rand() % 240 ] );
+    }
+    void freeHalf()
+    {
+        unsigned int idx;
+        for (idx=0; idx<_blocks.size(); idx+=2)
+        {
+            delete[] _blocks[ idx ];
+            _blocks[ idx ] = NULL;
+        }
+    }
+
+protected:
+    std::vector< char* > _blocks;
+};
+
+// One tile of the scene: a MatrixTransform over a Geode holding a
+//   grid x grid vertex Geometry with its own StateSet and Material.
+//   Everything is allocated with arenaNew(), so it comes from the
+//   current SceneArena if one is set.
+static osg::Node*
+createTile( unsigned int tile, unsigned int side, unsigned int grid,
+    bool reserve, HeapChurn* churn )
+{
+    osg::ref_ptr<osg::Geometry> geom = arenaNew<osg::Geometry>();
+    geom->setDataVariance( osg::Object::STATIC );
+    if (churn != NULL) churn->step();
+
+    osg::ref_ptr<osg::Vec3Array> v = arenaNew<osg::Vec3Array>();
+    if (reserve)
+        v->reserve( grid * grid );
+    geom->setVertexArray( v.get() );
+    unsigned int x, y;
+    for (y=0; y<grid; y++)
+    {
+        for (x=0; x<grid; x++)
+            v->push_back( osg::Vec3( (float)x, 0.f, (float)y ) / (float)( grid - 1 ) );
+        if (churn != NULL) churn->step();
+    }
+
+    osg::ref_ptr<osg::Vec3Array> n = arenaNew<osg::Vec3Array>();
+    geom->setNormalArray( n.get() );
+    geom->setNormalBinding( osg::Geometry::BIND_OVERALL );
+    n->push_back( osg::Vec3( 0.f, -1.f, 0.f ) );
+
+    osg::ref_ptr<osg::DrawElementsUShort> de =
+        arenaNew<osg::DrawElementsUShort>( osg::PrimitiveSet::TRIANGLES );
+    if (reserve)
+        de->reserve( ( grid - 1 ) * ( grid - 1 ) * 6 );
+    for (y=0; y+1<grid; y++)
+    {
+        for (x=0; x+1<grid; x++)
+        {
+            const unsigned short i = y * grid + x;
+            de->push_back( i ); de->push_back( i+1 ); de->push_back( i+grid+1 );
+            de->push_back( i ); de->push_back( i+grid+1 ); de->push_back( i+grid );
+        }
+    }
+    geom->addPrimitiveSet( de.get() );
+    if (churn != NULL) churn->step();
+
+    osg::ref_ptr<osg::Geode> geode = arenaNew<osg::Geode>();
+    geode->setDataVariance( osg::Object::STATIC );
+    geode->addDrawable( geom.get() );
+
+    osg::StateSet* state = arenaNew<osg::StateSet>();
+    geode->setStateSet( state );
+    osg::Material* mat = arenaNew<osg::Material>();
+    const float shade = (float)( tile % 8 ) / 7.f;
+    mat->setDiffuse( osg::Material::FRONT, osg::Vec4( shade, .5f, 1.f - shade, 1.f ) );
+    state->setAttribute( mat );
+    if (churn != NULL) churn->step();
+
+    osg::ref_ptr<osg::MatrixTransform> mt = arenaNew<osg::MatrixTransform>(
+        osg::Matrix::translate( 1.1f * ( tile % side ), 0.f, 1.1f * ( tile / side ) ) );
+    mt->setDataVariance( osg::Object::STATIC );
+    mt->addChild( geode.get() );
+    return( mt.release() );
+}
+
+static osg::Node*
+createProceduralScene( unsigned int numTiles, unsigned int grid,
+    bool reserve, HeapChurn* churn )
+{
+    osg::ref_ptr<osg::Group> root = arenaNew<osg::Group>();
+    root->setDataVariance( osg::Object::STATIC );
+    unsigned int side( 1 );
+    while (side * side < numTiles)
+        side++;
+    unsigned int idx;
+    for (idx=0; idx<numTiles; idx++)
+        root->addChild( createTile( idx, side, grid, reserve, churn ) );
+    return( root.release() );
+}
+
+
+// Reads what a traversal reads: each node, its StateSet, and each
+//   Geometry with its arrays and primitive sets.
+class TouchVisitor : public osg::NodeVisitor
+{
+public:
+    TouchVisitor()
+      : osg::NodeVisitor( osg::NodeVisitor::TRAVERSE_ALL_CHILDREN ),
+        _record( false ),
+        _sum( 0. )
+    {}
+
+    virtual void apply( osg::Node& node )
+    {
+        touch( &node );
+        touch( node.getStateSet() );
+        traverse( node );
+    }
+    virtual void apply( osg::Transform& transform )
+    {
+        osg::MatrixTransform* mt = transform.asMatrixTransform();
+        if (mt != NULL)
+            _sum += mt->getMatrix()( 3, 0 );
+        apply( (osg::Node&)transform );
+    }
+    virtual void apply( osg::Geode& geode )
+    {
+        unsigned int idx;
+        for (idx=0; idx<geode.getNumDrawables(); idx++)
+        {
+            osg::Geometry* geom = geode.getDrawable( idx )->asGeometry();
+            touch( geom );
+            if (geom == NULL)
+                continue;
+            touch( geom->getVertexArray() );
+            if (geom->getVertexArray() != NULL)
+                _sum += geom->getVertexArray()->getNumElements();
+            touch( geom->getNormalArray() );
+            unsigned int pIdx;
+            for (pIdx=0; pIdx<geom->getNumPrimitiveSets(); pIdx++)
+            {
+                osg::PrimitiveSet* ps = geom->getPrimitiveSet( pIdx );
+                touch( ps );
+                _sum += ps->getNumIndices();
+            }
+        }
+        apply( (osg::Node&)geode );
+    }
+
+    // Objects in traversal order, for the layout statistics.
+    bool _record;
+    std::vector< const void* > _objects;
+    double _sum;
+
+protected:
+    void touch( const void* object )
+    {
+        if ( (object != NULL) && _record )
+            _objects.push_back( object );
+    }
+};
+
+// How closely the objects a traversal visits lie in memory, in
+//   traversal order. Fewer pages and nearer neighbors mean fewer
+//   cache and TLB misses.
+static void
+reportLayout( const std::string& name, const std::vector< const void* >& objects )
+{
+    if (objects.size() < 2)
+        return;
+    const size_t PageSize( 4096 );
+    const size_t LineSize( 64 );
+    std::set< size_t > pages;
+    double strideSum( 0. );
+    unsigned int samePage( 0 ), nearby( 0 );
+    unsigned int idx;
+    for (idx=0; idx<objects.size(); idx++)
+    {
+        const size_t addr = (size_t)objects[ idx ];
+        pages.insert( addr / PageSize );
+        if (idx == 0)
+            continue;
+        const size_t prev = (size_t)objects[ idx-1 ];
+        const size_t stride = (addr > prev) ? addr - prev : prev - addr;
+        strideSum += (double)stride;
+        if (addr / PageSize == prev / PageSize)
+            samePage++;
+        if (stride <= 4 * LineSize)
+            nearby++;
+    }
+    const double pairs = (double)( objects.size() - 1 );
+    osg::notify( osg::ALWAYS ) << name << " layout: " << objects.size() << " objects on " <<
+        pages.size() << " pages, mean stride " << strideSum / pairs << " bytes, " <<
+        100. * samePage / pairs << "% on the previous object's page, " <<
+        100. * nearby / pairs << "% within 4 cache lines of it" << endl;
+}
+
+// Resets every bound below a node, so getBound() recomputes them.
+class DirtyBoundVisitor : public osg::NodeVisitor
+{
+public:
+    DirtyBoundVisitor()
+      : osg::NodeVisitor( osg::NodeVisitor::TRAVERSE_ALL_CHILDREN ) {}
+
+    virtual void apply( osg::Node& node )
+    {
+        node.dirtyBound();
+        traverse( node );
+    }
+    virtual void apply( osg::Geode& geode )
+    {
+        unsigned int idx;
+        for (idx=0; idx<geode.getNumDrawables(); idx++)
+            geode.getDrawable( idx )->dirtyBound();
+        apply( (osg::Node&)geode );
+    }
+};
+
+struct Configuration
+{
+    const char* _name;
+    bool _arena;
+    bool _reserve;
+};
+
+static void
+runConfiguration( const Configuration& config, unsigned int numTiles,
+    unsigned int grid, bool churn, unsigned int numRuns, TimingReport& report )
+{
+    osg::Timer* timer = osg::Timer::instance();
+    std::vector< double > build, visit, bound, release;
+    unsigned int run;
+    for (run=0; run<numRuns; run++)
+    {
+        HeapChurn heapChurn;
+        osg::ref_ptr< SceneArena > arena = config._arena ? new SceneArena : NULL;
+
+        osg::Timer_t start = timer->tick();
+        osg::ref_ptr<osg::Node> root;
+        {
+            ScopedSceneArena scope( arena.get() );
+            root = createProceduralScene( numTiles, grid, config._reserve,
+                churn ? &heapChurn : NULL );
+        }
+        build.push_back( timer->delta_m( start, timer->tick() ) );
+        heapChurn.freeHalf();
+
+        TouchVisitor tv;
+        tv._record = (run == 0);
+        start = timer->tick();
+        root->accept( tv );
+        visit.push_back( timer->delta_m( start, timer->tick() ) );
+        if (run == 0)
+        {
+            reportLayout( config._name, tv._objects );
+            if (arena.valid())
+                osg::notify( osg::ALWAYS ) << config._name << " arena: " <<
+                    arena->getNumAllocations() << " objects, " <<
+                    arena->getBytesUsed() / 1024 << " KB used of " <<
+                    arena->getBytesReserved() / 1024 << " KB in " <<
+                    arena->getNumBlocks() << " blocks" << endl;
+        }
+
+        DirtyBoundVisitor dbv;
+        root->accept( dbv );
+        start = timer->tick();
+        root->getBound();
+        bound.push_back( timer->delta_m( start, timer->tick() ) );
+
+        // Drop the scene and, with it, the arena's blocks.
+        start = timer->tick();
+        root = NULL;
+        arena = NULL;
+        release.push_back( timer->delta_m( start, timer->tick() ) );
+    }
+
+    const char* phases[ 4 ] = { "build", "visit", "bound", "release" };
+    const std::vector< double >* samples[ 4 ] = { &build, &visit, &bound, &release };
+    unsigned int idx;
+    for (idx=0; idx<4; idx++)
+    {
+        const TimingSummary summary = summarizeTimings( *( samples[ idx ] ) );
+        std::vector< std::string > keys;
+        keys.push_back( config._name );
+        keys.push_back( phases[ idx ] );
+        report.addRow( keys, summary );
+        osg::notify( osg::ALWAYS ) << config._name << ", " << phases[ idx ] << ": " <<
+            summary._mean << " ms mean, " << summary._p50 << " ms median" << endl;
+    }
+}
+
+int
+main( int argc, char** argv )
+{
+    osg::ArgumentParser arguments( &argc, argv );
+
+    // Usage: ArenaBenchmark [--tiles n] [--grid n] [--runs n]
+    //   [--no-churn] [--out file.csv|file.json]
+    unsigned int numTiles( 20000 );
+    arguments.read( "--tiles", numTiles );
+    unsigned int grid( 4 );
+    arguments.read( "--grid", grid );
+    if (grid < 2)
+        grid = 2;
+    unsigned int numRuns( 5 );
+    arguments.read( "--runs", numRuns );
+    const bool churn = !arguments.read( "--no-churn" );
+    std::string out( "ArenaBenchmark.csv" );
+    arguments.read( "--out", out );
+
+    osg::notify( osg::ALWAYS ) << numTiles << " tiles of " << grid << "x" << grid <<
+        " vertices, " << numRuns << " runs, " << ( churn ? "with" : "without" ) <<
+        " heap churn." << endl;
+
+    std::vector< std::string > keyNames;
+    keyNames.push_back( "configuration" );
+    keyNames.push_back( "phase" );
+    TimingReport report( keyNames );
+
+    const Configuration configs[] = {
+        { "heap", false, false },
+        { "heap+reserve", false, true },
+        { "arena+reserve", true, true },
+        { NULL, false, false } };
+    unsigned int idx;
+    for (idx=0; configs[ idx ]._name != NULL; idx++)
+        runConfiguration( configs[ idx ], numTiles, grid, churn, numRuns, report );
+
+    if (!report.write( out ))
+    {
+        osg::notify( osg::FATAL ) << "Unable to write \"" << out << "\"." << endl;
+        return( 1 );
+    }
+    osg::notify( osg::ALWAYS ) << "Wrote \"" << out << "\"." << endl;
+    return( 0 );
+}
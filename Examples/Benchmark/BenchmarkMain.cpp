@@ -0,0 +1,383 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// Benchmark Example, Headless CPU cost of update, cull and intersection
+
+#include "BenchmarkScenes.h"
+#include "HeadlessTraversals.h"
+#include "TimingStats.h"
+#include "FrameRecorder.h"
+#include "InstanceGroup.h"
+#include "GeometryConsolidator.h"
+#include "StateMerger.h"
+#include "TextBatch.h"
+#include "StatePool.h"
+#include "TransformFlattener.h"
+#include "SpatialGroup.h"
+#include "ParallelUpdate.h"
+#include <osg/MatrixTransform>
+#include <osg/ArgumentParser>
+#include <osg/Timer>
+#include <osg/Notify>
+#include <sstream>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <vector>
+#include <string>
+
+using std::endl;
+
+// Parse a comma-separated list of instance counts, such as
+//   "1,100,10000".
+static std::vector< unsigned int >
+parseCounts( const std::string& list )
+{
+    std::vector< unsigned int > counts;
+    std::istringstream in( list );
+    std::string item;
+    while (std::getline( in, item, ',' ))
+    {
+        unsigned int n = (unsigned int)atoi( item.c_str() );
+        if (n > 0)
+            counts.push_back( n );
+    }
+    return( counts );
+}
+
+static std::string
+toString( unsigned int n )
+{
+    std::ostringstream ostr;
+    ostr << n;
+    return( ostr.str() );
+}
+
+// Intersect the same rays with plain under a translated MatrixTransform,
+//   then with index in its place, and return the number of rays whose
+//   nearest hits differ. The camera is framed on plain and kept for
+//   both, so a pick that goes down the wrong octree cells shows up
+//   as a mismatch.
+static unsigned int
+countPickMismatches( osg::Node* plain, osg::Node* index, unsigned int numRays )
+{
+    osg::ref_ptr<osg::MatrixTransform> mt = new osg::MatrixTransform(
+        osg::Matrix::translate( osg::Vec3( 3.f, -2.f, 1.f ) * plain->getBound().radius() ) );
+    mt->addChild( plain );
+    std::vector< double > plainRatios, indexRatios;
+    {
+        HeadlessTraversals frame( mt.get() );
+        frame.intersect( numRays, &plainRatios );
+        mt->setChild( 0, index );
+        frame.intersect( numRays, &indexRatios );
+    }
+    unsigned int count( 0 );
+    unsigned int idx;
+    for (idx=0; idx<numRays; idx++)
+    {
+        if (fabs( plainRatios[ idx ] - indexRatios[ idx ] ) > 1e-6)
+            count++;
+    }
+    return( count );
+}
+
+int
+main( int argc, char** argv )
+{
+    osg::ArgumentParser arguments( &argc, argv );
+
+    // Usage: Benchmark [--scene name]... [--instances 1,10,100]
+    //   [--frames n] [--rays n] [--instancing] [--consolidate]
+    //   [--merge-state] [--batch-text] [--share-state] [--flatten]
+    //   [--batch-cull] [--occlusion] [--layers n] [--spatial]
+    //   [--simulate steps] [--update-threads 1,2,4]
+    //   [--out file.csv|file.json]
+    std::vector< std::string > sceneNames;
+    std::string name;
+    while (arguments.read( "--scene", name ))
+        sceneNames.push_back( name );
+    if (sceneNames.empty())
+    {
+        const BenchmarkScene* scene;
+        for (scene=benchmarkScenes; scene->_name != NULL; scene++)
+            sceneNames.push_back( scene->_name );
+    }
+    std::string instanceList( "1,10,100,1000,10000" );
+    arguments.read( "--instances", instanceList );
+    const std::vector< unsigned int > counts = parseCounts( instanceList );
+    unsigned int numFrames( 50 );
+    arguments.read( "--frames", numFrames );
+    unsigned int numRays( 8 );
+    arguments.read( "--rays", numRays );
+    const bool instancing = arguments.read( "--instancing" );
+    const bool consolidate = arguments.read( "--consolidate" );
+    const bool mergeState = arguments.read( "--merge-state" );
+    const bool batch = arguments.read( "--batch-text" );
+    const bool share = arguments.read( "--share-state" );
+    const bool flatten = arguments.read( "--flatten" );
+    const bool batchCull = arguments.read( "--batch-cull" );
+    const bool occlusion = arguments.read( "--occlusion" );
+    unsigned int numLayers( 1 );
+    arguments.read( "--layers", numLayers );
+    const bool spatial = arguments.read( "--spatial" );
+    unsigned int simSteps( 0 );
+    arguments.read( "--simulate", simSteps );
+    // Update thread counts to compare. Each count is a pass of its
+    //   own, and a report key.
+    std::string threadList;
+    const bool scaling = arguments.read( "--update-threads", threadList );
+    const std::vector< unsigned int > threadCounts = parseCounts( threadList );
+    const unsigned int numPasses = scaling ? threadCounts.size() : 1;
+    std::string out( "Benchmark.csv" );
+    arguments.read( "--out", out );
+
+    std::vector< std::string > keyNames;
+    keyNames.push_back( "scene" );
+    keyNames.push_back( "instances" );
+    if (scaling)
+        keyNames.push_back( "threads" );
+    keyNames.push_back( "phase" );
+    TimingReport report( keyNames );
+
+    // State shared across the scenes lives as long as they do.
+    osg::ref_ptr<StatePool> statePool;
+    if (share)
+        statePool = new StatePool;
+
+    bool picksMatch( true );
+    osg::Timer* timer = osg::Timer::instance();
+    const unsigned int isectScope = FrameRecorder::instance()->getScope( "intersect" );
+    unsigned int sIdx;
+    for (sIdx=0; sIdx<sceneNames.size(); sIdx++)
+    {
+        const BenchmarkScene* entry = findBenchmarkScene( sceneNames[ sIdx ] );
+        if (entry == NULL)
+        {
+            osg::notify( osg::WARN ) << "Unknown scene \"" << sceneNames[ sIdx ] << "\"." << endl;
+            continue;
+        }
+        osg::ref_ptr<osg::Node> scene = entry->_create();
+        if (!scene.valid())
+        {
+            osg::notify( osg::WARN ) << "Failed to create scene \"" << entry->_name << "\"." << endl;
+            continue;
+        }
+
+        if (consolidate)
+        {
+            // Every copy shares the scene, so consolidate it once.
+            const ConsolidationReport cr = consolidateGeometry( scene.get() );
+            osg::notify( osg::ALWAYS ) << entry->_name << ": drawables " <<
+                cr._before._drawables << " -> " << cr._after._drawables <<
+                ", primitive sets " << cr._before._primitiveSets << " -> " <<
+                cr._after._primitiveSets << ", triangles " << cr._before._triangles <<
+                " -> " << cr._after._triangles << ", ACMR " << cr._before.getACMR() <<
+                " -> " << cr._after.getACMR() << endl;
+        }
+        if (mergeState)
+        {
+            // After consolidating, which would reorder the merged
+            //   triangles behind the remap table's back.
+            const StateMergeReport mr = mergeByState( scene.get() );
+            osg::notify( osg::ALWAYS ) << entry->_name << ": geodes " <<
+                mr._geodesBefore << " -> " << mr._geodesAfter << ", drawables " <<
+                mr._drawablesBefore << " -> " << mr._drawablesAfter << " in " <<
+                mr._stateGroups << " state groups" << endl;
+        }
+        if (batch)
+        {
+            const unsigned int numTexts = batchText( scene.get() );
+            osg::notify( osg::ALWAYS ) << entry->_name << ": " << numTexts <<
+                " text drawables batched" << endl;
+        }
+        if (share)
+        {
+            // Pool the scene's state with that of the scenes
+            //   built so far.
+            const StateShareReport sr = shareState( scene.get(), statePool.get() );
+            osg::notify( osg::ALWAYS ) << entry->_name << ": StateSets " <<
+                sr._stateSetsBefore << " -> " << sr._stateSetsAfter << ", attributes " <<
+                sr._attributesBefore << " -> " << sr._attributesAfter << ", state memory " <<
+                sr._bytesBefore << " -> " << sr._bytesAfter << " bytes" << endl;
+        }
+
+        unsigned int cIdx;
+        for (cIdx=0; cIdx<counts.size(); cIdx++)
+        {
+            osg::ref_ptr<osg::Group> root = replicateScene( scene.get(), counts[ cIdx ], numLayers );
+            if (simSteps > 0)
+            {
+                // Before flattening and instancing, which leave the
+                //   now DYNAMIC transforms alone.
+                const unsigned int numSimulated = simulateCopies( root.get(), simSteps );
+                osg::notify( osg::ALWAYS ) << entry->_name << " x" << counts[ cIdx ] <<
+                    ": " << numSimulated << " copies simulated, " << simSteps <<
+                    " steps per frame" << endl;
+            }
+            if (flatten)
+            {
+                // Bake or instance the copies' transforms, and any
+                //   inside the scene, as the cost model sees fit.
+                const FlattenReport fr = flattenStaticTransforms( root.get() );
+                unsigned int dIdx;
+                for (dIdx=0; dIdx<fr._decisions.size(); dIdx++)
+                {
+                    const FlattenDecision& d = fr._decisions[ dIdx ];
+                    const char* outcome = ( d._outcome == FlattenDecision::BAKE ) ? "bake" :
+                        ( ( d._outcome == FlattenDecision::INSTANCE ) ? "instance" : "keep" );
+                    osg::notify( osg::INFO ) << "  " << d._name << ": " << d._sharers <<
+                        " transforms, " << d._vertices << " vertices, " << outcome <<
+                        ", " << d._cullSaving / 1000.f << " us saved, " <<
+                        d._bytesAdded << " bytes added" << endl;
+                }
+                osg::notify( osg::ALWAYS ) << entry->_name << " x" << counts[ cIdx ] <<
+                    ": transforms " << fr._transformsBefore << " -> " << fr._transformsAfter <<
+                    " (" << fr._baked << " baked, " << fr._instanced << " instanced, " <<
+                    fr._kept << " kept), estimated cull saving " << fr._cullSaving <<
+                    " us for " << fr._bytesAdded / 1024 << " KB of vertex data" << endl;
+            }
+            if (instancing)
+            {
+                // Collapse the copies, and any shared subgraphs
+                //   inside the scene, into InstanceGroups.
+                const InstancingReport ir = instanceSubgraphs( root.get() );
+                osg::notify( osg::ALWAYS ) << entry->_name << " x" << counts[ cIdx ] <<
+                    ": " << ir._instances << " transforms became " <<
+                    ir._instanceGroups << " instance groups, nodes " <<
+                    ir._nodesBefore << " -> " << ir._nodesAfter << ", node memory " <<
+                    ir._bytesBefore / 1024 << " -> " << ir._bytesAfter / 1024 << " KB" << endl;
+            }
+            if (spatial)
+            {
+                // Move the copies under a SpatialGroup.
+                osg::ref_ptr<SpatialGroup> index = new SpatialGroup;
+                index->setName( root->getName() );
+                unsigned int idx;
+                for (idx=0; idx<root->getNumChildren(); idx++)
+                    index->addChild( root->getChild( idx ) );
+                // Build the octree now, for the counts.
+                index->getBound();
+                osg::notify( osg::ALWAYS ) << entry->_name << " x" << counts[ cIdx ] <<
+                    ": " << index->getNumChildren() << " children in " <<
+                    index->getNumCells() << " octree cells" << endl;
+                // Picks through the octree must find what picks through
+                //   the plain Group do.
+                const unsigned int numChecked = std::max( numRays, 64u );
+                const unsigned int mismatches = countPickMismatches(
+                    root.get(), index.get(), numChecked );
+                picksMatch = picksMatch && (mismatches == 0);
+                if (mismatches > 0)
+                    osg::notify( osg::WARN ) << entry->_name << " x" << counts[ cIdx ] <<
+                        ": " << mismatches << " of " << numChecked <<
+                        " picks through the octree differ from the plain Group" << endl;
+                root = index.get();
+            }
+            HeadlessTraversals frame( root.get() );
+            if (occlusion)
+                frame.setOcclusionCulling( true );
+            if (batchCull || occlusion)
+            {
+                // The BatchCuller's bounds, test and emit scopes
+                //   become rows of their own.
+                frame.setBatchCulling( true );
+                osg::notify( osg::ALWAYS ) << entry->_name << " x" << counts[ cIdx ] <<
+                    ": " << frame.getBatchCuller()->getNumLeaves() << " leaves batch culled, " <<
+                    frame.getBatchCuller()->getNumFallbacks() << " subgraphs culled node by node" << endl;
+            }
+
+            double firstUpdate( 0. );
+            unsigned int tIdx;
+            for (tIdx=0; tIdx<numPasses; tIdx++)
+            {
+                // With --update-threads, each pass updates the same
+                //   copies on that many threads.
+                osg::ref_ptr<ParallelUpdateCallback> parallel;
+                std::string label;
+                if (scaling)
+                {
+                    parallel = new ParallelUpdateCallback( threadCounts[ tIdx ] );
+                    root->setUpdateCallback( parallel.get() );
+                    label = ", " + toString( parallel->getNumThreads() ) + " threads";
+                }
+
+                // One untimed frame computes bounds and warms caches,
+                //   and splits the update into tasks.
+                frame.update();
+                if (parallel.valid())
+                    osg::notify( osg::ALWAYS ) << entry->_name << " x" << counts[ cIdx ] <<
+                        label << ": " << parallel->getNumTasks() << " update tasks in " <<
+                        parallel->getNumUnits() << " independent units (" <<
+                        parallel->getNumSerialUnits() << " serial), " <<
+                        parallel->getNumShared() << " joined by shared objects" << endl;
+                const unsigned int numDrawn = frame.cull();
+                const unsigned int numHits = frame.intersect( numRays );
+
+                // Phases and scopes, such as TransformAnimator's, go to
+                //   the recorder; each channel becomes a report row.
+                FrameRecorder* recorder = FrameRecorder::instance();
+                recorder->reset();
+                unsigned int fIdx;
+                for (fIdx=0; fIdx<numFrames; fIdx++)
+                {
+                    osg::Timer_t t0 = timer->tick();
+                    frame.update();
+                    osg::Timer_t t1 = timer->tick();
+                    frame.cull();
+                    osg::Timer_t t2 = timer->tick();
+                    frame.intersect( numRays );
+                    osg::Timer_t t3 = timer->tick();
+                    recorder->record( FrameRecorder::UPDATE, timer->delta_m( t0, t1 ) );
+                    recorder->record( FrameRecorder::CULL, timer->delta_m( t1, t2 ) );
+                    recorder->record( isectScope, timer->delta_m( t2, t3 ) );
+                    recorder->endFrame();
+                }
+
+                std::vector< std::string > keys;
+                keys.push_back( entry->_name );
+                keys.push_back( toString( counts[ cIdx ] ) );
+                if (scaling)
+                    keys.push_back( toString( parallel->getNumThreads() ) );
+                recorder->addRows( report, keys );
+
+                if (occlusion)
+                {
+                    const OcclusionStats& os =
+                        frame.getBatchCuller()->getOcclusionCuller()->getStats();
+                    osg::notify( osg::ALWAYS ) << entry->_name << " x" << counts[ cIdx ] <<
+                        ": " << os._occluders << " occluders (" << os._occluderTriangles <<
+                        " triangles) in " << os._rasterizeTime << " ms, " << os._rejected <<
+                        " of " << os._tested << " leaves occluded in " << os._testTime <<
+                        " ms, last frame" << endl;
+                }
+
+                const TimingSummary update = recorder->getSummary( FrameRecorder::UPDATE );
+                const TimingSummary cull = recorder->getSummary( FrameRecorder::CULL );
+                const TimingSummary isect = recorder->getSummary( isectScope );
+                osg::notify( osg::ALWAYS ) << entry->_name << " x" << counts[ cIdx ] <<
+                    label << ": update " << update._p50 << " ms, cull " << cull._p50 <<
+                    " ms (" << numDrawn << " drawn), intersect " << isect._p50 <<
+                    " ms (" << numHits << "/" << numRays << " hit), median of " <<
+                    numFrames << " frames" << endl;
+
+                if (tIdx == 0)
+                    firstUpdate = update._p50;
+                if (parallel.valid())
+                {
+                    osg::notify( osg::ALWAYS ) << entry->_name << " x" << counts[ cIdx ] <<
+                        label << ": update speedup " << firstUpdate / update._p50 <<
+                        " over the first pass, " << parallel->getNumSteals() <<
+                        " batches stolen in the last frame" << endl;
+                    root->setUpdateCallback( NULL );
+                }
+            }
+        }
+    }
+
+    if (!report.write( out ))
+        return( 1 );
+    osg::notify( osg::ALWAYS ) << "Wrote \"" << out << "\"." << endl;
+    return( picksMatch ? 0 : 1 );
+}
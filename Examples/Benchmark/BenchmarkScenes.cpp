@@ -0,0 +1,137 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// Benchmark Example, The example scenes and their replication
+
+#include "BenchmarkScenes.h"
+#include <osg/MatrixTransform>
+#include <osg/NodeCallback>
+#include <algorithm>
+#include <cmath>
+
+// Every example names its scene function createSceneGraph(). The
+//   build compiles each example's scene source with a define that
+//   renames it, so all of them can link into one executable.
+osg::Node* createSimpleSceneGraph();
+osg::Node* createStateSceneGraph();
+osg::Node* createLightingSceneGraph();
+osg::Node* createTextSceneGraph();
+osg::Node* createTextureMappingSceneGraph();
+osg::Node* createCallbackSceneGraph();
+osg::Node* createPickingSceneGraph();
+
+// The update callback of simulateCopies(). Each has its own state,
+//   so the callbacks of different copies are independent.
+class SimulationCallback : public osg::NodeCallback
+{
+public:
+    SimulationCallback( const osg::Matrix& home, unsigned int steps,
+        float phase, float amplitude )
+      : _home( home ), _steps( steps ), _time( phase ),
+        _amplitude( amplitude ), _x( 0.f ), _v( 0.f ) {}
+
+    virtual void operator()( osg::Node* node, osg::NodeVisitor* nv )
+    {
+        // One frame at 60Hz, in _steps explicit Euler steps.
+        const float h = 1.f / ( 60.f * _steps );
+        unsigned int idx;
+        for (idx=0; idx<_steps; idx++)
+        {
+            const float force = sinf( _time ) - 4.f * _x - .5f * _v;
+            _v += force * h;
+            _x += _v * h;
+            _time += h;
+        }
+        osg::MatrixTransform* mt = static_cast< osg::MatrixTransform* >( node );
+        mt->setMatrix( _home * osg::Matrix::translate( 0.f, 0.f, _amplitude * _x ) );
+
+        traverse( node, nv );
+    }
+
+protected:
+    const osg::Matrix _home;
+    const unsigned int _steps;
+    float _time;
+    const float _amplitude;
+    float _x, _v;
+};
+
+
+const BenchmarkScene benchmarkScenes[] =
+{
+    { "Simple", createSimpleSceneGraph },
+    { "State", createStateSceneGraph },
+    { "Lighting", createLightingSceneGraph },
+    { "Text", createTextSceneGraph },
+    { "TextureMapping", createTextureMappingSceneGraph },
+    { "Callback", createCallbackSceneGraph },
+    { "Picking", createPickingSceneGraph },
+    { NULL, NULL }
+};
+
+const BenchmarkScene*
+findBenchmarkScene( const std::string& name )
+{
+    const BenchmarkScene* scene;
+    for (scene=benchmarkScenes; scene->_name != NULL; scene++)
+        if (name == scene->_name)
+            return( scene );
+    return( NULL );
+}
+
+osg::Group*
+replicateScene( osg::Node* scene, unsigned int instances,
+    unsigned int layers )
+{
+    osg::ref_ptr<osg::Group> root = new osg::Group;
+    root->setName( "Benchmark Root" );
+    root->setDataVariance( osg::Object::STATIC );
+
+    // Space the copies so their bounding spheres don't overlap.
+    const osg::BoundingSphere& bs = scene->getBound();
+    const float spacing = 2.2f * ( (bs.radius() > 0.f) ? bs.radius() : 1.f );
+    layers = std::max( std::min( layers, instances ), 1u );
+    const unsigned int perLayer = ( instances + layers - 1 ) / layers;
+    const unsigned int side = (unsigned int)ceil( sqrt( (double)perLayer ) );
+    const float offset = .5f * spacing * ( side - 1 );
+
+    unsigned int idx;
+    for (idx=0; idx<instances; idx++)
+    {
+        const unsigned int cell = idx % perLayer;
+        const float x = spacing * ( cell % side ) - offset;
+        const float y = spacing * ( idx / perLayer );
+        const float z = spacing * ( cell / side ) - offset;
+        osg::ref_ptr<osg::MatrixTransform> mt = new osg::MatrixTransform(
+                osg::Matrix::translate( x - bs.center().x(), y,
+                    z - bs.center().z() ) );
+        mt->setDataVariance( osg::Object::STATIC );
+        mt->addChild( scene );
+        root->addChild( mt.get() );
+    }
+    return( root.release() );
+}
+
+unsigned int
+simulateCopies( osg::Group* root, unsigned int steps )
+{
+    unsigned int count( 0 );
+    unsigned int idx;
+    for (idx=0; idx<root->getNumChildren(); idx++)
+    {
+        osg::MatrixTransform* mt = dynamic_cast< osg::MatrixTransform* >( root->getChild( idx ) );
+        if ( (mt == NULL) || (mt->getNumChildren() == 0) )
+            continue;
+        // The spring settles to a displacement of about 1/3, so the
+        //   copies move by about an eighth of their radius.
+        const float amplitude = .4f * mt->getChild( 0 )->getBound().radius();
+        mt->setDataVariance( osg::Object::DYNAMIC );
+        mt->setUpdateCallback( new SimulationCallback( mt->getMatrix(),
+                std::max( steps, 1u ), .37f * idx, amplitude ) );
+        count++;
+    }
+    return( count );
+}
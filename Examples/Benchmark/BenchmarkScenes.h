@@ -0,0 +1,48 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// Benchmark Example, The example scenes and their replication
+
+#ifndef __BENCHMARK_SCENES_H__
+#define __BENCHMARK_SCENES_H__
+
+#include <osg/Node>
+#include <osg/Group>
+#include <string>
+
+typedef osg::Node* (*SceneFactory)();
+
+// One of the example scenes the benchmark can run. _create is the
+//   example's createSceneGraph(), linked in under another name.
+struct BenchmarkScene
+{
+    const char* _name;
+    SceneFactory _create;
+};
+
+// The example scenes, ending with an entry whose _name is NULL.
+extern const BenchmarkScene benchmarkScenes[];
+
+// Return the scene called name, or NULL.
+const BenchmarkScene* findBenchmarkScene( const std::string& name );
+
+// Return a Group with instances copies of scene, each under its own
+//   MatrixTransform, laid out on square grids in the XZ plane. All
+//   copies share scene, so only the transforms are allocated per
+//   instance. The copies are split evenly across layers grids, one
+//   behind the other along +Y, the direction HeadlessTraversals
+//   looks, so the nearer layers hide the farther ones.
+osg::Group* replicateScene( osg::Node* scene, unsigned int instances,
+    unsigned int layers=1 );
+
+// Give each copy's MatrixTransform under root an update callback of
+//   its own that stands in for a simulation: every frame it steps a
+//   driven, damped spring steps times and bobs the copy up and down
+//   by the result. The transforms become DYNAMIC. Returns how many
+//   there were.
+unsigned int simulateCopies( osg::Group* root, unsigned int steps );
+
+#endif
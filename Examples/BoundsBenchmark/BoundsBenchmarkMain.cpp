@@ -0,0 +1,299 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// BoundsBenchmark, Times bounding-volume kernels and per-frame bound updates of animated transforms
+
+#include <osg/ArgumentParser>
+#include <osg/Group>
+#include <osg/MatrixTransform>
+#include <osg/Geode>
+#include <osg/Geometry>
+#include <osg/NodeVisitor>
+#include <osg/Timer>
+#include <osg/Notify>
+#include "FastBounds.h"
+#include "TransformAnimator.h"
+#include "SceneCache.h"
+#include "TimingStats.h"
+#include <cstdlib>
+#include <sstream>
+#include <vector>
+#include <string>
+
+using std::endl;
+
+
+// The vertices of every Geometry under a node.
+class CollectVerticesVisitor : public osg::NodeVisitor
+{
+public:
+    CollectVerticesVisitor()
+      : osg::NodeVisitor( osg::NodeVisitor::TRAVERSE_ALL_CHILDREN ) {}
+
+    virtual void apply( osg::Geode& geode )
+    {
+        unsigned int idx;
+        for (idx=0; idx<geode.getNumDrawables(); idx++)
+        {
+            osg::Geometry* geom = geode.getDrawable( idx )->asGeometry();
+            const osg::Vec3Array* v = (geom != NULL) ?
+                dynamic_cast< const osg::Vec3Array* >( geom->getVertexArray() ) : NULL;
+            if (v != NULL)
+                _vertices.insert( _vertices.end(), v->begin(), v->end() );
+        }
+    }
+
+    std::vector< osg::Vec3 > _vertices;
+};
+
+static void
+addRow( TimingReport& report, const std::string& test, const std::string& config,
+    const std::vector< double >& samples )
+{
+    const TimingSummary summary = summarizeTimings( samples );
+    std::vector< std::string > keys;
+    keys.push_back( test );
+    keys.push_back( config );
+    report.addRow( keys, summary );
+    osg::notify( osg::ALWAYS ) << test << ", " << config << ": " <<
+        summary._mean << " ms mean, " << summary._p50 << " ms median" << endl;
+}
+
+static bool
+sameBox( const osg::BoundingBox& a, const osg::BoundingBox& b )
+{
+    return( ( a._min == b._min ) && ( a._max == b._max ) );
+}
+
+// Time OSG's Geometry bound against computeBoundingBox() and
+//   computeBoundingSphere() over the same points.
+static void
+runKernels( const std::string& test, const std::vector< osg::Vec3 >& points,
+    unsigned int numRuns, unsigned int numThreads, TimingReport& report )
+{
+    if (points.empty())
+        return;
+
+    osg::ref_ptr<osg::Geometry> geom = new osg::Geometry;
+    geom->setVertexArray( new osg::Vec3Array( points.begin(), points.end() ) );
+    const osg::Vec3* p = &points[ 0 ];
+    const unsigned int count = points.size();
+
+    osg::Timer* timer = osg::Timer::instance();
+    std::vector< double > osgBox, simdBox1, simdBox, simdSphere;
+    osg::BoundingBox expected, bb;
+    osg::BoundingSphere bs;
+    unsigned int run;
+    for (run=0; run<numRuns; run++)
+    {
+        osg::Timer_t start = timer->tick();
+        expected = geom->computeBound();
+        osgBox.push_back( timer->delta_m( start, timer->tick() ) );
+
+        start = timer->tick();
+        bb = computeBoundingBox( p, count, 1 );
+        simdBox1.push_back( timer->delta_m( start, timer->tick() ) );
+
+        start = timer->tick();
+        bb = computeBoundingBox( p, count, numThreads );
+        simdBox.push_back( timer->delta_m( start, timer->tick() ) );
+
+        start = timer->tick();
+        bs = computeBoundingSphere( p, count, numThreads );
+        simdSphere.push_back( timer->delta_m( start, timer->tick() ) );
+    }
+    if (!sameBox( expected, bb ))
+        osg::notify( osg::WARN ) << test << ": computeBoundingBox() differs from OSG." << endl;
+    osg::notify( osg::ALWAYS ) << test << ": box radius " << expected.radius() <<
+        ", sphere radius " << bs.radius() << endl;
+
+    addRow( report, test, "osg box", osgBox );
+    addRow( report, test, "simd box, 1 thread", simdBox1 );
+    addRow( report, test, "simd box", simdBox );
+    addRow( report, test, "simd sphere", simdSphere );
+}
+
+// A small box, shared by every transform.
+static osg::Node*
+createLeaf()
+{
+    osg::ref_ptr<osg::Geometry> geom = new osg::Geometry;
+    osg::ref_ptr<osg::Vec3Array> v = new osg::Vec3Array;
+    unsigned int idx;
+    for (idx=0; idx<8; idx++)
+        v->push_back( osg::Vec3( (idx & 1) ? .4f : -.4f,
+            (idx & 2) ? .4f : -.4f, (idx & 4) ? .4f : -.4f ) );
+    geom->setVertexArray( v.get() );
+    geom->addPrimitiveSet( new osg::DrawArrays( osg::PrimitiveSet::POINTS, 0, 8 ) );
+
+    osg::ref_ptr<osg::Geode> geode = new osg::Geode;
+    geode->setDataVariance( osg::Object::STATIC );
+    geode->addDrawable( geom.get() );
+    return( geode.release() );
+}
+
+// numTransforms animated MatrixTransforms in a grid, fanout to a
+//   Group under the root.
+static osg::Group*
+createAnimatedScene( unsigned int numTransforms, unsigned int fanout,
+    TransformAnimator* animator, std::vector< osg::MatrixTransform* >& transforms )
+{
+    osg::ref_ptr<osg::Node> leaf = createLeaf();
+    osg::ref_ptr<osg::Group> root = new osg::Group;
+    osg::Group* parent( NULL );
+    unsigned int side( 1 );
+    while (side * side < numTransforms)
+        side++;
+    unsigned int idx;
+    for (idx=0; idx<numTransforms; idx++)
+    {
+        if (idx % fanout == 0)
+        {
+            parent = new osg::Group;
+            root->addChild( parent );
+        }
+        osg::ref_ptr<osg::MatrixTransform> mt = new osg::MatrixTransform;
+        mt->addChild( leaf.get() );
+        parent->addChild( mt.get() );
+        transforms.push_back( mt.get() );
+
+        const osg::Vec3 axis( (float)( rand() % 100 ), (float)( rand() % 100 ), 100.f );
+        animator->add( mt.get(), axis, .001f * (float)( 1 + rand() % 50 ),
+            osg::Vec3( (float)( idx % side ), (float)( idx / side ), 0.f ) );
+    }
+    return( root.release() );
+}
+
+// Time one frame's bound work for numTransforms animated transforms,
+//   three ways:
+//
+//   eager: the root's bound is asked for after every change, so each
+//     change recomputes its transform and every ancestor.
+//   lazy: OSG's default. Changes only dirty bounds, and the first
+//     getBound() on the root recomputes the dirty region on one thread.
+//   coalesced: a BoundUpdater recomputes the dirty region a level at
+//     a time, each node once, splitting large levels across threads.
+static void
+runAnimation( unsigned int numTransforms, unsigned int fanout, unsigned int numFrames,
+    unsigned int numThreads, TimingReport& report )
+{
+    osg::ref_ptr<TransformAnimator> animator = new TransformAnimator;
+    // Bounds are brought up to date below, so they can be timed.
+    animator->setUpdateBounds( false );
+    std::vector< osg::MatrixTransform* > transforms;
+    osg::ref_ptr<osg::Group> root = createAnimatedScene( numTransforms, fanout,
+        animator.get(), transforms );
+    root->getBound();
+
+    BoundUpdater updater;
+    updater.setNodes( std::vector< osg::Node* >( transforms.begin(), transforms.end() ) );
+
+    std::ostringstream test;
+    test << numTransforms << " transforms";
+    osg::notify( osg::ALWAYS ) << test.str() << " in " << updater.getNumLevels() <<
+        " levels: bound recomputes per frame, eager " <<
+        numTransforms * updater.getNumLevels() << ", lazy and coalesced " <<
+        updater.getNumNodes() << endl;
+
+    osg::Timer* timer = osg::Timer::instance();
+    std::vector< double > animate, eager, lazy, coalesced;
+    unsigned int frame;
+    for (frame=0; frame<numFrames; frame++)
+    {
+        osg::Timer_t start = timer->tick();
+        animator->advance();
+        animate.push_back( timer->delta_m( start, timer->tick() ) );
+
+        start = timer->tick();
+        root->getBound();
+        lazy.push_back( timer->delta_m( start, timer->tick() ) );
+
+        animator->advance();
+        start = timer->tick();
+        updater.update( numThreads );
+        coalesced.push_back( timer->delta_m( start, timer->tick() ) );
+
+        // Write back the same matrices again, one at a time, asking
+        //   for the root's bound after each.
+        start = timer->tick();
+        unsigned int idx;
+        for (idx=0; idx<transforms.size(); idx++)
+        {
+            transforms[ idx ]->setMatrix( transforms[ idx ]->getMatrix() );
+            root->getBound();
+        }
+        eager.push_back( timer->delta_m( start, timer->tick() ) );
+    }
+
+    addRow( report, test.str(), "animate", animate );
+    addRow( report, test.str(), "eager bound", eager );
+    addRow( report, test.str(), "lazy bound", lazy );
+    addRow( report, test.str(), "coalesced bound", coalesced );
+}
+
+int
+main( int argc, char** argv )
+{
+    osg::ArgumentParser arguments( &argc, argv );
+
+    // Usage: BoundsBenchmark [--model file] [--points n] [--runs n]
+    //   [--transforms n] [--fanout n] [--frames n] [--threads n]
+    //   [--out file.csv|file.json]
+    std::string model( "cow.osg" );
+    arguments.read( "--model", model );
+    unsigned int numPoints( 1000000 );
+    arguments.read( "--points", numPoints );
+    unsigned int numRuns( 20 );
+    arguments.read( "--runs", numRuns );
+    unsigned int numTransforms( 10000 );
+    arguments.read( "--transforms", numTransforms );
+    unsigned int fanout( 100 );
+    arguments.read( "--fanout", fanout );
+    if (fanout < 1)
+        fanout = 1;
+    unsigned int numFrames( 100 );
+    arguments.read( "--frames", numFrames );
+    unsigned int numThreads( 0 );
+    arguments.read( "--threads", numThreads );
+    std::string out( "BoundsBenchmark.csv" );
+    arguments.read( "--out", out );
+
+    std::vector< std::string > keyNames;
+    keyNames.push_back( "test" );
+    keyNames.push_back( "configuration" );
+    TimingReport report( keyNames );
+
+    osg::ref_ptr<osg::Node> node = readCachedNodeFile( model );
+    if (node.valid())
+    {
+        CollectVerticesVisitor cvv;
+        node->accept( cvv );
+        std::ostringstream test;
+        test << model << " (" << cvv._vertices.size() << " points)";
+        runKernels( test.str(), cvv._vertices, numRuns, numThreads, report );
+    }
+    else
+        osg::notify( osg::WARN ) << "Unable to load \"" << model << "\"." << endl;
+
+    std::vector< osg::Vec3 > points( numPoints );
+    unsigned int idx;
+    for (idx=0; idx<numPoints; idx++)
+        points[ idx ].set( (float)rand() / RAND_MAX, (float)rand() / RAND_MAX,
+            (float)rand() / RAND_MAX );
+    std::ostringstream test;
+    test << numPoints << " points";
+    runKernels( test.str(), points, numRuns, numThreads, report );
+
+    runAnimation( numTransforms, fanout, numFrames, numThreads, report );
+
+    if (!report.write( out ))
+    {
+        osg::notify( osg::FATAL ) << "Unable to write \"" << out << "\"." << endl;
+        return( 1 );
+    }
+    osg::notify( osg::ALWAYS ) << "Wrote \"" << out << "\"." << endl;
+    return( 0 );
+}
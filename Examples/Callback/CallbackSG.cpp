@@ -0,0 +1,81 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// Callback Example, Using an update callback to modify the scene graph
+
+#include "TransformAnimator.h"
+#include <osg/Group>
+#include <osg/MatrixTransform>
+#include "SpatialGroup.h"
+#include "SceneCache.h"
+#include "GeometryConsolidator.h"
+#include "FastBounds.h"
+#include <osg/Notify>
+
+// Create the scene graph. This is a Group root node with two
+//   MatrixTransform children, which multiply parent a single
+//   Geode loaded from the cow.osg model file.
+osg::Node*
+createSceneGraph()
+{
+    // Load the cow model. readCachedNodeFile() reads a binary
+    //   copy of cow.osg when one is cached and up to date.
+    osg::ref_ptr<osg::Node> cow = readCachedNodeFile( "cow.osg" );
+    if (!cow.valid())
+    {
+        osg::notify( osg::FATAL ) << "Unable to load data file. Exiting." << std::endl;
+        return( NULL );
+    }
+    // Merge the model's fragmented primitive sets, and give its
+    //   large Geometry SIMD bounds.
+    consolidateGeometry( cow.get() );
+    installFastBounds( cow.get() );
+    // Data variance is STATIC because we won't modify it.
+    cow->setDataVariance( osg::Object::STATIC );
+
+    // Create a MatrixTransform to display the cow on the left.
+    osg::ref_ptr<osg::MatrixTransform> mtLeft =
+            new osg::MatrixTransform;
+    mtLeft->setName( "Left Cow\nDYNAMIC" );
+    // Set data variance to DYNAMIC to let OSG know that we
+    //   will modify this node during the update traversal.
+    mtLeft->setDataVariance( osg::Object::DYNAMIC );
+    osg::Matrix m;
+    m.makeTranslate( -6.f, 0.f, 0.f );
+    mtLeft->setMatrix( m );
+    mtLeft->addChild( cow.get() );
+
+    // Create a MatrixTransform to display the cow on the right.
+    osg::ref_ptr<osg::MatrixTransform> mtRight =
+            new osg::MatrixTransform;
+    mtRight->setName( "Right Cow\nSTATIC" );
+    // Data variance is STATIC because we won't modify it.
+    mtRight->setDataVariance( osg::Object::STATIC );
+    m.makeTranslate( 6.f, 0.f, 0.f );
+    mtRight->setMatrix( m );
+    mtRight->addChild( cow.get() );
+
+    // Create the root node. A SpatialGroup is a Group that keeps
+    //   its children in an octree, so cull and picking skip the
+    //   ones out of view however many there are.
+    osg::ref_ptr<SpatialGroup> root = new SpatialGroup;
+    root->setName( "Root Node" );
+    // Data variance is STATIC because we won't modify it.
+    root->setDataVariance( osg::Object::STATIC );
+    root->addChild( mtLeft.get() );
+    root->addChild( mtRight.get() );
+
+    // Set the update callback. The TransformAnimator spins the
+    //   left cow about its Z axis, 0.01 radians per frame, then
+    //   translates it to the left. One animator on the root can
+    //   drive any number of transforms.
+    osg::ref_ptr<TransformAnimator> animator = new TransformAnimator;
+    animator->add( mtLeft.get(), osg::Vec3( 0.f, 0.f, 1.f ), 0.01f,
+            osg::Vec3( -6.f, 0.f, 0.f ) );
+    root->setUpdateCallback( animator.get() );
+
+    return( root.release() );
+}
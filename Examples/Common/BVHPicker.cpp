@@ -0,0 +1,755 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// Bounding volume hierarchy picking used by the Picking example
+
+#include "BVHPicker.h"
+#include "InstanceGroup.h"
+#include "SpatialGroup.h"
+#include "ParallelLoop.h"
+#include <osg/NodeVisitor>
+#include <osg/Geode>
+#include <osg/Transform>
+#include <osg/TriangleFunctor>
+#include <osg/Notify>
+#include <OpenThreads/Mutex>
+#include <OpenThreads/ScopedLock>
+#include <algorithm>
+#include <map>
+
+
+// Leaves hold at most this many triangles.
+static const unsigned int LeafSize( 4 );
+
+// Collects the triangles of a Geometry through a TriangleFunctor,
+//   numbering them in the order the functor visits them.
+struct TriangleCollector
+{
+    TriangleCollector() : _triangles( NULL ), _count( 0 ) {}
+
+    void operator()( const osg::Vec3& v1, const osg::Vec3& v2,
+            const osg::Vec3& v3, bool )
+    {
+        std::vector< osg::Vec3 >& t = *_triangles;
+        t.push_back( v1 );
+        t.push_back( v2 );
+        t.push_back( v3 );
+        _count++;
+    }
+
+    std::vector< osg::Vec3 >* _triangles;
+    unsigned int _count;
+};
+
+// Orders triangles by their centroid along one axis.
+struct CentroidLess
+{
+    CentroidLess( int axis ) : _axis( axis ) {}
+
+    template< class T >
+    bool operator()( const T& a, const T& b ) const
+    {
+        return( ( a._v[0][_axis] + a._v[1][_axis] + a._v[2][_axis] ) <
+                ( b._v[0][_axis] + b._v[1][_axis] + b._v[2][_axis] ) );
+    }
+
+    int _axis;
+};
+
+// True if box lies entirely on the negative side of any plane.
+static bool
+outside( const PlaneList& planes, const osg::BoundingBox& box )
+{
+    unsigned int idx;
+    for (idx=0; idx<planes.size(); idx++)
+        if (planes[ idx ].intersect( box ) < 0)
+            return( true );
+    return( false );
+}
+
+static bool
+outside( const PlaneList& planes, const osg::BoundingSphere& bs )
+{
+    if (!bs.valid())
+        return( true );
+    unsigned int idx;
+    for (idx=0; idx<planes.size(); idx++)
+        if (planes[ idx ].intersect( bs ) < 0)
+            return( true );
+    return( false );
+}
+
+// Clip the segment start+t*dir to box, narrowing [tMin,tMax].
+//   Returns false if the segment misses the box.
+static bool
+clipSegment( const osg::BoundingBox& box, const osg::Vec3& start,
+    const osg::Vec3& dir, double& tMin, double& tMax )
+{
+    int axis;
+    for (axis=0; axis<3; axis++)
+    {
+        if (dir[ axis ] == 0.f)
+        {
+            if ( (start[ axis ] < box._min[ axis ]) ||
+                    (start[ axis ] > box._max[ axis ]) )
+                return( false );
+            continue;
+        }
+        double t0 = ( box._min[ axis ] - start[ axis ] ) / dir[ axis ];
+        double t1 = ( box._max[ axis ] - start[ axis ] ) / dir[ axis ];
+        if (t0 > t1)
+            std::swap( t0, t1 );
+        if (t0 > tMin)
+            tMin = t0;
+        if (t1 < tMax)
+            tMax = t1;
+        if (tMin > tMax)
+            return( false );
+    }
+    return( true );
+}
+
+static bool
+outside( const osg::Vec3& start, const osg::Vec3& end,
+    const osg::BoundingBox& box )
+{
+    if (!box.valid())
+        return( true );
+    double tMin( 0. ), tMax( 1. );
+    return( !clipSegment( box, start, end - start, tMin, tMax ) );
+}
+
+static bool
+outside( const osg::Vec3& start, const osg::Vec3& end,
+    const osg::BoundingSphere& bs )
+{
+    if (!bs.valid())
+        return( true );
+    // Distance from the center to the nearest point on the segment.
+    const osg::Vec3 dir( end - start );
+    const double len2 = dir.length2();
+    double t = ( len2 > 0. ) ? ( ( bs.center() - start ) * dir ) / len2 : 0.;
+    if (t < 0.)
+        t = 0.;
+    else if (t > 1.)
+        t = 1.;
+    const osg::Vec3 nearest( start + dir * t );
+    return( ( bs.center() - nearest ).length2() > bs.radius2() );
+}
+
+
+// The vertex array and primitive sets, in order.
+void
+TriangleBVH::getSources( const osg::Geometry& geom, std::vector< Source >& sources )
+{
+    const osg::Array* verts = geom.getVertexArray();
+    Source s;
+    s._object = verts;
+    s._size = verts ? verts->getNumElements() : 0;
+    s._modifiedCount = verts ? verts->getModifiedCount() : 0;
+    sources.push_back( s );
+    unsigned int idx;
+    for (idx=0; idx<geom.getNumPrimitiveSets(); idx++)
+    {
+        const osg::PrimitiveSet* ps = geom.getPrimitiveSet( idx );
+        s._object = ps;
+        s._size = ps->getNumIndices();
+        s._modifiedCount = ps->getModifiedCount();
+        sources.push_back( s );
+    }
+}
+
+TriangleBVH::TriangleBVH( const osg::Geometry& geom )
+{
+    getSources( geom, _sources );
+
+    std::vector< osg::Vec3 > verts;
+    osg::TriangleFunctor< TriangleCollector > tf;
+    tf._triangles = &verts;
+    geom.accept( tf );
+
+    _triangles.resize( tf._count );
+    unsigned int idx;
+    for (idx=0; idx<tf._count; idx++)
+    {
+        Triangle& t = _triangles[ idx ];
+        t._v[0] = verts[ idx*3 ];
+        t._v[1] = verts[ idx*3+1 ];
+        t._v[2] = verts[ idx*3+2 ];
+        t._index = idx;
+    }
+
+    if (!_triangles.empty())
+    {
+        // A balanced tree has fewer than 2n/LeafSize nodes.
+        _nodes.reserve( 2 * _triangles.size() / LeafSize + 1 );
+        build( 0, _triangles.size() );
+    }
+}
+
+// Build the subtree over _triangles[first,first+count) and return
+//   the index of its root. Interior nodes split at the median
+//   centroid along the longest axis of the centroid bounds.
+unsigned int
+TriangleBVH::build( unsigned int first, unsigned int count )
+{
+    const unsigned int nodeIdx = _nodes.size();
+    _nodes.push_back( Node() );
+
+    osg::BoundingBox box, centers;
+    unsigned int idx;
+    for (idx=first; idx<first+count; idx++)
+    {
+        const Triangle& t = _triangles[ idx ];
+        box.expandBy( t._v[0] );
+        box.expandBy( t._v[1] );
+        box.expandBy( t._v[2] );
+        centers.expandBy( ( t._v[0] + t._v[1] + t._v[2] ) / 3.f );
+    }
+    _nodes[ nodeIdx ]._box = box;
+    _nodes[ nodeIdx ]._first = first;
+    _nodes[ nodeIdx ]._count = count;
+
+    const osg::Vec3 extent( centers._max - centers._min );
+    int axis( 0 );
+    if (extent[1] > extent[axis])
+        axis = 1;
+    if (extent[2] > extent[axis])
+        axis = 2;
+    if ( (count <= LeafSize) || (extent[axis] <= 0.f) )
+        return( nodeIdx );
+
+    const unsigned int mid = first + count / 2;
+    std::nth_element( _triangles.begin() + first, _triangles.begin() + mid,
+            _triangles.begin() + first + count, CentroidLess( axis ) );
+
+    build( first, mid - first );
+    const unsigned int right = build( mid, first + count - mid );
+    _nodes[ nodeIdx ]._first = right;
+    _nodes[ nodeIdx ]._count = 0;
+    return( nodeIdx );
+}
+
+bool
+TriangleBVH::matches( const osg::Geometry& geom ) const
+{
+    std::vector< Source > current;
+    getSources( geom, current );
+    if (current.size() != _sources.size())
+        return( false );
+    unsigned int idx;
+    for (idx=0; idx<_sources.size(); idx++)
+    {
+        const Source& a = _sources[ idx ];
+        const Source& b = current[ idx ];
+        if ( (a._object != b._object) || (a._size != b._size) ||
+                (a._modifiedCount != b._modifiedCount) )
+            return( false );
+    }
+    return( true );
+}
+
+bool
+TriangleBVH::intersect( const PlaneList& planes, const osg::Matrix& localToEye,
+    unsigned int& triangle, osg::Vec3& point, double& depth ) const
+{
+    if (_nodes.empty())
+        return( false );
+
+    bool found( false );
+    std::vector< osg::Vec3 > poly, clipped;
+    std::vector< unsigned int > stack;
+    stack.push_back( 0 );
+    while (!stack.empty())
+    {
+        const unsigned int nodeIdx = stack.back();
+        stack.pop_back();
+        const Node& node = _nodes[ nodeIdx ];
+        if (outside( planes, node._box ))
+            continue;
+        if (node._count == 0)
+        {
+            stack.push_back( node._first );
+            stack.push_back( nodeIdx + 1 );
+            continue;
+        }
+
+        unsigned int idx;
+        for (idx=node._first; idx<node._first+node._count; idx++)
+        {
+            const Triangle& t = _triangles[ idx ];
+            poly.assign( t._v, t._v+3 );
+
+            // Clip the triangle to each plane in turn. Whatever
+            //   is left is the part inside the region.
+            unsigned int pIdx;
+            for (pIdx=0; pIdx<planes.size() && !poly.empty(); pIdx++)
+            {
+                const osg::Plane& plane = planes[ pIdx ];
+                clipped.clear();
+                unsigned int vIdx;
+                for (vIdx=0; vIdx<poly.size(); vIdx++)
+                {
+                    const osg::Vec3& a = poly[ vIdx ];
+                    const osg::Vec3& b = poly[ (vIdx+1) % poly.size() ];
+                    const double da = plane.distance( a );
+                    const double db = plane.distance( b );
+                    if (da >= 0.)
+                        clipped.push_back( a );
+                    if ( (da >= 0.) != (db >= 0.) )
+                        clipped.push_back( a + ( b - a ) * ( da / ( da - db ) ) );
+                }
+                poly.swap( clipped );
+            }
+
+            unsigned int vIdx;
+            for (vIdx=0; vIdx<poly.size(); vIdx++)
+            {
+                const double d = -( poly[ vIdx ] * localToEye ).z();
+                if (!found || (d < depth))
+                {
+                    found = true;
+                    depth = d;
+                    point = poly[ vIdx ];
+                    triangle = t._index;
+                }
+            }
+        }
+    }
+    return( found );
+}
+
+
+bool
+TriangleBVH::intersect( const osg::Vec3& start, const osg::Vec3& end,
+    unsigned int& triangle, osg::Vec3& point, double& ratio ) const
+{
+    if (_nodes.empty())
+        return( false );
+
+    const osg::Vec3 dir( end - start );
+    bool found( false );
+    double best( 1. );
+
+    // Children are visited nearest first, and anything that starts
+    //   beyond the best hit so far is skipped, so a segment usually
+    //   reaches only a handful of leaves.
+    std::vector< std::pair< double, unsigned int > > stack;
+    double tMin( 0. ), tMax( 1. );
+    if (!clipSegment( _nodes[ 0 ]._box, start, dir, tMin, tMax ))
+        return( false );
+    stack.push_back( std::make_pair( tMin, 0u ) );
+    while (!stack.empty())
+    {
+        const double entry = stack.back().first;
+        const unsigned int nodeIdx = stack.back().second;
+        stack.pop_back();
+        if (entry > best)
+            continue;
+        const Node& node = _nodes[ nodeIdx ];
+        if (node._count == 0)
+        {
+            const unsigned int child[ 2 ] = { nodeIdx + 1, node._first };
+            double t[ 2 ];
+            bool hit[ 2 ];
+            int cIdx;
+            for (cIdx=0; cIdx<2; cIdx++)
+            {
+                double t0( 0. ), t1( best );
+                hit[ cIdx ] = clipSegment( _nodes[ child[ cIdx ] ]._box,
+                        start, dir, t0, t1 );
+                t[ cIdx ] = t0;
+            }
+            // Push the farther child first so the nearer one pops first.
+            const int nearIdx = ( hit[ 0 ] && hit[ 1 ] && (t[ 1 ] < t[ 0 ]) ) ? 1 : 0;
+            if (hit[ 1 - nearIdx ])
+                stack.push_back( std::make_pair( t[ 1 - nearIdx ], child[ 1 - nearIdx ] ) );
+            if (hit[ nearIdx ])
+                stack.push_back( std::make_pair( t[ nearIdx ], child[ nearIdx ] ) );
+            continue;
+        }
+
+        unsigned int idx;
+        for (idx=node._first; idx<node._first+node._count; idx++)
+        {
+            // Moller-Trumbore, accepting either winding.
+            const Triangle& tri = _triangles[ idx ];
+            const osg::Vec3 e1( tri._v[1] - tri._v[0] );
+            const osg::Vec3 e2( tri._v[2] - tri._v[0] );
+            const osg::Vec3 p( dir ^ e2 );
+            const double det = e1 * p;
+            if (det == 0.)
+                continue;
+            const double inv = 1. / det;
+            const osg::Vec3 s( start - tri._v[0] );
+            const double u = ( s * p ) * inv;
+            if ( (u < 0.) || (u > 1.) )
+                continue;
+            const osg::Vec3 q( s ^ e1 );
+            const double v = ( dir * q ) * inv;
+            if ( (v < 0.) || (u + v > 1.) )
+                continue;
+            const double t = ( e2 * q ) * inv;
+            if ( (t < 0.) || (t > best) || (found && (t == best)) )
+                continue;
+            found = true;
+            best = t;
+            triangle = tri._index;
+        }
+    }
+    if (found)
+    {
+        ratio = best;
+        point = start + dir * best;
+    }
+    return( found );
+}
+
+
+static OpenThreads::Mutex s_bvhMutex;
+
+osg::ref_ptr< TriangleBVH >
+getTriangleBVH( osg::Geometry& geom )
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock( s_bvhMutex );
+
+    TriangleBVH* bvh = dynamic_cast< TriangleBVH* >( geom.getUserData() );
+    if ( (bvh == NULL) && (geom.getUserData() != NULL) )
+    {
+        osg::notify( osg::INFO ) << "getTriangleBVH: " << geom.getName() <<
+            " already has user data; not caching its BVH." << std::endl;
+        return( NULL );
+    }
+    if ( (bvh == NULL) || !bvh->matches( geom ) )
+    {
+        // Built for the first time, or the geometry changed.
+        bvh = new TriangleBVH( geom );
+        geom.setUserData( bvh );
+    }
+    return( bvh );
+}
+
+
+
+
+PickQuery
+PickQuery::rectangle( double xMin, double yMin, double xMax, double yMax )
+{
+    PickQuery q;
+    q._type = RECTANGLE;
+    q._xMin = xMin;
+    q._yMin = yMin;
+    q._xMax = xMax;
+    q._yMax = yMax;
+    return( q );
+}
+
+PickQuery
+PickQuery::segment( const osg::Vec3& start, const osg::Vec3& end )
+{
+    PickQuery q;
+    q._type = SEGMENT;
+    q._start = start;
+    q._end = end;
+    return( q );
+}
+
+
+// Hierarchies already looked up by one thread, so it takes the
+//   getTriangleBVH() lock once per Geometry rather than once per
+//   Geometry per query.
+typedef std::map< osg::Geometry*, osg::ref_ptr< TriangleBVH > > BVHMap;
+
+// Traverses the scene with one query transformed into each local
+//   coordinate frame, and keeps the hit nearest the eye (for a
+//   rectangle) or the segment start (for a segment).
+class BVHPickVisitor : public osg::NodeVisitor
+{
+public:
+    BVHPickVisitor( const osg::Matrix& view, const osg::Matrix& proj,
+            BVHMap& bvhs )
+      : osg::NodeVisitor( osg::NodeVisitor::TRAVERSE_ACTIVE_CHILDREN ),
+        _view( view ),
+        _proj( proj ),
+        _bvhs( bvhs ),
+        _type( PickQuery::RECTANGLE )
+    {
+    }
+
+    void pick( osg::Node& scene, const PickQuery& query, PickResult& result )
+    {
+        _type = query._type;
+        _frames.clear();
+        _result = PickResult();
+        if (_type == PickQuery::RECTANGLE)
+        {
+            // The rectangle's sides and the near plane, in clip
+            //   coordinates.
+            _clipPlanes.clear();
+            _clipPlanes.push_back( osg::Plane( 1., 0., 0., -query._xMin ) );
+            _clipPlanes.push_back( osg::Plane( -1., 0., 0., query._xMax ) );
+            _clipPlanes.push_back( osg::Plane( 0., 1., 0., -query._yMin ) );
+            _clipPlanes.push_back( osg::Plane( 0., -1., 0., query._yMax ) );
+            _clipPlanes.push_back( osg::Plane( 0., 0., 1., 1. ) );
+            pushFrame( _view );
+        }
+        else
+        {
+            _start = query._start;
+            _end = query._end;
+            pushFrame( osg::Matrix::identity() );
+        }
+
+        scene.accept( *this );
+        result = _result;
+    }
+
+    virtual void apply( osg::Node& node )
+    {
+        if (outside( node.getBound() ))
+            return;
+        traverse( node );
+    }
+
+    virtual void apply( osg::Transform& transform )
+    {
+        if (outside( transform.getBound() ))
+            return;
+        osg::Matrix m( _frames.back()._matrix );
+        transform.computeLocalToWorldMatrix( m, this );
+        pushFrame( m );
+        traverse( transform );
+        _frames.pop_back();
+    }
+
+    virtual void apply( osg::Group& group )
+    {
+        SpatialGroup* sg = dynamic_cast<SpatialGroup*>( &group );
+        if (sg != NULL)
+        {
+            if (outside( sg->getBound() ))
+                return;
+            // Only the children the octree can't rule out. Each
+            //   level of recursion gets its own list.
+            const Frame& frame = _frames.back();
+            std::vector< osg::Node* > children;
+            if (_type == PickQuery::RECTANGLE)
+                sg->findChildren( frame._planes, children );
+            else
+                sg->findChildren( frame._start, frame._end, children );
+            unsigned int idx;
+            for (idx=0; idx<children.size(); idx++)
+                children[ idx ]->accept( *this );
+            return;
+        }
+        InstanceGroup* ig = dynamic_cast<InstanceGroup*>( &group );
+        if (ig == NULL)
+        {
+            apply( static_cast<osg::Node&>( group ) );
+            return;
+        }
+        if (outside( ig->getBound() ))
+            return;
+
+        // Visit the children once per instance, in that instance's
+        //   frame.
+        const osg::Matrix parent( _frames.back()._matrix );
+        unsigned int idx;
+        for (idx=0; idx<ig->getNumInstances(); idx++)
+        {
+            if (outside( ig->getInstanceBound( idx ) ))
+                continue;
+            pushFrame( ig->getMatrix( idx ) * parent );
+            ig->osg::Group::traverse( *this );
+            _frames.pop_back();
+        }
+    }
+
+    virtual void apply( osg::Geode& geode )
+    {
+        if (outside( geode.getBound() ))
+            return;
+
+        const Frame& frame = _frames.back();
+        unsigned int idx;
+        for (idx=0; idx<geode.getNumDrawables(); idx++)
+        {
+            osg::Geometry* geom = geode.getDrawable( idx )->asGeometry();
+            if ( (geom == NULL) || outside( geom->getBound() ) )
+                continue;
+            TriangleBVH* bvh = lookup( *geom );
+
+            unsigned int triangle;
+            osg::Vec3 point;
+            double depth;
+            bool hit;
+            if (_type == PickQuery::RECTANGLE)
+                hit = bvh->intersect( frame._planes, frame._matrix,
+                        triangle, point, depth );
+            else
+                hit = bvh->intersect( frame._start, frame._end,
+                        triangle, point, depth );
+            if ( !hit || (_result._hit && (depth >= _result._depth)) )
+                continue;
+
+            _result._hit = true;
+            _result._nodePath = getNodePath();
+            _result._drawable = geom;
+            _result._primitiveIndex = triangle;
+            _result._localPoint = point;
+            _result._depth = depth;
+        }
+    }
+
+protected:
+    // The query in one local coordinate frame. _matrix maps local
+    //   coordinates to eye coordinates for a rectangle, and to world
+    //   coordinates for a segment.
+    struct Frame
+    {
+        osg::Matrix _matrix;
+        PlaneList _planes;
+        osg::Vec3 _start, _end;
+    };
+
+    void pushFrame( const osg::Matrix& m )
+    {
+        _frames.push_back( Frame() );
+        Frame& frame = _frames.back();
+        frame._matrix = m;
+        if (_type == PickQuery::RECTANGLE)
+        {
+            // A plane transformed by the inverse of local-to-clip
+            //   is the same plane in local coordinates.
+            const osg::Matrix mvp( m * _proj );
+            frame._planes = _clipPlanes;
+            unsigned int idx;
+            for (idx=0; idx<frame._planes.size(); idx++)
+                frame._planes[ idx ].transformProvidingInverse( mvp );
+        }
+        else
+        {
+            const osg::Matrix inv( osg::Matrix::inverse( m ) );
+            frame._start = _start * inv;
+            frame._end = _end * inv;
+        }
+    }
+
+    template< class T >
+    bool outside( const T& bound ) const
+    {
+        const Frame& frame = _frames.back();
+        if (_type == PickQuery::RECTANGLE)
+            return( ::outside( frame._planes, bound ) );
+        return( ::outside( frame._start, frame._end, bound ) );
+    }
+
+    TriangleBVH* lookup( osg::Geometry& geom )
+    {
+        BVHMap::iterator it = _bvhs.find( &geom );
+        if (it != _bvhs.end())
+            return( it->second.get() );
+
+        // Use the cached hierarchy, or a temporary one if the
+        //   Geometry's user data is taken.
+        osg::ref_ptr< TriangleBVH > bvh = getTriangleBVH( geom );
+        if (!bvh.valid())
+            bvh = new TriangleBVH( geom );
+        _bvhs[ &geom ] = bvh;
+        return( bvh.get() );
+    }
+
+    const osg::Matrix _view;
+    const osg::Matrix _proj;
+    BVHMap& _bvhs;
+
+    PickQuery::Type _type;
+    PlaneList _clipPlanes;
+    osg::Vec3 _start, _end;
+    std::vector< Frame > _frames;
+
+    PickResult _result;
+};
+
+
+bool
+pickPolytope( osg::Camera* camera, osg::Node* scene,
+    double xMin, double yMin, double xMax, double yMax, PickResult& result )
+{
+    if ( (camera == NULL) || (scene == NULL) )
+        return( false );
+
+    BVHMap bvhs;
+    BVHPickVisitor pv( camera->getViewMatrix(),
+            camera->getProjectionMatrix(), bvhs );
+    pv.pick( *scene, PickQuery::rectangle( xMin, yMin, xMax, yMax ), result );
+    return( result._hit );
+}
+
+
+// Queries are handed out in blocks, so each thread reuses one
+//   visitor and one BVHMap for many queries.
+static const unsigned int QueriesPerBlock( 16 );
+
+class PickBatchTask : public ParallelTask
+{
+public:
+    PickBatchTask( osg::Camera& camera, osg::Node& scene,
+            const std::vector< PickQuery >& queries,
+            std::vector< PickResult >& results )
+      : _view( camera.getViewMatrix() ),
+        _proj( camera.getProjectionMatrix() ),
+        _scene( scene ),
+        _queries( queries ),
+        _results( results )
+    {
+    }
+
+    virtual void operator()( unsigned int index )
+    {
+        BVHMap bvhs;
+        BVHPickVisitor pv( _view, _proj, bvhs );
+        const unsigned int first = index * QueriesPerBlock;
+        const unsigned int last = osg::minimum(
+                (unsigned int)_queries.size(), first + QueriesPerBlock );
+        unsigned int idx;
+        for (idx=first; idx<last; idx++)
+            pv.pick( _scene, _queries[ idx ], _results[ idx ] );
+    }
+
+protected:
+    const osg::Matrix _view;
+    const osg::Matrix _proj;
+    osg::Node& _scene;
+    const std::vector< PickQuery >& _queries;
+    std::vector< PickResult >& _results;
+};
+
+unsigned int
+pickBatch( osg::Camera* camera, osg::Node* scene,
+    const std::vector< PickQuery >& queries,
+    std::vector< PickResult >& results, unsigned int numThreads )
+{
+    results.clear();
+    results.resize( queries.size() );
+    if ( (camera == NULL) || (scene == NULL) || queries.empty() )
+        return( 0 );
+
+    // Compute any dirty bounds now. The workers only read them.
+    scene->getBound();
+
+    PickBatchTask task( *camera, *scene, queries, results );
+    const unsigned int numBlocks =
+            ( queries.size() + QueriesPerBlock - 1 ) / QueriesPerBlock;
+    runParallel( task, numBlocks, numThreads );
+
+    unsigned int numHits( 0 );
+    unsigned int idx;
+    for (idx=0; idx<results.size(); idx++)
+        if (results[ idx ]._hit)
+            numHits++;
+    return( numHits );
+}
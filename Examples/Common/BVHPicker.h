@@ -0,0 +1,145 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// Bounding volume hierarchy picking used by the Picking example
+
+#ifndef __BVH_PICKER_H__
+#define __BVH_PICKER_H__
+
+#include <osg/Referenced>
+#include <osg/ref_ptr>
+#include <osg/Geometry>
+#include <osg/BoundingBox>
+#include <osg/Plane>
+#include <osg/Camera>
+#include <osg/Node>
+#include <vector>
+
+typedef std::vector<osg::Plane> PlaneList;
+
+// A bounding volume hierarchy over the triangles of one Geometry,
+//   in the Geometry's local coordinates. Build one with
+//   getTriangleBVH(), which caches it on the Geometry so that every
+//   instance of a shared Geometry uses the same hierarchy.
+class TriangleBVH : public osg::Referenced
+{
+public:
+    TriangleBVH( const osg::Geometry& geom );
+
+    // Find the triangle nearest the eye that is at least partly
+    //   inside the convex region bounded by planes (points with
+    //   a non-negative plane distance are inside). localToEye maps
+    //   local coordinates to eye coordinates and is used to measure
+    //   depth. Returns false if no triangle is inside.
+    bool intersect( const PlaneList& planes, const osg::Matrix& localToEye,
+        unsigned int& triangle, osg::Vec3& point, double& depth ) const;
+
+    // Find the triangle nearest start on the segment from start to
+    //   end, in local coordinates. ratio is the hit's fraction of
+    //   the way from start to end. Returns false on a miss.
+    bool intersect( const osg::Vec3& start, const osg::Vec3& end,
+        unsigned int& triangle, osg::Vec3& point, double& ratio ) const;
+
+    unsigned int getNumTriangles() const { return( _triangles.size() ); }
+
+    // True if the hierarchy still describes geom's current vertices
+    //   and primitive sets: the same objects, of the same sizes, not
+    //   dirtied since it was built.
+    bool matches( const osg::Geometry& geom ) const;
+
+protected:
+    virtual ~TriangleBVH() {}
+
+    struct Triangle
+    {
+        osg::Vec3 _v[ 3 ];
+        unsigned int _index;
+    };
+    // Leaves have _count > 0 and own _triangles[_first,_first+_count).
+    //   Interior nodes have _count == 0; the left child follows its
+    //   parent, and _first is the index of the right child.
+    struct Node
+    {
+        osg::BoundingBox _box;
+        unsigned int _first;
+        unsigned int _count;
+    };
+
+    unsigned int build( unsigned int first, unsigned int count );
+
+    std::vector< Triangle > _triangles;
+    std::vector< Node > _nodes;
+
+    // What the hierarchy was built from. Held, so that a new array
+    //   or primitive set can't reuse a freed one's address.
+    struct Source
+    {
+        osg::ref_ptr< const osg::Referenced > _object;
+        unsigned int _size;
+        unsigned int _modifiedCount;
+    };
+    static void getSources( const osg::Geometry& geom, std::vector< Source >& sources );
+    std::vector< Source > _sources;
+};
+
+// Return the TriangleBVH for geom, building it the first time it's
+//   needed, or again once geom has changed, and storing it as geom's
+//   user data. Returns NULL if geom's user data is already used for
+//   something else. Safe to call from several threads at once; the
+//   result is held, since another thread may replace it on geom.
+osg::ref_ptr< TriangleBVH > getTriangleBVH( osg::Geometry& geom );
+
+// One query for pickBatch(): either a rectangle in normalized
+//   (-1 to 1) projection coordinates, like pickPolytope() takes,
+//   or a line segment in world coordinates.
+struct PickQuery
+{
+    enum Type { RECTANGLE, SEGMENT };
+
+    static PickQuery rectangle( double xMin, double yMin,
+        double xMax, double yMax );
+    static PickQuery segment( const osg::Vec3& start, const osg::Vec3& end );
+
+    Type _type;
+    double _xMin, _yMin, _xMax, _yMax;
+    osg::Vec3 _start, _end;
+};
+
+// The nearest hit for one pick. _nodePath runs from the scene root
+//   to the Geode, like PolytopeIntersector's nodePath. _depth is the
+//   eye-space depth of the hit for a rectangle, or the hit's fraction
+//   of the segment for a segment.
+struct PickResult
+{
+    PickResult() : _hit( false ), _primitiveIndex( 0 ), _depth( 0. ) {}
+
+    bool _hit;
+    osg::NodePath _nodePath;
+    osg::ref_ptr< osg::Drawable > _drawable;
+    unsigned int _primitiveIndex;
+    osg::Vec3 _localPoint;
+    double _depth;
+};
+
+// Pick the scene under camera with a rectangle in normalized
+//   (-1 to 1) projection coordinates, the same region that an
+//   osgUtil::PolytopeIntersector in the PROJECTION frame tests.
+//   Subgraphs are culled by their bounding volumes, and each
+//   Geometry is tested through its TriangleBVH. Returns true and
+//   fills in result with the hit nearest the eye, if there is one.
+bool pickPolytope( osg::Camera* camera, osg::Node* scene,
+    double xMin, double yMin, double xMax, double yMax, PickResult& result );
+
+// Run many picks as one batch, spread across numThreads threads
+//   (0 means one per processor). results[i] holds the answer to
+//   queries[i]. The scene must not change while the batch runs;
+//   bounds are brought up to date on the calling thread before the
+//   workers start. Returns the number of queries that hit.
+unsigned int pickBatch( osg::Camera* camera, osg::Node* scene,
+    const std::vector< PickQuery >& queries,
+    std::vector< PickResult >& results, unsigned int numThreads=0 );
+
+#endif
@@ -0,0 +1,493 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// Frustum culling of a scene's leaves in SIMD batches
+
+#include "BatchCuller.h"
+#include "FrameRecorder.h"
+#include <osgUtil/CullVisitor>
+#include <osg/Drawable>
+#include <osg/Polytope>
+#include <osg/Math>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#if defined( __AVX__ )
+#  define CULL_USE_AVX
+#  include <immintrin.h>
+#elif defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && ( _M_IX86_FP >= 2 ) )
+#  define CULL_USE_SSE2
+#  include <emmintrin.h>
+#endif
+
+
+// A Polytope's clipping mask has a bit per plane.
+static const unsigned int MaxPlanes( 32 );
+
+
+// Append base+bit to visible for each bit set in the low eight bits
+//   of mask. Every slot is written and only the set bits advance n,
+//   so there's no branch to mispredict.
+static inline unsigned int
+appendVisible( unsigned int* visible, unsigned int n,
+    unsigned int base, unsigned int mask )
+{
+    unsigned int bit;
+    for (bit=0; bit<8; bit++)
+    {
+        visible[ n ] = base + bit;
+        n += ( mask >> bit ) & 1;
+    }
+    return( n );
+}
+
+unsigned int
+cullSpheres( const float* cx, const float* cy, const float* cz,
+    const float* radius, unsigned int count,
+    const osg::Vec4* planes, unsigned int numPlanes, unsigned int* visible )
+{
+    numPlanes = std::min( numPlanes, MaxPlanes );
+    unsigned int n( 0 );
+    unsigned int idx( 0 );
+    unsigned int pIdx;
+
+#if defined( CULL_USE_AVX )
+    __m256 pa[ MaxPlanes ], pb[ MaxPlanes ], pc[ MaxPlanes ], pd[ MaxPlanes ];
+    for (pIdx=0; pIdx<numPlanes; pIdx++)
+    {
+        pa[ pIdx ] = _mm256_set1_ps( planes[ pIdx ][ 0 ] );
+        pb[ pIdx ] = _mm256_set1_ps( planes[ pIdx ][ 1 ] );
+        pc[ pIdx ] = _mm256_set1_ps( planes[ pIdx ][ 2 ] );
+        pd[ pIdx ] = _mm256_set1_ps( planes[ pIdx ][ 3 ] );
+    }
+    const __m256 zero = _mm256_setzero_ps();
+    for (; idx+8<=count; idx+=8)
+    {
+        const __m256 x = _mm256_loadu_ps( cx + idx );
+        const __m256 y = _mm256_loadu_ps( cy + idx );
+        const __m256 z = _mm256_loadu_ps( cz + idx );
+        const __m256 r = _mm256_loadu_ps( radius + idx );
+        unsigned int mask( 0xff );
+        for (pIdx=0; pIdx<numPlanes; pIdx++)
+        {
+            const __m256 d = _mm256_add_ps(
+                _mm256_add_ps( _mm256_mul_ps( pa[ pIdx ], x ), _mm256_mul_ps( pb[ pIdx ], y ) ),
+                _mm256_add_ps( _mm256_mul_ps( pc[ pIdx ], z ), _mm256_add_ps( pd[ pIdx ], r ) ) );
+            mask &= _mm256_movemask_ps( _mm256_cmp_ps( d, zero, _CMP_GE_OQ ) );
+        }
+        n = appendVisible( visible, n, idx, mask );
+    }
+#elif defined( CULL_USE_SSE2 )
+    __m128 pa[ MaxPlanes ], pb[ MaxPlanes ], pc[ MaxPlanes ], pd[ MaxPlanes ];
+    for (pIdx=0; pIdx<numPlanes; pIdx++)
+    {
+        pa[ pIdx ] = _mm_set1_ps( planes[ pIdx ][ 0 ] );
+        pb[ pIdx ] = _mm_set1_ps( planes[ pIdx ][ 1 ] );
+        pc[ pIdx ] = _mm_set1_ps( planes[ pIdx ][ 2 ] );
+        pd[ pIdx ] = _mm_set1_ps( planes[ pIdx ][ 3 ] );
+    }
+    const __m128 zero = _mm_setzero_ps();
+    for (; idx+8<=count; idx+=8)
+    {
+        // Two vectors of four, so the compaction below serves both
+        //   paths.
+        const __m128 x0 = _mm_loadu_ps( cx + idx ), x1 = _mm_loadu_ps( cx + idx + 4 );
+        const __m128 y0 = _mm_loadu_ps( cy + idx ), y1 = _mm_loadu_ps( cy + idx + 4 );
+        const __m128 z0 = _mm_loadu_ps( cz + idx ), z1 = _mm_loadu_ps( cz + idx + 4 );
+        const __m128 r0 = _mm_loadu_ps( radius + idx ), r1 = _mm_loadu_ps( radius + idx + 4 );
+        unsigned int mask( 0xff );
+        for (pIdx=0; pIdx<numPlanes; pIdx++)
+        {
+            const __m128 d0 = _mm_add_ps(
+                _mm_add_ps( _mm_mul_ps( pa[ pIdx ], x0 ), _mm_mul_ps( pb[ pIdx ], y0 ) ),
+                _mm_add_ps( _mm_mul_ps( pc[ pIdx ], z0 ), _mm_add_ps( pd[ pIdx ], r0 ) ) );
+            const __m128 d1 = _mm_add_ps(
+                _mm_add_ps( _mm_mul_ps( pa[ pIdx ], x1 ), _mm_mul_ps( pb[ pIdx ], y1 ) ),
+                _mm_add_ps( _mm_mul_ps( pc[ pIdx ], z1 ), _mm_add_ps( pd[ pIdx ], r1 ) ) );
+            mask &= _mm_movemask_ps( _mm_cmpge_ps( d0, zero ) ) |
+                ( _mm_movemask_ps( _mm_cmpge_ps( d1, zero ) ) << 4 );
+        }
+        n = appendVisible( visible, n, idx, mask );
+    }
+#endif
+
+    // The remainder, or everything without SIMD.
+    for (; idx<count; idx++)
+    {
+        unsigned int inside( 1 );
+        for (pIdx=0; pIdx<numPlanes; pIdx++)
+            inside &= (unsigned int)( planes[ pIdx ][ 0 ] * cx[ idx ] +
+                    planes[ pIdx ][ 1 ] * cy[ idx ] + planes[ pIdx ][ 2 ] * cz[ idx ] +
+                    ( planes[ pIdx ][ 3 ] + radius[ idx ] ) >= 0.f );
+        visible[ n ] = idx;
+        n += inside;
+    }
+    return( n );
+}
+
+
+// Eye-space depth of coord, as osgUtil::CullVisitor computes it.
+static inline float
+eyeDepth( const osg::Vec3& coord, const osg::Matrix& matrix )
+{
+    return( -( (float)coord[ 0 ] * (float)matrix( 0, 2 ) +
+            (float)coord[ 1 ] * (float)matrix( 1, 2 ) +
+            (float)coord[ 2 ] * (float)matrix( 2, 2 ) + (float)matrix( 3, 2 ) ) );
+}
+
+
+BatchCuller::BatchCuller( osg::Node* scene )
+  : _scene( scene ),
+    _boundsScope( FrameRecorder::instance()->getScope( "BatchCuller bounds" ) ),
+    _testScope( FrameRecorder::instance()->getScope( "BatchCuller test" ) ),
+    _emitScope( FrameRecorder::instance()->getScope( "BatchCuller emit" ) )
+{
+    rebuild();
+}
+
+void
+BatchCuller::rebuild()
+{
+    _transforms.clear();
+    _states.clear();
+    _leaves.clear();
+    _fallbacks.clear();
+    if (_scene.valid())
+        gather( _scene.get(), -1, -1 );
+
+    _world.resize( _transforms.size() );
+    _scale.resize( _transforms.size() );
+    _modelView.resize( _transforms.size() );
+    const unsigned int numLeaves = _leaves.size();
+    _centerX.resize( numLeaves );
+    _centerY.resize( numLeaves );
+    _centerZ.resize( numLeaves );
+    _radius.resize( numLeaves );
+    _visible.resize( numLeaves );
+}
+
+int
+BatchCuller::addState( const osg::StateSet* stateSet, int parent )
+{
+    if (stateSet == NULL)
+        return( parent );
+    StateChain chain;
+    chain._stateSet = stateSet;
+    chain._parent = parent;
+    _states.push_back( chain );
+    return( _states.size() - 1 );
+}
+
+void
+BatchCuller::gather( osg::Node* node, int transform, int state )
+{
+    // A node mask of zero hides the subgraph from every cull. Any
+    //   other mask but all ones depends on the cull's traversal
+    //   mask, which CullVisitor checks.
+    if (node->getNodeMask() == 0)
+        return;
+    const char* className = node->className();
+    bool plain = ( node->getNodeMask() == 0xffffffff ) &&
+            ( node->getCullCallback() == NULL ) && node->getCullingActive();
+
+    if (plain && !strcmp( className, "Geode" ))
+    {
+        osg::Geode* geode = static_cast< osg::Geode* >( node );
+        unsigned int idx;
+        for (idx=0; idx<geode->getNumDrawables(); idx++)
+            if (geode->getDrawable( idx )->getCullCallback() != NULL)
+                plain = false;
+        if (plain)
+        {
+            Leaf leaf;
+            leaf._node = node;
+            leaf._transform = transform;
+            leaf._state = addState( node->getStateSet(), state );
+            leaf._opaque = isOpaque( *geode, leaf._state );
+            _leaves.push_back( leaf );
+            return;
+        }
+    }
+    else if (plain && ( !strcmp( className, "Group" ) ||
+            !strcmp( className, "MatrixTransform" ) ))
+    {
+        osg::Group* group = static_cast< osg::Group* >( node );
+        if (!strcmp( className, "MatrixTransform" ))
+        {
+            osg::MatrixTransform* mt = static_cast< osg::MatrixTransform* >( node );
+            if (mt->getReferenceFrame() == osg::Transform::RELATIVE_RF)
+            {
+                Transform t;
+                t._node = mt;
+                t._parent = transform;
+                _transforms.push_back( t );
+                transform = _transforms.size() - 1;
+            }
+            else
+                plain = false;
+        }
+        if (plain)
+        {
+            state = addState( node->getStateSet(), state );
+            unsigned int idx;
+            for (idx=0; idx<group->getNumChildren(); idx++)
+                gather( group->getChild( idx ), transform, state );
+            return;
+        }
+    }
+
+    Leaf fallback;
+    fallback._node = node;
+    fallback._transform = transform;
+    fallback._state = state;
+    fallback._opaque = false;
+    _fallbacks.push_back( fallback );
+}
+
+bool
+BatchCuller::isOpaque( const osg::Geode& geode, int state ) const
+{
+    for (; state>=0; state=_states[ state ]._parent)
+        if (_states[ state ]._stateSet->getRenderingHint() == osg::StateSet::TRANSPARENT_BIN)
+            return( false );
+
+    bool hasGeometry( false );
+    unsigned int idx;
+    for (idx=0; idx<geode.getNumDrawables(); idx++)
+    {
+        const osg::Drawable* drawable = geode.getDrawable( idx );
+        if ((drawable->getStateSet() != NULL) &&
+                (drawable->getStateSet()->getRenderingHint() == osg::StateSet::TRANSPARENT_BIN))
+            return( false );
+        if (drawable->asGeometry() != NULL)
+            hasGeometry = true;
+    }
+    return( hasGeometry );
+}
+
+void
+BatchCuller::refreshBounds()
+{
+    unsigned int idx;
+    for (idx=0; idx<_transforms.size(); idx++)
+    {
+        const Transform& t = _transforms[ idx ];
+        if (t._parent < 0)
+            _world[ idx ] = t._node->getMatrix();
+        else
+            _world[ idx ] = t._node->getMatrix() * _world[ t._parent ];
+
+        // Scale the radius by the longest axis, as
+        //   osg::Transform::computeBound() does.
+        const osg::Matrix& m = _world[ idx ];
+        const double sx = m( 0, 0 ) * m( 0, 0 ) + m( 0, 1 ) * m( 0, 1 ) + m( 0, 2 ) * m( 0, 2 );
+        const double sy = m( 1, 0 ) * m( 1, 0 ) + m( 1, 1 ) * m( 1, 1 ) + m( 1, 2 ) * m( 1, 2 );
+        const double sz = m( 2, 0 ) * m( 2, 0 ) + m( 2, 1 ) * m( 2, 1 ) + m( 2, 2 ) * m( 2, 2 );
+        _scale[ idx ] = (float)sqrt( std::max( sx, std::max( sy, sz ) ) );
+    }
+
+    for (idx=0; idx<_leaves.size(); idx++)
+    {
+        const Leaf& leaf = _leaves[ idx ];
+        const osg::BoundingSphere& bs = leaf._node->getBound();
+        if (!bs.valid())
+        {
+            // Outside any plane.
+            _centerX[ idx ] = _centerY[ idx ] = _centerZ[ idx ] = 0.f;
+            _radius[ idx ] = -FLT_MAX;
+            continue;
+        }
+        osg::Vec3 center( bs.center() );
+        float radius( bs.radius() );
+        if (leaf._transform >= 0)
+        {
+            center = center * _world[ leaf._transform ];
+            radius *= _scale[ leaf._transform ];
+        }
+        _centerX[ idx ] = center.x();
+        _centerY[ idx ] = center.y();
+        _centerZ[ idx ] = center.z();
+        _radius[ idx ] = radius;
+    }
+}
+
+void
+BatchCuller::pushStates( osgUtil::CullVisitor& cv, int state ) const
+{
+    if (state < 0)
+        return;
+    pushStates( cv, _states[ state ]._parent );
+    cv.pushStateSet( _states[ state ]._stateSet );
+}
+
+void
+BatchCuller::popStates( osgUtil::CullVisitor& cv, int state ) const
+{
+    for (; state>=0; state=_states[ state ]._parent)
+        cv.popStateSet();
+}
+
+// Orders occluder candidates largest first.
+static bool
+largerOccluder( const std::pair< float, unsigned int >& a,
+    const std::pair< float, unsigned int >& b )
+{
+    return( a.first > b.first );
+}
+
+unsigned int
+BatchCuller::cullOccluded( osgUtil::CullVisitor& cv, unsigned int numVisible )
+{
+    OcclusionCuller* occlusionCuller = _occlusionCuller.get();
+    const osg::Matrix view( *cv.getModelViewMatrix() );
+
+    // A leaf's share of the view goes as its radius over its depth.
+    _occluders.clear();
+    unsigned int idx;
+    for (idx=0; idx<numVisible; idx++)
+    {
+        const unsigned int leaf = _visible[ idx ];
+        if (!_leaves[ leaf ]._opaque)
+            continue;
+        const float depth = eyeDepth( osg::Vec3( _centerX[ leaf ], _centerY[ leaf ],
+                _centerZ[ leaf ] ), view );
+        _occluders.push_back( std::make_pair(
+                _radius[ leaf ] / std::max( depth, _radius[ leaf ] ), leaf ) );
+    }
+    const unsigned int numCandidates = std::min( (unsigned int)_occluders.size(),
+            occlusionCuller->getMaxOccluders() );
+    std::partial_sort( _occluders.begin(), _occluders.begin() + numCandidates,
+            _occluders.end(), largerOccluder );
+
+    occlusionCuller->beginFrame( view * *cv.getProjectionMatrix() );
+    for (idx=0; idx<numCandidates; idx++)
+    {
+        const Leaf& leaf = _leaves[ _occluders[ idx ].second ];
+        if (!occlusionCuller->addOccluder( *static_cast< osg::Geode* >( leaf._node ),
+                (leaf._transform >= 0) ? _world[ leaf._transform ] : osg::Matrix::identity() ))
+            break;
+    }
+    occlusionCuller->endOccluders();
+
+    unsigned int numLeft( 0 );
+    for (idx=0; idx<numVisible; idx++)
+    {
+        const Leaf& leaf = _leaves[ _visible[ idx ] ];
+        if (!occlusionCuller->isOccluded( static_cast< osg::Geode* >( leaf._node )->getBoundingBox(),
+                (leaf._transform >= 0) ? _world[ leaf._transform ] : osg::Matrix::identity() ))
+            _visible[ numLeft++ ] = _visible[ idx ];
+    }
+    occlusionCuller->endFrame();
+    return( numLeft );
+}
+
+osg::RefMatrix*
+BatchCuller::getModelView( osgUtil::CullVisitor& cv, int transform,
+    const osg::Matrix& view )
+{
+    if (transform < 0)
+        return( cv.getModelViewMatrix() );
+    if (!_modelView[ transform ].valid())
+        _modelView[ transform ] = cv.createOrReuseMatrix( _world[ transform ] * view );
+    return( _modelView[ transform ].get() );
+}
+
+unsigned int
+BatchCuller::cull( osgUtil::CullVisitor& cv )
+{
+    FrameRecorder* recorder = FrameRecorder::instance();
+    {
+        ScopedFrameTimer timer( recorder, _boundsScope );
+        refreshBounds();
+    }
+
+    // With only the view matrix pushed, the culling set's planes are
+    //   in world space, like the leaf bounds.
+    osg::Vec4 planes[ MaxPlanes ];
+    unsigned int numPlanes( 0 );
+    osg::Polytope& frustum = cv.getCurrentCullingSet().getFrustum();
+    const osg::Polytope::PlaneList& planeList = frustum.getPlaneList();
+    const osg::Polytope::ClippingMask mask = frustum.getCurrentMask();
+    osg::Polytope::ClippingMask selector( 1 );
+    unsigned int idx;
+    for (idx=0; (idx<planeList.size()) && (numPlanes<MaxPlanes); idx++, selector<<=1)
+    {
+        if (!( mask & selector ))
+            continue;
+        planes[ numPlanes++ ].set( (float)planeList[ idx ][ 0 ], (float)planeList[ idx ][ 1 ],
+                (float)planeList[ idx ][ 2 ], (float)planeList[ idx ][ 3 ] );
+    }
+
+    unsigned int numVisible( 0 );
+    if (!_leaves.empty())
+    {
+        ScopedFrameTimer timer( recorder, _testScope );
+        numVisible = cullSpheres( &_centerX[ 0 ], &_centerY[ 0 ], &_centerZ[ 0 ],
+                &_radius[ 0 ], _leaves.size(), planes, numPlanes, &_visible[ 0 ] );
+    }
+    if (_occlusionCuller.valid() && (numVisible > 0))
+        numVisible = cullOccluded( cv, numVisible );
+
+    ScopedFrameTimer timer( recorder, _emitScope );
+    const osg::Matrix view( *cv.getModelViewMatrix() );
+    const bool computeNearFar = ( cv.getComputeNearFarMode() !=
+            osg::CullSettings::DO_NOT_COMPUTE_NEAR_FAR );
+
+    // Add each visible leaf's drawables the way
+    //   CullVisitor::apply(Geode&) does, without a culling set of its
+    //   own.
+    for (idx=0; idx<numVisible; idx++)
+    {
+        const Leaf& leaf = _leaves[ _visible[ idx ] ];
+        osg::Geode* geode = static_cast< osg::Geode* >( leaf._node );
+        osg::RefMatrix* mv = getModelView( cv, leaf._transform, view );
+        pushStates( cv, leaf._state );
+
+        unsigned int dIdx;
+        for (dIdx=0; dIdx<geode->getNumDrawables(); dIdx++)
+        {
+            osg::Drawable* drawable = geode->getDrawable( dIdx );
+            const osg::BoundingBox& bb = drawable->getBound();
+            if (computeNearFar && bb.valid() &&
+                    !cv.updateCalculatedNearFar( *mv, *drawable, false ))
+                continue;
+
+            const float depth = bb.valid() ? eyeDepth( bb.center(), *mv ) : 0.f;
+            if (osg::isNaN( depth ))
+                continue;
+
+            const osg::StateSet* ss = drawable->getStateSet();
+            if (ss != NULL)
+                cv.pushStateSet( ss );
+            cv.addDrawableAndDepth( drawable, mv, depth );
+            if (ss != NULL)
+                cv.popStateSet();
+        }
+
+        popStates( cv, leaf._state );
+    }
+
+    // Everything else goes through the CullVisitor, under the
+    //   transforms and StateSets gathered above it.
+    for (idx=0; idx<_fallbacks.size(); idx++)
+    {
+        const Leaf& fallback = _fallbacks[ idx ];
+        if (fallback._transform >= 0)
+            cv.pushModelViewMatrix( getModelView( cv, fallback._transform, view ),
+                    osg::Transform::RELATIVE_RF );
+        pushStates( cv, fallback._state );
+        fallback._node->accept( cv );
+        popStates( cv, fallback._state );
+        if (fallback._transform >= 0)
+            cv.popModelViewMatrix();
+    }
+
+    // Let the CullVisitor reuse the matrices next frame.
+    for (idx=0; idx<_modelView.size(); idx++)
+        _modelView[ idx ] = NULL;
+    return( numVisible );
+}
@@ -0,0 +1,146 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// Frustum culling of a scene's leaves in SIMD batches
+
+#ifndef __BATCH_CULLER_H__
+#define __BATCH_CULLER_H__
+
+#include "OcclusionCuller.h"
+#include <osg/Referenced>
+#include <osg/ref_ptr>
+#include <osg/Node>
+#include <osg/Geode>
+#include <osg/MatrixTransform>
+#include <osg/StateSet>
+#include <osg/Matrix>
+#include <osg/Vec4>
+#include <utility>
+#include <vector>
+
+namespace osgUtil {
+    class CullVisitor;
+}
+
+// Test count bounding spheres, given as parallel arrays, against
+//   numPlanes planes (a, b, c, d, with the inside where
+//   a*x + b*y + c*z + d >= 0), and write the indices of those not
+//   entirely outside any plane to visible, in order. visible must
+//   hold count entries. Returns the number written.
+//
+// Eight spheres are tested per step: as one AVX vector where the
+//   compiler targets AVX, as two SSE2 vectors where it targets
+//   SSE2, and with branch-free scalar code otherwise.
+unsigned int cullSpheres( const float* cx, const float* cy, const float* cz,
+    const float* radius, unsigned int count,
+    const osg::Vec4* planes, unsigned int numPlanes, unsigned int* visible );
+
+// Culls a scene without visiting it node by node. The scene is
+//   gathered once into a flat list of leaves (Geodes), each with
+//   the MatrixTransforms and StateSets above it. Each cull, the
+//   leaves' world-space bounding spheres are refreshed into
+//   contiguous arrays, tested against the frustum with
+//   cullSpheres(), and the drawables of the visible leaves go
+//   straight into the render graph.
+//
+// Plain Groups, MatrixTransforms and Geodes are gathered. Any other
+//   node, and any node with a cull callback, culling turned off, a
+//   partial node mask or an absolute reference frame, is culled the
+//   usual way, as are Geodes with drawable cull callbacks. Call
+//   rebuild() after changing the scene's structure or node masks;
+//   matrices and bounds may change freely.
+//
+// Leaves are tested against the view frustum only: there's no small
+//   feature culling, and a visible Geode's drawables aren't tested
+//   one by one. With an OcclusionCuller, the leaves that pass are
+//   then tested against the nearest of them, drawn as occluders.
+class BatchCuller : public osg::Referenced
+{
+public:
+    BatchCuller( osg::Node* scene );
+
+    // Gather the scene again.
+    void rebuild();
+
+    // Cull the scene into cv, whose projection and view matrices
+    //   are already pushed, as osgUtil::SceneView does before
+    //   traversing the scene. Returns the number of leaves visible.
+    unsigned int cull( osgUtil::CullVisitor& cv );
+
+    // Test the leaves in the frustum for occlusion before they go
+    //   into the render graph. The opaque leaves that fill the most
+    //   of the view, up to the culler's limits, are its occluders.
+    //   NULL, the default, turns occlusion culling off.
+    void setOcclusionCuller( OcclusionCuller* occlusionCuller ) { _occlusionCuller = occlusionCuller; }
+    OcclusionCuller* getOcclusionCuller() { return( _occlusionCuller.get() ); }
+
+    unsigned int getNumLeaves() const { return( _leaves.size() ); }
+    // Subgraphs culled the usual way.
+    unsigned int getNumFallbacks() const { return( _fallbacks.size() ); }
+
+protected:
+    virtual ~BatchCuller() {}
+
+    // Gather node and its subgraph, below the given transform and
+    //   state chain.
+    void gather( osg::Node* node, int transform, int state );
+    int addState( const osg::StateSet* stateSet, int parent );
+    bool isOpaque( const osg::Geode& geode, int state ) const;
+    // World-space bounds of every leaf.
+    void refreshBounds();
+    // Remove occluded leaves from the first numVisible of _visible,
+    //   and return how many are left.
+    unsigned int cullOccluded( osgUtil::CullVisitor& cv, unsigned int numVisible );
+    void pushStates( osgUtil::CullVisitor& cv, int state ) const;
+    void popStates( osgUtil::CullVisitor& cv, int state ) const;
+    osg::RefMatrix* getModelView( osgUtil::CullVisitor& cv, int transform,
+        const osg::Matrix& view );
+
+    struct Transform
+    {
+        osg::MatrixTransform* _node;
+        int _parent;
+    };
+    // A StateSet and the chain of StateSets above it.
+    struct StateChain
+    {
+        const osg::StateSet* _stateSet;
+        int _parent;
+    };
+    struct Leaf
+    {
+        osg::Node* _node;
+        int _transform, _state;
+        // Whether a leaf may occlude: Geometry outside the
+        //   transparent bin.
+        bool _opaque;
+    };
+
+    osg::ref_ptr<osg::Node> _scene;
+
+    // Parents come before their children in each list. -1 means none.
+    std::vector< Transform > _transforms;
+    std::vector< StateChain > _states;
+    std::vector< Leaf > _leaves;
+    std::vector< Leaf > _fallbacks;
+
+    // Per transform, refreshed each cull.
+    std::vector< osg::Matrix > _world;
+    std::vector< float > _scale;
+    std::vector< osg::ref_ptr<osg::RefMatrix> > _modelView;
+
+    // Per leaf.
+    std::vector< float > _centerX, _centerY, _centerZ, _radius;
+    std::vector< unsigned int > _visible;
+
+    osg::ref_ptr< OcclusionCuller > _occlusionCuller;
+    // Visible opaque leaves, by how much of the view they fill.
+    std::vector< std::pair< float, unsigned int > > _occluders;
+
+    unsigned int _boundsScope, _testScope, _emitScope;
+};
+
+#endif
@@ -0,0 +1,1244 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// Compact binary scene files (.qsgb)
+
+#include "BinaryScene.h"
+#include "InstanceGroup.h"
+#include "ParallelLoop.h"
+#include <osgDB/Registry>
+#include <osgDB/FileUtils>
+#include <osgDB/FileNameUtils>
+#include <osg/Group>
+#include <osg/MatrixTransform>
+#include <osg/Geode>
+#include <osg/Geometry>
+#include <osg/StateSet>
+#include <osg/LOD>
+#include <osg/Switch>
+#include <osg/Sequence>
+#include <osg/Notify>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <map>
+#include <vector>
+
+
+// A file is the header, then the root node's record. A record is a
+//   tag; TagNull, TagRef and an object ID, or a definition tag, the
+//   new object's ID and its fields. Objects are defined where they're
+//   first referenced, and their children, drawables, StateSets and
+//   arrays are records nested in their fields. Strings are a length
+//   and that many bytes. Fields are in native byte order; the magic
+//   number doesn't match on a machine with the other order.
+static const unsigned int SceneMagic( 0x42475351 ); // "QSGB"
+static const unsigned int SceneVersion( 1 );
+
+enum RecordTag
+{
+    TagNull = 0,
+    TagRef,
+    // Common node fields, then the MatrixTransform or InstanceGroup
+    //   fields, then the children or drawables.
+    TagGroup,
+    TagMatrixTransform,
+    TagInstanceGroup,
+    TagGeode,
+    // Name, data variance, StateSet, display list and VBO use, then
+    //   the arrays, their bindings and the primitive sets.
+    TagGeometry,
+    // Array type, element count, byte count and the elements.
+    TagArray,
+    // Primitive set type, mode, then DrawArrays first and count, or
+    //   a first, count and lengths, or an index count and indices.
+    TagPrimitiveSet,
+    // Name, data variance, rendering hint, render bin details, then
+    //   the modes and attributes, and each unit's texture modes and
+    //   texture attributes.
+    TagStateSet,
+    // A StateSet record, then the object in .osg form. The StateSet
+    //   replaces the object's own, unless it's TagNull.
+    TagEmbedded,
+    // As TagEmbedded for a Group, then its children.
+    TagEmbeddedGroup
+};
+
+// Geometry is encoded in batches of about this many bytes.
+static const unsigned int FlushSize( 16 << 20 );
+
+
+static void
+putU32( std::string& out, unsigned int value )
+{
+    out.append( (const char*)&value, sizeof( value ) );
+}
+
+static void
+putI32( std::string& out, int value )
+{
+    out.append( (const char*)&value, sizeof( value ) );
+}
+
+static void
+putF64( std::string& out, double value )
+{
+    out.append( (const char*)&value, sizeof( value ) );
+}
+
+static void
+putString( std::string& out, const std::string& value )
+{
+    putU32( out, value.size() );
+    out.append( value );
+}
+
+static void
+putMatrix( std::string& out, const osg::Matrix& m )
+{
+    unsigned int idx;
+    for (idx=0; idx<16; idx++)
+        putF64( out, m.ptr()[ idx ] );
+}
+
+static bool
+isSupportedArray( const osg::Array* array )
+{
+    if (array == NULL)
+        return( true );
+    switch( array->getType() )
+    {
+        case osg::Array::Vec2ArrayType:
+        case osg::Array::Vec3ArrayType:
+        case osg::Array::Vec4ArrayType:
+        case osg::Array::FloatArrayType:
+        case osg::Array::Vec4ubArrayType:
+            return( true );
+        default:
+            return( false );
+    }
+}
+
+static bool
+isSupportedPrimitiveSet( const osg::PrimitiveSet* ps )
+{
+    switch( ps->getType() )
+    {
+        case osg::PrimitiveSet::DrawArraysPrimitiveType:
+        case osg::PrimitiveSet::DrawArrayLengthsPrimitiveType:
+        case osg::PrimitiveSet::DrawElementsUBytePrimitiveType:
+        case osg::PrimitiveSet::DrawElementsUShortPrimitiveType:
+        case osg::PrimitiveSet::DrawElementsUIntPrimitiveType:
+            return( true );
+        default:
+            return( false );
+    }
+}
+
+// True if the node has nothing beyond what the native records hold.
+static bool
+isPlainNode( const osg::Node& node )
+{
+    return( (node.getUpdateCallback() == NULL) &&
+        (node.getEventCallback() == NULL) &&
+        (node.getCullCallback() == NULL) &&
+        (node.getUserData() == NULL) &&
+        node.getDescriptions().empty() );
+}
+
+static bool
+isPlainGeometry( const osg::Geometry& geom )
+{
+    if ( (strcmp( geom.className(), "Geometry" ) != 0) ||
+            (geom.getUpdateCallback() != NULL) ||
+            (geom.getEventCallback() != NULL) ||
+            (geom.getCullCallback() != NULL) ||
+            (geom.getDrawCallback() != NULL) ||
+            (geom.getUserData() != NULL) ||
+            (geom.getNumVertexAttribArrays() != 0) ||
+            (geom.getVertexIndices() != NULL) ||
+            (geom.getNormalIndices() != NULL) ||
+            (geom.getColorIndices() != NULL) ||
+            (geom.getSecondaryColorIndices() != NULL) ||
+            (geom.getFogCoordIndices() != NULL) )
+        return( false );
+    if ( !isSupportedArray( geom.getVertexArray() ) ||
+            !isSupportedArray( geom.getNormalArray() ) ||
+            !isSupportedArray( geom.getColorArray() ) ||
+            !isSupportedArray( geom.getSecondaryColorArray() ) ||
+            !isSupportedArray( geom.getFogCoordArray() ) )
+        return( false );
+    unsigned int idx;
+    for (idx=0; idx<geom.getNumTexCoordArrays(); idx++)
+    {
+        if ( !isSupportedArray( geom.getTexCoordArray( idx ) ) ||
+                (geom.getTexCoordIndices( idx ) != NULL) )
+            return( false );
+    }
+    for (idx=0; idx<geom.getNumPrimitiveSets(); idx++)
+    {
+        if (!isSupportedPrimitiveSet( geom.getPrimitiveSet( idx ) ))
+            return( false );
+    }
+    return( true );
+}
+
+
+// An array or primitive set in a Geometry's payload: NULL, a
+//   reference to an object written before, or a definition.
+struct PayloadItem
+{
+    PayloadItem( const osg::Object* object=NULL, unsigned int id=0, bool define=false )
+      : _object( object ), _id( id ), _define( define ) {}
+
+    const osg::Object* _object;
+    unsigned int _id;
+    bool _define;
+};
+
+// A Geometry whose arrays and primitive sets are waiting to be
+//   encoded. IDs are assigned when the Geometry is reached, so that
+//   they follow file order whichever thread encodes the payload.
+struct GeometryPayload
+{
+    const osg::Geometry* _geometry;
+    std::vector< PayloadItem > _items;
+    std::string _data;
+};
+
+static void
+putItem( std::string& out, const PayloadItem& item )
+{
+    if (item._object == NULL)
+    {
+        putU32( out, TagNull );
+        return;
+    }
+    if (!item._define)
+    {
+        putU32( out, TagRef );
+        putU32( out, item._id );
+        return;
+    }
+
+    const osg::Array* array = dynamic_cast<const osg::Array*>( item._object );
+    if (array != NULL)
+    {
+        putU32( out, TagArray );
+        putU32( out, item._id );
+        putU32( out, array->getType() );
+        putU32( out, array->getNumElements() );
+        putU32( out, array->getTotalDataSize() );
+        out.append( (const char*)array->getDataPointer(), array->getTotalDataSize() );
+        return;
+    }
+
+    const osg::PrimitiveSet* ps = static_cast<const osg::PrimitiveSet*>( item._object );
+    putU32( out, TagPrimitiveSet );
+    putU32( out, item._id );
+    putU32( out, ps->getType() );
+    putU32( out, ps->getMode() );
+    switch( ps->getType() )
+    {
+        case osg::PrimitiveSet::DrawArraysPrimitiveType:
+        {
+            const osg::DrawArrays* da = static_cast<const osg::DrawArrays*>( ps );
+            putI32( out, da->getFirst() );
+            putI32( out, da->getCount() );
+            break;
+        }
+        case osg::PrimitiveSet::DrawArrayLengthsPrimitiveType:
+        {
+            const osg::DrawArrayLengths* dal = static_cast<const osg::DrawArrayLengths*>( ps );
+            putI32( out, dal->getFirst() );
+            putU32( out, dal->size() );
+            if (!dal->empty())
+                out.append( (const char*)&( dal->front() ), dal->size() * sizeof( GLsizei ) );
+            break;
+        }
+        case osg::PrimitiveSet::DrawElementsUBytePrimitiveType:
+        {
+            const osg::DrawElementsUByte* de = static_cast<const osg::DrawElementsUByte*>( ps );
+            putU32( out, de->size() );
+            if (!de->empty())
+                out.append( (const char*)&( de->front() ), de->size() * sizeof( GLubyte ) );
+            break;
+        }
+        case osg::PrimitiveSet::DrawElementsUShortPrimitiveType:
+        {
+            const osg::DrawElementsUShort* de = static_cast<const osg::DrawElementsUShort*>( ps );
+            putU32( out, de->size() );
+            if (!de->empty())
+                out.append( (const char*)&( de->front() ), de->size() * sizeof( GLushort ) );
+            break;
+        }
+        default:
+        {
+            const osg::DrawElementsUInt* de = static_cast<const osg::DrawElementsUInt*>( ps );
+            putU32( out, de->size() );
+            if (!de->empty())
+                out.append( (const char*)&( de->front() ), de->size() * sizeof( GLuint ) );
+            break;
+        }
+    }
+}
+
+// Encodes the payload in the order GeometryWriter planned its items,
+//   with the bindings and counts between them.
+static void
+encodePayload( GeometryPayload& payload )
+{
+    const osg::Geometry* geom = payload._geometry;
+    std::string& out = payload._data;
+    std::vector< PayloadItem >::const_iterator it = payload._items.begin();
+    putItem( out, *it++ );
+    putItem( out, *it++ );
+    putU32( out, geom->getNormalBinding() );
+    putItem( out, *it++ );
+    putU32( out, geom->getColorBinding() );
+    putItem( out, *it++ );
+    putU32( out, geom->getSecondaryColorBinding() );
+    putItem( out, *it++ );
+    putU32( out, geom->getFogCoordBinding() );
+    putU32( out, geom->getNumTexCoordArrays() );
+    unsigned int idx;
+    for (idx=0; idx<geom->getNumTexCoordArrays(); idx++)
+        putItem( out, *it++ );
+    putU32( out, geom->getNumPrimitiveSets() );
+    for (idx=0; idx<geom->getNumPrimitiveSets(); idx++)
+        putItem( out, *it++ );
+}
+
+class PayloadEncoder : public ParallelTask
+{
+public:
+    PayloadEncoder( std::vector< GeometryPayload >& payloads )
+      : _payloads( payloads ) {}
+
+    virtual void operator()( unsigned int index )
+    {
+        encodePayload( _payloads[ index ] );
+    }
+
+protected:
+    std::vector< GeometryPayload >& _payloads;
+};
+
+
+// Walks the scene and writes its records. Everything but Geometry
+//   payloads is encoded as it's reached; payloads wait in _payloads
+//   until a batch is full, and are then encoded in parallel and
+//   written out in order with the records around them.
+class SceneWriter
+{
+public:
+    SceneWriter( FILE* fp, unsigned int numThreads )
+      : _fp( fp ),
+        _numThreads( numThreads ),
+        _nextId( 1 ),
+        _pendingBytes( 0 ),
+        _ok( true )
+    {
+        _osgRW = osgDB::Registry::instance()->getReaderWriterForExtension( "osg" );
+    }
+
+    bool write( const osg::Node& root )
+    {
+        std::string& out = tail();
+        putU32( out, SceneMagic );
+        putU32( out, SceneVersion );
+        writeNode( &root );
+        flush();
+        return( _ok );
+    }
+
+protected:
+    // Serial output goes to the last chunk, unless that's a payload.
+    struct Chunk
+    {
+        Chunk() : _payload( -1 ) {}
+        std::string _data;
+        int _payload;
+    };
+
+    std::string& tail()
+    {
+        if (_chunks.empty() || (_chunks.back()._payload >= 0))
+            _chunks.push_back( Chunk() );
+        return( _chunks.back()._data );
+    }
+
+    // Write a TagNull or TagRef record and return true, or return
+    //   false if object is new.
+    bool writeRef( const osg::Object* object )
+    {
+        std::string& out = tail();
+        if (object == NULL)
+        {
+            putU32( out, TagNull );
+            return( true );
+        }
+        std::map< const osg::Object*, unsigned int >::const_iterator it = _ids.find( object );
+        if (it == _ids.end())
+            return( false );
+        putU32( out, TagRef );
+        putU32( out, it->second );
+        return( true );
+    }
+    unsigned int define( const osg::Object* object )
+    {
+        const unsigned int id = _nextId++;
+        _ids[ object ] = id;
+        return( id );
+    }
+
+    // The object in .osg form, or an empty string if the plugin
+    //   can't write it.
+    std::string embed( const osg::Object& object )
+    {
+        if (_osgRW == NULL)
+            return( std::string( "" ) );
+        std::ostringstream ostr;
+        if (!_osgRW->writeObject( object, ostr ).success())
+            return( std::string( "" ) );
+        return( ostr.str() );
+    }
+    void writeEmbedded( const osg::Object* object, unsigned int tag,
+        const osg::Object& text, const osg::StateSet* stateSet )
+    {
+        const std::string osgText = embed( text );
+        if (osgText.empty())
+        {
+            osg::notify( osg::WARN ) << "writeBinarySceneFile: Can't write a " <<
+                object->className() << ", skipping it." << std::endl;
+            putU32( tail(), TagNull );
+            return;
+        }
+        const unsigned int id = define( object );
+        putU32( tail(), tag );
+        putU32( tail(), id );
+        writeStateSet( stateSet );
+        putString( tail(), osgText );
+    }
+
+    void writeNodeFields( const osg::Node& node )
+    {
+        std::string& out = tail();
+        putString( out, node.getName() );
+        putU32( out, node.getDataVariance() );
+        putU32( out, node.getNodeMask() );
+        putU32( out, node.getCullingActive() ? 1 : 0 );
+        writeStateSet( node.getStateSet() );
+    }
+    void writeChildren( const osg::Group& group )
+    {
+        putU32( tail(), group.getNumChildren() );
+        unsigned int idx;
+        for (idx=0; idx<group.getNumChildren(); idx++)
+            writeNode( group.getChild( idx ) );
+    }
+
+    void writeNode( const osg::Node* node )
+    {
+        if (writeRef( node ))
+            return;
+
+        const std::string className( node->className() );
+        const bool plain = isPlainNode( *node );
+        const osg::Group* group = node->asGroup();
+        if (plain && ( (className == "Group") || (className == "MatrixTransform") ||
+                (className == "InstanceGroup") ))
+        {
+            const unsigned int id = define( node );
+            unsigned int tag( TagGroup );
+            if (className == "MatrixTransform")
+                tag = TagMatrixTransform;
+            else if (className == "InstanceGroup")
+                tag = TagInstanceGroup;
+            putU32( tail(), tag );
+            putU32( tail(), id );
+            writeNodeFields( *node );
+
+            if (tag == TagMatrixTransform)
+            {
+                const osg::MatrixTransform* mt = static_cast<const osg::MatrixTransform*>( node );
+                putU32( tail(), mt->getReferenceFrame() );
+                putMatrix( tail(), mt->getMatrix() );
+            }
+            else if (tag == TagInstanceGroup)
+                writeInstances( *static_cast<const InstanceGroup*>( node ) );
+            writeChildren( *group );
+        }
+        else if (plain && (className == "Geode"))
+        {
+            const osg::Geode* geode = node->asGeode();
+            const unsigned int id = define( node );
+            putU32( tail(), TagGeode );
+            putU32( tail(), id );
+            writeNodeFields( *node );
+            putU32( tail(), geode->getNumDrawables() );
+            unsigned int idx;
+            for (idx=0; idx<geode->getNumDrawables(); idx++)
+                writeDrawable( geode->getDrawable( idx ) );
+        }
+        else if ( (group != NULL) && (dynamic_cast<const osg::LOD*>( node ) == NULL) &&
+                (dynamic_cast<const osg::Switch*>( node ) == NULL) &&
+                (dynamic_cast<const osg::Sequence*>( node ) == NULL) )
+        {
+            // Embed a copy without children or StateSet, and write
+            //   those natively. Classes with per-child data (LOD,
+            //   Switch, Sequence) are embedded whole instead.
+            osg::ref_ptr<osg::Group> copy = static_cast<osg::Group*>(
+                group->clone( osg::CopyOp::SHALLOW_COPY ) );
+            copy->removeChildren( 0, copy->getNumChildren() );
+            copy->setStateSet( NULL );
+            writeEmbedded( node, TagEmbeddedGroup, *copy, node->getStateSet() );
+            if (_ids.find( node ) != _ids.end())
+                writeChildren( *group );
+        }
+        else
+            writeEmbedded( node, TagEmbedded, *node, NULL );
+    }
+
+    void writeInstances( const InstanceGroup& ig )
+    {
+        bool hasStateSets( false );
+        unsigned int idx;
+        for (idx=0; idx<ig.getNumInstances(); idx++)
+        {
+            if (ig.getInstanceStateSet( idx ) != NULL)
+                hasStateSets = true;
+        }
+        putU32( tail(), ig.getNumInstances() );
+        putU32( tail(), hasStateSets ? 1 : 0 );
+        for (idx=0; idx<ig.getNumInstances(); idx++)
+        {
+            putMatrix( tail(), ig.getMatrix( idx ) );
+            if (hasStateSets)
+                writeStateSet( ig.getInstanceStateSet( idx ) );
+        }
+    }
+
+    void writeDrawable( const osg::Drawable* drawable )
+    {
+        if (writeRef( drawable ))
+            return;
+
+        const osg::Geometry* geom = drawable->asGeometry();
+        if ( (geom == NULL) || !isPlainGeometry( *geom ) )
+        {
+            osg::ref_ptr<osg::Drawable> copy = static_cast<osg::Drawable*>(
+                drawable->clone( osg::CopyOp::SHALLOW_COPY ) );
+            copy->setStateSet( NULL );
+            writeEmbedded( drawable, TagEmbedded, *copy, drawable->getStateSet() );
+            return;
+        }
+
+        const unsigned int id = define( geom );
+        putU32( tail(), TagGeometry );
+        putU32( tail(), id );
+        putString( tail(), geom->getName() );
+        putU32( tail(), geom->getDataVariance() );
+        writeStateSet( geom->getStateSet() );
+        putU32( tail(), geom->getUseDisplayList() ? 1 : 0 );
+        putU32( tail(), geom->getUseVertexBufferObjects() ? 1 : 0 );
+
+        // Plan the payload in encodePayload()'s order.
+        GeometryPayload payload;
+        payload._geometry = geom;
+        planItem( payload, geom->getVertexArray() );
+        planItem( payload, geom->getNormalArray() );
+        planItem( payload, geom->getColorArray() );
+        planItem( payload, geom->getSecondaryColorArray() );
+        planItem( payload, geom->getFogCoordArray() );
+        unsigned int idx;
+        for (idx=0; idx<geom->getNumTexCoordArrays(); idx++)
+            planItem( payload, geom->getTexCoordArray( idx ) );
+        for (idx=0; idx<geom->getNumPrimitiveSets(); idx++)
+            planItem( payload, geom->getPrimitiveSet( idx ) );
+
+        Chunk chunk;
+        chunk._payload = _payloads.size();
+        _chunks.push_back( chunk );
+        _payloads.push_back( payload );
+        if (_pendingBytes >= FlushSize)
+            flush();
+    }
+    void planItem( GeometryPayload& payload, const osg::Array* array )
+    {
+        if (array == NULL)
+            payload._items.push_back( PayloadItem() );
+        else
+            planObject( payload, array, array->getTotalDataSize() );
+    }
+    void planItem( GeometryPayload& payload, const osg::PrimitiveSet* ps )
+    {
+        planObject( payload, ps, ps->getTotalDataSize() );
+    }
+    void planObject( GeometryPayload& payload, const osg::Object* object, unsigned int size )
+    {
+        std::map< const osg::Object*, unsigned int >::const_iterator it = _ids.find( object );
+        if (it != _ids.end())
+        {
+            payload._items.push_back( PayloadItem( object, it->second, false ) );
+            return;
+        }
+        payload._items.push_back( PayloadItem( object, define( object ), true ) );
+        _pendingBytes += size;
+    }
+
+    void writeStateSet( const osg::StateSet* stateSet )
+    {
+        if (writeRef( stateSet ))
+            return;
+        if ( !stateSet->getUniformList().empty() ||
+                (stateSet->getUpdateCallback() != NULL) ||
+                (stateSet->getEventCallback() != NULL) )
+        {
+            writeEmbedded( stateSet, TagEmbedded, *stateSet, NULL );
+            return;
+        }
+
+        const unsigned int id = define( stateSet );
+        std::string& out = tail();
+        putU32( out, TagStateSet );
+        putU32( out, id );
+        putString( out, stateSet->getName() );
+        putU32( out, stateSet->getDataVariance() );
+        putI32( out, stateSet->getRenderingHint() );
+        putU32( out, stateSet->getRenderBinMode() );
+        putI32( out, stateSet->getBinNumber() );
+        putString( out, stateSet->getBinName() );
+
+        writeModes( stateSet->getModeList() );
+        writeAttributes( stateSet->getAttributeList() );
+        const osg::StateSet::TextureModeList& texModes = stateSet->getTextureModeList();
+        putU32( tail(), texModes.size() );
+        unsigned int idx;
+        for (idx=0; idx<texModes.size(); idx++)
+            writeModes( texModes[ idx ] );
+        const osg::StateSet::TextureAttributeList& texAttrs = stateSet->getTextureAttributeList();
+        putU32( tail(), texAttrs.size() );
+        for (idx=0; idx<texAttrs.size(); idx++)
+            writeAttributes( texAttrs[ idx ] );
+    }
+    void writeModes( const osg::StateSet::ModeList& modes )
+    {
+        std::string& out = tail();
+        putU32( out, modes.size() );
+        osg::StateSet::ModeList::const_iterator it;
+        for (it=modes.begin(); it!=modes.end(); it++)
+        {
+            putU32( out, it->first );
+            putU32( out, it->second );
+        }
+    }
+    void writeAttributes( const osg::StateSet::AttributeList& attrs )
+    {
+        putU32( tail(), attrs.size() );
+        osg::StateSet::AttributeList::const_iterator it;
+        for (it=attrs.begin(); it!=attrs.end(); it++)
+        {
+            const osg::StateAttribute* attr = it->second.first.get();
+            if (!writeRef( attr ))
+                writeEmbedded( attr, TagEmbedded, *attr, NULL );
+            putU32( tail(), it->second.second );
+        }
+    }
+
+    // Encode the waiting payloads, then write out every chunk.
+    void flush()
+    {
+        PayloadEncoder encoder( _payloads );
+        runParallel( encoder, _payloads.size(), _numThreads );
+
+        unsigned int idx;
+        for (idx=0; _ok && (idx<_chunks.size()); idx++)
+        {
+            const std::string& data = ( _chunks[ idx ]._payload < 0 ) ?
+                _chunks[ idx ]._data : _payloads[ _chunks[ idx ]._payload ]._data;
+            if (!data.empty())
+                _ok = (fwrite( data.data(), 1, data.size(), _fp ) == data.size());
+        }
+        _chunks.clear();
+        _payloads.clear();
+        _pendingBytes = 0;
+    }
+
+    FILE* _fp;
+    const unsigned int _numThreads;
+    osgDB::ReaderWriter* _osgRW;
+    std::map< const osg::Object*, unsigned int > _ids;
+    unsigned int _nextId;
+    std::vector< Chunk > _chunks;
+    std::vector< GeometryPayload > _payloads;
+    unsigned int _pendingBytes;
+    bool _ok;
+};
+
+bool
+writeBinarySceneFile( const osg::Node& node, const std::string& fileName,
+    unsigned int numThreads )
+{
+    // Write a temporary file and rename it, so a reader never sees
+    //   a partly written file.
+    const std::string tempName = fileName + ".tmp";
+    FILE* fp = fopen( tempName.c_str(), "wb" );
+    if (fp == NULL)
+        return( false );
+    bool ok;
+    {
+        SceneWriter writer( fp, numThreads );
+        ok = writer.write( node );
+    }
+    ok = (fclose( fp ) == 0) && ok;
+#ifdef _WIN32
+    remove( fileName.c_str() );
+#endif
+    if (!ok || (rename( tempName.c_str(), fileName.c_str() ) != 0))
+    {
+        remove( tempName.c_str() );
+        return( false );
+    }
+    return( true );
+}
+
+
+// Reads records back, keeping every defined object by ID.
+class SceneReader
+{
+public:
+    SceneReader( FILE* fp )
+      : _fp( fp ),
+        _ok( true )
+    {
+        _osgRW = osgDB::Registry::instance()->getReaderWriterForExtension( "osg" );
+        fseek( _fp, 0, SEEK_END );
+        _fileSize = ftell( _fp );
+        rewind( _fp );
+    }
+
+    osg::Node* read()
+    {
+        if ( (getU32() != SceneMagic) || (getU32() != SceneVersion) )
+            return( NULL );
+        osg::ref_ptr<osg::Node> root;
+        if (!readTyped( root ))
+            return( NULL );
+        return( root.release() );
+    }
+
+protected:
+    unsigned int getU32()
+    {
+        unsigned int value( 0 );
+        getBytes( &value, sizeof( value ) );
+        return( value );
+    }
+    int getI32()
+    {
+        int value( 0 );
+        getBytes( &value, sizeof( value ) );
+        return( value );
+    }
+    double getF64()
+    {
+        double value( 0. );
+        getBytes( &value, sizeof( value ) );
+        return( value );
+    }
+    std::string getString()
+    {
+        const unsigned int size = getU32();
+        std::string value;
+        if (fits( size, 1 ) && (size > 0))
+        {
+            value.resize( size );
+            getBytes( &( value[ 0 ] ), size );
+        }
+        return( value );
+    }
+    osg::Matrix getMatrix()
+    {
+        osg::Matrix m;
+        unsigned int idx;
+        for (idx=0; idx<16; idx++)
+            m.ptr()[ idx ] = getF64();
+        return( m );
+    }
+    void getBytes( void* data, unsigned int size )
+    {
+        if (_ok && (size > 0))
+            _ok = (fread( data, 1, size, _fp ) == size);
+    }
+    // Counts come from the file, so check that count elements of
+    //   elementSize bytes are left in it before allocating for them.
+    //   A damaged count then fails the read instead of allocating
+    //   gigabytes.
+    bool fits( unsigned int count, unsigned int elementSize )
+    {
+        if (_ok && ( (double)count * elementSize > (double)( _fileSize - ftell( _fp ) ) ))
+            _ok = false;
+        return( _ok );
+    }
+
+    // Read a record that must hold a T (or TagNull).
+    template< class T >
+    bool readTyped( osg::ref_ptr< T >& result )
+    {
+        // After a failure, object may be one that define() refused to
+        //   hold, and already deleted.
+        osg::Object* object = readObject();
+        if (!_ok)
+        {
+            result = NULL;
+            return( false );
+        }
+        result = dynamic_cast< T* >( object );
+        if ( (object != NULL) && !result.valid() )
+            _ok = false;
+        return( _ok );
+    }
+
+    void define( unsigned int id, osg::Object* object )
+    {
+        // IDs are sequential, and every definition takes at least
+        //   a tag and an ID.
+        if ( (id == 0) || ((double)id > (double)_fileSize / 8.) )
+        {
+            _ok = false;
+            return;
+        }
+        if (id >= _objects.size())
+            _objects.resize( id + 1 );
+        _objects[ id ] = object;
+    }
+
+    osg::Object* readObject()
+    {
+        const unsigned int tag = getU32();
+        if (!_ok || (tag == TagNull))
+            return( NULL );
+        const unsigned int id = getU32();
+        if (!_ok)
+            return( NULL );
+
+        switch( tag )
+        {
+            case TagRef:
+                if ( (id < _objects.size()) && _objects[ id ].valid() )
+                    return( _objects[ id ].get() );
+                _ok = false;
+                return( NULL );
+
+            case TagGroup:
+            case TagMatrixTransform:
+            case TagInstanceGroup:
+            {
+                osg::ref_ptr<osg::Group> group;
+                if (tag == TagMatrixTransform)
+                    group = new osg::MatrixTransform;
+                else if (tag == TagInstanceGroup)
+                    group = new InstanceGroup;
+                else
+                    group = new osg::Group;
+                define( id, group.get() );
+                readNodeFields( *group );
+                if (tag == TagMatrixTransform)
+                {
+                    osg::MatrixTransform* mt = static_cast<osg::MatrixTransform*>( group.get() );
+                    mt->setReferenceFrame( (osg::Transform::ReferenceFrame)getU32() );
+                    mt->setMatrix( getMatrix() );
+                }
+                else if (tag == TagInstanceGroup)
+                    readInstances( *static_cast<InstanceGroup*>( group.get() ) );
+                readChildren( *group );
+                return( group.get() );
+            }
+
+            case TagGeode:
+            {
+                osg::ref_ptr<osg::Geode> geode = new osg::Geode;
+                define( id, geode.get() );
+                readNodeFields( *geode );
+                const unsigned int numDrawables = getU32();
+                unsigned int idx;
+                for (idx=0; _ok && (idx<numDrawables); idx++)
+                {
+                    osg::ref_ptr<osg::Drawable> drawable;
+                    if (readTyped( drawable ) && drawable.valid())
+                        geode->addDrawable( drawable.get() );
+                }
+                return( geode.get() );
+            }
+
+            case TagGeometry:
+                return( readGeometry( id ) );
+
+            case TagArray:
+                return( readArray( id ) );
+
+            case TagPrimitiveSet:
+                return( readPrimitiveSet( id ) );
+
+            case TagStateSet:
+                return( readStateSet( id ) );
+
+            case TagEmbedded:
+            case TagEmbeddedGroup:
+            {
+                osg::ref_ptr<osg::StateSet> stateSet;
+                readTyped( stateSet );
+                const std::string text = getString();
+                if (!_ok || (_osgRW == NULL))
+                {
+                    _ok = false;
+                    return( NULL );
+                }
+                std::istringstream istr( text );
+                osgDB::ReaderWriter::ReadResult rr = _osgRW->readObject( istr );
+                osg::ref_ptr<osg::Object> object = rr.getObject();
+                if (!object.valid())
+                {
+                    _ok = false;
+                    return( NULL );
+                }
+                define( id, object.get() );
+                if (stateSet.valid())
+                {
+                    osg::Node* node = dynamic_cast<osg::Node*>( object.get() );
+                    osg::Drawable* drawable = dynamic_cast<osg::Drawable*>( object.get() );
+                    if (node != NULL)
+                        node->setStateSet( stateSet.get() );
+                    else if (drawable != NULL)
+                        drawable->setStateSet( stateSet.get() );
+                }
+                if (tag == TagEmbeddedGroup)
+                {
+                    osg::Group* group = dynamic_cast<osg::Group*>( object.get() );
+                    if (group == NULL)
+                    {
+                        _ok = false;
+                        return( NULL );
+                    }
+                    readChildren( *group );
+                }
+                return( object.get() );
+            }
+
+            default:
+                _ok = false;
+                return( NULL );
+        }
+    }
+
+    void readNodeFields( osg::Node& node )
+    {
+        node.setName( getString() );
+        node.setDataVariance( (osg::Object::DataVariance)getU32() );
+        node.setNodeMask( getU32() );
+        node.setCullingActive( getU32() != 0 );
+        osg::ref_ptr<osg::StateSet> stateSet;
+        if (readTyped( stateSet ))
+            node.setStateSet( stateSet.get() );
+    }
+    void readChildren( osg::Group& group )
+    {
+        const unsigned int numChildren = getU32();
+        unsigned int idx;
+        for (idx=0; _ok && (idx<numChildren); idx++)
+        {
+            osg::ref_ptr<osg::Node> child;
+            if (readTyped( child ) && child.valid())
+                group.addChild( child.get() );
+        }
+    }
+    void readInstances( InstanceGroup& ig )
+    {
+        const unsigned int numInstances = getU32();
+        const bool hasStateSets = (getU32() != 0);
+        unsigned int idx;
+        for (idx=0; _ok && (idx<numInstances); idx++)
+        {
+            const osg::Matrix m = getMatrix();
+            osg::ref_ptr<osg::StateSet> stateSet;
+            if (hasStateSets)
+                readTyped( stateSet );
+            ig.addInstance( m, stateSet.get() );
+        }
+    }
+
+    osg::Object* readGeometry( unsigned int id )
+    {
+        osg::ref_ptr<osg::Geometry> geom = new osg::Geometry;
+        define( id, geom.get() );
+        geom->setName( getString() );
+        geom->setDataVariance( (osg::Object::DataVariance)getU32() );
+        osg::ref_ptr<osg::StateSet> stateSet;
+        readTyped( stateSet );
+        geom->setStateSet( stateSet.get() );
+        geom->setUseDisplayList( getU32() != 0 );
+        geom->setUseVertexBufferObjects( getU32() != 0 );
+
+        osg::ref_ptr<osg::Array> array;
+        readTyped( array );
+        geom->setVertexArray( array.get() );
+        readTyped( array );
+        geom->setNormalArray( array.get() );
+        geom->setNormalBinding( (osg::Geometry::AttributeBinding)getU32() );
+        readTyped( array );
+        geom->setColorArray( array.get() );
+        geom->setColorBinding( (osg::Geometry::AttributeBinding)getU32() );
+        readTyped( array );
+        geom->setSecondaryColorArray( array.get() );
+        geom->setSecondaryColorBinding( (osg::Geometry::AttributeBinding)getU32() );
+        readTyped( array );
+        geom->setFogCoordArray( array.get() );
+        geom->setFogCoordBinding( (osg::Geometry::AttributeBinding)getU32() );
+        const unsigned int numTexCoords = getU32();
+        unsigned int idx;
+        for (idx=0; _ok && (idx<numTexCoords); idx++)
+        {
+            readTyped( array );
+            geom->setTexCoordArray( idx, array.get() );
+        }
+        const unsigned int numPrimitiveSets = getU32();
+        for (idx=0; _ok && (idx<numPrimitiveSets); idx++)
+        {
+            osg::ref_ptr<osg::PrimitiveSet> ps;
+            if (readTyped( ps ) && ps.valid())
+                geom->addPrimitiveSet( ps.get() );
+        }
+        return( geom.get() );
+    }
+
+    template< class A >
+    osg::Array* readArrayData( unsigned int numElements, unsigned int size )
+    {
+        if ( !fits( size, 1 ) ||
+                !fits( numElements, sizeof( typename A::ElementDataType ) ) )
+            return( NULL );
+        osg::ref_ptr< A > array = new A( numElements );
+        if (array->getTotalDataSize() != size)
+        {
+            _ok = false;
+            return( NULL );
+        }
+        if (numElements > 0)
+            getBytes( &( ( *array )[ 0 ] ), size );
+        return( array.release() );
+    }
+    osg::Object* readArray( unsigned int id )
+    {
+        const unsigned int type = getU32();
+        const unsigned int numElements = getU32();
+        const unsigned int size = getU32();
+        if (!_ok)
+            return( NULL );
+        osg::ref_ptr<osg::Array> array;
+        switch( type )
+        {
+            case osg::Array::Vec2ArrayType:
+                array = readArrayData< osg::Vec2Array >( numElements, size );
+                break;
+            case osg::Array::Vec3ArrayType:
+                array = readArrayData< osg::Vec3Array >( numElements, size );
+                break;
+            case osg::Array::Vec4ArrayType:
+                array = readArrayData< osg::Vec4Array >( numElements, size );
+                break;
+            case osg::Array::FloatArrayType:
+                array = readArrayData< osg::FloatArray >( numElements, size );
+                break;
+            case osg::Array::Vec4ubArrayType:
+                array = readArrayData< osg::Vec4ubArray >( numElements, size );
+                break;
+            default:
+                _ok = false;
+                break;
+        }
+        if (!_ok)
+            return( NULL );
+        define( id, array.get() );
+        return( array.get() );
+    }
+
+    template< class D >
+    osg::PrimitiveSet* readElements( GLenum mode )
+    {
+        osg::ref_ptr< D > de = new D( mode );
+        const unsigned int numIndices = getU32();
+        if (fits( numIndices, sizeof( typename D::value_type ) ) && (numIndices > 0))
+        {
+            de->resize( numIndices );
+            getBytes( &( de->front() ), numIndices * sizeof( de->front() ) );
+        }
+        return( de.release() );
+    }
+    osg::Object* readPrimitiveSet( unsigned int id )
+    {
+        const unsigned int type = getU32();
+        const GLenum mode = getU32();
+        osg::ref_ptr<osg::PrimitiveSet> ps;
+        switch( type )
+        {
+            case osg::PrimitiveSet::DrawArraysPrimitiveType:
+            {
+                const int first = getI32();
+                const int count = getI32();
+                ps = new osg::DrawArrays( mode, first, count );
+                break;
+            }
+            case osg::PrimitiveSet::DrawArrayLengthsPrimitiveType:
+            {
+                const int first = getI32();
+                osg::ref_ptr<osg::DrawArrayLengths> dal = new osg::DrawArrayLengths( mode, first );
+                const unsigned int numLengths = getU32();
+                if (fits( numLengths, sizeof( GLsizei ) ) && (numLengths > 0))
+                {
+                    dal->resize( numLengths );
+                    getBytes( &( dal->front() ), numLengths * sizeof( GLsizei ) );
+                }
+                ps = dal;
+                break;
+            }
+            case osg::PrimitiveSet::DrawElementsUBytePrimitiveType:
+                ps = readElements< osg::DrawElementsUByte >( mode );
+                break;
+            case osg::PrimitiveSet::DrawElementsUShortPrimitiveType:
+                ps = readElements< osg::DrawElementsUShort >( mode );
+                break;
+            case osg::PrimitiveSet::DrawElementsUIntPrimitiveType:
+                ps = readElements< osg::DrawElementsUInt >( mode );
+                break;
+            default:
+                _ok = false;
+                break;
+        }
+        if (!_ok)
+            return( NULL );
+        define( id, ps.get() );
+        return( ps.get() );
+    }
+
+    osg::Object* readStateSet( unsigned int id )
+    {
+        osg::ref_ptr<osg::StateSet> stateSet = new osg::StateSet;
+        define( id, stateSet.get() );
+        stateSet->setName( getString() );
+        stateSet->setDataVariance( (osg::Object::DataVariance)getU32() );
+        // The hint changes the bin details, so set them after it.
+        stateSet->setRenderingHint( getI32() );
+        const osg::StateSet::RenderBinMode binMode = (osg::StateSet::RenderBinMode)getU32();
+        const int binNumber = getI32();
+        const std::string binName = getString();
+        stateSet->setRenderBinDetails( binNumber, binName, binMode );
+
+        unsigned int numModes = getU32();
+        unsigned int idx;
+        for (idx=0; _ok && (idx<numModes); idx++)
+        {
+            const GLenum mode = getU32();
+            stateSet->setMode( mode, getU32() );
+        }
+        unsigned int numAttrs = getU32();
+        for (idx=0; _ok && (idx<numAttrs); idx++)
+        {
+            osg::ref_ptr<osg::StateAttribute> attr;
+            readTyped( attr );
+            const unsigned int value = getU32();
+            if (attr.valid())
+                stateSet->setAttribute( attr.get(), value );
+        }
+
+        const unsigned int numTexModeUnits = getU32();
+        unsigned int unit;
+        for (unit=0; _ok && (unit<numTexModeUnits); unit++)
+        {
+            numModes = getU32();
+            for (idx=0; _ok && (idx<numModes); idx++)
+            {
+                const GLenum mode = getU32();
+                stateSet->setTextureMode( unit, mode, getU32() );
+            }
+        }
+        const unsigned int numTexAttrUnits = getU32();
+        for (unit=0; _ok && (unit<numTexAttrUnits); unit++)
+        {
+            numAttrs = getU32();
+            for (idx=0; _ok && (idx<numAttrs); idx++)
+            {
+                osg::ref_ptr<osg::StateAttribute> attr;
+                readTyped( attr );
+                const unsigned int value = getU32();
+                if (attr.valid())
+                    stateSet->setTextureAttribute( unit, attr.get(), value );
+            }
+        }
+        return( stateSet.get() );
+    }
+
+    FILE* _fp;
+    long _fileSize;
+    osgDB::ReaderWriter* _osgRW;
+    std::vector< osg::ref_ptr<osg::Object> > _objects;
+    bool _ok;
+};
+
+osg::Node*
+readBinarySceneFile( const std::string& fileName )
+{
+    FILE* fp = fopen( fileName.c_str(), "rb" );
+    if (fp == NULL)
+        return( NULL );
+    osg::ref_ptr<osg::Node> root;
+    {
+        SceneReader reader( fp );
+        root = reader.read();
+    }
+    fclose( fp );
+    if (!root.valid())
+        osg::notify( osg::WARN ) << "readBinarySceneFile: \"" << fileName <<
+            "\" is not a valid .qsgb file." << std::endl;
+    return( root.release() );
+}
+
+
+// Makes osgDB::readNodeFile() and writeNodeFile() handle .qsgb.
+class ReaderWriterQSGB : public osgDB::ReaderWriter
+{
+public:
+    virtual const char* className() const { return( "QSG binary scene reader/writer" ); }
+    virtual bool acceptsExtension( const std::string& extension ) const
+    {
+        return( osgDB::equalCaseInsensitive( extension, "qsgb" ) );
+    }
+
+    virtual ReadResult readNode( const std::string& fileName, const Options* options=NULL ) const
+    {
+        if (!acceptsExtension( osgDB::getLowerCaseFileExtension( fileName ) ))
+            return( ReadResult::FILE_NOT_HANDLED );
+        const std::string fullName = osgDB::findDataFile( fileName, options );
+        if (fullName.empty())
+            return( ReadResult::FILE_NOT_FOUND );
+        osg::Node* node = readBinarySceneFile( fullName );
+        if (node == NULL)
+            return( ReadResult::ERROR_IN_READING_FILE );
+        return( ReadResult( node ) );
+    }
+
+    virtual WriteResult writeNode( const osg::Node& node, const std::string& fileName,
+        const Options* =NULL ) const
+    {
+        if (!acceptsExtension( osgDB::getLowerCaseFileExtension( fileName ) ))
+            return( WriteResult::FILE_NOT_HANDLED );
+        if (!writeBinarySceneFile( node, fileName ))
+            return( WriteResult::ERROR_IN_WRITING_FILE );
+        return( WriteResult::FILE_SAVED );
+    }
+};
+
+static osgDB::RegisterReaderWriterProxy< ReaderWriterQSGB > s_qsgbProxy;
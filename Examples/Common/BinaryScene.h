@@ -0,0 +1,43 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// Compact binary scene files (.qsgb)
+
+#ifndef __BINARY_SCENE_H__
+#define __BINARY_SCENE_H__
+
+#include <osg/Node>
+#include <string>
+
+// Write the scene under node to a binary .qsgb file. Every object the
+//   scene references more than once, such as a Geode under several
+//   MatrixTransforms, a shared StateSet or a shared array, is written
+//   once and referred to by ID afterwards.
+//
+// Groups, MatrixTransforms, Geodes, InstanceGroups, Geometry, arrays,
+//   primitive sets and StateSets are written in a native binary form.
+//   Geometry arrays and primitive sets are encoded on numThreads
+//   threads (0 means one per processor), a batch at a time, and each
+//   batch is written as soon as it's encoded, so the file is never
+//   held in memory whole. Anything else (other node and drawable
+//   classes, state attributes, and objects with callbacks or user
+//   data) is embedded in .osg form through the stock plugin; the
+//   children of embedded Groups are still written natively.
+//
+// Fields are in native byte order. Returns false, and leaves no
+//   partial file, if the file can't be written.
+bool writeBinarySceneFile( const osg::Node& node, const std::string& fileName,
+    unsigned int numThreads=0 );
+
+// Read a .qsgb file written by writeBinarySceneFile(). Returns NULL
+//   if the file can't be read.
+osg::Node* readBinarySceneFile( const std::string& fileName );
+
+// Linking BinaryScene.cpp also registers a ReaderWriter for the
+//   .qsgb extension, so osgDB::writeNodeFile() and readNodeFile()
+//   handle .qsgb files with the two functions above.
+
+#endif
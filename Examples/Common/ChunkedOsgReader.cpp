@@ -0,0 +1,713 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// Parallel reader for large ASCII .osg files
+
+#include "ChunkedOsgReader.h"
+#include "ParallelLoop.h"
+#include <osgDB/ReadFile>
+#include <osgDB/Registry>
+#include <osgDB/FileUtils>
+#include <osgDB/FileNameUtils>
+#include <osg/Geode>
+#include <osg/Geometry>
+#include <osg/PrimitiveSet>
+#include <osg/NodeVisitor>
+#include <osg/Notify>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <set>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+
+
+// Numeric bodies larger than this are split into several chunks.
+static const size_t ChunkBytes( 256 * 1024 );
+
+// One array or primitive set body found by the scanner.
+struct NumericBody
+{
+    enum Kind
+    {
+        VERTICES, NORMALS, COLORS, SECONDARY_COLORS,
+        FOG_COORDS, TEX_COORDS, PRIMITIVES
+    };
+
+    Kind _kind;
+    // Index of the enclosing Geometry, in file order.
+    unsigned int _geometry;
+    // Texture unit for TEX_COORDS, primitive set index for PRIMITIVES.
+    unsigned int _slot;
+    // Array type (Vec3Array, ...) or primitive set class name.
+    std::string _type;
+    // Element count from the header, and scalars per element.
+    unsigned int _count;
+    unsigned int _components;
+    // Range of chunks holding this body.
+    unsigned int _firstChunk, _numChunks;
+};
+
+// A line-aligned piece of a numeric body, and its parsed values.
+struct Chunk
+{
+    const char* _begin;
+    const char* _end;
+    bool _integers;
+    bool _ok;
+    std::vector< float > _floats;
+    std::vector< unsigned int > _ints;
+};
+
+
+static inline bool
+isSpace( char c )
+{
+    return( (c == ' ') || (c == '\t') || (c == '\r') || (c == '\n') );
+}
+
+static void
+splitTokens( const char* p, const char* end, std::vector< std::string >& tokens )
+{
+    tokens.clear();
+    while (p < end)
+    {
+        while ((p < end) && isSpace( *p ))
+            p++;
+        const char* start = p;
+        while ((p < end) && !isSpace( *p ))
+            p++;
+        if (p > start)
+            tokens.push_back( std::string( start, p ) );
+    }
+}
+
+static bool
+isUnsigned( const std::string& token, unsigned int& value )
+{
+    if (token.empty() || (token.find_first_not_of( "0123456789" ) != std::string::npos))
+        return( false );
+    value = (unsigned int)( strtoul( token.c_str(), NULL, 10 ) );
+    return( true );
+}
+
+static unsigned int
+getArrayComponents( const std::string& type )
+{
+    if (type == "FloatArray")
+        return( 1 );
+    if (type == "Vec2Array")
+        return( 2 );
+    if (type == "Vec3Array")
+        return( 3 );
+    if (type == "Vec4Array")
+        return( 4 );
+    return( 0 );
+}
+
+
+// Exact powers of ten representable in a double.
+static const double Pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+// Parse one decimal number at p without locale lookups or a
+//   temporary string. Numbers with up to 15 significant digits and
+//   a small exponent (everything the .osg writer produces) are
+//   converted with one multiply or divide by an exact power of ten;
+//   anything else goes through strtod().
+static bool
+parseFloat( const char*& p, const char* end, float& value )
+{
+    const char* start = p;
+    bool negative( false );
+    if ((p < end) && ((*p == '-') || (*p == '+')))
+        negative = (*p++ == '-');
+
+    unsigned long long mantissa( 0 );
+    int digits( 0 ), exponent( 0 );
+    bool any( false );
+    while ((p < end) && (*p >= '0') && (*p <= '9'))
+    {
+        if (digits < 19)
+        {
+            mantissa = mantissa * 10 + (*p - '0');
+            if (mantissa != 0)
+                digits++;
+        }
+        else
+            exponent++;
+        p++; any = true;
+    }
+    if ((p < end) && (*p == '.'))
+    {
+        p++;
+        while ((p < end) && (*p >= '0') && (*p <= '9'))
+        {
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                if (mantissa != 0)
+                    digits++;
+                exponent--;
+            }
+            p++; any = true;
+        }
+    }
+    if (!any)
+    {
+        p = start;
+        return( false );
+    }
+    if ((p < end) && ((*p == 'e') || (*p == 'E')))
+    {
+        const char* e = p++;
+        bool expNegative( false );
+        if ((p < end) && ((*p == '-') || (*p == '+')))
+            expNegative = (*p++ == '-');
+        int exp( 0 );
+        bool expAny( false );
+        while ((p < end) && (*p >= '0') && (*p <= '9'))
+        {
+            if (exp < 10000)
+                exp = exp * 10 + (*p - '0');
+            p++; expAny = true;
+        }
+        if (!expAny)
+            // Not an exponent after all.
+            p = e;
+        else
+            exponent += expNegative ? -exp : exp;
+    }
+    if ((p < end) && !isSpace( *p ))
+    {
+        p = start;
+        return( false );
+    }
+
+    double d;
+    if ((digits <= 15) && (exponent >= -22) && (exponent <= 22))
+    {
+        d = (double)( mantissa );
+        if (exponent < 0)
+            d /= Pow10[ -exponent ];
+        else
+            d *= Pow10[ exponent ];
+        if (negative)
+            d = -d;
+    }
+    else
+    {
+        char buf[ 64 ];
+        size_t len = p - start;
+        if (len >= sizeof( buf ))
+            return( false );
+        memcpy( buf, start, len );
+        buf[ len ] = 0;
+        d = strtod( buf, NULL );
+    }
+    value = (float)( d );
+    return( true );
+}
+
+static bool
+parseUnsigned( const char*& p, const char* end, unsigned int& value )
+{
+    const char* start = p;
+    unsigned int v( 0 );
+    while ((p < end) && (*p >= '0') && (*p <= '9'))
+        v = v * 10 + (*p++ - '0');
+    if ((p == start) || ((p < end) && !isSpace( *p )))
+        return( false );
+    value = v;
+    return( true );
+}
+
+
+// Single pass over the file text. Records the numeric bodies, splits
+//   them into chunks, and builds a skeleton copy of the file with
+//   those bodies removed and their header counts set to zero.
+class OsgScanner
+{
+public:
+    OsgScanner( const std::string& text )
+      : _text( text ), _numGeometries( 0 ) {}
+
+    void scan()
+    {
+        const char* p = _text.data();
+        const char* end = p + _text.size();
+        const char* copied = p;
+        unsigned int primitive( 0 );
+        std::vector< std::string > tokens;
+
+        while (p < end)
+        {
+            const char* lineEnd = findLineEnd( p, end );
+            const char* next = (lineEnd < end) ? lineEnd+1 : end;
+
+            // Get the first token of the line.
+            const char* t = p;
+            while ((t < lineEnd) && isSpace( *t ))
+                t++;
+            const char* tEnd = t;
+            while ((tEnd < lineEnd) && !isSpace( *tEnd ))
+                tEnd++;
+            const std::string first( t, tEnd );
+
+            NumericBody body;
+            std::string header;
+            bool candidate( false );
+
+            if (first == "Geometry")
+            {
+                if (std::find( t, lineEnd, '{' ) != lineEnd)
+                {
+                    _numGeometries++;
+                    primitive = 0;
+                }
+            }
+            else if (_numGeometries == 0)
+            {
+                // Nothing to strip outside of Geometry blocks.
+            }
+            else if (first == "DrawArrays")
+                primitive++;
+            else if ((first == "DrawArrayLengths") || (first == "DrawElementsUByte") ||
+                (first == "DrawElementsUShort") || (first == "DrawElementsUInt"))
+            {
+                primitive++;
+                splitTokens( t, lineEnd, tokens );
+                candidate = primitiveHeader( tokens, primitive-1, body, header );
+            }
+            else if ((first == "VertexArray") || (first == "NormalArray") ||
+                (first == "ColorArray") || (first == "SecondaryColorArray") ||
+                (first == "FogCoordArray") || (first == "TexCoordArray"))
+            {
+                splitTokens( t, lineEnd, tokens );
+                candidate = arrayHeader( tokens, body, header );
+            }
+
+            if (!candidate)
+            {
+                p = next;
+                continue;
+            }
+
+            // The header must be followed by a line holding just "{",
+            //   and the body ends at the line holding the next "}".
+            const char* braceEnd = findLineEnd( next, end );
+            splitTokens( next, braceEnd, tokens );
+            if ((tokens.size() != 1) || (tokens[ 0 ] != "{") || (braceEnd >= end))
+            {
+                p = next;
+                continue;
+            }
+            const char* bodyBegin = braceEnd + 1;
+            const char* close = (const char*)( memchr( bodyBegin, '}', end - bodyBegin ) );
+            if (close == NULL)
+            {
+                p = next;
+                continue;
+            }
+            const char* bodyEnd = close;
+            while ((bodyEnd > bodyBegin) && (bodyEnd[ -1 ] != '\n'))
+                bodyEnd--;
+
+            // Copy everything up to this header into the skeleton,
+            //   then the rewritten header and the open brace. The
+            //   close brace is copied with the text that follows.
+            _skeleton.append( copied, t );
+            _skeleton.append( header );
+            _skeleton.append( lineEnd, bodyBegin );
+            copied = bodyEnd;
+
+            body._geometry = _numGeometries - 1;
+            body._firstChunk = (unsigned int)( _chunks.size() );
+            addChunks( bodyBegin, bodyEnd, body._kind == NumericBody::PRIMITIVES );
+            body._numChunks = (unsigned int)( _chunks.size() ) - body._firstChunk;
+            _bodies.push_back( body );
+
+            p = findLineEnd( close, end );
+        }
+        _skeleton.append( copied, end );
+    }
+
+    const std::string& getSkeleton() const { return( _skeleton ); }
+    const std::vector< NumericBody >& getBodies() const { return( _bodies ); }
+    std::vector< Chunk >& getChunks() { return( _chunks ); }
+    unsigned int getNumGeometries() const { return( _numGeometries ); }
+
+protected:
+    static const char* findLineEnd( const char* p, const char* end )
+    {
+        const char* nl = (const char*)( memchr( p, '\n', end - p ) );
+        return( (nl != NULL) ? nl : end );
+    }
+
+    // DrawArrayLengths <mode> <first> <count>
+    // DrawElementsUShort <mode> <count>
+    bool primitiveHeader( const std::vector< std::string >& tokens,
+        unsigned int index, NumericBody& body, std::string& header )
+    {
+        const bool lengths( tokens[ 0 ] == "DrawArrayLengths" );
+        if (tokens.size() != (lengths ? 4u : 3u))
+            return( false );
+        if (!isUnsigned( tokens.back(), body._count ))
+            return( false );
+        body._kind = NumericBody::PRIMITIVES;
+        body._slot = index;
+        body._type = tokens[ 0 ];
+        body._components = 1;
+
+        header = tokens[ 0 ] + " " + tokens[ 1 ];
+        if (lengths)
+            header += " " + tokens[ 2 ];
+        header += " 0";
+        return( true );
+    }
+
+    // VertexArray [<type>] <count>
+    // TexCoordArray <unit> <type> <count>
+    // Shared arrays (UniqueID, Use) are left to the stock reader.
+    bool arrayHeader( const std::vector< std::string >& tokens,
+        NumericBody& body, std::string& header )
+    {
+        unsigned int idx( 1 );
+        body._slot = 0;
+        if (tokens[ 0 ] == "TexCoordArray")
+        {
+            if ((tokens.size() < 2) || !isUnsigned( tokens[ 1 ], body._slot ))
+                return( false );
+            idx++;
+        }
+        if (tokens.size() == idx+2)
+            body._type = tokens[ idx ];
+        else if ((tokens.size() == idx+1) &&
+                ((tokens[ 0 ] == "VertexArray") || (tokens[ 0 ] == "NormalArray")))
+            body._type = "Vec3Array";
+        else
+            return( false );
+        body._components = getArrayComponents( body._type );
+        if ((body._components == 0) || !isUnsigned( tokens.back(), body._count ))
+            return( false );
+
+        if (tokens[ 0 ] == "VertexArray")
+            body._kind = NumericBody::VERTICES;
+        else if (tokens[ 0 ] == "NormalArray")
+            body._kind = NumericBody::NORMALS;
+        else if (tokens[ 0 ] == "ColorArray")
+            body._kind = NumericBody::COLORS;
+        else if (tokens[ 0 ] == "SecondaryColorArray")
+            body._kind = NumericBody::SECONDARY_COLORS;
+        else if (tokens[ 0 ] == "FogCoordArray")
+            body._kind = NumericBody::FOG_COORDS;
+        else
+            body._kind = NumericBody::TEX_COORDS;
+
+        header.clear();
+        unsigned int t;
+        for (t=0; t<tokens.size()-1; t++)
+            header += tokens[ t ] + " ";
+        header += "0";
+        return( true );
+    }
+
+    void addChunks( const char* begin, const char* end, bool integers )
+    {
+        do
+        {
+            const char* split = end;
+            if ((size_t)( end - begin ) > ChunkBytes)
+            {
+                split = findLineEnd( begin + ChunkBytes, end );
+                if (split < end)
+                    split++;
+            }
+            Chunk c;
+            c._begin = begin;
+            c._end = split;
+            c._integers = integers;
+            c._ok = false;
+            _chunks.push_back( c );
+            begin = split;
+        } while (begin < end);
+    }
+
+    const std::string& _text;
+    std::string _skeleton;
+    std::vector< NumericBody > _bodies;
+    std::vector< Chunk > _chunks;
+    unsigned int _numGeometries;
+};
+
+
+// Work item 0 reads the skeleton with the stock .osg plugin; the
+//   remaining items parse one chunk each. runParallel() hands items
+//   out in order, so the skeleton read overlaps the chunk parsing.
+class ParseTask : public ParallelTask
+{
+public:
+    ParseTask( const OsgScanner& scanner, std::vector< Chunk >& chunks,
+            const std::string& fullName )
+      : _scanner( scanner ), _chunks( chunks ), _fullName( fullName ) {}
+
+    virtual void operator()( unsigned int index )
+    {
+        if (index == 0)
+            readSkeleton();
+        else
+            parseChunk( _chunks[ index-1 ] );
+    }
+
+    osg::Node* getNode() { return( _node.get() ); }
+
+protected:
+    void readSkeleton()
+    {
+        osgDB::ReaderWriter* rw =
+                osgDB::Registry::instance()->getReaderWriterForExtension( "osg" );
+        if (rw == NULL)
+            return;
+
+        // Relative file names in the skeleton (textures, for
+        //   example) resolve against the original file's directory.
+        osg::ref_ptr<osgDB::ReaderWriter::Options> options =
+                new osgDB::ReaderWriter::Options;
+        options->setDatabasePath( osgDB::getFilePath( _fullName ) );
+
+        std::istringstream in( _scanner.getSkeleton() );
+        osgDB::ReaderWriter::ReadResult rr = rw->readNode( in, options.get() );
+        _node = rr.getNode();
+    }
+
+    static void parseChunk( Chunk& c )
+    {
+        const char* p = c._begin;
+        // Each line holds at least one value of a few bytes.
+        if (c._integers)
+            c._ints.reserve( (c._end - c._begin) / 4 );
+        else
+            c._floats.reserve( (c._end - c._begin) / 8 );
+
+        while (true)
+        {
+            while ((p < c._end) && isSpace( *p ))
+                p++;
+            if (p == c._end)
+                break;
+            if (c._integers)
+            {
+                unsigned int v;
+                if (!parseUnsigned( p, c._end, v ))
+                    return;
+                c._ints.push_back( v );
+            }
+            else
+            {
+                float v;
+                if (!parseFloat( p, c._end, v ))
+                    return;
+                c._floats.push_back( v );
+            }
+        }
+        c._ok = true;
+    }
+
+    const OsgScanner& _scanner;
+    std::vector< Chunk >& _chunks;
+    const std::string _fullName;
+    osg::ref_ptr<osg::Node> _node;
+};
+
+
+// Collect the unique Geometry objects in traversal order, which is
+//   the order the .osg plugin created them from the file.
+class CollectGeometries : public osg::NodeVisitor
+{
+public:
+    CollectGeometries()
+      : osg::NodeVisitor( osg::NodeVisitor::TRAVERSE_ALL_CHILDREN ) {}
+
+    virtual void apply( osg::Geode& geode )
+    {
+        unsigned int idx;
+        for (idx=0; idx<geode.getNumDrawables(); idx++)
+        {
+            osg::Geometry* geom = geode.getDrawable( idx )->asGeometry();
+            if ((geom != NULL) && _seen.insert( geom ).second)
+                _geometries.push_back( geom );
+        }
+        traverse( geode );
+    }
+
+    std::vector< osg::Geometry* > _geometries;
+
+protected:
+    std::set< osg::Geometry* > _seen;
+};
+
+
+template< class ArrayT >
+static osg::Array*
+makeArray( const NumericBody& body, const std::vector< Chunk >& chunks )
+{
+    osg::ref_ptr<ArrayT> a = new ArrayT( body._count );
+    if (body._count == 0)
+        return( a.release() );
+
+    float* dst = (float*)( &( (*a)[ 0 ] ) );
+    unsigned int idx;
+    for (idx=body._firstChunk; idx<body._firstChunk+body._numChunks; idx++)
+    {
+        const std::vector< float >& src = chunks[ idx ]._floats;
+        if (!src.empty())
+            memcpy( dst, &src[ 0 ], src.size() * sizeof( float ) );
+        dst += src.size();
+    }
+    return( a.release() );
+}
+
+template< class VectorT >
+static void
+fillIndices( VectorT& v, const NumericBody& body, const std::vector< Chunk >& chunks )
+{
+    v.resize( body._count );
+    unsigned int dst( 0 ), idx, jdx;
+    for (idx=body._firstChunk; idx<body._firstChunk+body._numChunks; idx++)
+    {
+        const std::vector< unsigned int >& src = chunks[ idx ]._ints;
+        for (jdx=0; jdx<src.size(); jdx++)
+            v[ dst++ ] = (typename VectorT::value_type)( src[ jdx ] );
+    }
+}
+
+static bool
+attachBody( osg::Geometry* geom, const NumericBody& body,
+    const std::vector< Chunk >& chunks )
+{
+    if (body._kind == NumericBody::PRIMITIVES)
+    {
+        if (body._slot >= geom->getNumPrimitiveSets())
+            return( false );
+        osg::PrimitiveSet* ps = geom->getPrimitiveSet( body._slot );
+        if (body._type == "DrawArrayLengths")
+        {
+            osg::DrawArrayLengths* dal = dynamic_cast< osg::DrawArrayLengths* >( ps );
+            if (dal == NULL)
+                return( false );
+            fillIndices( *dal, body, chunks );
+        }
+        else if (body._type == "DrawElementsUByte")
+        {
+            osg::DrawElementsUByte* de = dynamic_cast< osg::DrawElementsUByte* >( ps );
+            if (de == NULL)
+                return( false );
+            fillIndices( *de, body, chunks );
+        }
+        else if (body._type == "DrawElementsUShort")
+        {
+            osg::DrawElementsUShort* de = dynamic_cast< osg::DrawElementsUShort* >( ps );
+            if (de == NULL)
+                return( false );
+            fillIndices( *de, body, chunks );
+        }
+        else
+        {
+            osg::DrawElementsUInt* de = dynamic_cast< osg::DrawElementsUInt* >( ps );
+            if (de == NULL)
+                return( false );
+            fillIndices( *de, body, chunks );
+        }
+        ps->dirty();
+        return( true );
+    }
+
+    osg::Array* a;
+    switch (body._components)
+    {
+    case 1: a = makeArray< osg::FloatArray >( body, chunks ); break;
+    case 2: a = makeArray< osg::Vec2Array >( body, chunks ); break;
+    case 3: a = makeArray< osg::Vec3Array >( body, chunks ); break;
+    default: a = makeArray< osg::Vec4Array >( body, chunks ); break;
+    }
+
+    switch (body._kind)
+    {
+    case NumericBody::VERTICES: geom->setVertexArray( a ); break;
+    case NumericBody::NORMALS: geom->setNormalArray( a ); break;
+    case NumericBody::COLORS: geom->setColorArray( a ); break;
+    case NumericBody::SECONDARY_COLORS: geom->setSecondaryColorArray( a ); break;
+    case NumericBody::FOG_COORDS: geom->setFogCoordArray( a ); break;
+    default: geom->setTexCoordArray( body._slot, a ); break;
+    }
+    return( true );
+}
+
+
+osg::Node*
+readChunkedNodeFile( const std::string& fileName, unsigned int numThreads )
+{
+    const std::string fullName = osgDB::findDataFile( fileName );
+    if (fullName.empty() || (osgDB::getLowerCaseFileExtension( fullName ) != "osg"))
+        return( osgDB::readNodeFile( fileName ) );
+
+    std::string text;
+    {
+        std::ifstream in( fullName.c_str(), std::ios::in | std::ios::binary );
+        std::ostringstream ss;
+        ss << in.rdbuf();
+        text = ss.str();
+    }
+
+    OsgScanner scanner( text );
+    scanner.scan();
+    std::vector< Chunk >& chunks = scanner.getChunks();
+
+    ParseTask task( scanner, chunks, fullName );
+    runParallel( task, (unsigned int)( chunks.size() ) + 1, numThreads );
+
+    osg::ref_ptr<osg::Node> node = task.getNode();
+    CollectGeometries cg;
+    if (node.valid())
+        node->accept( cg );
+    if (!node.valid() || (cg._geometries.size() != scanner.getNumGeometries()))
+    {
+        osg::notify( osg::INFO ) << "readChunkedNodeFile: Can't read \"" << fullName <<
+            "\" in chunks, using osgDB::readNodeFile()." << std::endl;
+        return( osgDB::readNodeFile( fullName ) );
+    }
+
+    const std::vector< NumericBody >& bodies = scanner.getBodies();
+    unsigned int idx;
+    for (idx=0; idx<bodies.size(); idx++)
+    {
+        const NumericBody& body = bodies[ idx ];
+        size_t scalars( 0 );
+        bool ok( true );
+        unsigned int cdx;
+        for (cdx=body._firstChunk; cdx<body._firstChunk+body._numChunks; cdx++)
+        {
+            ok = ok && chunks[ cdx ]._ok;
+            scalars += chunks[ cdx ]._integers ?
+                chunks[ cdx ]._ints.size() : chunks[ cdx ]._floats.size();
+        }
+        if (!ok || (scalars != (size_t)( body._count ) * body._components) ||
+            !attachBody( cg._geometries[ body._geometry ], body, chunks ))
+        {
+            osg::notify( osg::INFO ) << "readChunkedNodeFile: Bad array data in \"" <<
+                fullName << "\", using osgDB::readNodeFile()." << std::endl;
+            return( osgDB::readNodeFile( fullName ) );
+        }
+    }
+
+    // Bounds were computed, if at all, from the empty arrays.
+    for (idx=0; idx<cg._geometries.size(); idx++)
+        cg._geometries[ idx ]->dirtyBound();
+
+    return( node.release() );
+}
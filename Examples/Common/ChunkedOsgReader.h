@@ -0,0 +1,29 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// Parallel reader for large ASCII .osg files
+
+#ifndef __CHUNKED_OSG_READER_H__
+#define __CHUNKED_OSG_READER_H__
+
+#include <osg/Node>
+#include <string>
+
+// Read an ASCII .osg file and return the same scene graph as
+//   osgDB::readNodeFile(). The file is scanned once for the bodies
+//   of Geometry vertex attribute arrays and primitive sets. Those
+//   numeric bodies are split into chunks and parsed on numThreads
+//   threads (0 means one per processor), while the rest of the file,
+//   with the bodies removed, goes through the stock .osg plugin.
+//   The parsed arrays are then attached to the Geometry objects the
+//   plugin created.
+//
+// Falls back to osgDB::readNodeFile() for files that aren't .osg, or
+//   that contain something the scanner doesn't understand.
+osg::Node* readChunkedNodeFile( const std::string& fileName,
+    unsigned int numThreads=0 );
+
+#endif
@@ -0,0 +1,234 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// Input event recording and headless replay
+
+#include "EventRecorder.h"
+#include "HeadlessTraversals.h"
+#include <osgViewer/Viewer>
+#include <osg/Timer>
+#include <osg/Notify>
+#include <fstream>
+#include <iomanip>
+#include <map>
+
+
+static const char* s_header( "QSGEVENTS" );
+static const int s_version( 1 );
+
+
+RecordedEvent::RecordedEvent()
+  : _frame( 0 ),
+    _time( 0. ),
+    _type( osgGA::GUIEventAdapter::NONE ),
+    _x( 0.f ), _y( 0.f ),
+    _xMin( -1.f ), _yMin( -1.f ), _xMax( 1.f ), _yMax( 1.f ),
+    _mouseYOrientation( osgGA::GUIEventAdapter::Y_INCREASING_UPWARDS ),
+    _button( 0 ), _buttonMask( 0 ),
+    _key( 0 ), _modKeyMask( 0 ),
+    _scrollingMotion( osgGA::GUIEventAdapter::SCROLL_NONE )
+{
+}
+
+static void
+writeMatrix( std::ostream& out, const osg::Matrixd& m )
+{
+    unsigned int r, c;
+    for (r=0; r<4; r++)
+        for (c=0; c<4; c++)
+            out << " " << m( r, c );
+}
+
+static void
+readMatrix( std::istream& in, osg::Matrixd& m )
+{
+    unsigned int r, c;
+    for (r=0; r<4; r++)
+        for (c=0; c<4; c++)
+            in >> m( r, c );
+}
+
+bool
+writeEventRecording( const EventRecording& events, const std::string& fileName )
+{
+    std::ofstream out( fileName.c_str() );
+    if (!out)
+    {
+        osg::notify( osg::WARN ) << "Can't write \"" << fileName << "\"." << std::endl;
+        return( false );
+    }
+
+    out << s_header << " " << s_version << " " << events.size() << "\n";
+    out << std::setprecision( 17 );
+    unsigned int idx;
+    for (idx=0; idx<events.size(); idx++)
+    {
+        const RecordedEvent& e = events[ idx ];
+        out << e._frame << " " << e._time << " " << e._type << " " <<
+            e._x << " " << e._y << " " << e._xMin << " " << e._yMin << " " <<
+            e._xMax << " " << e._yMax << " " << e._mouseYOrientation << " " <<
+            e._button << " " << e._buttonMask << " " << e._key << " " <<
+            e._modKeyMask << " " << e._scrollingMotion;
+        writeMatrix( out, e._view );
+        writeMatrix( out, e._projection );
+        out << "\n";
+    }
+    return( out.good() );
+}
+
+bool
+readEventRecording( const std::string& fileName, EventRecording& events )
+{
+    std::ifstream in( fileName.c_str() );
+    std::string header;
+    int version( 0 );
+    unsigned int count( 0 );
+    in >> header >> version >> count;
+    if (!in || (header != s_header) || (version != s_version))
+    {
+        osg::notify( osg::WARN ) << "\"" << fileName << "\" isn't an event recording." << std::endl;
+        return( false );
+    }
+
+    // The count is only trusted as far as the events are there, so a
+    //   damaged header can't allocate more than the file holds.
+    events.clear();
+    while (events.size() < count)
+    {
+        RecordedEvent e;
+        in >> e._frame >> e._time >> e._type >> e._x >> e._y >>
+            e._xMin >> e._yMin >> e._xMax >> e._yMax >> e._mouseYOrientation >>
+            e._button >> e._buttonMask >> e._key >> e._modKeyMask >> e._scrollingMotion;
+        readMatrix( in, e._view );
+        readMatrix( in, e._projection );
+        if (!in)
+            break;
+        events.push_back( e );
+    }
+    if (events.size() < count)
+    {
+        osg::notify( osg::WARN ) << "\"" << fileName << "\" ends after " <<
+            events.size() << " of " << count << " events." << std::endl;
+        return( false );
+    }
+    return( true );
+}
+
+
+bool
+EventRecordHandler::handle( const osgGA::GUIEventAdapter& ea,
+    osgGA::GUIActionAdapter& aa )
+{
+    osgViewer::Viewer* viewer = dynamic_cast< osgViewer::Viewer* >( &aa );
+    if (viewer == NULL)
+        return( false );
+
+    RecordedEvent e;
+    e._frame = viewer->getFrameStamp()->getFrameNumber();
+    e._time = ea.getTime();
+    e._type = ea.getEventType();
+    e._x = ea.getX();
+    e._y = ea.getY();
+    e._xMin = ea.getXmin();
+    e._yMin = ea.getYmin();
+    e._xMax = ea.getXmax();
+    e._yMax = ea.getYmax();
+    e._mouseYOrientation = ea.getMouseYOrientation();
+    e._button = ea.getButton();
+    e._buttonMask = ea.getButtonMask();
+    e._key = ea.getKey();
+    e._modKeyMask = ea.getModKeyMask();
+    e._scrollingMotion = ea.getScrollingMotion();
+    e._view = viewer->getCamera()->getViewMatrix();
+    e._projection = viewer->getCamera()->getProjectionMatrix();
+    _recording.push_back( e );
+
+    // Let the other handlers see the event.
+    return( false );
+}
+
+
+static const char*
+getEventName( int type )
+{
+    switch( type )
+    {
+        case osgGA::GUIEventAdapter::PUSH: return( "push" );
+        case osgGA::GUIEventAdapter::RELEASE: return( "release" );
+        case osgGA::GUIEventAdapter::DOUBLECLICK: return( "doubleclick" );
+        case osgGA::GUIEventAdapter::DRAG: return( "drag" );
+        case osgGA::GUIEventAdapter::MOVE: return( "move" );
+        case osgGA::GUIEventAdapter::KEYDOWN: return( "keydown" );
+        case osgGA::GUIEventAdapter::KEYUP: return( "keyup" );
+        case osgGA::GUIEventAdapter::FRAME: return( "frame" );
+        case osgGA::GUIEventAdapter::RESIZE: return( "resize" );
+        case osgGA::GUIEventAdapter::SCROLL: return( "scroll" );
+        default: return( "other" );
+    }
+}
+
+unsigned int
+replayEvents( const EventRecording& events, osgViewer::Viewer& viewer,
+    TimingReport& report )
+{
+    if (events.empty() || (viewer.getSceneData() == NULL))
+        return( 0 );
+
+    // The window size at the first event sets the viewport.
+    const unsigned int width = (unsigned int)( events[ 0 ]._xMax - events[ 0 ]._xMin );
+    const unsigned int height = (unsigned int)( events[ 0 ]._yMax - events[ 0 ]._yMin );
+    HeadlessTraversals frame( viewer.getSceneData(),
+        (width > 0) ? width : 1024, (height > 0) ? height : 768 );
+
+    osg::Timer* timer = osg::Timer::instance();
+    std::map< std::string, std::vector< double > > samples;
+    osgViewer::View::EventHandlers& handlers = viewer.getEventHandlers();
+    unsigned int idx;
+    for (idx=0; idx<events.size(); idx++)
+    {
+        const RecordedEvent& e = events[ idx ];
+        viewer.getCamera()->setViewMatrix( e._view );
+        viewer.getCamera()->setProjectionMatrix( e._projection );
+        frame.getCamera()->setViewMatrix( e._view );
+        frame.getCamera()->setProjectionMatrix( e._projection );
+
+        osg::ref_ptr<osgGA::GUIEventAdapter> ea = new osgGA::GUIEventAdapter;
+        ea->setEventType( (osgGA::GUIEventAdapter::EventType)e._type );
+        ea->setTime( e._time );
+        ea->setInputRange( e._xMin, e._yMin, e._xMax, e._yMax );
+        ea->setMouseYOrientation( (osgGA::GUIEventAdapter::MouseYOrientation)e._mouseYOrientation );
+        ea->setX( e._x );
+        ea->setY( e._y );
+        ea->setButton( e._button );
+        ea->setButtonMask( e._buttonMask );
+        ea->setKey( e._key );
+        ea->setModKeyMask( e._modKeyMask );
+        ea->setScrollingMotion( (osgGA::GUIEventAdapter::ScrollingMotion)e._scrollingMotion );
+
+        osg::Timer_t start = timer->tick();
+        osgViewer::View::EventHandlers::iterator it;
+        for (it=handlers.begin(); it!=handlers.end(); it++)
+            (*it)->handle( *ea, viewer );
+        samples[ getEventName( e._type ) ].push_back(
+            timer->delta_m( start, timer->tick() ) );
+
+        if (e._type == osgGA::GUIEventAdapter::FRAME)
+        {
+            start = timer->tick();
+            frame.update();
+            osg::Timer_t mid = timer->tick();
+            frame.cull();
+            samples[ "update" ].push_back( timer->delta_m( start, mid ) );
+            samples[ "cull" ].push_back( timer->delta_m( mid, timer->tick() ) );
+        }
+    }
+
+    std::map< std::string, std::vector< double > >::const_iterator sit;
+    for (sit=samples.begin(); sit!=samples.end(); sit++)
+        report.addRow( std::vector< std::string >( 1, sit->first ),
+            summarizeTimings( sit->second ) );
+    return( events.size() );
+}
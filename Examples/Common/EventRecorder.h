@@ -0,0 +1,86 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// Input event recording and headless replay
+
+#ifndef __EVENT_RECORDER_H__
+#define __EVENT_RECORDER_H__
+
+#include "TimingStats.h"
+#include <osgGA/GUIEventHandler>
+#include <osg/Matrix>
+#include <string>
+#include <vector>
+
+namespace osgViewer {
+    class Viewer;
+}
+
+// One event from a viewer's event traversal, with the camera
+//   matrices in effect when the handlers saw it.
+struct RecordedEvent
+{
+    RecordedEvent();
+
+    // The viewer's frame number, and the event's time stamp.
+    unsigned int _frame;
+    double _time;
+
+    // GUIEventAdapter fields.
+    int _type;
+    float _x, _y;
+    float _xMin, _yMin, _xMax, _yMax;
+    int _mouseYOrientation;
+    int _button, _buttonMask;
+    int _key, _modKeyMask;
+    int _scrollingMotion;
+
+    osg::Matrixd _view, _projection;
+};
+
+typedef std::vector< RecordedEvent > EventRecording;
+
+// Write events as text, one per line, or read them back. Values are
+//   written with enough digits to read back exactly.
+bool writeEventRecording( const EventRecording& events, const std::string& fileName );
+bool readEventRecording( const std::string& fileName, EventRecording& events );
+
+// Records every event the viewer's event traversal delivers,
+//   including FRAME events, with the viewer camera's matrices. Add
+//   it to the viewer before the handlers whose work is to be
+//   replayed, so each event is recorded before they act on it.
+class EventRecordHandler : public osgGA::GUIEventHandler
+{
+public:
+    EventRecordHandler() {}
+
+    virtual bool handle( const osgGA::GUIEventAdapter& ea,
+        osgGA::GUIActionAdapter& aa );
+
+    const EventRecording& getRecording() const { return( _recording ); }
+
+protected:
+    virtual ~EventRecordHandler() {}
+
+    EventRecording _recording;
+};
+
+// Feed recorded events to the viewer's event handlers, in order,
+//   without a window or graphics context. Before each event, the
+//   viewer's camera is given the recorded matrices, so handlers that
+//   pick see what the user saw. After the handlers see a FRAME
+//   event, the viewer's scene gets an update and a cull traversal,
+//   through HeadlessTraversals, with the same camera.
+//
+// Adds a row to report, keyed by event name, for the handlers' time
+//   per event of each type, and for the update and cull times per
+//   frame. The viewer must not be realized or have a camera
+//   manipulator; replay replaces both. Returns the number of events
+//   replayed.
+unsigned int replayEvents( const EventRecording& events,
+    osgViewer::Viewer& viewer, TimingReport& report );
+
+#endif
@@ -0,0 +1,488 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// SIMD bounding volumes and coalesced bound updates
+
+#include "FastBounds.h"
+#include "ParallelLoop.h"
+#include <osg/Geode>
+#include <osg/Geometry>
+#include <osg/NodeVisitor>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <map>
+#include <set>
+#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && ( _M_IX86_FP >= 2 ) )
+#  define BOUNDS_USE_SSE2
+#  include <emmintrin.h>
+#endif
+
+
+// Points per work item when an array is split across threads. Below
+//   two of these, threads cost more than they save.
+static const unsigned int PointBlockSize( 65536 );
+// Nodes per work item when a level is split across threads, and
+//   the smallest level that's split.
+static const unsigned int NodeBlockSize( 1024 );
+static const unsigned int NodeParallelThreshold( 4096 );
+
+
+// Extend min and max to points [first,last).
+static void
+boxRange( const osg::Vec3* points, unsigned int first, unsigned int last,
+    osg::Vec3& bbMin, osg::Vec3& bbMax )
+{
+    unsigned int idx( first );
+    float x0 = bbMin.x(), y0 = bbMin.y(), z0 = bbMin.z();
+    float x1 = bbMax.x(), y1 = bbMax.y(), z1 = bbMax.z();
+
+#ifdef BOUNDS_USE_SSE2
+    if (last - first >= 4)
+    {
+        // Four points are three loads, x0 y0 z0 x1 | y1 z1 x2 y2 |
+        //   z2 x3 y3 z3, regrouped by shuffles into x, y and z.
+        __m128 minX = _mm_set1_ps( x0 ), minY = _mm_set1_ps( y0 ), minZ = _mm_set1_ps( z0 );
+        __m128 maxX = _mm_set1_ps( x1 ), maxY = _mm_set1_ps( y1 ), maxZ = _mm_set1_ps( z1 );
+        for (; idx+4<=last; idx+=4)
+        {
+            const float* f = points[ idx ].ptr();
+            const __m128 r0 = _mm_loadu_ps( f );
+            const __m128 r1 = _mm_loadu_ps( f + 4 );
+            const __m128 r2 = _mm_loadu_ps( f + 8 );
+            const __m128 xy = _mm_shuffle_ps( r1, r2, _MM_SHUFFLE( 2, 1, 3, 2 ) );
+            const __m128 yz = _mm_shuffle_ps( r0, r1, _MM_SHUFFLE( 1, 0, 2, 1 ) );
+            const __m128 x = _mm_shuffle_ps( r0, xy, _MM_SHUFFLE( 2, 0, 3, 0 ) );
+            const __m128 y = _mm_shuffle_ps( yz, xy, _MM_SHUFFLE( 3, 1, 2, 0 ) );
+            const __m128 z = _mm_shuffle_ps( yz, r2, _MM_SHUFFLE( 3, 0, 3, 1 ) );
+            minX = _mm_min_ps( minX, x ); maxX = _mm_max_ps( maxX, x );
+            minY = _mm_min_ps( minY, y ); maxY = _mm_max_ps( maxY, y );
+            minZ = _mm_min_ps( minZ, z ); maxZ = _mm_max_ps( maxZ, z );
+        }
+
+        float lanes[ 6 ][ 4 ];
+        _mm_storeu_ps( lanes[ 0 ], minX ); _mm_storeu_ps( lanes[ 1 ], minY );
+        _mm_storeu_ps( lanes[ 2 ], minZ ); _mm_storeu_ps( lanes[ 3 ], maxX );
+        _mm_storeu_ps( lanes[ 4 ], maxY ); _mm_storeu_ps( lanes[ 5 ], maxZ );
+        unsigned int lane;
+        for (lane=0; lane<4; lane++)
+        {
+            x0 = std::min( x0, lanes[ 0 ][ lane ] );
+            y0 = std::min( y0, lanes[ 1 ][ lane ] );
+            z0 = std::min( z0, lanes[ 2 ][ lane ] );
+            x1 = std::max( x1, lanes[ 3 ][ lane ] );
+            y1 = std::max( y1, lanes[ 4 ][ lane ] );
+            z1 = std::max( z1, lanes[ 5 ][ lane ] );
+        }
+    }
+#endif
+
+    // No branches, so the compiler can vectorize.
+    for (; idx<last; idx++)
+    {
+        const osg::Vec3& p = points[ idx ];
+        x0 = (p.x() < x0) ? p.x() : x0;
+        y0 = (p.y() < y0) ? p.y() : y0;
+        z0 = (p.z() < z0) ? p.z() : z0;
+        x1 = (p.x() > x1) ? p.x() : x1;
+        y1 = (p.y() > y1) ? p.y() : y1;
+        z1 = (p.z() > z1) ? p.z() : z1;
+    }
+
+    bbMin.set( x0, y0, z0 );
+    bbMax.set( x1, y1, z1 );
+}
+
+// The greatest squared distance from center to points [first,last).
+static float
+radius2Range( const osg::Vec3* points, unsigned int first, unsigned int last,
+    const osg::Vec3& center )
+{
+    unsigned int idx( first );
+    const float cx = center.x(), cy = center.y(), cz = center.z();
+    float r2( 0.f );
+
+#ifdef BOUNDS_USE_SSE2
+    if (last - first >= 4)
+    {
+        const __m128 ccx = _mm_set1_ps( cx ), ccy = _mm_set1_ps( cy ), ccz = _mm_set1_ps( cz );
+        __m128 maxR2 = _mm_setzero_ps();
+        for (; idx+4<=last; idx+=4)
+        {
+            const float* f = points[ idx ].ptr();
+            const __m128 r0 = _mm_loadu_ps( f );
+            const __m128 r1 = _mm_loadu_ps( f + 4 );
+            const __m128 r2v = _mm_loadu_ps( f + 8 );
+            const __m128 xy = _mm_shuffle_ps( r1, r2v, _MM_SHUFFLE( 2, 1, 3, 2 ) );
+            const __m128 yz = _mm_shuffle_ps( r0, r1, _MM_SHUFFLE( 1, 0, 2, 1 ) );
+            const __m128 dx = _mm_sub_ps( _mm_shuffle_ps( r0, xy, _MM_SHUFFLE( 2, 0, 3, 0 ) ), ccx );
+            const __m128 dy = _mm_sub_ps( _mm_shuffle_ps( yz, xy, _MM_SHUFFLE( 3, 1, 2, 0 ) ), ccy );
+            const __m128 dz = _mm_sub_ps( _mm_shuffle_ps( yz, r2v, _MM_SHUFFLE( 3, 0, 3, 1 ) ), ccz );
+            const __m128 d2 = _mm_add_ps( _mm_add_ps( _mm_mul_ps( dx, dx ),
+                _mm_mul_ps( dy, dy ) ), _mm_mul_ps( dz, dz ) );
+            maxR2 = _mm_max_ps( maxR2, d2 );
+        }
+
+        float lanes[ 4 ];
+        _mm_storeu_ps( lanes, maxR2 );
+        r2 = std::max( std::max( lanes[ 0 ], lanes[ 1 ] ),
+            std::max( lanes[ 2 ], lanes[ 3 ] ) );
+    }
+#endif
+
+    for (; idx<last; idx++)
+    {
+        const osg::Vec3& p = points[ idx ];
+        const float dx = p.x() - cx, dy = p.y() - cy, dz = p.z() - cz;
+        const float d2 = dx*dx + dy*dy + dz*dz;
+        r2 = (d2 > r2) ? d2 : r2;
+    }
+    return( r2 );
+}
+
+
+// One block of points per index: the box around them, or their
+//   greatest squared distance from a center.
+class PointsTask : public ParallelTask
+{
+public:
+    PointsTask( const osg::Vec3* points, unsigned int count, unsigned int numBlocks )
+      : _points( points ),
+        _count( count ),
+        _center( NULL ),
+        _min( numBlocks, osg::Vec3( FLT_MAX, FLT_MAX, FLT_MAX ) ),
+        _max( numBlocks, osg::Vec3( -FLT_MAX, -FLT_MAX, -FLT_MAX ) ),
+        _radius2( numBlocks, 0.f )
+    {}
+
+    virtual void operator()( unsigned int index )
+    {
+        const unsigned int first = index * PointBlockSize;
+        const unsigned int last = std::min( first + PointBlockSize, _count );
+        if (_center == NULL)
+            boxRange( _points, first, last, _min[ index ], _max[ index ] );
+        else
+            _radius2[ index ] = radius2Range( _points, first, last, *_center );
+    }
+
+    const osg::Vec3* _points;
+    const unsigned int _count;
+    // NULL to compute boxes.
+    const osg::Vec3* _center;
+
+    std::vector< osg::Vec3 > _min, _max;
+    std::vector< float > _radius2;
+};
+
+// Run task over every block, on numThreads threads if there are
+//   enough blocks to make that worthwhile.
+static void
+runBlocks( PointsTask& task, unsigned int numThreads )
+{
+    const unsigned int numBlocks = task._radius2.size();
+    if (numBlocks < 2)
+    {
+        unsigned int idx;
+        for (idx=0; idx<numBlocks; idx++)
+            task( idx );
+    }
+    else
+        runParallel( task, numBlocks, numThreads );
+}
+
+osg::BoundingBox
+computeBoundingBox( const osg::Vec3* points, unsigned int count,
+    unsigned int numThreads )
+{
+    osg::BoundingBox bb;
+    if (count == 0)
+        return( bb );
+
+    PointsTask task( points, count, ( count + PointBlockSize - 1 ) / PointBlockSize );
+    runBlocks( task, numThreads );
+
+    unsigned int idx;
+    for (idx=0; idx<task._min.size(); idx++)
+    {
+        bb.expandBy( task._min[ idx ] );
+        bb.expandBy( task._max[ idx ] );
+    }
+    return( bb );
+}
+
+osg::BoundingSphere
+computeBoundingSphere( const osg::Vec3* points, unsigned int count,
+    unsigned int numThreads )
+{
+    const osg::BoundingBox bb = computeBoundingBox( points, count, numThreads );
+    if (!bb.valid())
+        return( osg::BoundingSphere() );
+
+    PointsTask task( points, count, ( count + PointBlockSize - 1 ) / PointBlockSize );
+    const osg::Vec3 center = bb.center();
+    task._center = &center;
+    runBlocks( task, numThreads );
+
+    float r2( 0.f );
+    unsigned int idx;
+    for (idx=0; idx<task._radius2.size(); idx++)
+        r2 = std::max( r2, task._radius2[ idx ] );
+    return( osg::BoundingSphere( center, sqrtf( r2 ) ) );
+}
+
+
+osg::BoundingBox
+FastBoundingBoxCallback::computeBound( const osg::Drawable& drawable ) const
+{
+    const osg::Geometry* geom = drawable.asGeometry();
+    const osg::Vec3Array* v = (geom != NULL) ?
+        dynamic_cast< const osg::Vec3Array* >( geom->getVertexArray() ) : NULL;
+    if (v == NULL)
+        return( drawable.computeBound() );
+    if (v->empty())
+        return( osg::BoundingBox() );
+    return( computeBoundingBox( &(*v)[ 0 ], v->size() ) );
+}
+
+class InstallFastBoundsVisitor : public osg::NodeVisitor
+{
+public:
+    InstallFastBoundsVisitor( unsigned int minVertices )
+      : osg::NodeVisitor( osg::NodeVisitor::TRAVERSE_ALL_CHILDREN ),
+        _minVertices( minVertices ),
+        _callback( new FastBoundingBoxCallback ),
+        _count( 0 )
+    {}
+
+    virtual void apply( osg::Geode& geode )
+    {
+        unsigned int idx;
+        for (idx=0; idx<geode.getNumDrawables(); idx++)
+        {
+            osg::Geometry* geom = geode.getDrawable( idx )->asGeometry();
+            if ((geom == NULL) || (geom->getComputeBoundingBoxCallback() != NULL) ||
+                    (_done.find( geom ) != _done.end()))
+                continue;
+            const osg::Vec3Array* v = dynamic_cast< const osg::Vec3Array* >(
+                geom->getVertexArray() );
+            if ((v == NULL) || (v->size() < _minVertices))
+                continue;
+
+            geom->setComputeBoundingBoxCallback( _callback.get() );
+            geom->dirtyBound();
+            _done.insert( geom );
+            _count++;
+        }
+    }
+
+    const unsigned int _minVertices;
+    osg::ref_ptr< FastBoundingBoxCallback > _callback;
+    std::set< const osg::Geometry* > _done;
+    unsigned int _count;
+};
+
+unsigned int
+installFastBounds( osg::Node* root, unsigned int minVertices )
+{
+    if (root == NULL)
+        return( 0 );
+    InstallFastBoundsVisitor ifbv( minVertices );
+    root->accept( ifbv );
+    return( ifbv._count );
+}
+
+
+// Bring the bounds of one block of a level's nodes up to date.
+class LevelBoundTask : public ParallelTask
+{
+public:
+    LevelBoundTask( const std::vector< osg::Node* >& nodes )
+      : _nodes( nodes ) {}
+
+    virtual void operator()( unsigned int index )
+    {
+        const unsigned int first = index * NodeBlockSize;
+        const unsigned int last = std::min( first + NodeBlockSize,
+            (unsigned int)( _nodes.size() ) );
+        unsigned int idx;
+        for (idx=first; idx<last; idx++)
+            _nodes[ idx ]->getBound();
+    }
+
+protected:
+    const std::vector< osg::Node* >& _nodes;
+};
+
+BoundUpdater::BoundUpdater()
+{
+}
+
+void
+BoundUpdater::setNodes( const std::vector< osg::Node* >& nodes )
+{
+    _nodes = nodes;
+    buildLevels();
+}
+
+void
+BoundUpdater::clear()
+{
+    _nodes.clear();
+    _levels.clear();
+    _levelNodes.clear();
+    _parentCounts.clear();
+    _parents.clear();
+}
+
+unsigned int
+BoundUpdater::getNumNodes() const
+{
+    unsigned int count( 0 );
+    unsigned int idx;
+    for (idx=0; idx<_levels.size(); idx++)
+        count += _levels[ idx ].size();
+    return( count );
+}
+
+// Raise node's height to at least height, and its ancestors'
+//   above it.
+static void
+raiseHeight( osg::Node* node, unsigned int height,
+    std::map< osg::Node*, unsigned int >& heights )
+{
+    std::map< osg::Node*, unsigned int >::iterator it = heights.find( node );
+    if (it == heights.end())
+        heights[ node ] = height;
+    else if (it->second < height)
+        it->second = height;
+    else
+        // Already this high, and so are its ancestors.
+        return;
+
+    unsigned int idx;
+    for (idx=0; idx<node->getNumParents(); idx++)
+        raiseHeight( node->getParent( idx ), height+1, heights );
+}
+
+void
+BoundUpdater::buildLevels()
+{
+    _levels.clear();
+    _levelNodes.clear();
+    _parentCounts.clear();
+    _parents.clear();
+
+    std::map< osg::Node*, unsigned int > heights;
+    unsigned int idx;
+    for (idx=0; idx<_nodes.size(); idx++)
+        raiseHeight( _nodes[ idx ], 0, heights );
+
+    // A changed node below another changed node lifts it above
+    //   level 0, so levels come from the heights, not from _nodes.
+    std::map< osg::Node*, unsigned int >::const_iterator it;
+    for (it=heights.begin(); it!=heights.end(); it++)
+    {
+        if (it->second >= _levels.size())
+            _levels.resize( it->second + 1 );
+        _levels[ it->second ].push_back( it->first );
+        _levelNodes.insert( it->first );
+    }
+
+    for (idx=0; idx<_levels.size(); idx++)
+    {
+        unsigned int ndx;
+        for (ndx=0; ndx<_levels[ idx ].size(); ndx++)
+        {
+            osg::Node* node = _levels[ idx ][ ndx ];
+            _parentCounts.push_back( node->getNumParents() );
+            unsigned int pdx;
+            for (pdx=0; pdx<node->getNumParents(); pdx++)
+                _parents.push_back( node->getParent( pdx ) );
+        }
+    }
+}
+
+// Checking from level 0 up means that a removed ancestor is noticed
+//   at its child, before the ancestor itself, which may be gone, is
+//   looked at. Parents are compared by address, so one swapped for
+//   another is noticed too.
+bool
+BoundUpdater::parentsChanged() const
+{
+    unsigned int count( 0 );
+    unsigned int parent( 0 );
+    unsigned int idx;
+    for (idx=0; idx<_levels.size(); idx++)
+    {
+        unsigned int ndx;
+        for (ndx=0; ndx<_levels[ idx ].size(); ndx++)
+        {
+            const osg::Node* node = _levels[ idx ][ ndx ];
+            if (node->getNumParents() != _parentCounts[ count++ ])
+                return( true );
+            unsigned int pdx;
+            for (pdx=0; pdx<node->getNumParents(); pdx++)
+                if (node->getParent( pdx ) != _parents[ parent++ ])
+                    return( true );
+        }
+    }
+    return( false );
+}
+
+// Bounds in the levels are recomputed from the children and Drawables
+//   outside them, so those are brought up to date first, serially, in
+//   case they're shared. They're gathered from the level nodes each
+//   time, as any of them may have been removed since the last update.
+static void
+updateOutsideBounds( const std::vector< std::vector< osg::Node* > >& levels,
+    const std::set< osg::Node* >& levelNodes )
+{
+    unsigned int idx;
+    for (idx=0; idx<levels.size(); idx++)
+    {
+        unsigned int ndx;
+        for (ndx=0; ndx<levels[ idx ].size(); ndx++)
+        {
+            osg::Node* node = levels[ idx ][ ndx ];
+            osg::Group* grp = node->asGroup();
+            unsigned int cdx;
+            for (cdx=0; (grp != NULL) && (cdx<grp->getNumChildren()); cdx++)
+                if (levelNodes.find( grp->getChild( cdx ) ) == levelNodes.end())
+                    grp->getChild( cdx )->getBound();
+            osg::Geode* geode = node->asGeode();
+            for (cdx=0; (geode != NULL) && (cdx<geode->getNumDrawables()); cdx++)
+                geode->getDrawable( cdx )->getBound();
+        }
+    }
+}
+
+unsigned int
+BoundUpdater::update( unsigned int numThreads )
+{
+    if (parentsChanged())
+        buildLevels();
+
+    updateOutsideBounds( _levels, _levelNodes );
+
+    unsigned int count( 0 );
+    unsigned int idx;
+    for (idx=0; idx<_levels.size(); idx++)
+    {
+        const std::vector< osg::Node* >& level = _levels[ idx ];
+        LevelBoundTask task( level );
+        const unsigned int numBlocks = ( level.size() + NodeBlockSize - 1 ) / NodeBlockSize;
+        if (level.size() < NodeParallelThreshold)
+        {
+            unsigned int bdx;
+            for (bdx=0; bdx<numBlocks; bdx++)
+                task( bdx );
+        }
+        else
+            runParallel( task, numBlocks, numThreads );
+        count += level.size();
+    }
+    return( count );
+}
@@ -0,0 +1,111 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// SIMD bounding volumes and coalesced bound updates
+
+#ifndef __FAST_BOUNDS_H__
+#define __FAST_BOUNDS_H__
+
+#include <osg/Drawable>
+#include <osg/BoundingBox>
+#include <osg/BoundingSphere>
+#include <osg/Node>
+#include <set>
+#include <vector>
+
+// The box and sphere around count points. Four points at a time are
+//   loaded and regrouped into x, y and z vectors with SSE2 where the
+//   compiler targets it, and large arrays are split across
+//   numThreads threads (0 means one per processor). The sphere is
+//   centered on the box and just reaches the farthest point, which
+//   takes a second pass but is tighter than the box's corners.
+//   Both are invalid if count is 0.
+osg::BoundingBox computeBoundingBox( const osg::Vec3* points, unsigned int count,
+    unsigned int numThreads=0 );
+osg::BoundingSphere computeBoundingSphere( const osg::Vec3* points,
+    unsigned int count, unsigned int numThreads=0 );
+
+// Computes a Geometry's bounding box with computeBoundingBox(). OSG
+//   computes it through a PrimitiveFunctor, one vertex at a time;
+//   the result is the same box. Drawables that aren't Geometry
+//   with a Vec3Array of vertices get OSG's computation.
+class FastBoundingBoxCallback : public osg::Drawable::ComputeBoundingBoxCallback
+{
+public:
+    FastBoundingBoxCallback() {}
+    FastBoundingBoxCallback( const FastBoundingBoxCallback& rhs,
+        const osg::CopyOp& copyop=osg::CopyOp::SHALLOW_COPY )
+      : osg::Drawable::ComputeBoundingBoxCallback( rhs, copyop ) {}
+    META_Object( osgQSG, FastBoundingBoxCallback );
+
+    virtual osg::BoundingBox computeBound( const osg::Drawable& drawable ) const;
+
+protected:
+    virtual ~FastBoundingBoxCallback() {}
+};
+
+// Give every Geometry under root with at least minVertices vertices
+//   a FastBoundingBoxCallback, and dirty its bound. Smaller Geometry
+//   gains nothing from it. Returns the number of Geometry changed.
+unsigned int installFastBounds( osg::Node* root, unsigned int minVertices=1024 );
+
+
+// Brings the bounds of a fixed set of nodes, and of all their
+//   ancestors, up to date in one pass.
+//
+// Changing many nodes in one frame, as TransformAnimator does, marks
+//   each node's bound dirty and walks up its parents, stopping at
+//   the first one that's already dirty, so each ancestor is dirtied
+//   once. The recompute is still left to whichever traversal first
+//   asks for the root's bound, and it then recurses through the
+//   whole dirty region on one thread.
+//
+// update() recomputes the region level by level instead: first the
+//   changed nodes, then their parents, then the grandparents, each
+//   node once and after all its changed children, so a level's
+//   nodes are independent and large levels are split across
+//   threads. Ancestors are ordered by their greatest distance above
+//   a changed node, worked out when the nodes are set and again
+//   whenever one of them or an ancestor changes parents. Children
+//   and Drawables outside the region are looked up afresh on each
+//   update(), so they may be added and removed freely. The nodes
+//   must stay in memory while they're set.
+class BoundUpdater
+{
+public:
+    BoundUpdater();
+
+    // The nodes that change. Replaces any nodes set before.
+    void setNodes( const std::vector< osg::Node* >& nodes );
+    void clear();
+
+    // Recompute the bounds of every dirty node among the changed
+    //   nodes and their ancestors, on up to numThreads threads
+    //   (0 means one per processor). Call after changing the nodes,
+    //   from the thread that changes them. Returns the number of
+    //   nodes checked; each dirty one is recomputed once.
+    unsigned int update( unsigned int numThreads=0 );
+
+    // The changed nodes and their ancestors.
+    unsigned int getNumNodes() const;
+    // Levels of the update, the changed nodes being level 0.
+    unsigned int getNumLevels() const { return( _levels.size() ); }
+
+protected:
+    void buildLevels();
+    bool parentsChanged() const;
+
+    std::vector< osg::Node* > _nodes;
+    std::vector< std::vector< osg::Node* > > _levels;
+    // The nodes in the levels, for telling their other children apart.
+    std::set< osg::Node* > _levelNodes;
+    // Each level's nodes' parent counts and parents when the levels
+    //   were built. Only compared, never dereferenced.
+    std::vector< unsigned int > _parentCounts;
+    std::vector< osg::Node* > _parents;
+};
+
+#endif
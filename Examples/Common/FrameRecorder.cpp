@@ -0,0 +1,272 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// Always-on per-phase frame timing with percentile reports
+
+#include "FrameRecorder.h"
+#include <osgViewer/Viewer>
+#include <osgGA/GUIEventHandler>
+#include <osg/Stats>
+#include <osg/Notify>
+#include <OpenThreads/ScopedLock>
+#include <algorithm>
+#include <csignal>
+
+
+static const char* s_phaseNames[ FrameRecorder::NUM_PHASES ] =
+{
+    "event", "update", "cull", "draw", "frame"
+};
+
+// Set by the signal handler, cleared by the endFrame() that writes.
+static volatile sig_atomic_t s_writeRequested( 0 );
+
+static void
+handleWriteSignal( int sig )
+{
+    s_writeRequested = 1;
+    // Some systems reset the handler on delivery.
+    signal( sig, handleWriteSignal );
+}
+
+
+// Copies OSG's statistics for each frame into a FrameRecorder.
+class RecordStatsHandler : public osgGA::GUIEventHandler
+{
+public:
+    RecordStatsHandler( FrameRecorder* recorder )
+      : _recorder( recorder ) {}
+
+    virtual bool handle( const osgGA::GUIEventAdapter& ea,
+        osgGA::GUIActionAdapter& aa )
+    {
+        if (ea.getEventType() != osgGA::GUIEventAdapter::FRAME)
+            return( false );
+        osgViewer::Viewer* viewer = dynamic_cast< osgViewer::Viewer* >( &aa );
+        if (viewer == NULL)
+            return( false );
+
+        // Realizing the viewer can add cameras, so check them
+        //   every frame.
+        osgViewer::ViewerBase::Cameras cameras;
+        viewer->getCameras( cameras );
+        unsigned int idx;
+        for (idx=0; idx<cameras.size(); idx++)
+            if (cameras[ idx ]->getStats() != NULL)
+                cameras[ idx ]->getStats()->collectStats( "rendering", true );
+
+        const unsigned int frameNumber = viewer->getFrameStamp()->getFrameNumber();
+        if (frameNumber >= 2)
+        {
+            // OSG records times in seconds.
+            const unsigned int frame = frameNumber - 2;
+            osg::Stats* stats = viewer->getViewerStats();
+            double t;
+            if (stats->getAttribute( frame, "Event traversal time taken", t ))
+                _recorder->record( FrameRecorder::EVENT, t * 1000. );
+            if (stats->getAttribute( frame, "Update traversal time taken", t ))
+                _recorder->record( FrameRecorder::UPDATE, t * 1000. );
+
+            double cull( 0. ), draw( 0. );
+            bool haveCull( false ), haveDraw( false );
+            for (idx=0; idx<cameras.size(); idx++)
+            {
+                osg::Stats* cameraStats = cameras[ idx ]->getStats();
+                if (cameraStats == NULL)
+                    continue;
+                if (cameraStats->getAttribute( frame, "Cull traversal time taken", t ))
+                {
+                    cull += t;
+                    haveCull = true;
+                }
+                if (cameraStats->getAttribute( frame, "Draw traversal time taken", t ))
+                {
+                    draw += t;
+                    haveDraw = true;
+                }
+            }
+            if (haveCull)
+                _recorder->record( FrameRecorder::CULL, cull * 1000. );
+            if (haveDraw)
+                _recorder->record( FrameRecorder::DRAW, draw * 1000. );
+        }
+
+        _recorder->endFrame();
+        return( false );
+    }
+
+protected:
+    virtual ~RecordStatsHandler() {}
+
+    osg::ref_ptr< FrameRecorder > _recorder;
+};
+
+
+FrameRecorder::Channel::Channel( const std::string& name, unsigned int capacity )
+  : _name( name ),
+    _samples( capacity, 0.f ),
+    _reset( 0 )
+{
+}
+
+FrameRecorder::FrameRecorder( unsigned int capacity )
+  : _mask( 0 ),
+    _numChannels( 0 ),
+    _lastFrame( 0 )
+{
+    unsigned int size( 1 );
+    while (size < capacity)
+        size <<= 1;
+    _mask = size - 1;
+
+    unsigned int idx;
+    for (idx=0; idx<NUM_PHASES+MaxScopes; idx++)
+        _channels[ idx ] = NULL;
+    for (idx=0; idx<NUM_PHASES; idx++)
+        _channels[ idx ] = new Channel( s_phaseNames[ idx ], size );
+    _numChannels = NUM_PHASES;
+}
+
+FrameRecorder::~FrameRecorder()
+{
+    unsigned int idx;
+    for (idx=0; idx<_numChannels; idx++)
+        delete _channels[ idx ];
+}
+
+FrameRecorder*
+FrameRecorder::instance()
+{
+    static osg::ref_ptr< FrameRecorder > recorder = new FrameRecorder;
+    return( recorder.get() );
+}
+
+unsigned int
+FrameRecorder::getScope( const std::string& name )
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _mutex );
+    unsigned int idx;
+    for (idx=0; idx<_numChannels; idx++)
+        if (_channels[ idx ]->_name == name)
+            return( idx );
+    if (_numChannels == NUM_PHASES+MaxScopes)
+    {
+        osg::notify( osg::WARN ) << "FrameRecorder: no room for scope \"" <<
+            name << "\"." << std::endl;
+        return( NUM_PHASES+MaxScopes );
+    }
+
+    _channels[ _numChannels ] = new Channel( name, _mask + 1 );
+    _numChannels = _numChannels + 1;
+    return( _numChannels - 1 );
+}
+
+void
+FrameRecorder::record( unsigned int channel, double ms )
+{
+    if (channel >= _numChannels)
+        return;
+    Channel* c = _channels[ channel ];
+    const unsigned int slot = ++( c->_next ) - 1;
+    c->_samples[ slot & _mask ] = (float)ms;
+}
+
+void
+FrameRecorder::attach( osgViewer::Viewer& viewer )
+{
+    osg::Stats* stats = viewer.getViewerStats();
+    stats->collectStats( "event", true );
+    stats->collectStats( "update", true );
+    viewer.addEventHandler( new RecordStatsHandler( this ) );
+}
+
+void
+FrameRecorder::endFrame()
+{
+    const osg::Timer_t now = osg::Timer::instance()->tick();
+    if (_lastFrame != 0)
+        record( FRAME, osg::Timer::instance()->delta_m( _lastFrame, now ) );
+    _lastFrame = now;
+
+    if (s_writeRequested)
+    {
+        s_writeRequested = 0;
+        write();
+    }
+}
+
+void
+FrameRecorder::writeOnSignal( int sig )
+{
+    signal( sig, handleWriteSignal );
+}
+
+TimingSummary
+FrameRecorder::getSummary( unsigned int channel ) const
+{
+    if (channel >= _numChannels)
+        return( TimingSummary() );
+    const Channel* c = _channels[ channel ];
+    const unsigned int count = std::min( (unsigned int)( c->_next ) - c->_reset,
+        _mask + 1 );
+    // The samples since the reset start at its slot, unless the ring
+    //   has filled since, when every slot holds one.
+    std::vector< double > samples( count );
+    unsigned int idx;
+    for (idx=0; idx<count; idx++)
+        samples[ idx ] = c->_samples[ ( c->_reset + idx ) & _mask ];
+    return( summarizeTimings( samples ) );
+}
+
+void
+FrameRecorder::addRows( TimingReport& report,
+    const std::vector< std::string >& keys ) const
+{
+    std::vector< std::string > rowKeys( keys );
+    rowKeys.push_back( "" );
+    unsigned int idx;
+    for (idx=0; idx<_numChannels; idx++)
+    {
+        const TimingSummary summary = getSummary( idx );
+        if (summary._count == 0)
+            continue;
+        rowKeys.back() = _channels[ idx ]->_name;
+        report.addRow( rowKeys, summary );
+    }
+}
+
+bool
+FrameRecorder::write() const
+{
+    if (_outputFile.empty())
+    {
+        osg::notify( osg::WARN ) << "FrameRecorder: no output file set." << std::endl;
+        return( false );
+    }
+    return( write( _outputFile ) );
+}
+
+bool
+FrameRecorder::write( const std::string& fileName ) const
+{
+    std::vector< std::string > keyNames;
+    keyNames.push_back( "channel" );
+    TimingReport report( keyNames );
+    addRows( report, std::vector< std::string >() );
+    if (!report.write( fileName ))
+        return( false );
+    osg::notify( osg::NOTICE ) << "Wrote frame timing to \"" << fileName << "\"." << std::endl;
+    return( true );
+}
+
+void
+FrameRecorder::reset()
+{
+    unsigned int idx;
+    for (idx=0; idx<_numChannels; idx++)
+        _channels[ idx ]->_reset = (unsigned int)( _channels[ idx ]->_next );
+    _lastFrame = 0;
+}
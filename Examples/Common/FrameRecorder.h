@@ -0,0 +1,144 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// Always-on per-phase frame timing with percentile reports
+
+#ifndef __FRAME_RECORDER_H__
+#define __FRAME_RECORDER_H__
+
+#include "TimingStats.h"
+#include <osg/Referenced>
+#include <osg/Timer>
+#include <OpenThreads/Atomic>
+#include <OpenThreads/Mutex>
+#include <string>
+#include <vector>
+
+namespace osgViewer {
+    class Viewer;
+}
+
+// Records how long each frame spends in each phase, and in any
+//   number of named scopes, and summarizes the recent frames as a
+//   TimingReport with p50, p95 and p99 times.
+//
+// Each channel (a phase or a scope) keeps its latest samples in a
+//   fixed ring buffer, so memory stays constant however long the
+//   application runs. record() claims a slot with one atomic
+//   increment and stores a float, with no lock, so any thread may
+//   record at any time. Reports read the rings while recording
+//   continues; a sample being written at that moment may be missed
+//   or counted from the lap before.
+class FrameRecorder : public osg::Referenced
+{
+public:
+    // The built-in channels. FRAME is the time from one frame's
+    //   start to the next.
+    enum Phase { EVENT, UPDATE, CULL, DRAW, FRAME, NUM_PHASES };
+
+    // Keep the latest capacity samples per channel, rounded up to a
+    //   power of two.
+    FrameRecorder( unsigned int capacity=4096 );
+
+    // The recorder that scopes in the Common code record to, such as
+    //   TransformAnimator's.
+    static FrameRecorder* instance();
+
+    // Return the channel named name, adding it if there isn't one.
+    //   Takes a lock; look channels up once, not every frame.
+    //   Returns NUM_PHASES+MaxScopes, which record() ignores, when
+    //   there's no room for another.
+    unsigned int getScope( const std::string& name );
+
+    // Record ms milliseconds to channel. Lock-free.
+    void record( unsigned int channel, double ms );
+
+    // Record the event, update, cull and draw times and the frame
+    //   time of every frame viewer runs. This turns on OSG's own
+    //   event, update and rendering statistics, and adds an event
+    //   handler that copies them two frames behind, once every
+    //   threading model has finished the frame, and calls
+    //   endFrame().
+    void attach( osgViewer::Viewer& viewer );
+
+    // Call once per frame when not attached to a viewer, as headless
+    //   runs do. Records the frame time, and writes the output file
+    //   if the signal from writeOnSignal() has arrived.
+    void endFrame();
+
+    // The file write() writes, as CSV or JSON by its extension.
+    void setOutputFile( const std::string& fileName ) { _outputFile = fileName; }
+    const std::string& getOutputFile() const { return( _outputFile ); }
+
+    // Write the output file when the process receives sig, such as
+    //   SIGUSR1, so a running application can be sampled. The
+    //   handler only sets a flag; the next endFrame() writes.
+    static void writeOnSignal( int sig );
+
+    // Summary of the samples channel holds.
+    TimingSummary getSummary( unsigned int channel ) const;
+    // Add a row to report for each channel with samples, keyed by
+    //   keys followed by the channel's name.
+    void addRows( TimingReport& report, const std::vector< std::string >& keys ) const;
+    // Write a report keyed by channel name to the output file or to
+    //   fileName.
+    bool write() const;
+    bool write( const std::string& fileName ) const;
+
+    // Forget every sample, so runs can be summarized separately.
+    //   Call while nothing records.
+    void reset();
+
+    static const unsigned int MaxScopes = 60;
+
+protected:
+    virtual ~FrameRecorder();
+
+    struct Channel
+    {
+        Channel( const std::string& name, unsigned int capacity );
+
+        const std::string _name;
+        std::vector< float > _samples;
+        // Slots claimed, and the count when reset() last ran.
+        OpenThreads::Atomic _next;
+        unsigned int _reset;
+    };
+
+    unsigned int _mask;
+    // Filled in order and never removed, so record() reads them
+    //   without a lock; _numChannels is raised after each is added.
+    Channel* _channels[ NUM_PHASES + MaxScopes ];
+    volatile unsigned int _numChannels;
+    OpenThreads::Mutex _mutex;
+
+    osg::Timer_t _lastFrame;
+    std::string _outputFile;
+};
+
+// Records the time from its construction to its destruction to a
+//   FrameRecorder channel.
+class ScopedFrameTimer
+{
+public:
+    ScopedFrameTimer( FrameRecorder* recorder, unsigned int channel )
+      : _recorder( recorder ),
+        _channel( channel ),
+        _start( osg::Timer::instance()->tick() )
+    {}
+    ~ScopedFrameTimer()
+    {
+        _recorder->record( _channel, osg::Timer::instance()->delta_m(
+            _start, osg::Timer::instance()->tick() ) );
+    }
+
+protected:
+    FrameRecorder* _recorder;
+    const unsigned int _channel;
+    const osg::Timer_t _start;
+};
+
+#endif
@@ -0,0 +1,729 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// Merges fragmented Geometry into fewer, vertex cache friendly draws
+
+#include "GeometryConsolidator.h"
+#include <osg/NodeVisitor>
+#include <osg/Switch>
+#include <osg/LOD>
+#include <osg/Sequence>
+#include <osg/Geode>
+#include <osg/Geometry>
+#include <osg/PrimitiveSet>
+#include <cstring>
+#include <cmath>
+#include <set>
+#include <vector>
+
+
+GeometryCounts::GeometryCounts()
+  : _geodes( 0 ),
+    _drawables( 0 ),
+    _primitiveSets( 0 ),
+    _triangles( 0 ),
+    _cacheMisses( 0 )
+{
+}
+
+double
+GeometryCounts::getACMR() const
+{
+    if (_triangles == 0)
+        return( 0. );
+    return( (double)_cacheMisses / (double)_triangles );
+}
+
+
+typedef std::vector< unsigned int > IndexList;
+
+static bool
+isTriangleMode( GLenum mode )
+{
+    return( (mode == osg::PrimitiveSet::TRIANGLES) ||
+        (mode == osg::PrimitiveSet::TRIANGLE_STRIP) ||
+        (mode == osg::PrimitiveSet::TRIANGLE_FAN) ||
+        (mode == osg::PrimitiveSet::QUADS) ||
+        (mode == osg::PrimitiveSet::QUAD_STRIP) ||
+        (mode == osg::PrimitiveSet::POLYGON) );
+}
+
+// Split a primitive set into the index runs it sends to OpenGL. A
+//   DrawArrayLengths is one run per length; everything else is one
+//   run.
+static void
+getRuns( const osg::PrimitiveSet& ps, std::vector< IndexList >& runs )
+{
+    if (ps.getType() == osg::PrimitiveSet::DrawArrayLengthsPrimitiveType)
+    {
+        const osg::DrawArrayLengths& dal =
+                static_cast< const osg::DrawArrayLengths& >( ps );
+        unsigned int first = dal.getFirst();
+        unsigned int idx;
+        for (idx=0; idx<dal.size(); idx++)
+        {
+            runs.push_back( IndexList() );
+            IndexList& run = runs.back();
+            unsigned int vIdx;
+            for (vIdx=0; vIdx<(unsigned int)dal[ idx ]; vIdx++)
+                run.push_back( first + vIdx );
+            first += dal[ idx ];
+        }
+        return;
+    }
+
+    runs.push_back( IndexList() );
+    IndexList& run = runs.back();
+    const unsigned int numIndices = ps.getNumIndices();
+    run.reserve( numIndices );
+    unsigned int idx;
+    for (idx=0; idx<numIndices; idx++)
+        run.push_back( ps.index( idx ) );
+}
+
+// Triangles are numbered the way osg::TriangleFunctor numbers them,
+//   degenerate ones included, so the numbers match the primitive
+//   indices the intersectors report.
+struct TriangleSink
+{
+    TriangleSink( IndexList& tris, IndexList* numbers, unsigned int first )
+      : _tris( tris ), _numbers( numbers ), _number( first ) {}
+
+    void add( unsigned int a, unsigned int b, unsigned int c )
+    {
+        const unsigned int number = _number++;
+        // Degenerate triangles draw nothing.
+        if ( (a == b) || (b == c) || (a == c) )
+            return;
+        _tris.push_back( a );
+        _tris.push_back( b );
+        _tris.push_back( c );
+        if (_numbers != NULL)
+            _numbers->push_back( number );
+    }
+
+    IndexList& _tris;
+    IndexList* _numbers;
+    unsigned int _number;
+};
+
+// Append the triangles of one run as a triangle list, with the
+//   same winding OpenGL would use.
+static void
+appendRunTriangles( GLenum mode, const IndexList& run, TriangleSink& sink )
+{
+    const unsigned int n = run.size();
+    unsigned int idx;
+    switch( mode )
+    {
+        case osg::PrimitiveSet::TRIANGLES:
+            for (idx=2; idx<n; idx+=3)
+                sink.add( run[ idx-2 ], run[ idx-1 ], run[ idx ] );
+            break;
+        case osg::PrimitiveSet::TRIANGLE_STRIP:
+            for (idx=2; idx<n; idx++)
+            {
+                if (idx % 2)
+                    sink.add( run[ idx-2 ], run[ idx ], run[ idx-1 ] );
+                else
+                    sink.add( run[ idx-2 ], run[ idx-1 ], run[ idx ] );
+            }
+            break;
+        case osg::PrimitiveSet::TRIANGLE_FAN:
+        case osg::PrimitiveSet::POLYGON:
+            for (idx=2; idx<n; idx++)
+                sink.add( run[ 0 ], run[ idx-1 ], run[ idx ] );
+            break;
+        case osg::PrimitiveSet::QUADS:
+            for (idx=3; idx<n; idx+=4)
+            {
+                sink.add( run[ idx-3 ], run[ idx-2 ], run[ idx-1 ] );
+                sink.add( run[ idx-3 ], run[ idx-1 ], run[ idx ] );
+            }
+            break;
+        case osg::PrimitiveSet::QUAD_STRIP:
+            for (idx=3; idx<n; idx+=2)
+            {
+                sink.add( run[ idx-3 ], run[ idx-2 ], run[ idx-1 ] );
+                sink.add( run[ idx-2 ], run[ idx ], run[ idx-1 ] );
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+unsigned int
+appendTriangles( const osg::PrimitiveSet& ps, std::vector< unsigned int >& tris,
+    std::vector< unsigned int >* numbers, unsigned int firstNumber )
+{
+    if (!isTriangleMode( ps.getMode() ))
+        return( 0 );
+    std::vector< IndexList > runs;
+    getRuns( ps, runs );
+    TriangleSink sink( tris, numbers, firstNumber );
+    unsigned int idx;
+    for (idx=0; idx<runs.size(); idx++)
+        appendRunTriangles( ps.getMode(), runs[ idx ], sink );
+    return( sink._number - firstNumber );
+}
+
+void
+appendIndices( const osg::PrimitiveSet& ps, std::vector< unsigned int >& indices )
+{
+    std::vector< IndexList > runs;
+    getRuns( ps, runs );
+    unsigned int idx;
+    for (idx=0; idx<runs.size(); idx++)
+        indices.insert( indices.end(), runs[ idx ].begin(), runs[ idx ].end() );
+}
+
+// Count the vertices a FIFO post-transform cache misses on while
+//   processing one index stream.
+static unsigned int
+countCacheMisses( const IndexList& indices, unsigned int cacheSize )
+{
+    std::vector< unsigned int > fifo( cacheSize, ~0u );
+    unsigned int next( 0 );
+    unsigned int misses( 0 );
+    unsigned int idx;
+    for (idx=0; idx<indices.size(); idx++)
+    {
+        const unsigned int v = indices[ idx ];
+        unsigned int cIdx;
+        for (cIdx=0; cIdx<cacheSize; cIdx++)
+            if (fifo[ cIdx ] == v)
+                break;
+        if (cIdx < cacheSize)
+            continue;
+        misses++;
+        fifo[ next ] = v;
+        next = ( next + 1 ) % cacheSize;
+    }
+    return( misses );
+}
+
+
+// Tom Forsyth's "Linear-Speed Vertex Cache Optimisation". Each
+//   vertex is scored by its position in a simulated LRU cache and by
+//   how many of its triangles are left; the next triangle is the
+//   best-scoring one that uses a cached vertex.
+static const int s_forsythCacheSize( 32 );
+
+static float
+vertexScore( int cachePos, unsigned int remaining )
+{
+    if (remaining == 0)
+        return( -1.f );
+
+    float score( 0.f );
+    if (cachePos >= 0)
+    {
+        // The last triangle's vertices score the same, so that the
+        //   order within a triangle doesn't matter.
+        if (cachePos < 3)
+            score = .75f;
+        else
+        {
+            const float scale = 1.f / ( s_forsythCacheSize - 3 );
+            score = (float)pow( 1.f - ( cachePos - 3 ) * scale, 1.5f );
+        }
+    }
+    // Favor vertices with few triangles left, to finish them off.
+    score += 2.f / (float)sqrt( (float)remaining );
+    return( score );
+}
+
+void
+optimizeVertexCache( std::vector< unsigned int >& tris, unsigned int numVertices,
+    std::vector< unsigned int >* order )
+{
+    const unsigned int numTris = tris.size() / 3;
+    unsigned int idx;
+    if (order != NULL)
+    {
+        // Unchanged, unless the triangles get reordered below.
+        order->resize( numTris );
+        for (idx=0; idx<numTris; idx++)
+            (*order)[ idx ] = idx;
+    }
+    if (numTris < 2)
+        return;
+
+    for (idx=0; idx<tris.size(); idx++)
+        if (tris[ idx ] >= numVertices)
+            return;
+
+    // Triangles using each vertex, as offsets into one array.
+    std::vector< unsigned int > remaining( numVertices, 0 );
+    for (idx=0; idx<tris.size(); idx++)
+        remaining[ tris[ idx ] ]++;
+    std::vector< unsigned int > offset( numVertices + 1, 0 );
+    for (idx=0; idx<numVertices; idx++)
+        offset[ idx+1 ] = offset[ idx ] + remaining[ idx ];
+    std::vector< unsigned int > adjacent( tris.size() );
+    std::vector< unsigned int > fill( offset.begin(), offset.end() - 1 );
+    for (idx=0; idx<tris.size(); idx++)
+        adjacent[ fill[ tris[ idx ] ]++ ] = idx / 3;
+
+    std::vector< int > cachePos( numVertices, -1 );
+    std::vector< float > vScore( numVertices );
+    for (idx=0; idx<numVertices; idx++)
+        vScore[ idx ] = vertexScore( -1, remaining[ idx ] );
+    std::vector< float > tScore( numTris );
+    std::vector< bool > added( numTris, false );
+    unsigned int best( 0 );
+    for (idx=0; idx<numTris; idx++)
+    {
+        tScore[ idx ] = vScore[ tris[ 3*idx ] ] + vScore[ tris[ 3*idx+1 ] ] +
+            vScore[ tris[ 3*idx+2 ] ];
+        if (tScore[ idx ] > tScore[ best ])
+            best = idx;
+    }
+
+    IndexList out, newOrder;
+    out.reserve( tris.size() );
+    newOrder.reserve( numTris );
+    std::vector< unsigned int > cache, newCache;
+    unsigned int cursor( 0 );
+    unsigned int count;
+    for (count=0; count<numTris; count++)
+    {
+        if (best == ~0u)
+        {
+            // Nothing in the cache has triangles left; start on
+            //   the next unused triangle.
+            while (added[ cursor ])
+                cursor++;
+            best = cursor;
+        }
+
+        added[ best ] = true;
+        const unsigned int* tri = &tris[ 3*best ];
+        out.insert( out.end(), tri, tri+3 );
+        newOrder.push_back( best );
+
+        // Remove the triangle from its vertices' lists.
+        unsigned int vIdx;
+        for (vIdx=0; vIdx<3; vIdx++)
+        {
+            const unsigned int v = tri[ vIdx ];
+            unsigned int* list = &adjacent[ offset[ v ] ];
+            unsigned int tIdx;
+            for (tIdx=0; list[ tIdx ] != best; tIdx++)
+                ;
+            list[ tIdx ] = list[ remaining[ v ] - 1 ];
+            remaining[ v ]--;
+        }
+
+        // Move the triangle's vertices to the front of the cache.
+        newCache.assign( tri, tri+3 );
+        for (idx=0; idx<cache.size(); idx++)
+        {
+            const unsigned int v = cache[ idx ];
+            if ( (v != tri[ 0 ]) && (v != tri[ 1 ]) && (v != tri[ 2 ]) )
+                newCache.push_back( v );
+        }
+        for (idx=s_forsythCacheSize; idx<newCache.size(); idx++)
+        {
+            cachePos[ newCache[ idx ] ] = -1;
+            vScore[ newCache[ idx ] ] = vertexScore( -1, remaining[ newCache[ idx ] ] );
+        }
+        if (newCache.size() > (unsigned int)s_forsythCacheSize)
+            newCache.resize( s_forsythCacheSize );
+        cache.swap( newCache );
+
+        // Rescore the cached vertices and their triangles, and pick
+        //   the best of those triangles next.
+        for (idx=0; idx<cache.size(); idx++)
+        {
+            cachePos[ cache[ idx ] ] = idx;
+            vScore[ cache[ idx ] ] = vertexScore( idx, remaining[ cache[ idx ] ] );
+        }
+        best = ~0u;
+        float bestScore( -1.f );
+        for (idx=0; idx<cache.size(); idx++)
+        {
+            const unsigned int v = cache[ idx ];
+            unsigned int tIdx;
+            for (tIdx=0; tIdx<remaining[ v ]; tIdx++)
+            {
+                const unsigned int t = adjacent[ offset[ v ] + tIdx ];
+                tScore[ t ] = vScore[ tris[ 3*t ] ] + vScore[ tris[ 3*t+1 ] ] +
+                    vScore[ tris[ 3*t+2 ] ];
+                if (tScore[ t ] > bestScore)
+                {
+                    bestScore = tScore[ t ];
+                    best = t;
+                }
+            }
+        }
+    }
+    tris.swap( out );
+    if (order != NULL)
+        order->swap( newOrder );
+}
+
+
+bool
+selectsChildren( const osg::Group& group )
+{
+    return( (dynamic_cast< const osg::Switch* >( &group ) != NULL) ||
+        (dynamic_cast< const osg::LOD* >( &group ) != NULL) ||
+        (dynamic_cast< const osg::Sequence* >( &group ) != NULL) );
+}
+
+osg::DrawElements*
+createDrawElements( GLenum mode, const std::vector< unsigned int >& indices )
+{
+    unsigned int maxIndex( 0 );
+    unsigned int idx;
+    for (idx=0; idx<indices.size(); idx++)
+        if (indices[ idx ] > maxIndex)
+            maxIndex = indices[ idx ];
+
+    if (maxIndex < 65536)
+    {
+        osg::DrawElementsUShort* de = new osg::DrawElementsUShort( mode );
+        de->reserve( indices.size() );
+        for (idx=0; idx<indices.size(); idx++)
+            de->push_back( (GLushort)indices[ idx ] );
+        return( de );
+    }
+    osg::DrawElementsUInt* de = new osg::DrawElementsUInt( mode );
+    de->insert( de->end(), indices.begin(), indices.end() );
+    return( de );
+}
+
+static bool
+hasPerPrimitiveBinding( const osg::Geometry& geom )
+{
+    const osg::Geometry::AttributeBinding bindings[] = {
+        geom.getNormalBinding(), geom.getColorBinding(),
+        geom.getSecondaryColorBinding(), geom.getFogCoordBinding() };
+    unsigned int idx;
+    for (idx=0; idx<4; idx++)
+        if ( (bindings[ idx ] == osg::Geometry::BIND_PER_PRIMITIVE) ||
+                (bindings[ idx ] == osg::Geometry::BIND_PER_PRIMITIVE_SET) )
+            return( true );
+    return( false );
+}
+
+// True if geom is a plain Geometry whose primitive sets can be
+//   rewritten or merged with another's.
+static bool
+canConsolidate( const osg::Geometry& geom )
+{
+    if (strcmp( geom.className(), "Geometry" ) != 0)
+        return( false );
+    if (hasPerPrimitiveBinding( geom ))
+        return( false );
+    if ( (geom.getVertexIndices() != NULL) || (geom.getNormalIndices() != NULL) ||
+            (geom.getColorIndices() != NULL) )
+        return( false );
+    unsigned int idx;
+    for (idx=0; idx<geom.getNumTexCoordArrays(); idx++)
+        if (geom.getTexCoordIndices( idx ) != NULL)
+            return( false );
+    osg::Geometry& g = const_cast< osg::Geometry& >( geom );
+    return( (g.getVertexArray() != NULL) &&
+        (g.getNumVertexAttribArrays() == 0) &&
+        (g.getUpdateCallback() == NULL) &&
+        (g.getCullCallback() == NULL) &&
+        (g.getDrawCallback() == NULL) &&
+        (g.getEventCallback() == NULL) &&
+        (g.getUserData() == NULL) &&
+        g.getName().empty() &&
+        !g.getInitialBound().valid() );
+}
+
+// True if a and b draw from the same arrays with the same state,
+//   so that b's primitive sets can move into a.
+static bool
+sameArrays( osg::Geometry& a, osg::Geometry& b )
+{
+    if ( (a.getStateSet() != b.getStateSet()) ||
+            (a.getVertexArray() != b.getVertexArray()) ||
+            (a.getNormalArray() != b.getNormalArray()) ||
+            (a.getNormalBinding() != b.getNormalBinding()) ||
+            (a.getColorArray() != b.getColorArray()) ||
+            (a.getColorBinding() != b.getColorBinding()) ||
+            (a.getSecondaryColorArray() != b.getSecondaryColorArray()) ||
+            (a.getSecondaryColorBinding() != b.getSecondaryColorBinding()) ||
+            (a.getFogCoordArray() != b.getFogCoordArray()) ||
+            (a.getFogCoordBinding() != b.getFogCoordBinding()) ||
+            (a.getNumTexCoordArrays() != b.getNumTexCoordArrays()) ||
+            (a.getUseDisplayList() != b.getUseDisplayList()) )
+        return( false );
+    unsigned int idx;
+    for (idx=0; idx<a.getNumTexCoordArrays(); idx++)
+        if (a.getTexCoordArray( idx ) != b.getTexCoordArray( idx ))
+            return( false );
+    return( true );
+}
+
+// True if geode can be folded into a sibling Geode.
+static bool
+isPlainGeode( osg::Geode& geode )
+{
+    return( (strcmp( geode.className(), "Geode" ) == 0) &&
+        (geode.getNumParents() == 1) &&
+        geode.getName().empty() &&
+        (geode.getStateSet() == NULL) &&
+        (geode.getDataVariance() != osg::Object::DYNAMIC) &&
+        (geode.getNodeMask() == ~0u) &&
+        geode.getCullingActive() &&
+        (geode.getUpdateCallback() == NULL) &&
+        (geode.getEventCallback() == NULL) &&
+        (geode.getCullCallback() == NULL) &&
+        (geode.getUserData() == NULL) );
+}
+
+
+// Collects the distinct Groups and Geodes under a node, and
+//   counts them along with their Drawables and triangles.
+class GeometryCollector : public osg::NodeVisitor
+{
+public:
+    GeometryCollector( unsigned int cacheSize )
+      : osg::NodeVisitor( osg::NodeVisitor::TRAVERSE_ALL_CHILDREN ),
+        _cacheSize( cacheSize )
+    {
+    }
+
+    virtual void apply( osg::Node& node )
+    {
+        if (!_visited.insert( &node ).second)
+            return;
+        if (node.asGroup() != NULL)
+            _groups.push_back( node.asGroup() );
+        traverse( node );
+    }
+
+    virtual void apply( osg::Geode& geode )
+    {
+        if (!_visited.insert( &geode ).second)
+            return;
+        _geodes.push_back( &geode );
+        _counts._geodes++;
+
+        unsigned int idx;
+        for (idx=0; idx<geode.getNumDrawables(); idx++)
+        {
+            osg::Drawable* drawable = geode.getDrawable( idx );
+            if (!_drawables.insert( drawable ).second)
+                continue;
+            _counts._drawables++;
+            osg::Geometry* geom = drawable->asGeometry();
+            if (geom != NULL)
+                countGeometry( *geom );
+        }
+    }
+
+    void countGeometry( const osg::Geometry& geom )
+    {
+        unsigned int idx;
+        for (idx=0; idx<geom.getNumPrimitiveSets(); idx++)
+        {
+            const osg::PrimitiveSet* ps = geom.getPrimitiveSet( idx );
+            _counts._primitiveSets++;
+            if (!isTriangleMode( ps->getMode() ))
+                continue;
+
+            std::vector< IndexList > runs;
+            getRuns( *ps, runs );
+            IndexList tris;
+            TriangleSink sink( tris, NULL, 0 );
+            unsigned int rIdx;
+            for (rIdx=0; rIdx<runs.size(); rIdx++)
+            {
+                appendRunTriangles( ps->getMode(), runs[ rIdx ], sink );
+                // The cache sees the run's index stream, which for
+                //   strips and fans is shorter than the triangles'.
+                _counts._cacheMisses += countCacheMisses( runs[ rIdx ], _cacheSize );
+            }
+            _counts._triangles += tris.size() / 3;
+        }
+    }
+
+    unsigned int _cacheSize;
+    std::set< osg::Node* > _visited;
+    std::set< osg::Drawable* > _drawables;
+    std::vector< osg::ref_ptr<osg::Group> > _groups;
+    std::vector< osg::ref_ptr<osg::Geode> > _geodes;
+    GeometryCounts _counts;
+};
+
+// Move the Drawables of plain sibling Geodes into the first one,
+//   and record the emptied Geodes in removed. The children of a
+//   Switch, LOD or Sequence are alternatives, and stay apart.
+static void
+mergeGeodes( osg::Group& group, std::set< osg::Node* >& removed )
+{
+    if (selectsChildren( group ))
+        return;
+    osg::Geode* target( NULL );
+    unsigned int idx( 0 );
+    while (idx < group.getNumChildren())
+    {
+        osg::Geode* geode = group.getChild( idx )->asGeode();
+        if ( (geode == NULL) || !isPlainGeode( *geode ) )
+        {
+            idx++;
+            continue;
+        }
+        if (target == NULL)
+        {
+            target = geode;
+            idx++;
+            continue;
+        }
+
+        unsigned int dIdx;
+        for (dIdx=0; dIdx<geode->getNumDrawables(); dIdx++)
+            target->addDrawable( geode->getDrawable( dIdx ) );
+        removed.insert( geode );
+        group.removeChild( idx, 1 );
+    }
+}
+
+// Move the primitive sets of Geometry that shares arrays and state
+//   with an earlier Geometry in the same Geode into that one.
+static void
+mergeDrawables( osg::Geode& geode )
+{
+    std::vector< osg::Geometry* > targets;
+    unsigned int idx( 0 );
+    while (idx < geode.getNumDrawables())
+    {
+        osg::Geometry* geom = geode.getDrawable( idx )->asGeometry();
+        if ( (geom == NULL) || !canConsolidate( *geom ) )
+        {
+            idx++;
+            continue;
+        }
+
+        unsigned int tIdx;
+        for (tIdx=0; tIdx<targets.size(); tIdx++)
+            if (sameArrays( *targets[ tIdx ], *geom ))
+                break;
+        if (tIdx == targets.size())
+        {
+            // A Geometry used elsewhere can't take on more
+            //   primitives.
+            if (geom->getNumParents() == 1)
+                targets.push_back( geom );
+            idx++;
+            continue;
+        }
+
+        unsigned int pIdx;
+        for (pIdx=0; pIdx<geom->getNumPrimitiveSets(); pIdx++)
+            targets[ tIdx ]->addPrimitiveSet( geom->getPrimitiveSet( pIdx ) );
+        geode.removeDrawables( idx, 1 );
+    }
+}
+
+// Rewrite geom's primitive sets as one triangle list, reordered for
+//   the vertex cache, plus one set each for POINTS and LINES.
+//   Other line modes are kept as they are.
+static void
+consolidatePrimitives( osg::Geometry& geom )
+{
+    IndexList tris, points, lines;
+    osg::Geometry::PrimitiveSetList kept;
+    unsigned int numTriangleSets( 0 ), numPointSets( 0 ), numLineSets( 0 );
+    unsigned int idx;
+    for (idx=0; idx<geom.getNumPrimitiveSets(); idx++)
+    {
+        osg::PrimitiveSet* ps = geom.getPrimitiveSet( idx );
+        const GLenum mode = ps->getMode();
+        IndexList* dest( NULL );
+        if (isTriangleMode( mode ))
+            numTriangleSets++;
+        else if (mode == osg::PrimitiveSet::POINTS)
+        {
+            numPointSets++;
+            dest = &points;
+        }
+        else if (mode == osg::PrimitiveSet::LINES)
+        {
+            numLineSets++;
+            dest = &lines;
+        }
+        else
+        {
+            kept.push_back( ps );
+            continue;
+        }
+
+        if (dest == NULL)
+            appendTriangles( *ps, tris );
+        else
+            appendIndices( *ps, *dest );
+    }
+
+    // Keep sets that are already a single set of their kind, unless
+    //   they're triangles, which always benefit from reordering.
+    if ( (numTriangleSets == 0) && (numPointSets < 2) && (numLineSets < 2) )
+        return;
+
+    osg::Geometry::PrimitiveSetList primitives( kept );
+    if (!points.empty())
+        primitives.push_back( createDrawElements( osg::PrimitiveSet::POINTS, points ) );
+    if (!lines.empty())
+        primitives.push_back( createDrawElements( osg::PrimitiveSet::LINES, lines ) );
+    if (!tris.empty())
+    {
+        optimizeVertexCache( tris, geom.getVertexArray()->getNumElements() );
+        primitives.push_back( createDrawElements( osg::PrimitiveSet::TRIANGLES, tris ) );
+    }
+    geom.setPrimitiveSetList( primitives );
+    geom.dirtyDisplayList();
+    geom.dirtyBound();
+}
+
+ConsolidationReport
+consolidateGeometry( osg::Node* root, unsigned int cacheSize )
+{
+    ConsolidationReport report;
+    if (root == NULL)
+        return( report );
+    if (cacheSize == 0)
+        cacheSize = 1;
+
+    GeometryCollector before( cacheSize );
+    root->accept( before );
+    report._before = before._counts;
+
+    std::set< osg::Node* > removed;
+    unsigned int idx;
+    for (idx=0; idx<before._groups.size(); idx++)
+        mergeGeodes( *( before._groups[ idx ] ), removed );
+
+    std::set< osg::Geometry* > done;
+    for (idx=0; idx<before._geodes.size(); idx++)
+    {
+        osg::Geode& geode = *( before._geodes[ idx ] );
+        if (removed.find( &geode ) != removed.end())
+            continue;
+        mergeDrawables( geode );
+
+        unsigned int dIdx;
+        for (dIdx=0; dIdx<geode.getNumDrawables(); dIdx++)
+        {
+            osg::Geometry* geom = geode.getDrawable( dIdx )->asGeometry();
+            if ( (geom != NULL) && canConsolidate( *geom ) &&
+                    done.insert( geom ).second )
+                consolidatePrimitives( *geom );
+        }
+    }
+
+    GeometryCollector after( cacheSize );
+    root->accept( after );
+    report._after = after._counts;
+    return( report );
+}
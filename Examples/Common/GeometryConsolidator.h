@@ -0,0 +1,92 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// Merges fragmented Geometry into fewer, vertex cache friendly draws
+
+#ifndef __GEOMETRY_CONSOLIDATOR_H__
+#define __GEOMETRY_CONSOLIDATOR_H__
+
+#include <osg/Node>
+#include <osg/PrimitiveSet>
+#include <vector>
+
+// Counts of distinct objects in a scene graph. Each primitive set
+//   is one draw call. _cacheMisses is the number of vertices a
+//   post-transform cache (a FIFO of the size passed to
+//   consolidateGeometry()) would have to transform to draw the
+//   triangles, with the cache emptied before each draw.
+struct GeometryCounts
+{
+    GeometryCounts();
+
+    // Average cache miss ratio: vertices transformed per triangle.
+    //   Lower is better; 0.5 is the ideal for a large grid.
+    double getACMR() const;
+
+    unsigned int _geodes;
+    unsigned int _drawables;
+    unsigned int _primitiveSets;
+    unsigned int _triangles;
+    unsigned int _cacheMisses;
+};
+
+struct ConsolidationReport
+{
+    GeometryCounts _before;
+    GeometryCounts _after;
+};
+
+// Reduce the number of drawables and draw calls under root:
+//
+// - Sibling Geodes with no StateSet, name or callbacks merge into
+//   one Geode, except under a Switch, LOD or Sequence.
+// - Geometry objects in one Geode that share their StateSet and
+//   all of their vertex arrays merge into one Geometry.
+// - In each Geometry, all triangles, triangle strips and fans,
+//   quads, quad strips and polygons become one indexed triangle
+//   list, and all POINTS and LINES sets become one set each.
+// - Each triangle list is reordered for the post-transform vertex
+//   cache with Tom Forsyth's linear-speed algorithm.
+//
+// Geometry with per-primitive bindings, index arrays, callbacks or
+//   user data is left alone.
+ConsolidationReport consolidateGeometry( osg::Node* root,
+    unsigned int cacheSize=16 );
+
+
+// The building blocks of consolidateGeometry(), for passes that
+//   rewrite primitive sets themselves.
+
+// Append the triangles ps draws to tris as a triangle list, with
+//   the winding OpenGL uses, leaving out degenerate triangles. If
+//   numbers isn't NULL, it gets each appended triangle's number,
+//   counting from firstNumber in the order osg::TriangleFunctor
+//   visits them (degenerate ones included). Returns the number of
+//   triangles ps draws, or 0 if it doesn't draw triangles.
+unsigned int appendTriangles( const osg::PrimitiveSet& ps,
+    std::vector< unsigned int >& tris,
+    std::vector< unsigned int >* numbers=NULL, unsigned int firstNumber=0 );
+
+// Append the vertex indices ps sends, in order.
+void appendIndices( const osg::PrimitiveSet& ps,
+    std::vector< unsigned int >& indices );
+
+// Reorder a triangle list for the post-transform vertex cache.
+//   Indices must be less than numVertices. If order isn't NULL, it
+//   gets the original position of each reordered triangle.
+void optimizeVertexCache( std::vector< unsigned int >& tris,
+    unsigned int numVertices, std::vector< unsigned int >* order=NULL );
+
+// True for a Switch, LOD or Sequence, which give meaning to each
+//   child's index, so their children can't be merged or moved.
+bool selectsChildren( const osg::Group& group );
+
+// A DrawElementsUShort if every index fits, otherwise a
+//   DrawElementsUInt.
+osg::DrawElements* createDrawElements( GLenum mode,
+    const std::vector< unsigned int >& indices );
+
+#endif
@@ -0,0 +1,334 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// Rasterized glyph cache for osgText fonts
+
+#include "GlyphCache.h"
+#include "SceneCache.h"
+#include <osg/Timer>
+#include <osg/Notify>
+#include <OpenThreads/Mutex>
+#include <OpenThreads/ScopedLock>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <map>
+#include <vector>
+
+
+// Cache files are a GlyphFileHeader, then for each glyph a
+//   GlyphFileRecord followed by its _dataSize bytes of image data.
+//   Fields are in native byte order; the magic number doesn't match
+//   on a machine with the other order.
+static const unsigned int GlyphMagic( 0x47475351 ); // "QSGG"
+static const unsigned int GlyphVersion( 1 );
+
+struct GlyphFileHeader
+{
+    unsigned int _magic;
+    unsigned int _version;
+    unsigned int _numGlyphs;
+};
+
+struct GlyphFileRecord
+{
+    unsigned int _charcode;
+    int _s, _t;
+    unsigned int _pixelFormat;
+    unsigned int _dataType;
+    unsigned int _packing;
+    unsigned int _dataSize;
+    float _horizontalBearing[ 2 ];
+    float _horizontalAdvance;
+    float _verticalBearing[ 2 ];
+    float _verticalAdvance;
+};
+
+
+// Wraps the FontImplementation readFontFile() created (FreeType,
+//   usually). osgText::Font asks it for each glyph the first time a
+//   Text needs that glyph at some resolution.
+class GlyphCacheImplementation : public osgText::Font::FontImplementation
+{
+public:
+    GlyphCacheImplementation( osgText::Font::FontImplementation* impl,
+        const std::string& fullName )
+      : _impl( impl ),
+        _fullName( fullName )
+    {}
+
+    virtual std::string getFileName() const
+    {
+        return( _impl->getFileName() );
+    }
+    virtual bool supportsMultipleFontResolutions() const
+    {
+        return( _impl->supportsMultipleFontResolutions() );
+    }
+    virtual osgText::Font::Glyph* getGlyph(
+        const osgText::FontResolution& fontRes, unsigned int charcode );
+    virtual osg::Vec2 getKerning( const osgText::FontResolution& fontRes,
+        unsigned int leftcharcode, unsigned int rightcharcode,
+        osgText::KerningType kerningType )
+    {
+        return( _impl->getKerning( fontRes, leftcharcode, rightcharcode, kerningType ) );
+    }
+    virtual bool hasVertical() const
+    {
+        return( _impl->hasVertical() );
+    }
+
+    // Write every resolution with new glyphs.
+    bool write();
+
+protected:
+    virtual ~GlyphCacheImplementation() {}
+
+    struct GlyphRecord
+    {
+        GlyphFileRecord _header;
+        std::vector< unsigned char > _data;
+    };
+    typedef std::map< unsigned int, GlyphRecord > GlyphRecordMap;
+
+    struct ResolutionCache
+    {
+        ResolutionCache() : _loaded( false ), _dirty( false ) {}
+
+        bool _loaded;
+        // Holds glyphs that aren't in the file yet.
+        bool _dirty;
+        GlyphRecordMap _glyphs;
+    };
+    typedef std::map< osgText::FontResolution, ResolutionCache > ResolutionCacheMap;
+
+    std::string getCacheName( const osgText::FontResolution& fontRes ) const;
+    ResolutionCache& getResolutionCache( const osgText::FontResolution& fontRes );
+    bool read( const std::string& cacheName, GlyphRecordMap& glyphs ) const;
+
+    osg::ref_ptr< osgText::Font::FontImplementation > _impl;
+    const std::string _fullName;
+    ResolutionCacheMap _caches;
+    OpenThreads::Mutex _mutex;
+};
+
+std::string
+GlyphCacheImplementation::getCacheName( const osgText::FontResolution& fontRes ) const
+{
+    std::ostringstream extension;
+    extension << fontRes.first << "x" << fontRes.second << ".glyphs";
+    return( getCacheFileName( _fullName, extension.str() ) );
+}
+
+GlyphCacheImplementation::ResolutionCache&
+GlyphCacheImplementation::getResolutionCache( const osgText::FontResolution& fontRes )
+{
+    ResolutionCache& cache = _caches[ fontRes ];
+    if (cache._loaded)
+        return( cache );
+    cache._loaded = true;
+
+    const std::string cacheName = getCacheName( fontRes );
+    if (!isCacheCurrent( cacheName, _fullName ))
+        return( cache );
+    osg::Timer_t start = osg::Timer::instance()->tick();
+    if (read( cacheName, cache._glyphs ))
+        osg::notify( osg::INFO ) << "Read " << cache._glyphs.size() << " glyphs from cache \"" <<
+            cacheName << "\" in " << osg::Timer::instance()->delta_m(
+            start, osg::Timer::instance()->tick() ) << "ms." << std::endl;
+    else
+    {
+        osg::notify( osg::WARN ) << "Unable to read cache file \"" << cacheName <<
+            "\". Rasterizing glyphs from \"" << _fullName << "\" instead." << std::endl;
+        cache._glyphs.clear();
+    }
+    return( cache );
+}
+
+osgText::Font::Glyph*
+GlyphCacheImplementation::getGlyph( const osgText::FontResolution& fontRes,
+    unsigned int charcode )
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _mutex );
+
+    ResolutionCache& cache = getResolutionCache( fontRes );
+    GlyphRecordMap::const_iterator it = cache._glyphs.find( charcode );
+    if (it != cache._glyphs.end())
+    {
+        // Hit: hand the Font the cached bitmap and metrics. The Font
+        //   keeps the Glyph, so this happens once per glyph.
+        const GlyphFileRecord& header = it->second._header;
+        osg::ref_ptr< osgText::Font::Glyph > glyph = new osgText::Font::Glyph;
+        glyph->allocateImage( header._s, header._t, 1, header._pixelFormat,
+            header._dataType, header._packing );
+        glyph->setInternalTextureFormat( header._pixelFormat );
+        if (header._dataSize > 0)
+            memcpy( glyph->data(), &( it->second._data[ 0 ] ), header._dataSize );
+        glyph->setHorizontalBearing( osg::Vec2( header._horizontalBearing[ 0 ],
+            header._horizontalBearing[ 1 ] ) );
+        glyph->setHorizontalAdvance( header._horizontalAdvance );
+        glyph->setVerticalBearing( osg::Vec2( header._verticalBearing[ 0 ],
+            header._verticalBearing[ 1 ] ) );
+        glyph->setVerticalAdvance( header._verticalAdvance );
+        addGlyph( fontRes, charcode, glyph.get() );
+        return( glyph.get() );
+    }
+
+    // Miss: rasterize, and keep a copy for the next write().
+    osgText::Font::Glyph* glyph = _impl->getGlyph( fontRes, charcode );
+    if (glyph == NULL)
+        return( NULL );
+
+    GlyphRecord& record = cache._glyphs[ charcode ];
+    GlyphFileRecord& header = record._header;
+    memset( &header, 0, sizeof( header ) );
+    header._charcode = charcode;
+    header._s = glyph->s();
+    header._t = glyph->t();
+    header._pixelFormat = glyph->getPixelFormat();
+    header._dataType = glyph->getDataType();
+    header._packing = glyph->getPacking();
+    header._dataSize = ( glyph->data() != NULL ) ? glyph->getTotalSizeInBytes() : 0;
+    header._horizontalBearing[ 0 ] = glyph->getHorizontalBearing().x();
+    header._horizontalBearing[ 1 ] = glyph->getHorizontalBearing().y();
+    header._horizontalAdvance = glyph->getHorizontalAdvance();
+    header._verticalBearing[ 0 ] = glyph->getVerticalBearing().x();
+    header._verticalBearing[ 1 ] = glyph->getVerticalBearing().y();
+    header._verticalAdvance = glyph->getVerticalAdvance();
+    record._data.assign( glyph->data(), glyph->data() + header._dataSize );
+    cache._dirty = true;
+
+    return( glyph );
+}
+
+bool
+GlyphCacheImplementation::read( const std::string& cacheName, GlyphRecordMap& glyphs ) const
+{
+    FILE* fp = fopen( cacheName.c_str(), "rb" );
+    if (fp == NULL)
+        return( false );
+
+    GlyphFileHeader header;
+    bool ok = ( (fread( &header, sizeof( header ), 1, fp ) == 1) &&
+        (header._magic == GlyphMagic) && (header._version == GlyphVersion) );
+    unsigned int idx;
+    for (idx=0; ok && (idx<header._numGlyphs); idx++)
+    {
+        GlyphFileRecord fileRecord;
+        ok = ( (fread( &fileRecord, sizeof( fileRecord ), 1, fp ) == 1) &&
+            (fileRecord._s >= 0) && (fileRecord._t >= 0) &&
+            (fileRecord._dataSize <= (unsigned int)( fileRecord._s * fileRecord._t * 4 )) );
+        if (!ok)
+            break;
+        GlyphRecord& record = glyphs[ fileRecord._charcode ];
+        record._header = fileRecord;
+        record._data.resize( fileRecord._dataSize );
+        if (fileRecord._dataSize > 0)
+            ok = (fread( &( record._data[ 0 ] ), 1, fileRecord._dataSize, fp ) ==
+                fileRecord._dataSize);
+    }
+    fclose( fp );
+    return( ok );
+}
+
+bool
+GlyphCacheImplementation::write()
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _mutex );
+
+    bool result( true );
+    ResolutionCacheMap::iterator it;
+    for (it=_caches.begin(); it!=_caches.end(); it++)
+    {
+        ResolutionCache& cache = it->second;
+        if (!cache._dirty)
+            continue;
+
+        // Write a temporary file and rename it, so another process
+        //   never reads a partly written file.
+        const std::string cacheName = getCacheName( it->first );
+        const std::string tempName = cacheName + ".tmp";
+        FILE* fp = fopen( tempName.c_str(), "wb" );
+        bool ok = (fp != NULL);
+        if (ok)
+        {
+            GlyphFileHeader header;
+            header._magic = GlyphMagic;
+            header._version = GlyphVersion;
+            header._numGlyphs = cache._glyphs.size();
+            ok = (fwrite( &header, sizeof( header ), 1, fp ) == 1);
+
+            GlyphRecordMap::const_iterator git;
+            for (git=cache._glyphs.begin(); ok && (git!=cache._glyphs.end()); git++)
+            {
+                const GlyphRecord& record = git->second;
+                ok = (fwrite( &( record._header ), sizeof( record._header ), 1, fp ) == 1);
+                if (ok && !record._data.empty())
+                    ok = (fwrite( &( record._data[ 0 ] ), 1, record._data.size(), fp ) ==
+                        record._data.size());
+            }
+            ok = (fclose( fp ) == 0) && ok;
+#ifdef _WIN32
+            remove( cacheName.c_str() );
+#endif
+            if (!ok || (rename( tempName.c_str(), cacheName.c_str() ) != 0))
+            {
+                remove( tempName.c_str() );
+                ok = false;
+            }
+        }
+
+        if (ok)
+        {
+            cache._dirty = false;
+            osg::notify( osg::INFO ) << "Wrote " << cache._glyphs.size() <<
+                " glyphs to cache \"" << cacheName << "\"." << std::endl;
+        }
+        else
+        {
+            osg::notify( osg::WARN ) << "Unable to write cache file \"" <<
+                cacheName << "\"." << std::endl;
+            result = false;
+        }
+    }
+    return( result );
+}
+
+
+osgText::Font*
+readCachedFontFile( const std::string& fileName )
+{
+    osg::ref_ptr< osgText::Font > font = osgText::readFontFile( fileName );
+    if (!font.valid())
+        return( NULL );
+
+    const std::string fullName = osgText::findFontFile( fileName );
+    osgText::Font::FontImplementation* impl = font->getImplementation();
+    if (fullName.empty() || (impl == NULL))
+        // The default font, or a font without glyphs to cache.
+        return( font.release() );
+
+    // setImplementation() clears the facade of the implementation
+    //   it replaces, but the wrapped implementation still adds its
+    //   glyphs to this Font.
+    osg::ref_ptr< osgText::Font::FontImplementation > wrapped = impl;
+    font->setImplementation( new GlyphCacheImplementation( wrapped.get(), fullName ) );
+    wrapped->_facade = font.get();
+
+    return( font.release() );
+}
+
+bool
+writeGlyphCache( osgText::Font* font )
+{
+    if (font == NULL)
+        return( false );
+    GlyphCacheImplementation* impl =
+        dynamic_cast< GlyphCacheImplementation* >( font->getImplementation() );
+    if (impl == NULL)
+        return( false );
+    return( impl->write() );
+}
@@ -0,0 +1,32 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// Rasterized glyph cache for osgText fonts
+
+#ifndef __GLYPH_CACHE_H__
+#define __GLYPH_CACHE_H__
+
+#include <osgText/Font>
+#include <string>
+
+// Load a font file the same way osgText::readFontFile() does, but
+//   serve its glyphs from cache files in the scene cache directory
+//   (see SceneCache.h) where possible, instead of rasterizing them
+//   with FreeType. There is one cache file per font file and font
+//   resolution, holding every glyph rasterized at that resolution
+//   so far; glyphs not in it are rasterized as usual and added to
+//   it by writeGlyphCache(). A font file newer than its cache files
+//   makes them stale.
+osgText::Font* readCachedFontFile( const std::string& fileName );
+
+// Write the cache files of a font from readCachedFontFile() for
+//   every resolution that rasterized new glyphs since it was read
+//   or last written. Call it once the Text drawables have their
+//   strings. Returns false if the font isn't from
+//   readCachedFontFile(), or a cache file couldn't be written.
+bool writeGlyphCache( osgText::Font* font );
+
+#endif
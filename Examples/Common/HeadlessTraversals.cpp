@@ -0,0 +1,178 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// Update, cull and intersection without a window
+
+#include "HeadlessTraversals.h"
+#include <osgUtil/IntersectionVisitor>
+#include <osgUtil/LineSegmentIntersector>
+#include <osgUtil/RenderLeaf>
+#include <cmath>
+
+
+// Count the render leaves in a culled render graph.
+static unsigned int
+countLeaves( const osgUtil::StateGraph& sg )
+{
+    unsigned int count = sg._leaves.size();
+    osgUtil::StateGraph::ChildList::const_iterator it;
+    for (it=sg._children.begin(); it!=sg._children.end(); it++)
+        count += countLeaves( *(it->second) );
+    return( count );
+}
+
+// Radical inverse in base b; spreads the ray positions evenly
+//   over the view without any randomness between runs.
+static double
+halton( unsigned int index, unsigned int b )
+{
+    double result( 0. ), f( 1. );
+    for (index++; index > 0; index /= b)
+    {
+        f /= b;
+        result += f * ( index % b );
+    }
+    return( result );
+}
+
+
+HeadlessTraversals::HeadlessTraversals( osg::Node* scene,
+    unsigned int width, unsigned int height )
+  : _scene( scene )
+{
+    _viewport = new osg::Viewport( 0, 0, width, height );
+    _frameStamp = new osg::FrameStamp;
+    _frameStamp->setFrameNumber( 0 );
+    _frameStamp->setReferenceTime( 0. );
+    _frameStamp->setSimulationTime( 0. );
+
+    // Back away along -Y until the bounding sphere fits in the
+    //   narrower field of view.
+    const double fovy( 30. );
+    const double aspect = (double)width / (double)height;
+    const osg::BoundingSphere& bs = _scene->getBound();
+    const double radius = (bs.radius() > 0.f) ? bs.radius() : 1.;
+    const double halfFov = osg::DegreesToRadians( fovy * .5 ) *
+            ( (aspect < 1.) ? aspect : 1. );
+    const double distance = radius / sin( halfFov );
+    const osg::Vec3d center( bs.center() );
+
+    _camera = new osg::Camera;
+    _camera->setViewport( _viewport.get() );
+    _camera->setViewMatrixAsLookAt( center - osg::Vec3d( 0., distance, 0. ),
+            center, osg::Vec3d( 0., 0., 1. ) );
+    _camera->setProjectionMatrixAsPerspective( fovy, aspect,
+            distance - radius * 1.01, distance + radius * 1.01 );
+    // The intersection visitor starts at the camera.
+    _camera->addChild( _scene.get() );
+
+    _updateVisitor = new osgUtil::UpdateVisitor;
+    _cullVisitor = new osgUtil::CullVisitor;
+    _stateGraph = new osgUtil::StateGraph;
+    _renderStage = new osgUtil::RenderStage;
+}
+
+HeadlessTraversals::~HeadlessTraversals()
+{
+    _camera->removeChild( _scene.get() );
+}
+
+void
+HeadlessTraversals::update()
+{
+    const int frame = _frameStamp->getFrameNumber() + 1;
+    _frameStamp->setFrameNumber( frame );
+    _frameStamp->setReferenceTime( frame / 60. );
+    _frameStamp->setSimulationTime( frame / 60. );
+
+    _updateVisitor->reset();
+    _updateVisitor->setFrameStamp( _frameStamp.get() );
+    _updateVisitor->setTraversalNumber( frame );
+    _scene->accept( *_updateVisitor );
+}
+
+unsigned int
+HeadlessTraversals::cull()
+{
+    // Follows osgUtil::SceneView::cullStage(), without the parts
+    //   that need a graphics context.
+    _stateGraph->clean();
+    _renderStage->reset();
+    _renderStage->setViewport( _viewport.get() );
+
+    _cullVisitor->reset();
+    _cullVisitor->setFrameStamp( _frameStamp.get() );
+    _cullVisitor->setTraversalNumber( _frameStamp->getFrameNumber() );
+    _cullVisitor->setStateGraph( _stateGraph.get() );
+    _cullVisitor->setRenderStage( _renderStage.get() );
+
+    _cullVisitor->pushViewport( _viewport.get() );
+    _cullVisitor->pushProjectionMatrix(
+            new osg::RefMatrix( _camera->getProjectionMatrix() ) );
+    _cullVisitor->pushModelViewMatrix(
+            new osg::RefMatrix( _camera->getViewMatrix() ),
+            osg::Transform::ABSOLUTE_RF );
+    if (_batchCuller.valid())
+        _batchCuller->cull( *_cullVisitor );
+    else
+        _scene->accept( *_cullVisitor );
+    _cullVisitor->popModelViewMatrix();
+    _cullVisitor->popProjectionMatrix();
+    _cullVisitor->popViewport();
+
+    _renderStage->sort();
+    _stateGraph->prune();
+    return( countLeaves( *_stateGraph ) );
+}
+
+void
+HeadlessTraversals::setBatchCulling( bool enable )
+{
+    if (!enable)
+        _batchCuller = NULL;
+    else if (!_batchCuller.valid())
+        _batchCuller = new BatchCuller( _scene.get() );
+}
+
+void
+HeadlessTraversals::setOcclusionCulling( bool enable )
+{
+    if (enable)
+    {
+        setBatchCulling( true );
+        if (_batchCuller->getOcclusionCuller() == NULL)
+            _batchCuller->setOcclusionCuller( new OcclusionCuller );
+    }
+    else if (_batchCuller.valid())
+        _batchCuller->setOcclusionCuller( NULL );
+}
+
+unsigned int
+HeadlessTraversals::intersect( unsigned int numRays,
+    std::vector< double >* ratios )
+{
+    if (ratios != NULL)
+        ratios->clear();
+    unsigned int numHits( 0 );
+    unsigned int idx;
+    for (idx=0; idx<numRays; idx++)
+    {
+        // Keep the rays off the very edge of the view.
+        const double x = ( halton( idx, 2 ) * 2. - 1. ) * .9;
+        const double y = ( halton( idx, 3 ) * 2. - 1. ) * .9;
+        osg::ref_ptr<osgUtil::LineSegmentIntersector> lsi =
+                new osgUtil::LineSegmentIntersector(
+                    osgUtil::Intersector::PROJECTION, x, y );
+        osgUtil::IntersectionVisitor iv( lsi.get() );
+        _camera->accept( iv );
+        if (lsi->containsIntersections())
+            numHits++;
+        if (ratios != NULL)
+            ratios->push_back( lsi->containsIntersections() ?
+                lsi->getFirstIntersection().ratio : -1. );
+    }
+    return( numHits );
+}
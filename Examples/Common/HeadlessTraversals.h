@@ -0,0 +1,75 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// Update, cull and intersection without a window
+
+#ifndef __HEADLESS_TRAVERSALS_H__
+#define __HEADLESS_TRAVERSALS_H__
+
+#include "BatchCuller.h"
+#include <osg/Node>
+#include <osg/Camera>
+#include <osg/FrameStamp>
+#include <osg/Viewport>
+#include <osgUtil/UpdateVisitor>
+#include <osgUtil/CullVisitor>
+#include <osgUtil/StateGraph>
+#include <osgUtil/RenderStage>
+#include <vector>
+
+// Runs the traversals osgViewer would run each frame, except draw,
+//   over one scene and a fixed camera. No window or graphics context
+//   is created, so this works on machines without a GPU. The camera
+//   looks along +Y at the scene's bounding sphere, which fills the
+//   view.
+class HeadlessTraversals
+{
+public:
+    HeadlessTraversals( osg::Node* scene,
+        unsigned int width=1024, unsigned int height=768 );
+    ~HeadlessTraversals();
+
+    // Advance the frame stamp and run an update traversal.
+    void update();
+
+    // Run a cull traversal into a fresh render graph, the way
+    //   osgUtil::SceneView does, and return the number of
+    //   drawables that survived culling.
+    unsigned int cull();
+
+    // Cull with a BatchCuller instead of visiting the scene node by
+    //   node. The scene is gathered when this is turned on.
+    void setBatchCulling( bool enable );
+    BatchCuller* getBatchCuller() { return( _batchCuller.get() ); }
+    // Also test the leaves in the frustum against a software depth
+    //   buffer of the nearest ones. Turns batch culling on; turning
+    //   this off leaves batch culling on.
+    void setOcclusionCulling( bool enable );
+
+    // Intersect numRays rays through fixed points in the view with
+    //   the scene, and return the number that hit something. If
+    //   ratios isn't NULL, it gets each ray's nearest hit as a
+    //   fraction of the ray, or -1 for a miss.
+    unsigned int intersect( unsigned int numRays,
+        std::vector< double >* ratios=NULL );
+
+    osg::Camera* getCamera() { return( _camera.get() ); }
+    osgUtil::CullVisitor* getCullVisitor() { return( _cullVisitor.get() ); }
+
+protected:
+    osg::ref_ptr<osg::Node> _scene;
+    osg::ref_ptr<osg::Camera> _camera;
+    osg::ref_ptr<osg::Viewport> _viewport;
+    osg::ref_ptr<osg::FrameStamp> _frameStamp;
+
+    osg::ref_ptr<osgUtil::UpdateVisitor> _updateVisitor;
+    osg::ref_ptr<osgUtil::CullVisitor> _cullVisitor;
+    osg::ref_ptr<osgUtil::StateGraph> _stateGraph;
+    osg::ref_ptr<osgUtil::RenderStage> _renderStage;
+    osg::ref_ptr<BatchCuller> _batchCuller;
+};
+
+#endif
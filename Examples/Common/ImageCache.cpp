@@ -0,0 +1,484 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// Decoded image cache and background image decoding
+
+#include "ImageCache.h"
+#include "SceneCache.h"
+#include "ParallelLoop.h"
+#include "MipmapGenerator.h"
+#include <osgDB/FileUtils>
+#include <osg/Timer>
+#include <osg/Notify>
+#include <OpenThreads/Thread>
+#include <OpenThreads/ScopedLock>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <sstream>
+#include <map>
+#include <vector>
+#ifdef _WIN32
+#  include <fstream>
+#else
+#  include <sys/types.h>
+#  include <sys/stat.h>
+#  include <sys/mman.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+
+
+// Cache files are this header, padding up to DataOffset, and then
+//   the image data with all of its mipmap levels, exactly as
+//   osg::Image holds them. Fields are in native byte order; the
+//   magic number doesn't match on a machine with the other order.
+static const unsigned int CacheMagic( 0x49475351 ); // "QSGI"
+static const unsigned int CacheVersion( 2 );
+static const unsigned int MaxMipmapLevels( 32 );
+// Keeps the data aligned for SIMD loads in the mapping.
+static const unsigned int DataOffset( 256 );
+
+struct CacheHeader
+{
+    unsigned int _magic;
+    unsigned int _version;
+    int _s, _t, _r;
+    int _internalTextureFormat;
+    unsigned int _pixelFormat;
+    unsigned int _dataType;
+    unsigned int _packing;
+    unsigned int _dataSize;
+    // The MipmapOptions the mipmaps were made with.
+    unsigned int _gammaCorrect;
+    float _alphaCutoff;
+    // Offsets of mipmap levels 1 and up, as
+    //   osg::Image::MipmapDataType holds them.
+    unsigned int _numMipmapOffsets;
+    unsigned int _mipmapOffsets[ MaxMipmapLevels ];
+};
+
+
+// An Image whose data is a private mapping of a cache file.
+class MappedImage : public osg::Image
+{
+public:
+    MappedImage( void* base, unsigned int size )
+      : _base( base ), _size( size ) {}
+
+protected:
+    // osg::Image's destructor leaves NO_DELETE data alone.
+    virtual ~MappedImage()
+    {
+#ifdef _WIN32
+        delete[] (char*)_base;
+#else
+        munmap( _base, _size );
+#endif
+    }
+
+    void* _base;
+    unsigned int _size;
+};
+
+
+// The mipmap options in an image read's option string.
+static MipmapOptions
+getMipmapOptions( const osgDB::ReaderWriter::Options* options )
+{
+    MipmapOptions mipmapOptions;
+    if (options == NULL)
+        return( mipmapOptions );
+
+    std::istringstream in( options->getOptionString() );
+    std::string token;
+    while (in >> token)
+    {
+        if (token == "mipmapNoGamma")
+            mipmapOptions._gammaCorrect = false;
+        else if (token.compare( 0, 18, "mipmapAlphaCutoff=" ) == 0)
+            mipmapOptions._alphaCutoff = (float)atof( token.c_str() + 18 );
+    }
+    return( mipmapOptions );
+}
+
+static bool
+writeImageCache( const osg::Image& image, const std::string& cacheName,
+    const MipmapOptions& mipmapOptions )
+{
+    const osg::Image::MipmapDataType& mipmaps = image.getMipmapLevels();
+    if (mipmaps.size() > MaxMipmapLevels)
+        return( false );
+
+    CacheHeader header;
+    memset( &header, 0, sizeof( header ) );
+    header._magic = CacheMagic;
+    header._version = CacheVersion;
+    header._s = image.s();
+    header._t = image.t();
+    header._r = image.r();
+    header._internalTextureFormat = image.getInternalTextureFormat();
+    header._pixelFormat = image.getPixelFormat();
+    header._dataType = image.getDataType();
+    header._packing = image.getPacking();
+    header._dataSize = image.getTotalSizeInBytesIncludingMipmaps();
+    header._gammaCorrect = mipmapOptions._gammaCorrect ? 1 : 0;
+    header._alphaCutoff = mipmapOptions._alphaCutoff;
+    header._numMipmapOffsets = mipmaps.size();
+    unsigned int idx;
+    for (idx=0; idx<mipmaps.size(); idx++)
+        header._mipmapOffsets[ idx ] = mipmaps[ idx ];
+
+    // Write a temporary file and rename it, so another process never
+    //   maps a partly written entry.
+    const std::string tempName = cacheName + ".tmp";
+    FILE* fp = fopen( tempName.c_str(), "wb" );
+    if (fp == NULL)
+        return( false );
+    char pad[ DataOffset ];
+    memset( pad, 0, DataOffset );
+    memcpy( pad, &header, sizeof( header ) );
+    bool ok = ( (fwrite( pad, 1, DataOffset, fp ) == DataOffset) &&
+        (fwrite( image.data(), 1, header._dataSize, fp ) == header._dataSize) );
+    ok = (fclose( fp ) == 0) && ok;
+#ifdef _WIN32
+    remove( cacheName.c_str() );
+#endif
+    if (!ok || (rename( tempName.c_str(), cacheName.c_str() ) != 0))
+    {
+        remove( tempName.c_str() );
+        return( false );
+    }
+    return( true );
+}
+
+// Return the cached image, or NULL if the entry is missing,
+//   doesn't look like one this code wrote, or has mipmaps made with
+//   other options.
+static osg::Image*
+readImageCache( const std::string& cacheName, const MipmapOptions& mipmapOptions )
+{
+    void* base;
+    unsigned int size;
+#ifdef _WIN32
+    std::ifstream in( cacheName.c_str(), std::ios::in | std::ios::binary );
+    if (!in.good())
+        return( NULL );
+    in.seekg( 0, std::ios::end );
+    size = (unsigned int)in.tellg();
+    in.seekg( 0, std::ios::beg );
+    if (size < DataOffset)
+        return( NULL );
+    base = new char[ size ];
+    in.read( (char*)base, size );
+    if (!in.good())
+    {
+        delete[] (char*)base;
+        return( NULL );
+    }
+#else
+    const int fd = open( cacheName.c_str(), O_RDONLY );
+    if (fd < 0)
+        return( NULL );
+    struct stat s;
+    if ( (fstat( fd, &s ) != 0) || (s.st_size < (off_t)DataOffset) )
+    {
+        close( fd );
+        return( NULL );
+    }
+    size = (unsigned int)s.st_size;
+    // A private, writable mapping: pages are shared with the page
+    //   cache until something, such as flipVertical(), writes to
+    //   them, and writes never reach the file.
+    base = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0 );
+    // The mapping stays valid after the file is closed.
+    close( fd );
+    if (base == MAP_FAILED)
+        return( NULL );
+#endif
+
+    // Hold the mapping in an Image right away, so every return
+    //   below releases it.
+    osg::ref_ptr< MappedImage > image = new MappedImage( base, size );
+
+    CacheHeader header;
+    memcpy( &header, base, sizeof( header ) );
+    if ( (header._magic != CacheMagic) || (header._version != CacheVersion) ||
+            (header._numMipmapOffsets > MaxMipmapLevels) ||
+            (header._dataSize > size - DataOffset) )
+        return( NULL );
+    if ( (header._numMipmapOffsets > 0) &&
+            ( ( (header._gammaCorrect != 0) != mipmapOptions._gammaCorrect ) ||
+            (header._alphaCutoff != mipmapOptions._alphaCutoff) ) )
+        return( NULL );
+
+    unsigned char* data = (unsigned char*)base + DataOffset;
+    image->setImage( header._s, header._t, header._r, header._internalTextureFormat,
+        header._pixelFormat, header._dataType, data, osg::Image::NO_DELETE,
+        header._packing );
+    if (header._numMipmapOffsets > 0)
+    {
+        osg::Image::MipmapDataType mipmaps( header._mipmapOffsets,
+            header._mipmapOffsets + header._numMipmapOffsets );
+        image->setMipmapLevels( mipmaps );
+    }
+    if (image->getTotalSizeInBytesIncludingMipmaps() != header._dataSize)
+        return( NULL );
+    return( image.release() );
+}
+
+osg::Image*
+readCachedImageFile( const std::string& fileName,
+    const osgDB::ReaderWriter::Options* options )
+{
+    const std::string fullName = osgDB::findDataFile( fileName, options );
+    if (fullName.empty())
+    {
+        osg::notify( osg::WARN ) << "Unable to find image file \"" <<
+            fileName << "\"." << std::endl;
+        return( NULL );
+    }
+
+    const std::string cacheName = getCacheFileName( fullName, "qsgi" );
+    const MipmapOptions mipmapOptions = getMipmapOptions( options );
+    osg::Timer_t start = osg::Timer::instance()->tick();
+
+    // Warm start: the cache is at least as new as the source.
+    if (isCacheCurrent( cacheName, fullName ))
+    {
+        osg::ref_ptr< osg::Image > image = readImageCache( cacheName, mipmapOptions );
+        if (image.valid())
+        {
+            image->setFileName( fileName );
+            osg::notify( osg::INFO ) << "Mapped \"" << fileName << "\" from cache \"" <<
+                cacheName << "\" in " << osg::Timer::instance()->delta_m(
+                start, osg::Timer::instance()->tick() ) << "ms." << std::endl;
+            return( image.release() );
+        }
+        osg::notify( osg::INFO ) << "Cache file \"" << cacheName <<
+            "\" is unreadable or has other mipmaps. Decoding \"" << fullName <<
+            "\" instead." << std::endl;
+    }
+
+    // Cold start, or stale cache. Read with the Registry directly,
+    //   so an installed CachedImageReadCallback doesn't send the
+    //   read back here.
+    osg::ref_ptr< osg::Image > image = osgDB::Registry::instance()->
+        readImageImplementation( fullName, options ).takeImage();
+    if (!image.valid())
+        return( NULL );
+    generateMipmaps( *image, mipmapOptions );
+    image->setFileName( fileName );
+    osg::notify( osg::INFO ) << "Decoded \"" << fullName << "\" in " <<
+        osg::Timer::instance()->delta_m( start, osg::Timer::instance()->tick() ) <<
+        "ms." << std::endl;
+
+    if (!writeImageCache( *image, cacheName, mipmapOptions ))
+        osg::notify( osg::WARN ) << "Unable to write cache file \"" <<
+            cacheName << "\"." << std::endl;
+
+    return( image.release() );
+}
+
+
+ImageRequest::ImageRequest( const std::string& fileName )
+  : _fileName( fileName ),
+    _done( false )
+{
+}
+
+bool
+ImageRequest::isDone() const
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _mutex );
+    return( _done );
+}
+
+osg::Image*
+ImageRequest::getImage()
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _mutex );
+    while (!_done)
+        _condition.wait( &_mutex );
+    return( _image.get() );
+}
+
+void
+ImageRequest::complete( osg::Image* image )
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _mutex );
+    _image = image;
+    _done = true;
+    _condition.broadcast();
+}
+
+
+// Decode threads that run until the program exits, taking requests
+//   in the order they were queued.
+class ImageDecodePool
+{
+public:
+    ImageDecodePool()
+      : _quit( false )
+    {
+        const unsigned int numThreads = getDefaultThreadCount();
+        unsigned int idx;
+        for (idx=0; idx<numThreads; idx++)
+        {
+            DecodeThread* thread = new DecodeThread( *this );
+            thread->start();
+            _threads.push_back( thread );
+        }
+    }
+    ~ImageDecodePool()
+    {
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _mutex );
+            _quit = true;
+            _condition.broadcast();
+        }
+        unsigned int idx;
+        for (idx=0; idx<_threads.size(); idx++)
+        {
+            _threads[ idx ]->join();
+            delete _threads[ idx ];
+        }
+    }
+
+    // Returns a reference taken under the lock, as a decode thread
+    //   may finish the request and let go of it at any time after.
+    osg::ref_ptr< ImageRequest > add( const std::string& fileName,
+        const osgDB::ReaderWriter::Options* options )
+    {
+        // Key on the full path, so different names for one file
+        //   share a request, and on the options, which can change
+        //   the mipmaps.
+        std::string key = osgDB::findDataFile( fileName, options );
+        if (key.empty())
+            key = fileName;
+        if (options != NULL)
+            key += "\n" + options->getOptionString();
+
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _mutex );
+        std::map< std::string, osg::ref_ptr< ImageRequest > >::iterator it =
+                _pending.find( key );
+        if (it != _pending.end())
+            return( it->second );
+
+        Job job;
+        job._key = key;
+        job._request = new ImageRequest( fileName );
+        job._options = options;
+        _pending[ key ] = job._request;
+        _queue.push_back( job );
+        _condition.signal();
+        return( job._request );
+    }
+
+    // Each decode thread runs this until the pool is destroyed.
+    void work();
+
+protected:
+    struct Job
+    {
+        std::string _key;
+        osg::ref_ptr< ImageRequest > _request;
+        osg::ref_ptr< const osgDB::ReaderWriter::Options > _options;
+    };
+
+    class DecodeThread : public OpenThreads::Thread
+    {
+    public:
+        DecodeThread( ImageDecodePool& pool ) : _pool( pool ) {}
+
+        virtual void run() { _pool.work(); }
+
+    protected:
+        ImageDecodePool& _pool;
+    };
+
+    std::vector< DecodeThread* > _threads;
+    std::vector< Job > _queue;
+    std::map< std::string, osg::ref_ptr< ImageRequest > > _pending;
+    bool _quit;
+    OpenThreads::Mutex _mutex;
+    OpenThreads::Condition _condition;
+};
+
+void
+ImageDecodePool::work()
+{
+    while (true)
+    {
+        Job job;
+        std::vector< Job > failed;
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _mutex );
+            while (_queue.empty() && !_quit)
+                _condition.wait( &_mutex );
+            if (_quit)
+            {
+                // Fail whatever is still queued, so that nobody
+                //   waits on it forever.
+                failed.swap( _queue );
+                unsigned int idx;
+                for (idx=0; idx<failed.size(); idx++)
+                    _pending.erase( failed[ idx ]._key );
+            }
+            else
+            {
+                job = _queue.front();
+                _queue.erase( _queue.begin() );
+            }
+        }
+        if (!job._request.valid())
+        {
+            unsigned int idx;
+            for (idx=0; idx<failed.size(); idx++)
+                failed[ idx ]._request->complete( NULL );
+            return;
+        }
+
+        osg::ref_ptr< osg::Image > image = readCachedImageFile(
+            job._request->getFileName(), job._options.get() );
+
+        // Forget the request before completing it; a later
+        //   request for the file reads it again (from the cache).
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _mutex );
+            _pending.erase( job._key );
+        }
+        job._request->complete( image.get() );
+    }
+}
+
+static ImageDecodePool&
+getImageDecodePool()
+{
+    // Created on first use; its destructor stops the threads at exit.
+    static ImageDecodePool pool;
+    return( pool );
+}
+
+osg::ref_ptr< ImageRequest >
+readImageFileAsync( const std::string& fileName,
+    const osgDB::ReaderWriter::Options* options )
+{
+    return( getImageDecodePool().add( fileName, options ) );
+}
+
+
+osgDB::ReaderWriter::ReadResult
+CachedImageReadCallback::readImage( const std::string& fileName,
+    const osgDB::ReaderWriter::Options* options )
+{
+    // The model that wants the image can't go on without it, so
+    //   decode here rather than wait on a decode thread.
+    osg::Image* image = readCachedImageFile( fileName, options );
+    if (image == NULL)
+        return( osgDB::ReaderWriter::ReadResult::FILE_NOT_FOUND );
+    return( osgDB::ReaderWriter::ReadResult( image ) );
+}
@@ -0,0 +1,98 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// Decoded image cache and background image decoding
+
+#ifndef __IMAGE_CACHE_H__
+#define __IMAGE_CACHE_H__
+
+#include <osg/Image>
+#include <osg/Referenced>
+#include <osg/ref_ptr>
+#include <osgDB/Registry>
+#include <OpenThreads/Mutex>
+#include <OpenThreads/Condition>
+#include <string>
+
+// Load an image file the same way osgDB::readImageFile() does, but
+//   keep a decoded copy, with a full mipmap chain, in the scene
+//   cache directory (see SceneCache.h). Later runs map the cached
+//   pixels into memory instead of decoding the PNG, SGI or other
+//   source file again; the returned Image's data is the mapping
+//   itself, and is unmapped when the Image is deleted. A source
+//   file newer than its cache entry is decoded and cached again.
+//
+// Mipmaps are made with generateMipmaps() for the 8-bit formats it
+//   handles (see MipmapGenerator.h). Other images are cached without
+//   them, and OpenGL generates them as usual. options is used to
+//   find the file, as readImageFile() would, and its option string
+//   can change the MipmapOptions:
+//
+//   mipmapNoGamma            average the stored values, not sRGB
+//   mipmapAlphaCutoff=<ref>  keep the coverage of AlphaFunc GREATER
+//                            <ref> in every level
+//
+//   A cache entry made with other mipmap options is made again.
+osg::Image* readCachedImageFile( const std::string& fileName,
+    const osgDB::ReaderWriter::Options* options=NULL );
+
+
+// The result of readImageFileAsync(), filled in by a decode
+//   thread.
+class ImageRequest : public osg::Referenced
+{
+public:
+    ImageRequest( const std::string& fileName );
+
+    const std::string& getFileName() const { return( _fileName ); }
+
+    // True once the image is decoded, or has failed to load.
+    bool isDone() const;
+
+    // Wait until the image is decoded, and return it, or NULL if
+    //   it couldn't be loaded.
+    osg::Image* getImage();
+
+    // Called by the decode thread.
+    void complete( osg::Image* image );
+
+protected:
+    virtual ~ImageRequest() {}
+
+    const std::string _fileName;
+    osg::ref_ptr< osg::Image > _image;
+    bool _done;
+    mutable OpenThreads::Mutex _mutex;
+    OpenThreads::Condition _condition;
+};
+
+// Queue an image file for decoding with readCachedImageFile() on
+//   a pool of decode threads (getDefaultThreadCount() of them), and
+//   return at once. Requests for a file that is already queued or
+//   decoding share one ImageRequest. If the pool shuts down at exit
+//   before decoding a request, the request completes without an
+//   image.
+osg::ref_ptr< ImageRequest > readImageFileAsync( const std::string& fileName,
+    const osgDB::ReaderWriter::Options* options=NULL );
+
+
+// Routes every image read through readCachedImageFile(), including
+//   the images model files load, such as cow.osg's reflect.rgb. The
+//   image is decoded, or mapped from the cache, on the reading
+//   thread, since the reader needs it before it can return. Install
+//   it with osgDB::Registry::instance()->setReadFileCallback().
+class CachedImageReadCallback : public osgDB::Registry::ReadFileCallback
+{
+public:
+    virtual osgDB::ReaderWriter::ReadResult readImage(
+        const std::string& fileName,
+        const osgDB::ReaderWriter::Options* options );
+
+protected:
+    virtual ~CachedImageReadCallback() {}
+};
+
+#endif
@@ -0,0 +1,476 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// A Group that draws its children once per instance matrix
+
+#include "InstanceGroup.h"
+#include <osg/MatrixTransform>
+#include <osg/Geode>
+#include <osg/NodeVisitor>
+#include <osg/Polytope>
+#include <osgUtil/CullVisitor>
+#include <osgUtil/IntersectionVisitor>
+#include <map>
+#include <set>
+#include <cstring>
+#include <cmath>
+
+
+InstanceGroup::InstanceGroup()
+{
+}
+
+InstanceGroup::InstanceGroup( const InstanceGroup& ig, const osg::CopyOp& copyop )
+  : osg::Group( ig, copyop ),
+    _matrices( ig._matrices ),
+    _stateSets( ig._stateSets )
+{
+}
+
+unsigned int
+InstanceGroup::addInstance( const osg::Matrix& m, osg::StateSet* stateSet )
+{
+    const unsigned int idx = _matrices.size();
+    _matrices.push_back( m );
+    if ( (stateSet != NULL) || !_stateSets.empty() )
+    {
+        _stateSets.resize( _matrices.size() );
+        _stateSets[ idx ] = stateSet;
+    }
+    dirtyBound();
+    return( idx );
+}
+
+void
+InstanceGroup::removeInstance( unsigned int idx )
+{
+    if (idx >= _matrices.size())
+        return;
+    const unsigned int last = _matrices.size() - 1;
+    _matrices[ idx ] = _matrices[ last ];
+    _matrices.pop_back();
+    if (!_stateSets.empty())
+    {
+        _stateSets[ idx ] = _stateSets[ last ];
+        _stateSets.pop_back();
+    }
+    dirtyBound();
+}
+
+void
+InstanceGroup::setMatrix( unsigned int idx, const osg::Matrix& m )
+{
+    _matrices[ idx ] = m;
+    dirtyBound();
+}
+
+osg::StateSet*
+InstanceGroup::getInstanceStateSet( unsigned int idx )
+{
+    return( _stateSets.empty() ? NULL : _stateSets[ idx ].get() );
+}
+
+const osg::StateSet*
+InstanceGroup::getInstanceStateSet( unsigned int idx ) const
+{
+    return( _stateSets.empty() ? NULL : _stateSets[ idx ].get() );
+}
+
+osg::BoundingSphere
+InstanceGroup::getInstanceBound( unsigned int idx ) const
+{
+    if (!getBound().valid())
+        return( osg::BoundingSphere() );
+    return( osg::BoundingSphere( osg::Vec3( _centerX[ idx ],
+            _centerY[ idx ], _centerZ[ idx ] ), _radius[ idx ] ) );
+}
+
+unsigned int
+InstanceGroup::getInstanceDataSize() const
+{
+    return( _matrices.capacity() * sizeof( osg::Matrix ) +
+        _stateSets.capacity() * sizeof( osg::ref_ptr<osg::StateSet> ) +
+        ( _centerX.capacity() + _centerY.capacity() +
+            _centerZ.capacity() + _radius.capacity() ) * sizeof( float ) );
+}
+
+
+osg::BoundingSphere
+InstanceGroup::computeBound() const
+{
+    const osg::BoundingSphere childBound = osg::Group::computeBound();
+    const unsigned int numInstances = _matrices.size();
+    _centerX.resize( numInstances );
+    _centerY.resize( numInstances );
+    _centerZ.resize( numInstances );
+    _radius.resize( numInstances );
+
+    osg::BoundingSphere bs;
+    if (!childBound.valid())
+        return( bs );
+
+    unsigned int idx;
+    for (idx=0; idx<numInstances; idx++)
+    {
+        const osg::Matrix& m = _matrices[ idx ];
+        const osg::Vec3 c = childBound.center() * m;
+
+        // Scale the radius by the longest transformed axis.
+        const double sx = m( 0, 0 ) * m( 0, 0 ) + m( 0, 1 ) * m( 0, 1 ) + m( 0, 2 ) * m( 0, 2 );
+        const double sy = m( 1, 0 ) * m( 1, 0 ) + m( 1, 1 ) * m( 1, 1 ) + m( 1, 2 ) * m( 1, 2 );
+        const double sz = m( 2, 0 ) * m( 2, 0 ) + m( 2, 1 ) * m( 2, 1 ) + m( 2, 2 ) * m( 2, 2 );
+        double s = ( sx > sy ) ? sx : sy;
+        if (sz > s)
+            s = sz;
+        const float r = childBound.radius() * (float)sqrt( s );
+
+        _centerX[ idx ] = c.x();
+        _centerY[ idx ] = c.y();
+        _centerZ[ idx ] = c.z();
+        _radius[ idx ] = r;
+        bs.expandBy( osg::BoundingSphere( c, r ) );
+    }
+    return( bs );
+}
+
+
+void
+InstanceGroup::traverse( osg::NodeVisitor& nv )
+{
+    switch( nv.getVisitorType() )
+    {
+        case osg::NodeVisitor::UPDATE_VISITOR:
+        case osg::NodeVisitor::EVENT_VISITOR:
+            // Callbacks below here run once, not once per instance.
+            osg::Group::traverse( nv );
+            return;
+
+        case osg::NodeVisitor::CULL_VISITOR:
+            if (dynamic_cast<osgUtil::CullVisitor*>( &nv ) != NULL)
+            {
+                cullInstances( nv );
+                return;
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    osgUtil::IntersectionVisitor* iv = dynamic_cast<osgUtil::IntersectionVisitor*>( &nv );
+    if (iv != NULL)
+    {
+        intersectInstances( *iv );
+        return;
+    }
+
+    // Anything else visits the children once, untransformed.
+    osg::Group::traverse( nv );
+}
+
+// IntersectionVisitor's push_clone() and pop_clone(), which move its
+//   intersector into the coordinates of the top model matrix, are
+//   protected. A pointer to them taken through a derived class can
+//   be called on any IntersectionVisitor.
+class IntersectionClone : public osgUtil::IntersectionVisitor
+{
+public:
+    static void push( osgUtil::IntersectionVisitor& iv )
+    {
+        (iv.*&IntersectionClone::push_clone)();
+    }
+    static void pop( osgUtil::IntersectionVisitor& iv )
+    {
+        (iv.*&IntersectionClone::pop_clone)();
+    }
+};
+
+// Traverse the children under each instance, the way
+//   IntersectionVisitor::apply(Transform&) does for a MatrixTransform.
+//   Hits get this node's path, not a path through a per-instance
+//   node; their matrices tell the instances apart.
+void
+InstanceGroup::intersectInstances( osgUtil::IntersectionVisitor& iv )
+{
+    unsigned int idx;
+    for (idx=0; idx<_matrices.size(); idx++)
+    {
+        osg::ref_ptr<osg::RefMatrix> matrix = new osg::RefMatrix( _matrices[ idx ] );
+        if (iv.getModelMatrix() != NULL)
+            matrix->postMult( *iv.getModelMatrix() );
+
+        iv.pushModelMatrix( matrix.get() );
+        IntersectionClone::push( iv );
+        osg::Group::traverse( iv );
+        IntersectionClone::pop( iv );
+        iv.popModelMatrix();
+    }
+}
+
+void
+InstanceGroup::cullInstances( osg::NodeVisitor& nv )
+{
+    osgUtil::CullVisitor* cv = static_cast<osgUtil::CullVisitor*>( &nv );
+    if (!getBound().valid())
+        return;
+
+    const unsigned int numInstances = _matrices.size();
+    std::vector< unsigned char > visible( numInstances, 1 );
+    unsigned char* vis = &visible[ 0 ];
+    const float* cx = &_centerX[ 0 ];
+    const float* cy = &_centerY[ 0 ];
+    const float* cz = &_centerZ[ 0 ];
+    const float* r = &_radius[ 0 ];
+
+    // Test every instance against each frustum plane that this
+    //   node's own bound isn't already entirely inside. The inner
+    //   loop has no branches, so the compiler can vectorize it.
+    osg::Polytope& frustum = cv->getCurrentCullingSet().getFrustum();
+    const osg::Polytope::PlaneList& planes = frustum.getPlaneList();
+    const osg::Polytope::ClippingMask mask = frustum.getCurrentMask();
+    osg::Polytope::ClippingMask selector( 1 );
+    unsigned int pIdx;
+    for (pIdx=0; pIdx<planes.size(); pIdx++, selector<<=1)
+    {
+        if (!( mask & selector ))
+            continue;
+        const float a = (float)planes[ pIdx ][ 0 ];
+        const float b = (float)planes[ pIdx ][ 1 ];
+        const float c = (float)planes[ pIdx ][ 2 ];
+        const float d = (float)planes[ pIdx ][ 3 ];
+        unsigned int idx;
+        for (idx=0; idx<numInstances; idx++)
+            vis[ idx ] &= (unsigned char)( a * cx[ idx ] + b * cy[ idx ] +
+                    c * cz[ idx ] + d >= -r[ idx ] );
+    }
+
+    // Traverse the children under each visible instance, the way
+    //   CullVisitor::apply(Transform&) does for a MatrixTransform.
+    const osg::Matrix parentMV( *cv->getModelViewMatrix() );
+    unsigned int idx;
+    for (idx=0; idx<numInstances; idx++)
+    {
+        if (!vis[ idx ])
+            continue;
+
+        osg::ref_ptr<osg::RefMatrix> mv =
+                cv->createOrReuseMatrix( _matrices[ idx ] * parentMV );
+        cv->pushModelViewMatrix( mv.get(), osg::Transform::RELATIVE_RF );
+        const osg::StateSet* ss = getInstanceStateSet( idx );
+        if (ss != NULL)
+            cv->pushStateSet( ss );
+
+        osg::Group::traverse( nv );
+
+        if (ss != NULL)
+            cv->popStateSet();
+        cv->popModelViewMatrix();
+    }
+}
+
+
+InstancingReport::InstancingReport()
+  : _instanceGroups( 0 ),
+    _instances( 0 ),
+    _nodesBefore( 0 ),
+    _nodesAfter( 0 ),
+    _bytesBefore( 0 ),
+    _bytesAfter( 0 )
+{
+}
+
+// Approximate memory used by one node, its child list and its
+//   parent list.
+static unsigned int
+nodeBytes( osg::Node& node )
+{
+    unsigned int bytes;
+    InstanceGroup* ig = dynamic_cast<InstanceGroup*>( &node );
+    if (ig != NULL)
+        bytes = sizeof( InstanceGroup ) + ig->getInstanceDataSize();
+    else if (dynamic_cast<osg::MatrixTransform*>( &node ) != NULL)
+        bytes = sizeof( osg::MatrixTransform );
+    else if (node.asTransform() != NULL)
+        bytes = sizeof( osg::Transform );
+    else if (node.asGroup() != NULL)
+        bytes = sizeof( osg::Group );
+    else if (node.asGeode() != NULL)
+        bytes = sizeof( osg::Geode );
+    else
+        bytes = sizeof( osg::Node );
+
+    if (node.asGroup() != NULL)
+        bytes += node.asGroup()->getNumChildren() * sizeof( osg::ref_ptr<osg::Node> );
+    bytes += node.getNumParents() * sizeof( osg::Group* );
+    return( bytes );
+}
+
+// Visits each distinct node once, counting nodes and bytes and
+//   collecting the Groups.
+class GroupCollector : public osg::NodeVisitor
+{
+public:
+    GroupCollector()
+      : osg::NodeVisitor( osg::NodeVisitor::TRAVERSE_ALL_CHILDREN ),
+        _numNodes( 0 ),
+        _bytes( 0 )
+    {
+    }
+
+    virtual void apply( osg::Node& node )
+    {
+        if (!_visited.insert( &node ).second)
+            return;
+        _numNodes++;
+        _bytes += nodeBytes( node );
+        if (node.asGroup() != NULL)
+            _groups.push_back( node.asGroup() );
+        traverse( node );
+    }
+
+    std::set< osg::Node* > _visited;
+    std::vector< osg::ref_ptr<osg::Group> > _groups;
+    unsigned int _numNodes;
+    unsigned int _bytes;
+};
+
+// Return node as a MatrixTransform if it's one that can become an
+//   instance, or NULL.
+static osg::MatrixTransform*
+instanceTransform( osg::Node* node, bool allowStateSet )
+{
+    osg::Transform* t = node->asTransform();
+    osg::MatrixTransform* mt = ( t != NULL ) ? t->asMatrixTransform() : NULL;
+    // Subclasses might do more than apply a matrix.
+    if ( (mt == NULL) || (strcmp( mt->className(), "MatrixTransform" ) != 0) )
+        return( NULL );
+
+    if ( (mt->getNumChildren() != 1) ||
+            !mt->getName().empty() ||
+            (mt->getDataVariance() == osg::Object::DYNAMIC) ||
+            (mt->getReferenceFrame() != osg::Transform::RELATIVE_RF) ||
+            (mt->getNodeMask() != ~0u) ||
+            !mt->getCullingActive() ||
+            (mt->getUpdateCallback() != NULL) ||
+            (mt->getEventCallback() != NULL) ||
+            (mt->getCullCallback() != NULL) ||
+            (mt->getUserData() != NULL) )
+        return( NULL );
+    if (!allowStateSet && (mt->getStateSet() != NULL))
+        return( NULL );
+    return( mt );
+}
+
+// The transforms under one parent that share a subgraph.
+struct InstanceSet
+{
+    osg::Node* _shared;
+    std::vector< unsigned int > _children;
+    std::vector< osg::Matrix > _matrices;
+    std::vector< osg::StateSet* > _stateSets;
+};
+
+static void
+instanceChildren( osg::Group& group, unsigned int minInstances,
+    InstancingReport& report )
+{
+    const unsigned int numChildren = group.getNumChildren();
+    std::vector< InstanceSet > sets;
+    std::map< osg::Node*, unsigned int > setIndex;
+    std::vector< int > owner( numChildren, -1 );
+
+    unsigned int idx;
+    for (idx=0; idx<numChildren; idx++)
+    {
+        osg::MatrixTransform* mt = instanceTransform( group.getChild( idx ), true );
+        if ( (mt == NULL) || (mt->getNumParents() != 1) )
+            continue;
+
+        // Fold a chain of transforms into one matrix.
+        osg::Matrix m( mt->getMatrix() );
+        osg::Node* shared = mt->getChild( 0 );
+        osg::MatrixTransform* inner;
+        while ((inner = instanceTransform( shared, false )) != NULL)
+        {
+            m = inner->getMatrix() * m;
+            shared = inner->getChild( 0 );
+        }
+
+        std::map< osg::Node*, unsigned int >::iterator it = setIndex.find( shared );
+        if (it == setIndex.end())
+        {
+            it = setIndex.insert( std::make_pair( shared, sets.size() ) ).first;
+            sets.push_back( InstanceSet() );
+            sets.back()._shared = shared;
+        }
+        InstanceSet& set = sets[ it->second ];
+        set._children.push_back( idx );
+        set._matrices.push_back( m );
+        set._stateSets.push_back( mt->getStateSet() );
+    }
+
+    std::vector< osg::ref_ptr<InstanceGroup> > instanceGroups( sets.size() );
+    unsigned int numInstanced( 0 );
+    unsigned int sIdx;
+    for (sIdx=0; sIdx<sets.size(); sIdx++)
+    {
+        const InstanceSet& set = sets[ sIdx ];
+        if (set._children.size() < minInstances)
+            continue;
+
+        osg::ref_ptr<InstanceGroup> ig = new InstanceGroup;
+        ig->addChild( set._shared );
+        for (idx=0; idx<set._children.size(); idx++)
+        {
+            ig->addInstance( set._matrices[ idx ], set._stateSets[ idx ] );
+            owner[ set._children[ idx ] ] = sIdx;
+        }
+        instanceGroups[ sIdx ] = ig;
+        numInstanced++;
+        report._instanceGroups++;
+        report._instances += set._children.size();
+    }
+    if (numInstanced == 0)
+        return;
+
+    // Rebuild the child list, with each InstanceGroup in place of
+    //   the first transform it replaces.
+    std::vector< osg::ref_ptr<osg::Node> > children;
+    for (idx=0; idx<numChildren; idx++)
+    {
+        const int s = owner[ idx ];
+        if (s < 0)
+            children.push_back( group.getChild( idx ) );
+        else if (sets[ s ]._children[ 0 ] == idx)
+            children.push_back( instanceGroups[ s ].get() );
+    }
+    group.removeChildren( 0, numChildren );
+    for (idx=0; idx<children.size(); idx++)
+        group.addChild( children[ idx ].get() );
+}
+
+InstancingReport
+instanceSubgraphs( osg::Node* root, unsigned int minInstances )
+{
+    InstancingReport report;
+    if (root == NULL)
+        return( report );
+
+    GroupCollector before;
+    root->accept( before );
+    report._nodesBefore = before._numNodes;
+    report._bytesBefore = before._bytes;
+
+    unsigned int idx;
+    for (idx=0; idx<before._groups.size(); idx++)
+        instanceChildren( *( before._groups[ idx ] ), minInstances, report );
+
+    GroupCollector after;
+    root->accept( after );
+    report._nodesAfter = after._numNodes;
+    report._bytesAfter = after._bytes;
+    return( report );
+}
@@ -0,0 +1,105 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// A Group that draws its children once per instance matrix
+
+#ifndef __INSTANCE_GROUP_H__
+#define __INSTANCE_GROUP_H__
+
+#include <osg/Group>
+#include <osg/StateSet>
+#include <osg/Matrix>
+#include <osg/ref_ptr>
+#include <vector>
+
+namespace osgUtil {
+    class IntersectionVisitor;
+}
+
+// Draws its children once for each instance, as if each instance
+//   were a MatrixTransform (with an optional StateSet) above the
+//   children. The instances are a contiguous array of matrices
+//   instead of nodes, and the cull traversal tests all of their
+//   bounding spheres against the view frustum in one pass before
+//   traversing the children under the visible ones.
+//
+// Intersection visits the children once per instance, with the
+//   instance's matrix pushed as a MatrixTransform's would be. Other
+//   traversals, such as update and event, visit the children once,
+//   not once per instance.
+class InstanceGroup : public osg::Group
+{
+public:
+    InstanceGroup();
+    InstanceGroup( const InstanceGroup& ig,
+        const osg::CopyOp& copyop=osg::CopyOp::SHALLOW_COPY );
+
+    META_Node( osgQSG, InstanceGroup );
+
+    // Add an instance and return its index. stateSet, if not NULL,
+    //   applies to this instance only.
+    unsigned int addInstance( const osg::Matrix& m,
+        osg::StateSet* stateSet=NULL );
+    // Remove an instance. The last instance moves into its place.
+    void removeInstance( unsigned int idx );
+
+    unsigned int getNumInstances() const { return( _matrices.size() ); }
+    void setMatrix( unsigned int idx, const osg::Matrix& m );
+    const osg::Matrix& getMatrix( unsigned int idx ) const { return( _matrices[ idx ] ); }
+    osg::StateSet* getInstanceStateSet( unsigned int idx );
+    const osg::StateSet* getInstanceStateSet( unsigned int idx ) const;
+
+    // Bounding sphere of one instance, in this node's coordinates.
+    osg::BoundingSphere getInstanceBound( unsigned int idx ) const;
+
+    // Bytes held by the per-instance arrays.
+    unsigned int getInstanceDataSize() const;
+
+    virtual void traverse( osg::NodeVisitor& nv );
+    virtual osg::BoundingSphere computeBound() const;
+
+protected:
+    virtual ~InstanceGroup() {}
+
+    void cullInstances( osg::NodeVisitor& nv );
+    void intersectInstances( osgUtil::IntersectionVisitor& iv );
+
+    std::vector< osg::Matrix > _matrices;
+    // Empty if no instance has its own StateSet.
+    std::vector< osg::ref_ptr<osg::StateSet> > _stateSets;
+
+    // Instance bounding spheres as parallel arrays, filled in by
+    //   computeBound().
+    mutable std::vector< float > _centerX, _centerY, _centerZ, _radius;
+};
+
+// What instanceSubgraphs() changed. Node counts are of distinct
+//   nodes. Memory is an estimate of the nodes themselves and their
+//   child and parent lists, not of the Drawables they hold, which
+//   instancing doesn't change.
+struct InstancingReport
+{
+    InstancingReport();
+
+    unsigned int _instanceGroups;
+    unsigned int _instances;
+    unsigned int _nodesBefore, _nodesAfter;
+    unsigned int _bytesBefore, _bytesAfter;
+};
+
+// Find subgraphs that appear under several MatrixTransforms of the
+//   same parent, and replace each such set of transforms with one
+//   InstanceGroup. A transform qualifies if it has one child, no
+//   name, callbacks or user data, isn't DYNAMIC, and uses the
+//   default node mask and reference frame; its StateSet, if any,
+//   becomes the instance's StateSet. Chains of qualifying transforms
+//   (without StateSets below the first) fold into one matrix. At
+//   least minInstances transforms must share a subgraph for it to
+//   be instanced.
+InstancingReport instanceSubgraphs( osg::Node* root,
+    unsigned int minInstances=2 );
+
+#endif
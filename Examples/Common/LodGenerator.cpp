@@ -0,0 +1,874 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// LOD chains from quadric error mesh simplification
+
+#include "LodGenerator.h"
+#include "GeometryConsolidator.h"
+#include "ParallelLoop.h"
+#include <osg/Geode>
+#include <osg/LOD>
+#include <osg/NodeVisitor>
+#include <osg/PrimitiveSet>
+#include <osg/Math>
+#include <osg/Timer>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+#include <map>
+#include <ostream>
+#include <set>
+
+
+// Seam and border planes outweigh face planes by this much, so
+//   collapses keep seams and borders where they are.
+static const double ConstraintWeight( 100. );
+// A collapse may not turn any remaining face further than this, as
+//   the cosine of the angle, which also keeps faces from flipping.
+static const double MinFaceCosine( .2 );
+
+
+LodSettings::LodSettings()
+  : _levels( 4 ),
+    _ratio( .5f ),
+    _minTriangles( 64 ),
+    _pixelError( 1.f ),
+    _screenHeight( 1080.f ),
+    _fieldOfView( 30.f ),
+    _numThreads( 0 )
+{
+}
+
+LodReport::LodReport()
+  : _geometries( 0 ),
+    _time( 0. )
+{
+}
+
+
+// Sum of squared distances to weighted planes, as a symmetric 4x4
+//   matrix, and the sum of the weights.
+struct Quadric
+{
+    Quadric()
+      : _aa( 0. ), _ab( 0. ), _ac( 0. ), _ad( 0. ), _bb( 0. ),
+        _bc( 0. ), _bd( 0. ), _cc( 0. ), _cd( 0. ), _dd( 0. ),
+        _weight( 0. ) {}
+
+    void addPlane( const osg::Vec3d& n, double d, double weight )
+    {
+        _aa += weight * n.x() * n.x(); _ab += weight * n.x() * n.y();
+        _ac += weight * n.x() * n.z(); _ad += weight * n.x() * d;
+        _bb += weight * n.y() * n.y(); _bc += weight * n.y() * n.z();
+        _bd += weight * n.y() * d; _cc += weight * n.z() * n.z();
+        _cd += weight * n.z() * d; _dd += weight * d * d;
+        _weight += weight;
+    }
+    void add( const Quadric& q )
+    {
+        _aa += q._aa; _ab += q._ab; _ac += q._ac; _ad += q._ad; _bb += q._bb;
+        _bc += q._bc; _bd += q._bd; _cc += q._cc; _cd += q._cd; _dd += q._dd;
+        _weight += q._weight;
+    }
+    double error( const osg::Vec3& p ) const
+    {
+        const double x = p.x(), y = p.y(), z = p.z();
+        return( x * ( _aa * x + 2. * ( _ab * y + _ac * z + _ad ) ) +
+                y * ( _bb * y + 2. * ( _bc * z + _bd ) ) +
+                z * ( _cc * z + 2. * _cd ) + _dd );
+    }
+    // The weighted mean squared distance. The weights are areas and
+    //   squared lengths, so error() is in length^4 units; this is in
+    //   length^2.
+    double meanError( const osg::Vec3& p ) const
+    {
+        return( ( _weight > 0. ) ? error( p ) / _weight : 0. );
+    }
+
+    double _aa, _ab, _ac, _ad, _bb, _bc, _bd, _cc, _cd, _dd;
+    double _weight;
+};
+
+// An edge of a triangle, between two positions, with the vertices
+//   (wedges) the triangle uses at each. p0 is the lesser position.
+struct EdgeRecord
+{
+    unsigned int _p0, _p1, _w0, _w1;
+
+    bool operator<( const EdgeRecord& rhs ) const
+    {
+        if (_p0 != rhs._p0)
+            return( _p0 < rhs._p0 );
+        return( _p1 < rhs._p1 );
+    }
+};
+
+// _cost orders collapses; _error is the same collapse's distance
+//   from the original surface, squared, in model units.
+struct Collapse
+{
+    double _cost;
+    double _error;
+    unsigned int _from, _to;
+
+    bool operator<( const Collapse& rhs ) const { return( _cost < rhs._cost ); }
+};
+
+
+// Edge collapse simplification of one triangle list. Vertices at the
+//   same position are wedges of one position; collapses move every
+//   wedge of a position onto a neighboring position's wedges, so
+//   no new vertices or attributes are made.
+class MeshSimplifier
+{
+public:
+    MeshSimplifier( const osg::Vec3Array& vertices, const std::vector< unsigned int >& tris );
+
+    unsigned int getNumTriangles() const { return( _numTriangles ); }
+    // The largest distance from the original surface of any collapse
+    //   so far, as the square root of its mean quadric error, in
+    //   model units.
+    float getError() const { return( (float)sqrt( std::max( _maxError, 0. ) ) ); }
+
+    // Collapse edges, cheapest first, until target triangles remain
+    //   or nothing more may collapse.
+    void simplify( unsigned int target );
+    // The remaining triangles.
+    void getTriangles( std::vector< unsigned int >& tris ) const;
+
+protected:
+    // How a position may move.
+    enum Kind { INTERIOR, CONSTRAINED, LOCKED };
+
+    void analyze();
+    bool collapse( unsigned int from, unsigned int to );
+
+    const osg::Vec3* _vertices;
+    // A position is named by its first wedge.
+    std::vector< unsigned int > _position;
+    std::vector< unsigned int > _tris;
+    std::vector< unsigned char > _removed;
+    unsigned int _numTriangles;
+    std::vector< Quadric > _quadrics;
+    double _maxError;
+
+    // Rebuilt each pass: triangles per position, the position's
+    //   kind, and the unique edges, seams and borders flagged.
+    std::vector< unsigned int > _adjacencyStart, _adjacency;
+    std::vector< unsigned char > _kind;
+    std::vector< EdgeRecord > _edges;
+    std::vector< unsigned char > _edgeConstrained;
+};
+
+MeshSimplifier::MeshSimplifier( const osg::Vec3Array& vertices,
+    const std::vector< unsigned int >& tris )
+  : _vertices( vertices.empty() ? NULL : &vertices[ 0 ] ),
+    _numTriangles( 0 ),
+    _maxError( 0. )
+{
+    const unsigned int numVertices = vertices.size();
+    _position.resize( numVertices );
+    std::map< osg::Vec3, unsigned int > firstAt;
+    unsigned int idx;
+    for (idx=0; idx<numVertices; idx++)
+        _position[ idx ] = firstAt.insert( std::make_pair( vertices[ idx ], idx ) ).first->second;
+
+    // Triangles with two corners at one position draw nothing.
+    for (idx=0; idx+2<tris.size(); idx+=3)
+    {
+        const unsigned int a = _position[ tris[ idx ] ];
+        const unsigned int b = _position[ tris[ idx+1 ] ];
+        const unsigned int c = _position[ tris[ idx+2 ] ];
+        if ((a == b) || (b == c) || (a == c))
+            continue;
+        _tris.insert( _tris.end(), tris.begin() + idx, tris.begin() + idx + 3 );
+    }
+    _numTriangles = _tris.size() / 3;
+    _removed.resize( _numTriangles, 0 );
+
+    // Each position starts with the planes of its faces, weighted by
+    //   area, and of its seams and borders.
+    _quadrics.resize( numVertices );
+    for (idx=0; idx<_numTriangles; idx++)
+    {
+        const osg::Vec3d p0( _vertices[ _tris[ idx*3 ] ] );
+        const osg::Vec3d p1( _vertices[ _tris[ idx*3+1 ] ] );
+        const osg::Vec3d p2( _vertices[ _tris[ idx*3+2 ] ] );
+        osg::Vec3d n = ( p1 - p0 ) ^ ( p2 - p0 );
+        const double area = n.normalize() * .5;
+        unsigned int corner;
+        for (corner=0; corner<3; corner++)
+            _quadrics[ _position[ _tris[ idx*3+corner ] ] ].addPlane( n, -( n * p0 ), area );
+    }
+
+    analyze();
+    for (idx=0; idx<_edges.size(); idx++)
+    {
+        if (!_edgeConstrained[ idx ])
+            continue;
+        // Find a triangle with this edge for the face normal.
+        const EdgeRecord& e = _edges[ idx ];
+        const osg::Vec3d p0( _vertices[ e._p0 ] ), p1( _vertices[ e._p1 ] );
+        unsigned int aIdx;
+        for (aIdx=_adjacencyStart[ e._p0 ]; aIdx<_adjacencyStart[ e._p0+1 ]; aIdx++)
+        {
+            const unsigned int t = _adjacency[ aIdx ];
+            const unsigned int* c = &_tris[ t*3 ];
+            if ((_position[ c[ 0 ] ] != e._p1) && (_position[ c[ 1 ] ] != e._p1) &&
+                    (_position[ c[ 2 ] ] != e._p1))
+                continue;
+            const osg::Vec3d face = ( osg::Vec3d( _vertices[ c[ 1 ] ] ) - osg::Vec3d( _vertices[ c[ 0 ] ] ) ) ^
+                    ( osg::Vec3d( _vertices[ c[ 2 ] ] ) - osg::Vec3d( _vertices[ c[ 0 ] ] ) );
+            const osg::Vec3d edge = p1 - p0;
+            osg::Vec3d n = edge ^ face;
+            if (n.normalize() == 0.)
+                break;
+            const double weight = ConstraintWeight * edge.length2();
+            _quadrics[ e._p0 ].addPlane( n, -( n * p0 ), weight );
+            _quadrics[ e._p1 ].addPlane( n, -( n * p0 ), weight );
+            break;
+        }
+    }
+}
+
+void
+MeshSimplifier::analyze()
+{
+    const unsigned int numVertices = _position.size();
+    const unsigned int numTris = _removed.size();
+
+    _adjacencyStart.assign( numVertices + 1, 0 );
+    unsigned int idx, corner;
+    for (idx=0; idx<numTris; idx++)
+        if (!_removed[ idx ])
+            for (corner=0; corner<3; corner++)
+                _adjacencyStart[ _position[ _tris[ idx*3+corner ] ] + 1 ]++;
+    for (idx=0; idx<numVertices; idx++)
+        _adjacencyStart[ idx+1 ] += _adjacencyStart[ idx ];
+    _adjacency.resize( _adjacencyStart[ numVertices ] );
+    std::vector< unsigned int > fill( _adjacencyStart.begin(), _adjacencyStart.end() - 1 );
+    _edges.clear();
+    for (idx=0; idx<numTris; idx++)
+    {
+        if (_removed[ idx ])
+            continue;
+        for (corner=0; corner<3; corner++)
+        {
+            const unsigned int w0 = _tris[ idx*3+corner ];
+            const unsigned int w1 = _tris[ idx*3+( corner+1 ) % 3 ];
+            _adjacency[ fill[ _position[ w0 ] ]++ ] = idx;
+            EdgeRecord e;
+            e._p0 = _position[ w0 ];
+            e._p1 = _position[ w1 ];
+            e._w0 = w0;
+            e._w1 = w1;
+            if (e._p0 > e._p1)
+            {
+                std::swap( e._p0, e._p1 );
+                std::swap( e._w0, e._w1 );
+            }
+            _edges.push_back( e );
+        }
+    }
+    std::sort( _edges.begin(), _edges.end() );
+
+    // Collapse the records of each edge into one. An edge is a
+    //   border if one triangle has it, a seam if its triangles use
+    //   different wedges, and locks its ends if more than two share
+    //   it.
+    std::vector< unsigned char > constrainedEdges( numVertices, 0 );
+    std::vector< unsigned char > locked( numVertices, 0 );
+    _edgeConstrained.clear();
+    unsigned int numUnique( 0 );
+    for (idx=0; idx<_edges.size(); )
+    {
+        unsigned int end( idx + 1 );
+        bool seam( false );
+        while ((end < _edges.size()) && (_edges[ end ]._p0 == _edges[ idx ]._p0) &&
+                (_edges[ end ]._p1 == _edges[ idx ]._p1))
+        {
+            if ((_edges[ end ]._w0 != _edges[ idx ]._w0) || (_edges[ end ]._w1 != _edges[ idx ]._w1))
+                seam = true;
+            end++;
+        }
+        const EdgeRecord e = _edges[ idx ];
+        const unsigned int count = end - idx;
+        if (count > 2)
+            locked[ e._p0 ] = locked[ e._p1 ] = 1;
+        const bool constrained = ( count == 1 ) || seam;
+        if (constrained)
+        {
+            constrainedEdges[ e._p0 ] = std::min( constrainedEdges[ e._p0 ] + 1, 255 );
+            constrainedEdges[ e._p1 ] = std::min( constrainedEdges[ e._p1 ] + 1, 255 );
+        }
+        _edges[ numUnique++ ] = e;
+        _edgeConstrained.push_back( constrained );
+        idx = end;
+    }
+    _edges.resize( numUnique );
+
+    // A position with one wedge and no seam or border is interior. One
+    //   on a single seam or border line may slide along it; where
+    //   lines meet or wedges split without a seam, it stays put.
+    _kind.assign( numVertices, LOCKED );
+    for (idx=0; idx<numVertices; idx++)
+    {
+        if ((_position[ idx ] != idx) || locked[ idx ] ||
+                (_adjacencyStart[ idx ] == _adjacencyStart[ idx+1 ]))
+            continue;
+        if (constrainedEdges[ idx ] == 2)
+            _kind[ idx ] = CONSTRAINED;
+        else if (constrainedEdges[ idx ] == 0)
+        {
+            bool oneWedge( true );
+            const unsigned int first = _adjacency[ _adjacencyStart[ idx ] ];
+            unsigned int wedge( 0 );
+            for (corner=0; corner<3; corner++)
+                if (_position[ _tris[ first*3+corner ] ] == idx)
+                    wedge = _tris[ first*3+corner ];
+            unsigned int aIdx;
+            for (aIdx=_adjacencyStart[ idx ]; aIdx<_adjacencyStart[ idx+1 ]; aIdx++)
+            {
+                const unsigned int* c = &_tris[ _adjacency[ aIdx ]*3 ];
+                for (corner=0; corner<3; corner++)
+                    if ((_position[ c[ corner ] ] == idx) && (c[ corner ] != wedge))
+                        oneWedge = false;
+            }
+            if (oneWedge)
+                _kind[ idx ] = INTERIOR;
+        }
+    }
+}
+
+bool
+MeshSimplifier::collapse( unsigned int from, unsigned int to )
+{
+    // Map each wedge of from to the wedge of to across a triangle
+    //   they share. A wedge with none, or two, can't move.
+    std::vector< std::pair< unsigned int, unsigned int > > wedgeMap;
+    const unsigned int first = _adjacencyStart[ from ];
+    const unsigned int last = _adjacencyStart[ from+1 ];
+    unsigned int aIdx, corner;
+    for (aIdx=first; aIdx<last; aIdx++)
+    {
+        const unsigned int* c = &_tris[ _adjacency[ aIdx ]*3 ];
+        unsigned int wFrom( ~0u ), wTo( ~0u );
+        for (corner=0; corner<3; corner++)
+        {
+            if (_position[ c[ corner ] ] == from)
+                wFrom = c[ corner ];
+            else if (_position[ c[ corner ] ] == to)
+                wTo = c[ corner ];
+        }
+        if (wTo == ~0u)
+            continue;
+        unsigned int mIdx;
+        for (mIdx=0; mIdx<wedgeMap.size(); mIdx++)
+            if (wedgeMap[ mIdx ].first == wFrom)
+                break;
+        if (mIdx == wedgeMap.size())
+            wedgeMap.push_back( std::make_pair( wFrom, wTo ) );
+        else if (wedgeMap[ mIdx ].second != wTo)
+            return( false );
+    }
+
+    // The link condition: the positions next to both must be those
+    //   across the triangles they share, or the collapse would pinch
+    //   the surface.
+    std::vector< unsigned int > fromRing, toRing;
+    unsigned int numShared( 0 );
+    for (aIdx=first; aIdx<last; aIdx++)
+    {
+        const unsigned int* c = &_tris[ _adjacency[ aIdx ]*3 ];
+        for (corner=0; corner<3; corner++)
+            fromRing.push_back( _position[ c[ corner ] ] );
+        if ((_position[ c[ 0 ] ] == to) || (_position[ c[ 1 ] ] == to) ||
+                (_position[ c[ 2 ] ] == to))
+            numShared++;
+    }
+    for (aIdx=_adjacencyStart[ to ]; aIdx<_adjacencyStart[ to+1 ]; aIdx++)
+        for (corner=0; corner<3; corner++)
+            toRing.push_back( _position[ _tris[ _adjacency[ aIdx ]*3+corner ] ] );
+    std::sort( fromRing.begin(), fromRing.end() );
+    fromRing.erase( std::unique( fromRing.begin(), fromRing.end() ), fromRing.end() );
+    std::sort( toRing.begin(), toRing.end() );
+    toRing.erase( std::unique( toRing.begin(), toRing.end() ), toRing.end() );
+    std::vector< unsigned int > common;
+    std::set_intersection( fromRing.begin(), fromRing.end(),
+            toRing.begin(), toRing.end(), std::back_inserter( common ) );
+    // The intersection also holds from and to themselves.
+    if (common.size() != numShared + 2)
+        return( false );
+
+    // Every other triangle must keep its facing, and find its wedge.
+    const osg::Vec3d target( _vertices[ to ] );
+    for (aIdx=first; aIdx<last; aIdx++)
+    {
+        const unsigned int* c = &_tris[ _adjacency[ aIdx ]*3 ];
+        bool hasTo( false );
+        unsigned int fromCorner( 0 );
+        for (corner=0; corner<3; corner++)
+        {
+            if (_position[ c[ corner ] ] == to)
+                hasTo = true;
+            else if (_position[ c[ corner ] ] == from)
+                fromCorner = corner;
+        }
+        if (hasTo)
+            continue;
+
+        unsigned int mIdx;
+        for (mIdx=0; mIdx<wedgeMap.size(); mIdx++)
+            if (wedgeMap[ mIdx ].first == c[ fromCorner ])
+                break;
+        if (mIdx == wedgeMap.size())
+            return( false );
+
+        osg::Vec3d p[ 3 ] = { osg::Vec3d( _vertices[ c[ 0 ] ] ),
+            osg::Vec3d( _vertices[ c[ 1 ] ] ), osg::Vec3d( _vertices[ c[ 2 ] ] ) };
+        const osg::Vec3d before = ( p[ 1 ] - p[ 0 ] ) ^ ( p[ 2 ] - p[ 0 ] );
+        p[ fromCorner ] = target;
+        const osg::Vec3d after = ( p[ 1 ] - p[ 0 ] ) ^ ( p[ 2 ] - p[ 0 ] );
+        const double lengths = sqrt( before.length2() * after.length2() );
+        if ((lengths == 0.) || (before * after < MinFaceCosine * lengths))
+            return( false );
+    }
+
+    for (aIdx=first; aIdx<last; aIdx++)
+    {
+        const unsigned int t = _adjacency[ aIdx ];
+        unsigned int* c = &_tris[ t*3 ];
+        for (corner=0; corner<3; corner++)
+        {
+            if (_position[ c[ corner ] ] != from)
+                continue;
+            unsigned int mIdx;
+            for (mIdx=0; mIdx<wedgeMap.size(); mIdx++)
+                if (wedgeMap[ mIdx ].first == c[ corner ])
+                    c[ corner ] = wedgeMap[ mIdx ].second;
+        }
+        if ((_position[ c[ 0 ] ] == _position[ c[ 1 ] ]) ||
+                (_position[ c[ 1 ] ] == _position[ c[ 2 ] ]) ||
+                (_position[ c[ 0 ] ] == _position[ c[ 2 ] ]))
+        {
+            _removed[ t ] = 1;
+            _numTriangles--;
+        }
+    }
+    _quadrics[ to ].add( _quadrics[ from ] );
+    return( true );
+}
+
+void
+MeshSimplifier::simplify( unsigned int target )
+{
+    std::vector< Collapse > collapses;
+    std::vector< unsigned char > touched;
+    while (_numTriangles > target)
+    {
+        analyze();
+
+        // The cheaper allowed direction of each edge. Interior
+        //   positions may move to any neighbor; seam and border
+        //   positions only along their line.
+        collapses.clear();
+        unsigned int idx;
+        for (idx=0; idx<_edges.size(); idx++)
+        {
+            const EdgeRecord& e = _edges[ idx ];
+            const bool constrained = ( _edgeConstrained[ idx ] != 0 );
+            Quadric q( _quadrics[ e._p0 ] );
+            q.add( _quadrics[ e._p1 ] );
+            Collapse c;
+            c._cost = DBL_MAX;
+            const unsigned int ends[ 2 ] = { e._p0, e._p1 };
+            unsigned int end;
+            for (end=0; end<2; end++)
+            {
+                const unsigned int from = ends[ end ], to = ends[ 1-end ];
+                const bool allowed = ( _kind[ from ] == INTERIOR ) ||
+                        ( ( _kind[ from ] == CONSTRAINED ) && constrained &&
+                            ( _kind[ to ] != INTERIOR ) );
+                if (!allowed)
+                    continue;
+                const double cost = q.error( _vertices[ to ] );
+                if (cost < c._cost)
+                {
+                    c._cost = cost;
+                    c._error = q.meanError( _vertices[ to ] );
+                    c._from = from;
+                    c._to = to;
+                }
+            }
+            if (c._cost < DBL_MAX)
+                collapses.push_back( c );
+        }
+        std::sort( collapses.begin(), collapses.end() );
+
+        // Collapse cheapest first, leaving alone any position near one
+        //   already collapsed this pass, whose triangles have changed.
+        touched.assign( _position.size(), 0 );
+        unsigned int numCollapsed( 0 );
+        for (idx=0; (idx<collapses.size()) && (_numTriangles>target); idx++)
+        {
+            const Collapse& c = collapses[ idx ];
+            if (touched[ c._from ] || touched[ c._to ])
+                continue;
+            if (!collapse( c._from, c._to ))
+                continue;
+            _maxError = std::max( _maxError, c._error );
+            numCollapsed++;
+            unsigned int aIdx, corner;
+            for (aIdx=_adjacencyStart[ c._from ]; aIdx<_adjacencyStart[ c._from+1 ]; aIdx++)
+                for (corner=0; corner<3; corner++)
+                    touched[ _position[ _tris[ _adjacency[ aIdx ]*3+corner ] ] ] = 1;
+            touched[ c._from ] = touched[ c._to ] = 1;
+        }
+        if (numCollapsed == 0)
+            break;
+    }
+}
+
+void
+MeshSimplifier::getTriangles( std::vector< unsigned int >& tris ) const
+{
+    tris.clear();
+    tris.reserve( _numTriangles * 3 );
+    unsigned int idx;
+    for (idx=0; idx<_removed.size(); idx++)
+        if (!_removed[ idx ])
+            tris.insert( tris.end(), _tris.begin() + idx*3, _tris.begin() + idx*3 + 3 );
+}
+
+
+// Append geom's triangles to tris. Returns its vertices if the
+//   triangles can be rewritten without touching its arrays, or NULL.
+static const osg::Vec3Array*
+getSimplifiableTriangles( const osg::Geometry& geom, std::vector< unsigned int >& tris )
+{
+    // Points and lines would be lost.
+    bool trianglesOnly( true );
+    unsigned int idx;
+    for (idx=0; idx<geom.getNumPrimitiveSets(); idx++)
+    {
+        const osg::PrimitiveSet* ps = geom.getPrimitiveSet( idx );
+        if ((appendTriangles( *ps, tris ) == 0) && (ps->getNumIndices() > 0))
+            trianglesOnly = false;
+    }
+
+    if (!trianglesOnly || (strcmp( geom.className(), "Geometry" ) != 0))
+        return( NULL );
+    const osg::Geometry::AttributeBinding bindings[] = {
+        geom.getNormalBinding(), geom.getColorBinding(),
+        geom.getSecondaryColorBinding(), geom.getFogCoordBinding() };
+    for (idx=0; idx<4; idx++)
+        if ((bindings[ idx ] == osg::Geometry::BIND_PER_PRIMITIVE) ||
+                (bindings[ idx ] == osg::Geometry::BIND_PER_PRIMITIVE_SET))
+            return( NULL );
+    if ((geom.getVertexIndices() != NULL) || (geom.getNormalIndices() != NULL) ||
+            (geom.getColorIndices() != NULL))
+        return( NULL );
+    for (idx=0; idx<geom.getNumTexCoordArrays(); idx++)
+        if (geom.getTexCoordIndices( idx ) != NULL)
+            return( NULL );
+    const osg::Vec3Array* vertices =
+            dynamic_cast< const osg::Vec3Array* >( geom.getVertexArray() );
+    if (vertices == NULL)
+        return( NULL );
+    for (idx=0; idx<tris.size(); idx++)
+        if (tris[ idx ] >= vertices->size())
+            return( NULL );
+    return( vertices );
+}
+
+// Simplify tris to each of targets in turn, appending each result,
+//   reordered for the vertex cache, to levels and its error to
+//   errors.
+static void
+simplifyLevels( const osg::Vec3Array& vertices, const std::vector< unsigned int >& tris,
+    const std::vector< unsigned int >& targets,
+    std::vector< std::vector< unsigned int > >& levels, std::vector< float >& errors )
+{
+    MeshSimplifier simplifier( vertices, tris );
+    unsigned int idx;
+    for (idx=0; idx<targets.size(); idx++)
+    {
+        simplifier.simplify( targets[ idx ] );
+        levels.push_back( std::vector< unsigned int >() );
+        simplifier.getTriangles( levels.back() );
+        optimizeVertexCache( levels.back(), vertices.size() );
+        errors.push_back( simplifier.getError() );
+    }
+}
+
+// A Geometry sharing everything with geom but its triangles.
+static osg::Geometry*
+createLevelGeometry( const osg::Geometry& geom, const std::vector< unsigned int >& tris )
+{
+    osg::Geometry* level = new osg::Geometry( geom, osg::CopyOp::SHALLOW_COPY );
+    level->removePrimitiveSet( 0, level->getNumPrimitiveSets() );
+    level->addPrimitiveSet( createDrawElements( osg::PrimitiveSet::TRIANGLES, tris ) );
+    return( level );
+}
+
+bool
+simplifyGeometry( const osg::Geometry& geom,
+    const std::vector< unsigned int >& targets,
+    std::vector< osg::ref_ptr< osg::Geometry > >& results,
+    std::vector< float >* errors )
+{
+    results.clear();
+    if (errors != NULL)
+        errors->clear();
+    std::vector< unsigned int > tris;
+    const osg::Vec3Array* vertices = getSimplifiableTriangles( geom, tris );
+    if (vertices == NULL)
+        return( false );
+
+    std::vector< std::vector< unsigned int > > levels;
+    std::vector< float > levelErrors;
+    simplifyLevels( *vertices, tris, targets, levels, levelErrors );
+    unsigned int idx;
+    for (idx=0; idx<levels.size(); idx++)
+        results.push_back( createLevelGeometry( geom, levels[ idx ] ) );
+    if (errors != NULL)
+        errors->swap( levelErrors );
+    return( true );
+}
+
+
+// Collects the Geodes under a node, once each, leaving out those
+//   that already have levels of detail.
+class LodGeodeCollector : public osg::NodeVisitor
+{
+public:
+    LodGeodeCollector()
+      : osg::NodeVisitor( osg::NodeVisitor::TRAVERSE_ALL_CHILDREN )
+    {
+    }
+
+    virtual void apply( osg::Geode& geode )
+    {
+        if (!_visited.insert( &geode ).second)
+            return;
+        unsigned int idx;
+        for (idx=0; idx<geode.getNumParents(); idx++)
+            if (dynamic_cast< osg::LOD* >( geode.getParent( idx ) ) != NULL)
+                return;
+        _geodes.push_back( &geode );
+    }
+
+    std::set< osg::Node* > _visited;
+    std::vector< osg::Geode* > _geodes;
+};
+
+// One Geometry's simplification, run on any thread. The results are
+//   triangle lists; Geometries are made on the calling thread, which
+//   keeps the shared arrays' reference counts single-threaded.
+struct SimplifyJob
+{
+    SimplifyJob() : _geometry( NULL ), _vertices( NULL ), _simplified( false ) {}
+
+    const osg::Geometry* _geometry;
+    const osg::Vec3Array* _vertices;
+    std::vector< unsigned int > _tris;
+    bool _simplified;
+    // Per level after the first.
+    std::vector< std::vector< unsigned int > > _levels;
+    std::vector< float > _errors;
+};
+
+class SimplifyTask : public ParallelTask
+{
+public:
+    SimplifyTask( std::vector< SimplifyJob >& jobs, const LodSettings& settings )
+      : _jobs( jobs ), _settings( settings ) {}
+
+    virtual void operator()( unsigned int index )
+    {
+        SimplifyJob& job = _jobs[ index ];
+        const unsigned int numTriangles = job._tris.size() / 3;
+        if ((job._vertices == NULL) || (numTriangles < _settings._minTriangles))
+            return;
+
+        std::vector< unsigned int > targets;
+        float target( (float)numTriangles );
+        unsigned int level;
+        for (level=1; level<_settings._levels; level++)
+        {
+            target *= _settings._ratio;
+            targets.push_back( (unsigned int)target );
+        }
+        simplifyLevels( *job._vertices, job._tris, targets, job._levels, job._errors );
+        job._simplified = true;
+    }
+
+protected:
+    std::vector< SimplifyJob >& _jobs;
+    const LodSettings& _settings;
+};
+
+osg::Node*
+generateLods( osg::Node* root, const LodSettings& settings, LodReport& report )
+{
+    osg::Timer* timer = osg::Timer::instance();
+    const osg::Timer_t start = timer->tick();
+    const unsigned int numLevels = std::max( settings._levels, 1u );
+    report = LodReport();
+    report._triangles.resize( numLevels, 0 );
+    report._error.resize( numLevels, 0.f );
+    if (root == NULL)
+        return( root );
+
+    LodGeodeCollector collector;
+    root->accept( collector );
+
+    // One job per Geometry, however many Geodes share it.
+    std::vector< SimplifyJob > jobs;
+    std::map< const osg::Drawable*, unsigned int > jobOf;
+    unsigned int gIdx, dIdx;
+    for (gIdx=0; gIdx<collector._geodes.size(); gIdx++)
+    {
+        const osg::Geode* geode = collector._geodes[ gIdx ];
+        for (dIdx=0; dIdx<geode->getNumDrawables(); dIdx++)
+        {
+            const osg::Geometry* geom = geode->getDrawable( dIdx )->asGeometry();
+            if ((geom == NULL) || (jobOf.find( geom ) != jobOf.end()))
+                continue;
+            jobOf[ geom ] = jobs.size();
+            jobs.push_back( SimplifyJob() );
+            jobs.back()._geometry = geom;
+            jobs.back()._vertices = getSimplifiableTriangles( *geom, jobs.back()._tris );
+        }
+    }
+    report._geometries = jobs.size();
+
+    SimplifyTask task( jobs, settings );
+    runParallel( task, jobs.size(), settings._numThreads );
+
+    // Geometries for every level of every simplified job.
+    std::vector< std::vector< osg::ref_ptr< osg::Geometry > > > levelGeometries( jobs.size() );
+    unsigned int jIdx;
+    for (jIdx=0; jIdx<jobs.size(); jIdx++)
+    {
+        const SimplifyJob& job = jobs[ jIdx ];
+        unsigned int level;
+        for (level=0; level<job._levels.size(); level++)
+            levelGeometries[ jIdx ].push_back(
+                    createLevelGeometry( *job._geometry, job._levels[ level ] ) );
+    }
+
+    // Pixels per unit at unit distance.
+    const double pixelScale = settings._screenHeight /
+            ( 2. * tan( osg::DegreesToRadians( settings._fieldOfView * .5 ) ) );
+    osg::ref_ptr< osg::Node > rootLod;
+    for (gIdx=0; gIdx<collector._geodes.size(); gIdx++)
+    {
+        osg::ref_ptr< osg::Geode > geode = collector._geodes[ gIdx ];
+        LodMeshReport mesh;
+        mesh._name = geode->getName();
+        mesh._triangles.resize( numLevels, 0 );
+        mesh._error.resize( numLevels, 0.f );
+        mesh._distance.resize( numLevels, 0.f );
+
+        bool simplified( false );
+        for (dIdx=0; dIdx<geode->getNumDrawables(); dIdx++)
+        {
+            const osg::Geometry* geom = geode->getDrawable( dIdx )->asGeometry();
+            if (geom == NULL)
+                continue;
+            const SimplifyJob& job = jobs[ jobOf[ geom ] ];
+            unsigned int level;
+            for (level=0; level<numLevels; level++)
+            {
+                if (job._simplified && (level > 0))
+                {
+                    mesh._triangles[ level ] += job._levels[ level-1 ].size() / 3;
+                    mesh._error[ level ] = std::max( mesh._error[ level ], job._errors[ level-1 ] );
+                }
+                else
+                    mesh._triangles[ level ] += job._tris.size() / 3;
+            }
+            simplified = simplified || job._simplified;
+        }
+
+        unsigned int level;
+        for (level=0; level<numLevels; level++)
+        {
+            report._triangles[ level ] += mesh._triangles[ level ];
+            report._error[ level ] = std::max( report._error[ level ], mesh._error[ level ] );
+        }
+        if (!simplified || (numLevels < 2))
+            continue;
+
+        // Each level takes over where its error shrinks to the pixel
+        //   budget.
+        for (level=1; level<numLevels; level++)
+            mesh._distance[ level ] = std::max( mesh._distance[ level-1 ],
+                    (float)( mesh._error[ level ] * pixelScale / settings._pixelError ) );
+
+        osg::ref_ptr< osg::LOD > lod = new osg::LOD;
+        lod->setName( geode->getName() );
+        lod->setDataVariance( geode->getDataVariance() );
+        lod->addChild( geode.get(), 0.f, mesh._distance[ 1 ] );
+        for (level=1; level<numLevels; level++)
+        {
+            osg::ref_ptr< osg::Geode > levelGeode =
+                    new osg::Geode( *geode, osg::CopyOp::SHALLOW_COPY );
+            levelGeode->removeDrawables( 0, levelGeode->getNumDrawables() );
+            for (dIdx=0; dIdx<geode->getNumDrawables(); dIdx++)
+            {
+                osg::Drawable* drawable = geode->getDrawable( dIdx );
+                std::map< const osg::Drawable*, unsigned int >::const_iterator it =
+                        jobOf.find( drawable );
+                if ((it != jobOf.end()) && jobs[ it->second ]._simplified)
+                    levelGeode->addDrawable( levelGeometries[ it->second ][ level-1 ].get() );
+                else
+                    levelGeode->addDrawable( drawable );
+            }
+            const float maxDistance = ( level+1 < numLevels ) ? mesh._distance[ level+1 ] : FLT_MAX;
+            lod->addChild( levelGeode.get(), mesh._distance[ level ], maxDistance );
+        }
+
+        // Copy the parent list; replacing the child edits it.
+        const osg::Node::ParentList parents = geode->getParents();
+        unsigned int pIdx;
+        for (pIdx=0; pIdx<parents.size(); pIdx++)
+            parents[ pIdx ]->replaceChild( geode.get(), lod.get() );
+        if (geode.get() == root)
+            rootLod = lod.get();
+        report._meshes.push_back( mesh );
+    }
+
+    report._time = timer->delta_m( start, timer->tick() );
+    if (rootLod.valid())
+        return( rootLod.release() );
+    return( root );
+}
+
+void
+writeLodReport( std::ostream& out, const LodReport& report )
+{
+    out << report._meshes.size() << " LODs from " << report._geometries <<
+        " geometries in " << report._time << " ms" << std::endl;
+    unsigned int idx, level;
+    for (idx=0; idx<report._meshes.size(); idx++)
+    {
+        const LodMeshReport& mesh = report._meshes[ idx ];
+        out << "  " << ( mesh._name.empty() ? std::string( "(unnamed)" ) : mesh._name ) << ":";
+        for (level=0; level<mesh._triangles.size(); level++)
+            out << " [" << level << "] " << mesh._triangles[ level ] << " tris, error " <<
+                mesh._error[ level ] << ", from " << mesh._distance[ level ];
+        out << std::endl;
+    }
+    out << "  total:";
+    for (level=0; level<report._triangles.size(); level++)
+        out << " [" << level << "] " << report._triangles[ level ] << " tris, error " <<
+            report._error[ level ];
+    out << std::endl;
+}
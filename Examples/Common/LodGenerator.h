@@ -0,0 +1,98 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// LOD chains from quadric error mesh simplification
+
+#ifndef __LOD_GENERATOR_H__
+#define __LOD_GENERATOR_H__
+
+#include <osg/Node>
+#include <osg/Geometry>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Controls generateLods().
+struct LodSettings
+{
+    LodSettings();
+
+    // Levels per LOD, counting the original, and each level's
+    //   triangles as a fraction of the level before.
+    unsigned int _levels;
+    float _ratio;
+    // Geometries with fewer triangles are used unchanged at every
+    //   level.
+    unsigned int _minTriangles;
+    // A level is drawn from the distance at which its error covers
+    //   _pixelError pixels, for a view _screenHeight pixels high
+    //   with a vertical field of view of _fieldOfView degrees.
+    float _pixelError;
+    float _screenHeight;
+    float _fieldOfView;
+    // Threads to simplify on. 0 uses getDefaultThreadCount().
+    unsigned int _numThreads;
+};
+
+// One Geode's LOD chain.
+struct LodMeshReport
+{
+    std::string _name;
+    // Per level, the triangles drawn, the error, and the distance
+    //   from which the level is drawn. Errors are in model units:
+    //   the square root of the largest collapse's quadric error,
+    //   divided by the total weight of the quadric's planes.
+    std::vector< unsigned int > _triangles;
+    std::vector< float > _error;
+    std::vector< float > _distance;
+};
+
+// What generateLods() did.
+struct LodReport
+{
+    LodReport();
+
+    unsigned int _geometries;
+    std::vector< LodMeshReport > _meshes;
+    // Per level, the triangles across every mesh, and the largest
+    //   error.
+    std::vector< unsigned int > _triangles;
+    std::vector< float > _error;
+    double _time;
+};
+
+// Simplify geom to about targetTriangles triangles by quadric error
+//   edge collapses. Every vertex that remains keeps its position,
+//   normal, colors and texture coordinates, so the result shares
+//   geom's arrays and StateSet and only its triangles differ.
+//   Vertices where attributes split (seams, such as texture
+//   coordinate borders) and open borders only collapse along the
+//   seam or border, onto another vertex of it.
+//
+// Each entry of targets makes one Geometry, in order; targets must
+//   decrease. errors, if not NULL, gets each one's error. Returns
+//   false, with results empty, if geom can't be simplified: it must
+//   be a plain Geometry with a Vec3Array of vertices, drawing only
+//   triangles, without per-primitive bindings or index arrays.
+bool simplifyGeometry( const osg::Geometry& geom,
+    const std::vector< unsigned int >& targets,
+    std::vector< osg::ref_ptr< osg::Geometry > >& results,
+    std::vector< float >* errors=NULL );
+
+// Replace each Geode under root that has enough triangles with an
+//   osg::LOD whose first child is the Geode and whose other children
+//   draw simplified copies of its Geometries, farther away. Shared
+//   Geodes become one shared LOD. Geometries are simplified in
+//   parallel. Returns root, or the LOD that replaces it if root is
+//   a Geode.
+osg::Node* generateLods( osg::Node* root, const LodSettings& settings,
+    LodReport& report );
+
+// Write each LOD's triangles, error and switch distance per level,
+//   and the totals, one line per LOD.
+void writeLodReport( std::ostream& out, const LodReport& report );
+
+#endif
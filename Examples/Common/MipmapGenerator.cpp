@@ -0,0 +1,475 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// CPU mipmap chain generation for 8-bit images
+
+#include "MipmapGenerator.h"
+#include "ParallelLoop.h"
+#include <cmath>
+#include <cstring>
+#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && ( _M_IX86_FP >= 2 ) )
+#  define MIPMAP_USE_SSE2
+#  include <emmintrin.h>
+#endif
+
+
+MipmapOptions::MipmapOptions()
+  : _gammaCorrect( true ),
+    _alphaCutoff( 0.f ),
+    _simd( true ),
+    _numThreads( 0 )
+{
+}
+
+MipmapOptions
+getNaiveMipmapOptions()
+{
+    MipmapOptions options;
+    options._gammaCorrect = false;
+    options._simd = false;
+    options._numThreads = 1;
+    return( options );
+}
+
+
+// Linear values are looked up in a table with this many entries to
+//   convert them back to sRGB.
+static const unsigned int LinearSteps( 4096 );
+// Levels with fewer rows than this per thread use one thread.
+static const int MinRowsPerBand( 32 );
+
+struct GammaTables
+{
+    GammaTables()
+    {
+        unsigned int idx;
+        for (idx=0; idx<256; idx++)
+        {
+            const float c = idx / 255.f;
+            _toLinear[ idx ] = (c <= 0.04045f) ? c / 12.92f :
+                (float)pow( (c + 0.055f) / 1.055f, 2.4f );
+            _unorm[ idx ] = c;
+        }
+        for (idx=0; idx<LinearSteps; idx++)
+        {
+            const float l = idx / (float)( LinearSteps-1 );
+            const float s = (l <= 0.0031308f) ? l * 12.92f :
+                1.055f * (float)pow( l, 1.f / 2.4f ) - 0.055f;
+            _toSRGB[ idx ] = (unsigned char)( s * 255.f + .5f );
+        }
+    }
+
+    float _toLinear[ 256 ];
+    // Plain conversion to [0,1], for alpha.
+    float _unorm[ 256 ];
+    unsigned char _toSRGB[ LinearSteps ];
+};
+static const GammaTables gammaTables;
+
+
+struct Level
+{
+    int _width, _height;
+    unsigned int _rowSize;
+    unsigned int _offset;
+};
+
+// Which component holds alpha, or -1 for none.
+static int
+getAlphaComponent( GLenum pixelFormat )
+{
+    switch( pixelFormat )
+    {
+        case GL_ALPHA:
+            return( 0 );
+        case GL_LUMINANCE_ALPHA:
+            return( 1 );
+        case GL_RGBA:
+        case GL_BGRA:
+            return( 3 );
+        default:
+            return( -1 );
+    }
+}
+
+// Filters rows of one level from the level above it.
+struct LevelFilter
+{
+    const unsigned char* _src;
+    unsigned char* _dst;
+    Level _srcLevel, _dstLevel;
+    unsigned int _components;
+    bool _gammaCorrect;
+    bool _simd;
+    // Per component: the table that converts it to [0,1], and the
+    //   scale from a sum of four to an index into _fromFloat.
+    const float* _toFloat[ 4 ];
+    float _scale[ 4 ];
+    // Per component: converts back to 8 bits, or NULL for linear.
+    const unsigned char* _fromFloat[ 4 ];
+
+    void filterRows( int y0, int y1 ) const;
+
+protected:
+    void boxRow( const unsigned char* row0, const unsigned char* row1,
+        unsigned char* dst ) const;
+    void gammaRow( const unsigned char* row0, const unsigned char* row1,
+        unsigned char* dst ) const;
+};
+
+void
+LevelFilter::filterRows( int y0, int y1 ) const
+{
+    const int sh = _srcLevel._height;
+    int y;
+    for (y=y0; y<y1; y++)
+    {
+        const unsigned char* row0 = _src + (2*y) * _srcLevel._rowSize;
+        const unsigned char* row1 = _src + ( (2*y+1 < sh) ? 2*y+1 : 2*y ) * _srcLevel._rowSize;
+        unsigned char* dst = _dst + y * _dstLevel._rowSize;
+        if (_gammaCorrect)
+            gammaRow( row0, row1, dst );
+        else
+            boxRow( row0, row1, dst );
+    }
+}
+
+// Average the stored values.
+void
+LevelFilter::boxRow( const unsigned char* row0, const unsigned char* row1,
+    unsigned char* dst ) const
+{
+    const int sw = _srcLevel._width;
+    const int dw = _dstLevel._width;
+    const unsigned int n = _components;
+    int x( 0 );
+
+#ifdef MIPMAP_USE_SSE2
+    if (_simd && (n == 4))
+    {
+        // Two destination pixels from four source pixels per pass,
+        //   with the sums in 16-bit lanes.
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i two = _mm_set1_epi16( 2 );
+        for (; x+2<=dw; x+=2)
+        {
+            const __m128i a = _mm_loadu_si128( (const __m128i*)( row0 + 8*x ) );
+            const __m128i b = _mm_loadu_si128( (const __m128i*)( row1 + 8*x ) );
+            const __m128i lo = _mm_add_epi16( _mm_unpacklo_epi8( a, zero ),
+                _mm_unpacklo_epi8( b, zero ) );
+            const __m128i hi = _mm_add_epi16( _mm_unpackhi_epi8( a, zero ),
+                _mm_unpackhi_epi8( b, zero ) );
+            __m128i sum = _mm_add_epi16( _mm_unpacklo_epi64( lo, hi ),
+                _mm_unpackhi_epi64( lo, hi ) );
+            sum = _mm_srli_epi16( _mm_add_epi16( sum, two ), 2 );
+            _mm_storel_epi64( (__m128i*)( dst + 4*x ), _mm_packus_epi16( sum, sum ) );
+        }
+    }
+#endif
+
+    for (; x<dw; x++)
+    {
+        const unsigned int x0 = 2*x * n;
+        const unsigned int x1 = ( (2*x+1 < sw) ? 2*x+1 : 2*x ) * n;
+        unsigned int c;
+        for (c=0; c<n; c++)
+            dst[ x*n + c ] = (unsigned char)(
+                ( row0[ x0+c ] + row0[ x1+c ] + row1[ x0+c ] + row1[ x1+c ] + 2 ) >> 2 );
+    }
+}
+
+// Average in linear space.
+void
+LevelFilter::gammaRow( const unsigned char* row0, const unsigned char* row1,
+    unsigned char* dst ) const
+{
+    const int sw = _srcLevel._width;
+    const int dw = _dstLevel._width;
+    const unsigned int n = _components;
+    int x( 0 );
+
+#ifdef MIPMAP_USE_SSE2
+    if (_simd && (n == 4))
+    {
+        const float* t0 = _toFloat[ 0 ];
+        const float* t1 = _toFloat[ 1 ];
+        const float* t2 = _toFloat[ 2 ];
+        const float* t3 = _toFloat[ 3 ];
+        const __m128 scale = _mm_set_ps( _scale[ 3 ], _scale[ 2 ], _scale[ 1 ], _scale[ 0 ] );
+        for (; x<dw; x++)
+        {
+            const unsigned int x0 = 8*x;
+            const unsigned int x1 = ( (2*x+1 < sw) ? 2*x+1 : 2*x ) * 4;
+            __m128 sum = _mm_set_ps( t3[ row0[ x0+3 ] ], t2[ row0[ x0+2 ] ],
+                t1[ row0[ x0+1 ] ], t0[ row0[ x0 ] ] );
+            sum = _mm_add_ps( sum, _mm_set_ps( t3[ row0[ x1+3 ] ], t2[ row0[ x1+2 ] ],
+                t1[ row0[ x1+1 ] ], t0[ row0[ x1 ] ] ) );
+            sum = _mm_add_ps( sum, _mm_set_ps( t3[ row1[ x0+3 ] ], t2[ row1[ x0+2 ] ],
+                t1[ row1[ x0+1 ] ], t0[ row1[ x0 ] ] ) );
+            sum = _mm_add_ps( sum, _mm_set_ps( t3[ row1[ x1+3 ] ], t2[ row1[ x1+2 ] ],
+                t1[ row1[ x1+1 ] ], t0[ row1[ x1 ] ] ) );
+            // Rounds to nearest.
+            int idx[ 4 ];
+            _mm_storeu_si128( (__m128i*)idx, _mm_cvtps_epi32( _mm_mul_ps( sum, scale ) ) );
+            unsigned int c;
+            for (c=0; c<4; c++)
+                dst[ 4*x + c ] = (_fromFloat[ c ] != NULL) ?
+                    _fromFloat[ c ][ idx[ c ] ] : (unsigned char)idx[ c ];
+        }
+    }
+#endif
+
+    for (; x<dw; x++)
+    {
+        const unsigned int x0 = 2*x * n;
+        const unsigned int x1 = ( (2*x+1 < sw) ? 2*x+1 : 2*x ) * n;
+        unsigned int c;
+        for (c=0; c<n; c++)
+        {
+            const float* t = _toFloat[ c ];
+            const float sum = t[ row0[ x0+c ] ] + t[ row0[ x1+c ] ] +
+                t[ row1[ x0+c ] ] + t[ row1[ x1+c ] ];
+            const unsigned int idx = (unsigned int)( sum * _scale[ c ] + .5f );
+            dst[ x*n + c ] = (_fromFloat[ c ] != NULL) ?
+                _fromFloat[ c ][ idx ] : (unsigned char)idx;
+        }
+    }
+}
+
+class LevelTask : public ParallelTask
+{
+public:
+    LevelTask( const LevelFilter& filter, unsigned int numBands )
+      : _filter( filter ), _numBands( numBands ) {}
+
+    virtual void operator()( unsigned int band )
+    {
+        const int h = _filter._dstLevel._height;
+        _filter.filterRows( h * band / _numBands, h * (band+1) / _numBands );
+    }
+
+protected:
+    const LevelFilter& _filter;
+    const unsigned int _numBands;
+};
+
+// Number of texels in a level whose alpha passes AlphaFunc GREATER
+//   cutoff.
+static unsigned int
+countCoverage( const unsigned char* data, const Level& level,
+    unsigned int components, int alpha, float cutoff )
+{
+    unsigned int count( 0 );
+    int x, y;
+    for (y=0; y<level._height; y++)
+    {
+        const unsigned char* row = data + y * level._rowSize + alpha;
+        for (x=0; x<level._width; x++)
+            if (row[ x*components ] > cutoff * 255.f)
+                count++;
+    }
+    return( count );
+}
+
+// Scale the level's alpha so that about target texels pass the
+//   alpha test.
+static void
+scaleCoverage( unsigned char* data, const Level& level,
+    unsigned int components, int alpha, float cutoff, unsigned int target )
+{
+    unsigned int histogram[ 256 ];
+    memset( histogram, 0, sizeof( histogram ) );
+    int x, y;
+    for (y=0; y<level._height; y++)
+    {
+        const unsigned char* row = data + y * level._rowSize + alpha;
+        for (x=0; x<level._width; x++)
+            histogram[ row[ x*components ] ]++;
+    }
+
+    // Find the lowest alpha value that has to pass to reach the
+    //   target: the target-th highest value.
+    unsigned int count( 0 );
+    int a;
+    for (a=255; a>1; a--)
+    {
+        count += histogram[ a ];
+        if (count >= target)
+            break;
+    }
+
+    // Scale so that a passes and a-1 doesn't.
+    const float threshold = cutoff * 255.f;
+    const float s = threshold / ( a - .5f );
+    if ( (s > .999f) && (s < 1.001f) )
+        return;
+    for (y=0; y<level._height; y++)
+    {
+        unsigned char* row = data + y * level._rowSize + alpha;
+        for (x=0; x<level._width; x++)
+        {
+            const float v = row[ x*components ] * s + .5f;
+            row[ x*components ] = (unsigned char)( (v > 255.f) ? 255.f : v );
+        }
+    }
+}
+
+
+bool
+canGenerateMipmaps( const osg::Image& image )
+{
+    if ( (image.getDataType() != GL_UNSIGNED_BYTE) || (image.r() != 1) ||
+            (image.s() < 1) || (image.t() < 1) || (image.data() == NULL) ||
+            image.isMipmap() )
+        return( false );
+    switch( image.getPixelFormat() )
+    {
+        case GL_LUMINANCE:
+        case GL_ALPHA:
+        case GL_LUMINANCE_ALPHA:
+        case GL_RGB:
+        case GL_RGBA:
+        case GL_BGR:
+        case GL_BGRA:
+            return( true );
+        default:
+            return( false );
+    }
+}
+
+bool
+generateMipmaps( osg::Image& image, const MipmapOptions& options )
+{
+    if (!canGenerateMipmaps( image ))
+        return( false );
+
+    const GLenum pixelFormat = image.getPixelFormat();
+    const GLenum dataType = image.getDataType();
+    const int packing = image.getPacking();
+    const unsigned int components = osg::Image::computeNumComponents( pixelFormat );
+    const int alpha = getAlphaComponent( pixelFormat );
+
+    std::vector< Level > levels;
+    Level level;
+    level._width = image.s();
+    level._height = image.t();
+    level._offset = 0;
+    while (true)
+    {
+        level._rowSize = osg::Image::computeRowWidthInBytes(
+            level._width, pixelFormat, dataType, packing );
+        levels.push_back( level );
+        if ( (level._width == 1) && (level._height == 1) )
+            break;
+        level._offset += level._rowSize * level._height;
+        level._width = (level._width > 1) ? level._width/2 : 1;
+        level._height = (level._height > 1) ? level._height/2 : 1;
+    }
+    const Level& last = levels.back();
+    unsigned char* data = new unsigned char[ last._offset + last._rowSize * last._height ];
+    memcpy( data, image.data(), levels[ 0 ]._rowSize * levels[ 0 ]._height );
+
+    LevelFilter filter;
+    filter._components = components;
+    filter._gammaCorrect = options._gammaCorrect;
+    filter._simd = options._simd;
+    unsigned int c;
+    for (c=0; c<4; c++)
+    {
+        // Alpha isn't color.
+        const bool linear = !options._gammaCorrect || ((int)c == alpha);
+        filter._toFloat[ c ] = linear ? gammaTables._unorm : gammaTables._toLinear;
+        filter._scale[ c ] = .25f * ( linear ? 255.f : (float)( LinearSteps-1 ) );
+        filter._fromFloat[ c ] = linear ? NULL : gammaTables._toSRGB;
+    }
+
+    const bool coverage = (options._alphaCutoff > 0.f) && (alpha >= 0);
+    double coverageFraction( 0. );
+    if (coverage)
+        coverageFraction = countCoverage( data, levels[ 0 ], components,
+            alpha, options._alphaCutoff ) / (double)( levels[ 0 ]._width * levels[ 0 ]._height );
+
+    const unsigned int numThreads = (options._numThreads == 0) ?
+        getDefaultThreadCount() : options._numThreads;
+    unsigned int idx;
+    for (idx=1; idx<levels.size(); idx++)
+    {
+        filter._srcLevel = levels[ idx-1 ];
+        filter._dstLevel = levels[ idx ];
+        filter._src = data + levels[ idx-1 ]._offset;
+        filter._dst = data + levels[ idx ]._offset;
+
+        // Each level needs the whole level above it, so the threads
+        //   split each level's rows between them.
+        unsigned int numBands = levels[ idx ]._height / MinRowsPerBand;
+        if (numBands > numThreads * 4)
+            numBands = numThreads * 4;
+        if ( (numThreads > 1) && (numBands > 1) )
+        {
+            LevelTask task( filter, numBands );
+            runParallel( task, numBands, numThreads );
+        }
+        else
+            filter.filterRows( 0, levels[ idx ]._height );
+
+        if (coverage)
+        {
+            const Level& l = levels[ idx ];
+            const unsigned int target = (unsigned int)(
+                coverageFraction * l._width * l._height + .5 );
+            if (target > 0)
+                scaleCoverage( filter._dst, l, components, alpha,
+                    options._alphaCutoff, target );
+        }
+    }
+
+    osg::Image::MipmapDataType mipmaps;
+    for (idx=1; idx<levels.size(); idx++)
+        mipmaps.push_back( levels[ idx ]._offset );
+    image.setImage( image.s(), image.t(), image.r(), image.getInternalTextureFormat(),
+        pixelFormat, dataType, data, osg::Image::USE_NEW_DELETE, packing );
+    image.setMipmapLevels( mipmaps );
+    return( true );
+}
+
+
+class ImageBatchTask : public ParallelTask
+{
+public:
+    ImageBatchTask( const std::vector< osg::Image* >& images,
+            const MipmapOptions& options )
+      : _images( images ),
+        _options( options ),
+        _done( images.size(), 0 )
+    {
+        // Parallel across images, so one thread per image.
+        _options._numThreads = 1;
+    }
+
+    virtual void operator()( unsigned int index )
+    {
+        if (_images[ index ] != NULL)
+            _done[ index ] = generateMipmaps( *( _images[ index ] ), _options ) ? 1 : 0;
+    }
+
+    const std::vector< osg::Image* >& _images;
+    MipmapOptions _options;
+    std::vector< unsigned char > _done;
+};
+
+unsigned int
+generateMipmaps( const std::vector< osg::Image* >& images,
+    const MipmapOptions& options )
+{
+    ImageBatchTask task( images, options );
+    runParallel( task, images.size(), options._numThreads );
+
+    unsigned int count( 0 );
+    unsigned int idx;
+    for (idx=0; idx<task._done.size(); idx++)
+        count += task._done[ idx ];
+    return( count );
+}
@@ -0,0 +1,58 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// CPU mipmap chain generation for 8-bit images
+
+#ifndef __MIPMAP_GENERATOR_H__
+#define __MIPMAP_GENERATOR_H__
+
+#include <osg/Image>
+#include <string>
+#include <vector>
+
+struct MipmapOptions
+{
+    MipmapOptions();
+
+    // Average color in linear space, treating 8-bit color as sRGB,
+    //   so that mipmaps don't darken. Alpha is always linear.
+    bool _gammaCorrect;
+    // If greater than 0, scale each level's alpha so that the
+    //   fraction of texels an AlphaFunc GREATER test with this
+    //   reference value passes stays what it is in level 0. Keeps
+    //   alpha-tested foliage from thinning out with distance.
+    float _alphaCutoff;
+    // Use the SSE2 kernels, where the compiler targets SSE2.
+    bool _simd;
+    // Threads for the rows of one image; 0 uses
+    //   getDefaultThreadCount(). Small levels always use one.
+    unsigned int _numThreads;
+};
+
+// The plain path, for comparison: a 2x2 box filter on the stored
+//   8-bit values, scalar, on one thread.
+MipmapOptions getNaiveMipmapOptions();
+
+// True if generateMipmaps() handles the image: an uncompressed 2D
+//   GL_UNSIGNED_BYTE image in a LUMINANCE, ALPHA, LUMINANCE_ALPHA,
+//   RGB, RGBA, BGR or BGRA format, without mipmaps yet.
+bool canGenerateMipmaps( const osg::Image& image );
+
+// Replace image's data with a copy that has the full mipmap chain
+//   down to 1x1, each level a 2x2 box filter of the one above (the
+//   last row or column repeats at odd sizes). Returns false, and
+//   leaves the image alone, if canGenerateMipmaps() is false.
+bool generateMipmaps( osg::Image& image,
+    const MipmapOptions& options=MipmapOptions() );
+
+// generateMipmaps() for many images at once, in parallel across
+//   images; options._numThreads is the number of threads for the
+//   whole batch. Images it can't handle are skipped. Returns the
+//   number of images given mipmaps.
+unsigned int generateMipmaps( const std::vector< osg::Image* >& images,
+    const MipmapOptions& options=MipmapOptions() );
+
+#endif
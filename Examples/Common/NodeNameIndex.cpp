@@ -0,0 +1,269 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// Incrementally maintained index from node names to nodes
+
+#include "NodeNameIndex.h"
+
+
+const NodeNameIndex::NameId NodeNameIndex::InvalidName( ~0u );
+
+// Returned by lookups that find nothing.
+static const NodeNameIndex::NodeList s_emptyList;
+
+
+NodeNameIndex::NodeNameIndex()
+{
+    rehash( 64 );
+}
+
+NodeNameIndex::NodeNameIndex( osg::Node* root )
+{
+    rehash( 64 );
+    setRoot( root );
+}
+
+void
+NodeNameIndex::setRoot( osg::Node* root )
+{
+    _entries.clear();
+    unsigned int idx;
+    for (idx=0; idx<_byName.size(); idx++)
+        _byName[ idx ].clear();
+
+    _root = root;
+    if (_root.valid())
+        addRef( _root.get() );
+}
+
+
+// FNV-1a; names are short, so this is cheaper than a compare
+//   against every name in the graph.
+unsigned int
+NodeNameIndex::hash( const std::string& name )
+{
+    unsigned int h( 2166136261u );
+    unsigned int idx;
+    for (idx=0; idx<name.size(); idx++)
+    {
+        h ^= (unsigned char)name[ idx ];
+        h *= 16777619u;
+    }
+    return( h );
+}
+
+void
+NodeNameIndex::rehash( unsigned int numBuckets )
+{
+    _buckets.assign( numBuckets, InvalidName );
+    _next.assign( _names.size(), InvalidName );
+    NameId id;
+    for (id=0; id<_names.size(); id++)
+    {
+        const unsigned int b = hash( _names[ id ] ) & ( numBuckets - 1 );
+        _next[ id ] = _buckets[ b ];
+        _buckets[ b ] = id;
+    }
+}
+
+NodeNameIndex::NameId
+NodeNameIndex::getNameId( const std::string& name ) const
+{
+    NameId id = _buckets[ hash( name ) & ( _buckets.size() - 1 ) ];
+    while ( (id != InvalidName) && (_names[ id ] != name) )
+        id = _next[ id ];
+    return( id );
+}
+
+NodeNameIndex::NameId
+NodeNameIndex::intern( const std::string& name )
+{
+    NameId id = getNameId( name );
+    if (id != InvalidName)
+        return( id );
+
+    id = _names.size();
+    _names.push_back( name );
+    _byName.push_back( NodeList() );
+    _sorted[ name ] = id;
+
+    // Keep the load factor at or below one. The bucket count
+    //   stays a power of two.
+    if (_names.size() > _buckets.size())
+        rehash( _buckets.size() * 2 );
+    else
+    {
+        const unsigned int b = hash( name ) & ( _buckets.size() - 1 );
+        _next.push_back( _buckets[ b ] );
+        _buckets[ b ] = id;
+    }
+    return( id );
+}
+
+
+const NodeNameIndex::NodeList&
+NodeNameIndex::find( NameId id ) const
+{
+    if (id >= _byName.size())
+        return( s_emptyList );
+    return( _byName[ id ] );
+}
+
+const NodeNameIndex::NodeList&
+NodeNameIndex::find( const std::string& name ) const
+{
+    return( find( getNameId( name ) ) );
+}
+
+osg::Node*
+NodeNameIndex::findFirst( const std::string& name ) const
+{
+    const NodeList& nodes = find( name );
+    return( nodes.empty() ? NULL : nodes[ 0 ] );
+}
+
+void
+NodeNameIndex::find( const std::vector< std::string >& names,
+    NodeList& nodes ) const
+{
+    unsigned int idx;
+    for (idx=0; idx<names.size(); idx++)
+    {
+        const NodeList& found = find( names[ idx ] );
+        nodes.insert( nodes.end(), found.begin(), found.end() );
+    }
+}
+
+void
+NodeNameIndex::findPrefix( const std::string& prefix, NodeList& nodes ) const
+{
+    // Names with the prefix sort together, starting at the prefix.
+    std::map< std::string, NameId >::const_iterator it =
+            _sorted.lower_bound( prefix );
+    for ( ; it != _sorted.end(); it++)
+    {
+        if (it->first.compare( 0, prefix.size(), prefix ) != 0)
+            break;
+        const NodeList& found = _byName[ it->second ];
+        nodes.insert( nodes.end(), found.begin(), found.end() );
+    }
+}
+
+
+bool
+NodeNameIndex::addChild( osg::Group* parent, osg::Node* child )
+{
+    if ( (parent == NULL) || (child == NULL) || !parent->addChild( child ) )
+        return( false );
+    if (_entries.find( parent ) != _entries.end())
+        addRef( child );
+    return( true );
+}
+
+bool
+NodeNameIndex::removeChild( osg::Group* parent, osg::Node* child )
+{
+    if ( (parent == NULL) || (child == NULL) || !parent->containsNode( child ) )
+        return( false );
+
+    // Hold a reference so the child outlives its removal from
+    //   both the parent and the index.
+    osg::ref_ptr< osg::Node > keep( child );
+    parent->removeChild( child );
+    if (_entries.find( parent ) != _entries.end())
+        removeRef( child );
+    return( true );
+}
+
+void
+NodeNameIndex::setName( osg::Node* node, const std::string& name )
+{
+    node->setName( name );
+    EntryMap::iterator it = _entries.find( node );
+    if (it == _entries.end())
+        return;
+    eraseName( it->second );
+    insertName( node, it->second );
+}
+
+
+// Count one more indexed edge into node. On the first, add node
+//   and everything below it.
+void
+NodeNameIndex::addRef( osg::Node* node )
+{
+    EntryMap::iterator it = _entries.find( node );
+    if (it != _entries.end())
+    {
+        it->second._refs++;
+        return;
+    }
+
+    Entry& entry = _entries[ node ];
+    entry._refs = 1;
+    insertName( node, entry );
+
+    osg::Group* grp = node->asGroup();
+    if (grp != NULL)
+    {
+        unsigned int idx;
+        for (idx=0; idx<grp->getNumChildren(); idx++)
+            addRef( grp->getChild( idx ) );
+    }
+}
+
+// Count one less indexed edge into node. On the last, remove node
+//   and release its children.
+void
+NodeNameIndex::removeRef( osg::Node* node )
+{
+    EntryMap::iterator it = _entries.find( node );
+    if (it == _entries.end())
+        return;
+    if (--it->second._refs > 0)
+        return;
+
+    eraseName( it->second );
+    _entries.erase( it );
+
+    osg::Group* grp = node->asGroup();
+    if (grp != NULL)
+    {
+        unsigned int idx;
+        for (idx=0; idx<grp->getNumChildren(); idx++)
+            removeRef( grp->getChild( idx ) );
+    }
+}
+
+void
+NodeNameIndex::insertName( osg::Node* node, Entry& entry )
+{
+    if (node->getName().empty())
+    {
+        entry._name = InvalidName;
+        return;
+    }
+    entry._name = intern( node->getName() );
+    NodeList& nodes = _byName[ entry._name ];
+    entry._slot = nodes.size();
+    nodes.push_back( node );
+}
+
+void
+NodeNameIndex::eraseName( Entry& entry )
+{
+    if (entry._name == InvalidName)
+        return;
+
+    // Move the last node in the list into the vacated slot.
+    NodeList& nodes = _byName[ entry._name ];
+    osg::Node* last = nodes.back();
+    nodes[ entry._slot ] = last;
+    nodes.pop_back();
+    if (entry._slot < nodes.size())
+        _entries[ last ]._slot = entry._slot;
+    entry._name = InvalidName;
+}
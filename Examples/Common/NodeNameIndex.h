@@ -0,0 +1,106 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// Incrementally maintained index from node names to nodes
+
+#ifndef __NODE_NAME_INDEX_H__
+#define __NODE_NAME_INDEX_H__
+
+#include <osg/Node>
+#include <osg/Group>
+#include <osg/ref_ptr>
+#include <map>
+#include <string>
+#include <vector>
+
+// Maps the names of every node under a root node to the nodes that
+//   carry them. The index is built with one traversal when the root
+//   is set. After that, make graph changes through addChild(),
+//   removeChild() and setName() below, which update the index in
+//   place instead of traversing again.
+//
+// Names are interned: each distinct name gets a NameId, and a lookup
+//   by NameId is a single array access. A lookup by string hashes
+//   the string once. Nodes reachable along several paths are listed
+//   once.
+class NodeNameIndex
+{
+public:
+    typedef std::vector< osg::Node* > NodeList;
+    typedef unsigned int NameId;
+
+    // The NameId of a name that has never been interned.
+    static const NameId InvalidName;
+
+    NodeNameIndex();
+    NodeNameIndex( osg::Node* root );
+
+    // Index root and everything below it, replacing any previous
+    //   contents (interned names are kept).
+    void setRoot( osg::Node* root );
+    osg::Node* getRoot() { return( _root.get() ); }
+
+    // Return the NameId for name, creating one if necessary.
+    NameId intern( const std::string& name );
+    // Return the NameId for name, or InvalidName.
+    NameId getNameId( const std::string& name ) const;
+
+    // All nodes with the given name, or an empty list.
+    const NodeList& find( NameId id ) const;
+    const NodeList& find( const std::string& name ) const;
+    // The first node with the given name, or NULL.
+    osg::Node* findFirst( const std::string& name ) const;
+    // Append the nodes with any of the given names.
+    void find( const std::vector< std::string >& names, NodeList& nodes ) const;
+    // Append the nodes whose names start with prefix.
+    void findPrefix( const std::string& prefix, NodeList& nodes ) const;
+
+    // Graph edits that keep the index up to date. parent need not
+    //   be in the indexed graph, in which case only the graph
+    //   changes.
+    bool addChild( osg::Group* parent, osg::Node* child );
+    bool removeChild( osg::Group* parent, osg::Node* child );
+    void setName( osg::Node* node, const std::string& name );
+
+    // Number of distinct nodes in the indexed graph.
+    unsigned int getNumNodes() const { return( _entries.size() ); }
+
+protected:
+    struct Entry
+    {
+        // Edges into this node from indexed parents.
+        unsigned int _refs;
+        NameId _name;
+        // Position in _byName[ _name ].
+        unsigned int _slot;
+    };
+    typedef std::map< osg::Node*, Entry > EntryMap;
+
+    void addRef( osg::Node* node );
+    void removeRef( osg::Node* node );
+    void insertName( osg::Node* node, Entry& entry );
+    void eraseName( Entry& entry );
+
+    static unsigned int hash( const std::string& name );
+    void rehash( unsigned int numBuckets );
+
+    osg::ref_ptr< osg::Node > _root;
+    EntryMap _entries;
+
+    // Interned names. _byName[id] lists the nodes named _names[id].
+    std::vector< std::string > _names;
+    std::vector< NodeList > _byName;
+
+    // Chained hash table over _names: _buckets holds the first
+    //   NameId in each chain and _next the rest.
+    std::vector< NameId > _buckets;
+    std::vector< NameId > _next;
+
+    // Sorted names for prefix lookups.
+    std::map< std::string, NameId > _sorted;
+};
+
+#endif
@@ -0,0 +1,338 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// Software occlusion culling against a hierarchical depth buffer
+
+#include "OcclusionCuller.h"
+#include "FrameRecorder.h"
+#include <osg/Geometry>
+#include <osg/TriangleFunctor>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && ( _M_IX86_FP >= 2 ) )
+#  define OCCLUSION_USE_SSE2
+#  include <emmintrin.h>
+#endif
+
+
+// Clip-space w below which a vertex counts as at or behind the eye.
+static const float MinW( 1e-5f );
+// Texels per side a test reads, at most, before going a level
+//   coarser.
+static const int MaxTestTexels( 4 );
+
+
+// Collects the triangles of a Geometry through a TriangleFunctor.
+struct OccluderCollector
+{
+    OccluderCollector() : _triangles( NULL ) {}
+
+    void operator()( const osg::Vec3& v1, const osg::Vec3& v2,
+            const osg::Vec3& v3, bool )
+    {
+        _triangles->push_back( v1 );
+        _triangles->push_back( v2 );
+        _triangles->push_back( v3 );
+    }
+
+    std::vector< osg::Vec3 >* _triangles;
+};
+
+
+OcclusionStats::OcclusionStats()
+  : _occluders( 0 ),
+    _occluderTriangles( 0 ),
+    _tested( 0 ),
+    _rejected( 0 ),
+    _rasterizeTime( 0. ),
+    _testTime( 0. )
+{
+}
+
+
+OcclusionCuller::OcclusionCuller( unsigned int width, unsigned int height )
+  : _width( std::max( width, 1u ) ),
+    _height( std::max( height, 1u ) ),
+    _maxOccluders( 32 ),
+    _maxOccluderTriangles( 65536 ),
+    _frameStart( 0 ),
+    _testStart( 0 ),
+    _rasterizeScope( FrameRecorder::instance()->getScope( "OcclusionCuller rasterize" ) ),
+    _testScope( FrameRecorder::instance()->getScope( "OcclusionCuller test" ) )
+{
+    unsigned int w( _width ), h( _height );
+    while (true)
+    {
+        Level level;
+        level._width = w;
+        level._height = h;
+        level._stride = ( w + 3 ) & ~3u;
+        level._depth.resize( level._stride * h, FLT_MAX );
+        _levels.push_back( level );
+        if ((w == 1) && (h == 1))
+            break;
+        w = ( w + 1 ) / 2;
+        h = ( h + 1 ) / 2;
+    }
+}
+
+void
+OcclusionCuller::beginFrame( const osg::Matrix& viewProjection )
+{
+    _frameStart = osg::Timer::instance()->tick();
+    _viewProjection = viewProjection;
+    _stats = OcclusionStats();
+    std::fill( _levels[ 0 ]._depth.begin(), _levels[ 0 ]._depth.end(), FLT_MAX );
+}
+
+const std::vector< osg::Vec3 >&
+OcclusionCuller::getTriangles( const osg::Geode& geode )
+{
+    std::map< const osg::Geode*, std::vector< osg::Vec3 > >::iterator it =
+            _triangles.find( &geode );
+    if (it != _triangles.end())
+        return( it->second );
+
+    std::vector< osg::Vec3 >& triangles = _triangles[ &geode ];
+    osg::TriangleFunctor< OccluderCollector > tf;
+    tf._triangles = &triangles;
+    unsigned int idx;
+    for (idx=0; idx<geode.getNumDrawables(); idx++)
+    {
+        const osg::Geometry* geom = geode.getDrawable( idx )->asGeometry();
+        if (geom != NULL)
+            geom->accept( tf );
+    }
+    return( triangles );
+}
+
+bool
+OcclusionCuller::addOccluder( const osg::Geode& geode, const osg::Matrix& localToWorld )
+{
+    if ((_stats._occluders >= _maxOccluders) ||
+            (_stats._occluderTriangles >= _maxOccluderTriangles))
+        return( false );
+
+    const std::vector< osg::Vec3 >& triangles = getTriangles( geode );
+    const osg::Matrix m( localToWorld * _viewProjection );
+    unsigned int idx;
+    for (idx=0; idx+2<triangles.size(); idx+=3)
+        drawTriangle( osg::Vec4( triangles[ idx ], 1.f ) * m,
+                osg::Vec4( triangles[ idx+1 ], 1.f ) * m,
+                osg::Vec4( triangles[ idx+2 ], 1.f ) * m );
+
+    _stats._occluders++;
+    _stats._occluderTriangles += triangles.size() / 3;
+    return( true );
+}
+
+void
+OcclusionCuller::drawTriangle( const osg::Vec4& c0, const osg::Vec4& c1, const osg::Vec4& c2 )
+{
+    // Clipping at the near plane would add vertices; dropping the
+    //   triangle only loses occlusion.
+    if ((c0.w() < MinW) || (c1.w() < MinW) || (c2.w() < MinW))
+        return;
+
+    // Window coordinates, with pixel centers at half integers.
+    const float w( (float)_width ), h( (float)_height );
+    float x[ 3 ], y[ 3 ], z[ 3 ];
+    const osg::Vec4* c[ 3 ] = { &c0, &c1, &c2 };
+    unsigned int idx;
+    for (idx=0; idx<3; idx++)
+    {
+        const float invW = 1.f / c[ idx ]->w();
+        x[ idx ] = ( c[ idx ]->x() * invW * .5f + .5f ) * w;
+        y[ idx ] = ( c[ idx ]->y() * invW * .5f + .5f ) * h;
+        z[ idx ] = c[ idx ]->z() * invW;
+    }
+
+    // Either winding occludes; make it counterclockwise.
+    float area = ( x[ 1 ] - x[ 0 ] ) * ( y[ 2 ] - y[ 0 ] ) -
+            ( x[ 2 ] - x[ 0 ] ) * ( y[ 1 ] - y[ 0 ] );
+    if (area == 0.f)
+        return;
+    if (area < 0.f)
+    {
+        std::swap( x[ 1 ], x[ 2 ] );
+        std::swap( y[ 1 ], y[ 2 ] );
+        std::swap( z[ 1 ], z[ 2 ] );
+        area = -area;
+    }
+
+    const int xMin = std::max( (int)floor( std::min( x[ 0 ], std::min( x[ 1 ], x[ 2 ] ) ) ), 0 );
+    const int xMax = std::min( (int)ceil( std::max( x[ 0 ], std::max( x[ 1 ], x[ 2 ] ) ) ), (int)_width - 1 );
+    const int yMin = std::max( (int)floor( std::min( y[ 0 ], std::min( y[ 1 ], y[ 2 ] ) ) ), 0 );
+    const int yMax = std::min( (int)ceil( std::max( y[ 0 ], std::max( y[ 1 ], y[ 2 ] ) ) ), (int)_height - 1 );
+    if ((xMin > xMax) || (yMin > yMax))
+        return;
+
+    // Edge functions a*x + b*y + c, positive inside. Edge e runs
+    //   from vertex e+1 to vertex e+2, opposite vertex e, so it's
+    //   also that vertex's barycentric weight times area.
+    float a[ 3 ], b[ 3 ], e[ 3 ];
+    for (idx=0; idx<3; idx++)
+    {
+        const unsigned int i0 = ( idx + 1 ) % 3, i1 = ( idx + 2 ) % 3;
+        a[ idx ] = y[ i0 ] - y[ i1 ];
+        b[ idx ] = x[ i1 ] - x[ i0 ];
+        e[ idx ] = x[ i0 ] * y[ i1 ] - x[ i1 ] * y[ i0 ];
+    }
+    // Depth as a plane over the window, raised to its farthest within
+    //   a pixel.
+    const float invArea = 1.f / area;
+    const float za = ( a[ 0 ] * z[ 0 ] + a[ 1 ] * z[ 1 ] + a[ 2 ] * z[ 2 ] ) * invArea;
+    const float zb = ( b[ 0 ] * z[ 0 ] + b[ 1 ] * z[ 1 ] + b[ 2 ] * z[ 2 ] ) * invArea;
+    const float zc = ( e[ 0 ] * z[ 0 ] + e[ 1 ] * z[ 1 ] + e[ 2 ] * z[ 2 ] ) * invArea +
+            .5f * ( fabs( za ) + fabs( zb ) );
+
+    Level& level = _levels[ 0 ];
+    // Start on a multiple of four; the pixels before xMin fail the
+    //   edge tests, and the padding absorbs those past the width.
+    const int xStart = xMin & ~3;
+    int py;
+    for (py=yMin; py<=yMax; py++)
+    {
+        const float fy = py + .5f;
+        float* row = &level._depth[ py * level._stride ];
+        const float r0 = b[ 0 ] * fy + e[ 0 ];
+        const float r1 = b[ 1 ] * fy + e[ 1 ];
+        const float r2 = b[ 2 ] * fy + e[ 2 ];
+        const float rz = zb * fy + zc;
+        int px( xStart );
+#ifdef OCCLUSION_USE_SSE2
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 a0 = _mm_set1_ps( a[ 0 ] ), a1 = _mm_set1_ps( a[ 1 ] ), a2 = _mm_set1_ps( a[ 2 ] );
+        const __m128 az = _mm_set1_ps( za );
+        const __m128 v0 = _mm_set1_ps( r0 ), v1 = _mm_set1_ps( r1 ), v2 = _mm_set1_ps( r2 );
+        const __m128 vz = _mm_set1_ps( rz );
+        const __m128 four = _mm_set1_ps( 4.f );
+        __m128 fx = _mm_setr_ps( px + .5f, px + 1.5f, px + 2.5f, px + 3.5f );
+        for (; px<=xMax; px+=4, fx=_mm_add_ps( fx, four ))
+        {
+            const __m128 inside = _mm_and_ps(
+                _mm_cmpge_ps( _mm_add_ps( _mm_mul_ps( a0, fx ), v0 ), zero ),
+                _mm_and_ps( _mm_cmpge_ps( _mm_add_ps( _mm_mul_ps( a1, fx ), v1 ), zero ),
+                    _mm_cmpge_ps( _mm_add_ps( _mm_mul_ps( a2, fx ), v2 ), zero ) ) );
+            const __m128 depth = _mm_add_ps( _mm_mul_ps( az, fx ), vz );
+            const __m128 old = _mm_loadu_ps( row + px );
+            const __m128 nearer = _mm_min_ps( old, depth );
+            _mm_storeu_ps( row + px, _mm_or_ps( _mm_and_ps( inside, nearer ),
+                    _mm_andnot_ps( inside, old ) ) );
+        }
+#else
+        for (; px<=xMax; px++)
+        {
+            const float fx = px + .5f;
+            if ((a[ 0 ] * fx + r0 >= 0.f) && (a[ 1 ] * fx + r1 >= 0.f) &&
+                    (a[ 2 ] * fx + r2 >= 0.f))
+                row[ px ] = std::min( row[ px ], za * fx + rz );
+        }
+#endif
+    }
+}
+
+void
+OcclusionCuller::endOccluders()
+{
+    // Each texel holds the farthest depth of the up to four texels
+    //   below it.
+    unsigned int lIdx;
+    for (lIdx=1; lIdx<_levels.size(); lIdx++)
+    {
+        const Level& fine = _levels[ lIdx-1 ];
+        Level& coarse = _levels[ lIdx ];
+        unsigned int tx, ty;
+        for (ty=0; ty<coarse._height; ty++)
+        {
+            const float* row0 = &fine._depth[ ( ty * 2 ) * fine._stride ];
+            const float* row1 = &fine._depth[ std::min( ty * 2 + 1, fine._height - 1 ) * fine._stride ];
+            float* out = &coarse._depth[ ty * coarse._stride ];
+            for (tx=0; tx<coarse._width; tx++)
+            {
+                const unsigned int x0 = tx * 2;
+                const unsigned int x1 = std::min( x0 + 1, fine._width - 1 );
+                out[ tx ] = std::max( std::max( row0[ x0 ], row0[ x1 ] ),
+                        std::max( row1[ x0 ], row1[ x1 ] ) );
+            }
+        }
+    }
+
+    _testStart = osg::Timer::instance()->tick();
+    _stats._rasterizeTime = osg::Timer::instance()->delta_m( _frameStart, _testStart );
+}
+
+bool
+OcclusionCuller::isOccluded( const osg::BoundingBox& bb, const osg::Matrix& localToWorld )
+{
+    if (!bb.valid())
+        return( false );
+    _stats._tested++;
+
+    const osg::Matrix m( localToWorld * _viewProjection );
+    float xMin( FLT_MAX ), yMin( FLT_MAX ), zMin( FLT_MAX );
+    float xMax( -FLT_MAX ), yMax( -FLT_MAX );
+    unsigned int idx;
+    for (idx=0; idx<8; idx++)
+    {
+        const osg::Vec4 c = osg::Vec4( bb.corner( idx ), 1.f ) * m;
+        if (c.w() < MinW)
+            return( false );
+        const float invW = 1.f / c.w();
+        xMin = std::min( xMin, c.x() * invW );
+        xMax = std::max( xMax, c.x() * invW );
+        yMin = std::min( yMin, c.y() * invW );
+        yMax = std::max( yMax, c.y() * invW );
+        zMin = std::min( zMin, c.z() * invW );
+    }
+
+    // Every pixel the box touches, clamped to the window.
+    const int px0 = std::max( (int)floor( ( xMin * .5f + .5f ) * _width ), 0 );
+    const int px1 = std::min( (int)floor( ( xMax * .5f + .5f ) * _width ), (int)_width - 1 );
+    const int py0 = std::max( (int)floor( ( yMin * .5f + .5f ) * _height ), 0 );
+    const int py1 = std::min( (int)floor( ( yMax * .5f + .5f ) * _height ), (int)_height - 1 );
+    if ((px0 > px1) || (py0 > py1))
+        return( false );
+
+    // The finest level where the box spans a few texels.
+    unsigned int lIdx( 0 );
+    while ((lIdx+1 < _levels.size()) &&
+            (( px1 >> lIdx ) - ( px0 >> lIdx ) >= MaxTestTexels ||
+            ( py1 >> lIdx ) - ( py0 >> lIdx ) >= MaxTestTexels))
+        lIdx++;
+
+    const Level& level = _levels[ lIdx ];
+    int tx, ty;
+    for (ty=( py0 >> lIdx ); ty<=( py1 >> lIdx ); ty++)
+    {
+        const float* row = &level._depth[ ty * level._stride ];
+        for (tx=( px0 >> lIdx ); tx<=( px1 >> lIdx ); tx++)
+            if (row[ tx ] >= zMin)
+                return( false );
+    }
+
+    _stats._rejected++;
+    return( true );
+}
+
+void
+OcclusionCuller::endFrame()
+{
+    _stats._testTime = osg::Timer::instance()->delta_m(
+        _testStart, osg::Timer::instance()->tick() );
+    FrameRecorder::instance()->record( _rasterizeScope, _stats._rasterizeTime );
+    FrameRecorder::instance()->record( _testScope, _stats._testTime );
+}
+
+float
+OcclusionCuller::getDepth( unsigned int x, unsigned int y ) const
+{
+    const Level& level = _levels[ 0 ];
+    if ((x >= level._width) || (y >= level._height))
+        return( FLT_MAX );
+    return( level._depth[ y * level._stride + x ] );
+}
@@ -0,0 +1,117 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// Software occlusion culling against a hierarchical depth buffer
+
+#ifndef __OCCLUSION_CULLER_H__
+#define __OCCLUSION_CULLER_H__
+
+#include <osg/Referenced>
+#include <osg/Geode>
+#include <osg/Matrix>
+#include <osg/BoundingBox>
+#include <osg/Timer>
+#include <map>
+#include <vector>
+
+// What one frame of occlusion culling did.
+struct OcclusionStats
+{
+    OcclusionStats();
+
+    unsigned int _occluders;
+    unsigned int _occluderTriangles;
+    unsigned int _tested;
+    unsigned int _rejected;
+    // Milliseconds spent drawing occluders and building the
+    //   hierarchy, and testing bounds.
+    double _rasterizeTime;
+    double _testTime;
+};
+
+// A low-resolution depth buffer on the CPU. Each frame, a few large
+//   opaque objects (occluders) are drawn into it, and the buffer is
+//   reduced into a hierarchy whose texels hold the farthest depth
+//   of the texels below. A bounding box is occluded when its nearest
+//   depth is behind the farthest depth in every texel it covers,
+//   which one coarse level usually answers in a few reads.
+//
+// Pixels take an occluder's depth where a triangle covers their
+//   centers, as the GPU would draw it, but at the triangle's
+//   farthest depth within the pixel. Triangles crossing the near
+//   plane aren't drawn, and bounds crossing it are never occluded.
+//   Four pixels are drawn at a time with SSE2 where the compiler
+//   targets it.
+class OcclusionCuller : public osg::Referenced
+{
+public:
+    OcclusionCuller( unsigned int width=256, unsigned int height=128 );
+
+    // Draw at most this many occluders per frame, and stop adding
+    //   occluders once this many triangles have been drawn.
+    void setMaxOccluders( unsigned int count ) { _maxOccluders = count; }
+    unsigned int getMaxOccluders() const { return( _maxOccluders ); }
+    void setMaxOccluderTriangles( unsigned int count ) { _maxOccluderTriangles = count; }
+    unsigned int getMaxOccluderTriangles() const { return( _maxOccluderTriangles ); }
+
+    // Clear the buffer for a frame seen through viewProjection, the
+    //   view matrix times the projection matrix.
+    void beginFrame( const osg::Matrix& viewProjection );
+    // Draw the triangles of geode's Geometry drawables, placed in the
+    //   world by localToWorld. Returns false, drawing nothing, once
+    //   the occluder or triangle budget is spent. Triangles are
+    //   cached per Geode; call clearCache() if their vertices change.
+    bool addOccluder( const osg::Geode& geode, const osg::Matrix& localToWorld );
+    // Build the hierarchy. Call after the last addOccluder().
+    void endOccluders();
+
+    // Whether bb, placed in the world by localToWorld, is hidden
+    //   behind the occluders.
+    bool isOccluded( const osg::BoundingBox& bb, const osg::Matrix& localToWorld );
+    // Call after the last isOccluded() of the frame. The test time is
+    //   the time since endOccluders(). Both times also go to
+    //   FrameRecorder::instance(), as the "OcclusionCuller
+    //   rasterize" and "OcclusionCuller test" scopes.
+    void endFrame();
+
+    // This frame's statistics.
+    const OcclusionStats& getStats() const { return( _stats ); }
+
+    void clearCache() { _triangles.clear(); }
+
+    unsigned int getWidth() const { return( _width ); }
+    unsigned int getHeight() const { return( _height ); }
+    // Depth at pixel (x,y) of level 0, as normalized device z.
+    float getDepth( unsigned int x, unsigned int y ) const;
+
+protected:
+    virtual ~OcclusionCuller() {}
+
+    const std::vector< osg::Vec3 >& getTriangles( const osg::Geode& geode );
+    void drawTriangle( const osg::Vec4& c0, const osg::Vec4& c1, const osg::Vec4& c2 );
+
+    unsigned int _width, _height;
+    unsigned int _maxOccluders, _maxOccluderTriangles;
+
+    osg::Matrix _viewProjection;
+
+    // Level 0 rows are padded to a multiple of four pixels. Each
+    //   coarser level halves the one before, rounding up.
+    struct Level
+    {
+        unsigned int _width, _height, _stride;
+        std::vector< float > _depth;
+    };
+    std::vector< Level > _levels;
+
+    std::map< const osg::Geode*, std::vector< osg::Vec3 > > _triangles;
+
+    OcclusionStats _stats;
+    osg::Timer_t _frameStart, _testStart;
+    unsigned int _rasterizeScope, _testScope;
+};
+
+#endif
@@ -0,0 +1,106 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// Minimal OpenThreads-based parallel loop used by the example utilities
+
+#include "ParallelLoop.h"
+#include <OpenThreads/Thread>
+#include <OpenThreads/Mutex>
+#include <OpenThreads/ScopedLock>
+#include <cstdlib>
+#include <vector>
+
+
+// Work items are handed out one at a time from a shared counter,
+//   so threads that draw cheap items keep taking more.
+class WorkQueue
+{
+public:
+    WorkQueue( ParallelTask& task, unsigned int count )
+      : _task( task ), _count( count ), _next( 0 ) {}
+
+    void drain()
+    {
+        unsigned int index;
+        while (take( index ))
+            _task( index );
+    }
+
+protected:
+    bool take( unsigned int& index )
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _mutex );
+        if (_next >= _count)
+            return( false );
+        index = _next++;
+        return( true );
+    }
+
+    ParallelTask& _task;
+    const unsigned int _count;
+    unsigned int _next;
+    OpenThreads::Mutex _mutex;
+};
+
+class WorkerThread : public OpenThreads::Thread
+{
+public:
+    WorkerThread( WorkQueue& queue ) : _queue( queue ) {}
+
+    virtual void run() { _queue.drain(); }
+
+protected:
+    WorkQueue& _queue;
+};
+
+
+unsigned int
+getDefaultThreadCount()
+{
+    const char* env = getenv( "OSGQSG_THREADS" );
+    if (env != NULL)
+    {
+        int n = atoi( env );
+        if (n > 0)
+            return( (unsigned int)n );
+    }
+    int n = OpenThreads::GetNumberOfProcessors();
+    return( (n > 0) ? (unsigned int)n : 1 );
+}
+
+void
+runParallel( ParallelTask& task, unsigned int count,
+    unsigned int numThreads )
+{
+    if (numThreads == 0)
+        numThreads = getDefaultThreadCount();
+    if (numThreads > count)
+        numThreads = count;
+
+    WorkQueue queue( task, count );
+    if (numThreads <= 1)
+    {
+        queue.drain();
+        return;
+    }
+
+    std::vector< WorkerThread* > threads;
+    unsigned int idx;
+    for (idx=1; idx<numThreads; idx++)
+    {
+        WorkerThread* thread = new WorkerThread( queue );
+        thread->start();
+        threads.push_back( thread );
+    }
+
+    // The calling thread works too, then waits for the others.
+    queue.drain();
+    for (idx=0; idx<threads.size(); idx++)
+    {
+        threads[ idx ]->join();
+        delete threads[ idx ];
+    }
+}
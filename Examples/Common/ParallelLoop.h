@@ -0,0 +1,35 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// Minimal OpenThreads-based parallel loop used by the example utilities
+
+#ifndef __PARALLEL_LOOP_H__
+#define __PARALLEL_LOOP_H__
+
+// Derive a class from ParallelTask and implement operator() to
+//   process one work item. runParallel() calls operator() exactly
+//   once for each index in [0,count), from several threads at once,
+//   so operator() must only write data owned by its index.
+class ParallelTask
+{
+public:
+    virtual ~ParallelTask() {}
+
+    virtual void operator()( unsigned int index ) = 0;
+};
+
+// Return the number of threads runParallel() uses by default: one
+//   per processor, or the value of the OSGQSG_THREADS environment
+//   variable if it is set.
+unsigned int getDefaultThreadCount();
+
+// Run task(0) through task(count-1) on numThreads threads, and
+//   return when all of them are done. The calling thread does its
+//   share of the work. A numThreads of 0 uses getDefaultThreadCount().
+void runParallel( ParallelTask& task, unsigned int count,
+    unsigned int numThreads=0 );
+
+#endif
@@ -0,0 +1,680 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// Parallel update traversal of independent subtrees
+
+#include "ParallelUpdate.h"
+#include "ParallelLoop.h"
+#include <osg/Geode>
+#include <osg/StateSet>
+#include <osg/NodeVisitor>
+#include <OpenThreads/Thread>
+#include <OpenThreads/Mutex>
+#include <OpenThreads/Condition>
+#include <OpenThreads/ScopedLock>
+#include <algorithm>
+#include <cstring>
+
+
+static const unsigned int NoUnit( ~0u );
+// Batches per thread to aim for; more leave more to steal.
+static const unsigned int BatchesPerThread( 16 );
+
+// Node classes whose traversal visits every child, in order, and
+//   does nothing else during the update traversal.
+static const char* splittableClasses[][ 2 ] = {
+    { "osg", "Group" },
+    { "osg", "MatrixTransform" },
+    { "osg", "PositionAttitudeTransform" },
+    { "osgQSG", "SpatialGroup" },
+    { NULL, NULL }
+};
+
+// Whether the update traversal does anything at node, the test
+//   osgUtil::UpdateVisitor makes.
+static bool
+needsUpdate( const osg::Node& node )
+{
+    const osg::StateSet* ss = node.getStateSet();
+    return( (node.getUpdateCallback() != NULL) ||
+        (node.getNumChildrenRequiringUpdateTraversal() > 0) ||
+        ( (ss != NULL) && ss->requiresUpdateTraversal() ) );
+}
+
+struct HeavierUnit
+{
+    HeavierUnit( const std::vector< ParallelUpdateCallback::Unit >& units )
+      : _units( units ) {}
+    bool operator()( unsigned int a, unsigned int b ) const
+    {
+        return( _units[ a ]._cost > _units[ b ]._cost );
+    }
+    const std::vector< ParallelUpdateCallback::Unit >& _units;
+};
+
+
+// The threads of one ParallelUpdateCallback. They wait between
+//   frames; run() deals the batches to one queue per thread, wakes
+//   them, works as thread 0, and returns once every queue is empty
+//   and every thread idle.
+class UpdatePool
+{
+public:
+    UpdatePool( ParallelUpdateCallback& owner, unsigned int numThreads );
+    ~UpdatePool();
+
+    void run();
+    unsigned int getNumSteals() const;
+
+    // The loop of threads 1 and up.
+    void serve( unsigned int thread );
+
+protected:
+    // One thread's batches. The owner takes from _front, thieves
+    //   from _back.
+    struct Queue
+    {
+        OpenThreads::Mutex _mutex;
+        std::vector< unsigned int > _batches;
+        unsigned int _front, _back;
+        unsigned int _steals;
+    };
+
+    void work( unsigned int thread );
+    bool take( unsigned int thread, unsigned int& batch );
+
+    ParallelUpdateCallback& _owner;
+    std::vector< Queue* > _queues;
+    std::vector< OpenThreads::Thread* > _threads;
+
+    OpenThreads::Mutex _mutex;
+    OpenThreads::Condition _start, _done;
+    unsigned int _generation;
+    unsigned int _busy;
+    bool _quit;
+};
+
+class UpdateThread : public OpenThreads::Thread
+{
+public:
+    UpdateThread( UpdatePool& pool, unsigned int thread )
+      : _pool( pool ), _thread( thread ) {}
+
+    virtual void run() { _pool.serve( _thread ); }
+
+protected:
+    UpdatePool& _pool;
+    const unsigned int _thread;
+};
+
+
+UpdatePool::UpdatePool( ParallelUpdateCallback& owner, unsigned int numThreads )
+  : _owner( owner ),
+    _generation( 0 ),
+    _busy( 0 ),
+    _quit( false )
+{
+    unsigned int idx;
+    for (idx=0; idx<numThreads; idx++)
+        _queues.push_back( new Queue );
+    for (idx=1; idx<numThreads; idx++)
+    {
+        UpdateThread* thread = new UpdateThread( *this, idx );
+        thread->start();
+        _threads.push_back( thread );
+    }
+}
+
+UpdatePool::~UpdatePool()
+{
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _mutex );
+        _quit = true;
+        _start.broadcast();
+    }
+    unsigned int idx;
+    for (idx=0; idx<_threads.size(); idx++)
+    {
+        _threads[ idx ]->join();
+        delete _threads[ idx ];
+    }
+    for (idx=0; idx<_queues.size(); idx++)
+        delete _queues[ idx ];
+}
+
+void
+UpdatePool::run()
+{
+    // Deal the batches, heaviest first, round the threads. The
+    //   others are waiting, so the queues need no locks yet.
+    const unsigned int numThreads = _queues.size();
+    const unsigned int numBatches = _owner._batches.size() - 1;
+    unsigned int idx;
+    for (idx=0; idx<numThreads; idx++)
+    {
+        _queues[ idx ]->_batches.clear();
+        _queues[ idx ]->_steals = 0;
+    }
+    for (idx=0; idx<numBatches; idx++)
+        _queues[ idx % numThreads ]->_batches.push_back( idx );
+    for (idx=0; idx<numThreads; idx++)
+    {
+        _queues[ idx ]->_front = 0;
+        _queues[ idx ]->_back = _queues[ idx ]->_batches.size();
+    }
+
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _mutex );
+        _generation++;
+        _busy = numThreads - 1;
+        _start.broadcast();
+    }
+    work( 0 );
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _mutex );
+    while (_busy > 0)
+        _done.wait( &_mutex );
+}
+
+unsigned int
+UpdatePool::getNumSteals() const
+{
+    unsigned int steals( 0 );
+    unsigned int idx;
+    for (idx=0; idx<_queues.size(); idx++)
+        steals += _queues[ idx ]->_steals;
+    return( steals );
+}
+
+void
+UpdatePool::serve( unsigned int thread )
+{
+    unsigned int generation( 0 );
+    while (true)
+    {
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _mutex );
+            while (!_quit && (_generation == generation))
+                _start.wait( &_mutex );
+            if (_quit)
+                return;
+            generation = _generation;
+        }
+        work( thread );
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _mutex );
+        if (--_busy == 0)
+            _done.signal();
+    }
+}
+
+void
+UpdatePool::work( unsigned int thread )
+{
+    osg::NodeVisitor& nv = *( _owner._visitors[ thread ] );
+    const std::vector< unsigned int >& order = _owner._order;
+    const std::vector< unsigned int >& batches = _owner._batches;
+    unsigned int batch;
+    while (take( thread, batch ))
+    {
+        unsigned int idx;
+        for (idx=batches[ batch ]; idx<batches[ batch+1 ]; idx++)
+            _owner.runUnit( order[ idx ], nv, *_owner._base );
+    }
+}
+
+bool
+UpdatePool::take( unsigned int thread, unsigned int& batch )
+{
+    {
+        Queue& own = *( _queues[ thread ] );
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock( own._mutex );
+        if (own._front < own._back)
+        {
+            batch = own._batches[ own._front++ ];
+            return( true );
+        }
+    }
+    // No batches are added during a frame, so once every queue has
+    //   been found empty, the work is done.
+    const unsigned int numThreads = _queues.size();
+    unsigned int idx;
+    for (idx=1; idx<numThreads; idx++)
+    {
+        Queue& victim = *( _queues[ ( thread + idx ) % numThreads ] );
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock( victim._mutex );
+        if (victim._front < victim._back)
+        {
+            batch = victim._batches[ --victim._back ];
+            _queues[ thread ]->_steals++;
+            return( true );
+        }
+    }
+    return( false );
+}
+
+
+ParallelUpdateCallback::ParallelUpdateCallback( unsigned int numThreads )
+  : _numThreads( (numThreads > 0) ? numThreads : getDefaultThreadCount() ),
+    _partitionStale( true ),
+    _top( NULL ),
+    _traversalMask( 0 ),
+    _nodeMaskOverride( 0 ),
+    _numShared( 0 ),
+    _numSteals( 0 ),
+    _pool( NULL ),
+    _base( NULL )
+{
+}
+
+ParallelUpdateCallback::~ParallelUpdateCallback()
+{
+    delete _pool;
+}
+
+void
+ParallelUpdateCallback::setHint( osg::Node* node, Hint hint )
+{
+    if (hint == SPLIT)
+        _hints.erase( node );
+    else
+        _hints[ node ] = hint;
+    _partitionStale = true;
+}
+
+ParallelUpdateCallback::Hint
+ParallelUpdateCallback::getHint( const osg::Node* node ) const
+{
+    std::map< const osg::Node*, Hint >::const_iterator it = _hints.find( node );
+    return( (it != _hints.end()) ? it->second : SPLIT );
+}
+
+void
+ParallelUpdateCallback::keepTogether( osg::Node* a, osg::Node* b )
+{
+    _links.push_back( std::make_pair( a, b ) );
+    _partitionStale = true;
+}
+
+void
+ParallelUpdateCallback::setThreadSafe( osg::Object* obj )
+{
+    _threadSafe.insert( obj );
+    _partitionStale = true;
+}
+
+void
+ParallelUpdateCallback::operator()( osg::Node* node, osg::NodeVisitor* nv )
+{
+    // Traverse as usual where there's nothing to split, or where
+    //   another callback follows this one and would be skipped.
+    osg::Group* group = node->asGroup();
+    if ( (_numThreads <= 1) || (group == NULL) || (getNestedCallback() != NULL) ||
+        (nv->getVisitorType() != osg::NodeVisitor::UPDATE_VISITOR) )
+    {
+        traverse( node, nv );
+        return;
+    }
+
+    if (_partitionStale || partitionChanged( *group, *nv ))
+        partition( *group, *nv );
+
+    // A dirtyBound() call stops at the first node that's already
+    //   dirty, so dirtying the split nodes here keeps the tasks from
+    //   writing to them, or to anything above them.
+    unsigned int idx;
+    for (idx=0; idx<_splits.size(); idx++)
+        _splits[ idx ]._group->dirtyBound();
+
+    const osg::NodePath base( nv->getNodePath() );
+    _numSteals = 0;
+    if (_batches.size() == 2)
+    {
+        // One batch: not worth waking the threads.
+        for (idx=0; idx<_order.size(); idx++)
+            runUnit( _order[ idx ], *nv, base );
+    }
+    else if (_batches.size() > 2)
+    {
+        if (_pool == NULL)
+        {
+            for (idx=0; idx<_numThreads; idx++)
+                _visitors.push_back( new osgUtil::UpdateVisitor );
+            _pool = new UpdatePool( *this, _numThreads );
+        }
+        for (idx=0; idx<_visitors.size(); idx++)
+        {
+            osgUtil::UpdateVisitor& uv = *( _visitors[ idx ] );
+            uv.setFrameStamp( const_cast< osg::FrameStamp* >( nv->getFrameStamp() ) );
+            uv.setTraversalNumber( nv->getTraversalNumber() );
+            uv.setTraversalMask( nv->getTraversalMask() );
+            uv.setNodeMaskOverride( nv->getNodeMaskOverride() );
+        }
+        _base = &base;
+        _pool->run();
+        _base = NULL;
+        _numSteals = _pool->getNumSteals();
+    }
+
+    for (idx=0; idx<_serial.size(); idx++)
+        runUnit( _serial[ idx ], *nv, base );
+    nv->getNodePath() = base;
+}
+
+void
+ParallelUpdateCallback::runUnit( unsigned int unit, osg::NodeVisitor& nv,
+    const osg::NodePath& base )
+{
+    const std::vector< unsigned int >& tasks = _units[ unit ]._tasks;
+    unsigned int idx;
+    for (idx=0; idx<tasks.size(); idx++)
+    {
+        const Task& task = _tasks[ tasks[ idx ] ];
+        const osg::NodePath& path = _splits[ task._split ]._path;
+        osg::NodePath& nodePath = nv.getNodePath();
+        nodePath = base;
+        nodePath.insert( nodePath.end(), path.begin(), path.end() );
+        task._node->accept( nv );
+    }
+}
+
+// Whether the split nodes, or what the traversal sees of them, have
+//   changed since the partition.
+bool
+ParallelUpdateCallback::partitionChanged( const osg::Group& top,
+    const osg::NodeVisitor& nv ) const
+{
+    if ( (&top != _top) || (nv.getTraversalMask() != _traversalMask) ||
+        (nv.getNodeMaskOverride() != _nodeMaskOverride) )
+        return( true );
+
+    unsigned int idx;
+    for (idx=0; idx<_splits.size(); idx++)
+    {
+        const Split& s = _splits[ idx ];
+        const osg::Group& g = *( s._group );
+        if ( (g.getNumChildren() != s._children.size()) ||
+            (g.getNumChildrenRequiringUpdateTraversal() != s._numRequiring) ||
+            (g.getNodeMask() != s._nodeMask) )
+            return( true );
+        // Only the top may gain update callbacks; it has this one.
+        if ( (idx > 0) && !isSplittable( g ) )
+            return( true );
+        unsigned int cIdx;
+        for (cIdx=0; cIdx<s._children.size(); cIdx++)
+            if (g.getChild( cIdx ) != s._children[ cIdx ])
+                return( true );
+    }
+    return( false );
+}
+
+void
+ParallelUpdateCallback::partition( osg::Group& top, const osg::NodeVisitor& nv )
+{
+    _top = &top;
+    _traversalMask = nv.getTraversalMask();
+    _nodeMaskOverride = nv.getNodeMaskOverride();
+    _splits.clear();
+    _tasks.clear();
+    _units.clear();
+    _order.clear();
+    _batches.clear();
+    _serial.clear();
+    _numShared = 0;
+
+    // Split until the pieces are small next to each thread's share.
+    //   The cost of a subtree is the number of nodes the update
+    //   traversal visits in it.
+    const unsigned int total = getCost( top );
+    const unsigned int grain = std::max( total / ( _numThreads * BatchesPerThread ), 1u );
+    osg::NodePath path;
+    split( top, path, nv, grain );
+
+    // Join tasks that reach the same objects.
+    const unsigned int numTasks = _tasks.size();
+    _join.resize( numTasks );
+    unsigned int idx;
+    for (idx=0; idx<numTasks; idx++)
+        _join[ idx ] = idx;
+    for (idx=0; idx<numTasks; idx++)
+        gather( *( _tasks[ idx ]._node ), idx );
+    for (idx=0; idx<_links.size(); idx++)
+    {
+        std::vector< unsigned int > owners;
+        findOwners( *( _links[ idx ].first ), owners );
+        findOwners( *( _links[ idx ].second ), owners );
+        unsigned int oIdx;
+        for (oIdx=1; oIdx<owners.size(); oIdx++)
+        {
+            const unsigned int a = findRoot( owners[ 0 ] );
+            const unsigned int b = findRoot( owners[ oIdx ] );
+            if (a != b)
+                _join[ std::max( a, b ) ] = std::min( a, b );
+        }
+    }
+
+    // One unit per set of joined tasks, each in traversal order.
+    std::vector< unsigned int > unitOf( numTasks, NoUnit );
+    std::vector< bool > serial;
+    for (idx=0; idx<numTasks; idx++)
+    {
+        const unsigned int root = findRoot( idx );
+        if (unitOf[ root ] == NoUnit)
+        {
+            unitOf[ root ] = _units.size();
+            _units.push_back( Unit() );
+            _units.back()._cost = 0;
+            serial.push_back( false );
+        }
+        const unsigned int unit = unitOf[ root ];
+        _units[ unit ]._tasks.push_back( idx );
+        _units[ unit ]._cost += _tasks[ idx ]._cost;
+        if (_tasks[ idx ]._serial)
+            serial[ unit ] = true;
+    }
+    for (idx=0; idx<_units.size(); idx++)
+    {
+        if (serial[ idx ])
+            _serial.push_back( idx );
+        else
+            _order.push_back( idx );
+    }
+
+    // Heaviest first, so the last batches taken, and stolen, are the
+    //   small ones. Small units share batches.
+    std::stable_sort( _order.begin(), _order.end(), HeavierUnit( _units ) );
+    unsigned int cost( 0 );
+    for (idx=0; idx<_order.size(); idx++)
+    {
+        if (cost == 0)
+            _batches.push_back( idx );
+        cost += _units[ _order[ idx ] ]._cost;
+        if (cost >= grain)
+            cost = 0;
+    }
+    _batches.push_back( _order.size() );
+
+    _cost.clear();
+    _owner.clear();
+    _join.clear();
+    _partitionStale = false;
+}
+
+// Record group as split, then split its children or make them tasks.
+//   path ends with group, unless group is the top.
+void
+ParallelUpdateCallback::split( osg::Group& group, osg::NodePath& path,
+    const osg::NodeVisitor& nv, unsigned int grain )
+{
+    const unsigned int splitIdx = _splits.size();
+    _splits.push_back( Split() );
+    Split& s = _splits.back();
+    s._group = &group;
+    s._path = path;
+    s._numRequiring = group.getNumChildrenRequiringUpdateTraversal();
+    s._nodeMask = group.getNodeMask();
+    unsigned int idx;
+    for (idx=0; idx<group.getNumChildren(); idx++)
+        s._children.push_back( group.getChild( idx ) );
+
+    for (idx=0; idx<group.getNumChildren(); idx++)
+    {
+        osg::Node* child = group.getChild( idx );
+        if (!needsUpdate( *child ))
+            continue;
+
+        // A node with several parents would be split once for each,
+        //   so it's a task, and gather() joins its copies.
+        if ( isSplittable( *child ) && (getHint( child ) == SPLIT) &&
+            (child->getNumParents() == 1) && nv.validNodeMask( *child ) &&
+            (getCost( *child ) > grain) )
+        {
+            path.push_back( child );
+            split( *( child->asGroup() ), path, nv, grain );
+            path.pop_back();
+        }
+        else
+        {
+            Task task;
+            task._node = child;
+            task._split = splitIdx;
+            task._cost = getCost( *child );
+            task._serial = false;
+            _tasks.push_back( task );
+        }
+    }
+}
+
+bool
+ParallelUpdateCallback::isSplittable( const osg::Node& node ) const
+{
+    if ( (node.asGroup() == NULL) || (node.getUpdateCallback() != NULL) ||
+        ( (node.getStateSet() != NULL) && node.getStateSet()->requiresUpdateTraversal() ) )
+        return( false );
+    unsigned int idx;
+    for (idx=0; splittableClasses[ idx ][ 0 ] != NULL; idx++)
+        if ( (strcmp( node.libraryName(), splittableClasses[ idx ][ 0 ] ) == 0) &&
+            (strcmp( node.className(), splittableClasses[ idx ][ 1 ] ) == 0) )
+            return( true );
+    return( false );
+}
+
+unsigned int
+ParallelUpdateCallback::getCost( const osg::Node& node )
+{
+    std::map< const osg::Node*, unsigned int >::const_iterator it = _cost.find( &node );
+    if (it != _cost.end())
+        return( it->second );
+
+    unsigned int cost( 1 );
+    const osg::Group* group = node.asGroup();
+    if (group != NULL)
+    {
+        unsigned int idx;
+        for (idx=0; idx<group->getNumChildren(); idx++)
+            if (needsUpdate( *( group->getChild( idx ) ) ))
+                cost += getCost( *( group->getChild( idx ) ) );
+    }
+    else
+        // A Geode counts its Drawables with update callbacks.
+        cost += node.getNumChildrenRequiringUpdateTraversal();
+    _cost[ &node ] = cost;
+    return( cost );
+}
+
+// Claim what task's update traversal reaches below node.
+void
+ParallelUpdateCallback::gather( const osg::Node& node, unsigned int task )
+{
+    if (!claim( &node, task ))
+        return;
+    if (getHint( &node ) == SERIAL)
+        _tasks[ task ]._serial = true;
+
+    const osg::NodeCallback* cb;
+    for (cb=node.getUpdateCallback(); cb!=NULL; cb=cb->getNestedCallback())
+        claim( cb, task );
+    const osg::StateSet* ss = node.getStateSet();
+    if ( (ss != NULL) && ss->requiresUpdateTraversal() )
+        claim( ss, task );
+
+    unsigned int idx;
+    const osg::Geode* geode = node.asGeode();
+    if (geode != NULL)
+    {
+        for (idx=0; idx<geode->getNumDrawables(); idx++)
+        {
+            const osg::Drawable* d = geode->getDrawable( idx );
+            if (d->getUpdateCallback() != NULL)
+            {
+                claim( d, task );
+                claim( d->getUpdateCallback(), task );
+            }
+        }
+        return;
+    }
+
+    const osg::Group* group = node.asGroup();
+    if (group == NULL)
+        return;
+    for (idx=0; idx<group->getNumChildren(); idx++)
+    {
+        const osg::Node* child = group->getChild( idx );
+        if (needsUpdate( *child ))
+            gather( *child, task );
+        else if (child->getDataVariance() == osg::Object::DYNAMIC)
+            claim( child, task );
+    }
+}
+
+// Claim obj for task. If another task has it, join the two. Returns
+//   false if obj was claimed already, by any task.
+bool
+ParallelUpdateCallback::claim( const osg::Object* obj, unsigned int task )
+{
+    if (_threadSafe.find( obj ) != _threadSafe.end())
+        return( true );
+    std::pair< std::map< const osg::Object*, unsigned int >::iterator, bool > result =
+            _owner.insert( std::make_pair( obj, task ) );
+    if (result.second)
+        return( true );
+
+    const unsigned int a = findRoot( result.first->second );
+    const unsigned int b = findRoot( task );
+    if (a != b)
+    {
+        _join[ std::max( a, b ) ] = std::min( a, b );
+        _numShared++;
+    }
+    return( false );
+}
+
+// Append the tasks that claimed node or, failing that, the nearest
+//   nodes above it.
+void
+ParallelUpdateCallback::findOwners( const osg::Node& node,
+    std::vector< unsigned int >& tasks ) const
+{
+    std::map< const osg::Object*, unsigned int >::const_iterator it = _owner.find( &node );
+    if (it != _owner.end())
+    {
+        tasks.push_back( it->second );
+        return;
+    }
+    unsigned int idx;
+    for (idx=0; idx<node.getNumParents(); idx++)
+        if (node.getParent( idx ) != _top)
+            findOwners( *( node.getParent( idx ) ), tasks );
+}
+
+unsigned int
+ParallelUpdateCallback::findRoot( unsigned int task )
+{
+    while (_join[ task ] != task)
+    {
+        _join[ task ] = _join[ _join[ task ] ];
+        task = _join[ task ];
+    }
+    return( task );
+}
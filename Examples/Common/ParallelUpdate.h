@@ -0,0 +1,182 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// Parallel update traversal of independent subtrees
+
+#ifndef __PARALLEL_UPDATE_H__
+#define __PARALLEL_UPDATE_H__
+
+#include <osg/NodeCallback>
+#include <osg/Group>
+#include <osgUtil/UpdateVisitor>
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+class UpdatePool;
+struct HeavierUnit;
+
+// An update callback that runs the update traversal below its node
+//   on several threads. Attach it to the scene root, after any other
+//   update callbacks there; it takes the place of traversing the
+//   children.
+//
+// The graph is split into tasks: plain Groups, MatrixTransforms,
+//   PositionAttitudeTransforms and SpatialGroups without update
+//   callbacks of their own are split, from the top down, until the
+//   pieces are small enough to share out, and each child below that
+//   needs an update traversal becomes a task. Then tasks that touch
+//   the same thing are joined into one, whose subtrees run one after
+//   another on one thread:
+//
+// - a node, update callback, StateSet or Drawable that the update
+//   traversal reaches from both, such as a shared model with an
+//   update callback inside;
+// - a DYNAMIC node below both, which a callback of either may
+//   modify, even though the traversal doesn't reach it. A shared
+//   STATIC node without update callbacks, such as the cow shared
+//   by the Callback example's transforms, joins nothing.
+//
+// Annotations cover what can't be seen from the graph: setHint()
+//   keeps a subtree whole or runs it alone, keepTogether() joins
+//   the tasks that reach two nodes, and setThreadSafe() lets tasks
+//   share an object, such as one stateless callback on many nodes.
+//
+// Each frame, the joined tasks are packed into batches, heaviest
+//   first, and dealt to the threads' queues. A thread works through
+//   its own queue from the front and, once it's empty, steals from
+//   the back of the others'. SERIAL tasks then run on the calling
+//   thread with the update visitor that reached this callback; the
+//   others get an osgUtil::UpdateVisitor of their own per thread,
+//   with the frame stamp, masks and node path copied over.
+//
+// Callbacks may modify their own subtrees. Callbacks that change
+//   the graph's structure or update callbacks, or that reach outside
+//   their subtrees, need a SERIAL hint or keepTogether(). The tasks
+//   are found again when the children of a split node change or the
+//   hints do; call dirtyPartition() after changes further down.
+//   Every split node's bound is dirtied each frame before the tasks
+//   run, so that their dirtyBound() calls stop below the nodes they
+//   share.
+class ParallelUpdateCallback : public osg::NodeCallback
+{
+public:
+    // numThreads of 0 uses getDefaultThreadCount(). With one thread,
+    //   the children are traversed as usual.
+    ParallelUpdateCallback( unsigned int numThreads=0 );
+
+    enum Hint
+    {
+        // Split if possible. The default.
+        SPLIT,
+        // Don't split: the subtree is one task.
+        WHOLE,
+        // Run on the calling thread, after the parallel tasks, and
+        //   along with every task that touches the same things.
+        SERIAL
+    };
+    void setHint( osg::Node* node, Hint hint );
+    Hint getHint( const osg::Node* node ) const;
+
+    // Run the tasks that reach a and b as one.
+    void keepTogether( osg::Node* a, osg::Node* b );
+    // Let tasks that reach obj run at the same time.
+    void setThreadSafe( osg::Object* obj );
+
+    void dirtyPartition() { _partitionStale = true; }
+
+    unsigned int getNumThreads() const { return( _numThreads ); }
+
+    // The last partition: tasks found, the independent units they
+    //   were joined into, how many of those run serially, and the
+    //   objects that caused joins.
+    unsigned int getNumTasks() const { return( _tasks.size() ); }
+    unsigned int getNumUnits() const { return( _units.size() ); }
+    unsigned int getNumSerialUnits() const { return( _serial.size() ); }
+    unsigned int getNumShared() const { return( _numShared ); }
+    // Batches taken from another thread's queue in the last frame.
+    unsigned int getNumSteals() const { return( _numSteals ); }
+
+    virtual void operator()( osg::Node* node, osg::NodeVisitor* nv );
+
+protected:
+    virtual ~ParallelUpdateCallback();
+
+    friend class UpdatePool;
+    friend struct HeavierUnit;
+
+    // A split node, with what it looked like when it was split.
+    //   _path runs from below the callback's node down to _group.
+    struct Split
+    {
+        osg::Group* _group;
+        osg::NodePath _path;
+        std::vector< osg::Node* > _children;
+        unsigned int _numRequiring;
+        osg::Node::NodeMask _nodeMask;
+    };
+    // A child of _split's node that needs an update traversal.
+    struct Task
+    {
+        osg::Node* _node;
+        unsigned int _split;
+        unsigned int _cost;
+        bool _serial;
+    };
+    // Joined tasks, in traversal order.
+    struct Unit
+    {
+        std::vector< unsigned int > _tasks;
+        unsigned int _cost;
+    };
+
+    bool partitionChanged( const osg::Group& top, const osg::NodeVisitor& nv ) const;
+    void partition( osg::Group& top, const osg::NodeVisitor& nv );
+    void split( osg::Group& group, osg::NodePath& path, const osg::NodeVisitor& nv,
+        unsigned int grain );
+    bool isSplittable( const osg::Node& node ) const;
+    unsigned int getCost( const osg::Node& node );
+    void gather( const osg::Node& node, unsigned int task );
+    bool claim( const osg::Object* obj, unsigned int task );
+    void findOwners( const osg::Node& node, std::vector< unsigned int >& tasks ) const;
+    unsigned int findRoot( unsigned int task );
+
+    void runUnit( unsigned int unit, osg::NodeVisitor& nv, const osg::NodePath& base );
+
+    unsigned int _numThreads;
+    std::map< const osg::Node*, Hint > _hints;
+    std::vector< std::pair< const osg::Node*, const osg::Node* > > _links;
+    std::set< const osg::Object* > _threadSafe;
+
+    bool _partitionStale;
+    const osg::Group* _top;
+    osg::Node::NodeMask _traversalMask;
+    osg::Node::NodeMask _nodeMaskOverride;
+    std::vector< Split > _splits;
+    std::vector< Task > _tasks;
+    std::vector< Unit > _units;
+    // Units run in parallel, heaviest first, packed into batches:
+    //   batch i is _order[_batches[i]] to _order[_batches[i+1]].
+    std::vector< unsigned int > _order;
+    std::vector< unsigned int > _batches;
+    std::vector< unsigned int > _serial;
+    unsigned int _numShared;
+    unsigned int _numSteals;
+
+    // Partition scratch: costs of the nodes below, the task that
+    //   first reached each object, and the joins between tasks.
+    std::map< const osg::Node*, unsigned int > _cost;
+    std::map< const osg::Object*, unsigned int > _owner;
+    std::vector< unsigned int > _join;
+
+    // Made on the first parallel frame.
+    UpdatePool* _pool;
+    std::vector< osg::ref_ptr< osgUtil::UpdateVisitor > > _visitors;
+    const osg::NodePath* _base;
+};
+
+#endif
@@ -0,0 +1,130 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// Region allocation for bulk scene graph construction
+
+#include "SceneArena.h"
+#include <OpenThreads/ScopedLock>
+
+
+const unsigned int SceneArena::DefaultBlockSize( 1 << 20 );
+
+// Each allocation starts with a header holding its arena, padded
+//   so the object after it keeps this alignment.
+static const size_t Alignment( 16 );
+static const size_t HeaderSize( Alignment );
+
+static SceneArena* s_current( NULL );
+
+
+SceneArena::SceneArena( unsigned int blockSize )
+  : _blockSize( blockSize ),
+    _next( NULL ),
+    _remaining( 0 ),
+    _numAllocations( 0 ),
+    _bytesUsed( 0 ),
+    _bytesReserved( 0 )
+{
+}
+
+SceneArena::~SceneArena()
+{
+    unsigned int idx;
+    for (idx=0; idx<_blocks.size(); idx++)
+        delete[] _blocks[ idx ];
+}
+
+void*
+SceneArena::allocate( size_t size )
+{
+    const size_t total = HeaderSize + ( (size + Alignment - 1) & ~(Alignment - 1) );
+    char* p;
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _mutex );
+        if (total <= _remaining)
+        {
+            p = _next;
+            _next += total;
+            _remaining -= total;
+        }
+        else
+        {
+            // Objects larger than a quarter block get a block of their
+            //   own, and the current block stays open for the rest.
+            const bool own = (total > _blockSize / 4);
+            const size_t blockSize = own ? total : _blockSize;
+            // new[] of char is aligned for any fundamental type; round
+            //   the start up to Alignment in case that's less.
+            char* block = new char[ blockSize + Alignment ];
+            _blocks.push_back( block );
+            _bytesReserved += blockSize + Alignment;
+            p = block + ( ( Alignment - ( (size_t)block & (Alignment - 1) ) ) & (Alignment - 1) );
+            if (!own)
+            {
+                _next = p + total;
+                _remaining = blockSize - total;
+            }
+        }
+        _numAllocations++;
+        _bytesUsed += total;
+    }
+
+    *(SceneArena**)p = this;
+    // Keeps the blocks until the object is gone.
+    ref();
+    return( p + HeaderSize );
+}
+
+void
+SceneArena::deallocate( void* ptr )
+{
+    if (ptr == NULL)
+        return;
+    SceneArena* arena = *(SceneArena**)( (char*)ptr - HeaderSize );
+    // The memory stays in its block. The last object releases the
+    //   arena, and the arena releases every block.
+    arena->unref();
+}
+
+unsigned int
+SceneArena::getNumBlocks() const
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _mutex );
+    return( _blocks.size() );
+}
+
+unsigned int
+SceneArena::getNumAllocations() const
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _mutex );
+    return( _numAllocations );
+}
+
+size_t
+SceneArena::getBytesUsed() const
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _mutex );
+    return( _bytesUsed );
+}
+
+size_t
+SceneArena::getBytesReserved() const
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _mutex );
+    return( _bytesReserved );
+}
+
+void
+SceneArena::setCurrent( SceneArena* arena )
+{
+    s_current = arena;
+}
+
+SceneArena*
+SceneArena::getCurrent()
+{
+    return( s_current );
+}
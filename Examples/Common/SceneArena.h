@@ -0,0 +1,157 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// Region allocation for bulk scene graph construction
+
+#ifndef __SCENE_ARENA_H__
+#define __SCENE_ARENA_H__
+
+#include <osg/Referenced>
+#include <OpenThreads/Mutex>
+#include <cstddef>
+#include <vector>
+
+// A region of memory that scene graph objects (nodes, drawables,
+//   arrays, primitive sets, StateSets and attributes) are allocated
+//   from one after another, so that a subgraph built at once lies
+//   contiguously in memory in the order it was built. Allocation is
+//   a pointer bump; deleting an object runs its destructor as usual
+//   but doesn't return its memory. The memory is released all at
+//   once, when the last object allocated from the arena, and every
+//   other reference to the arena, is gone.
+//
+// Meant for STATIC subgraphs that are built, used and thrown away
+//   as a whole, such as procedural scenes that are rebuilt often.
+//   Objects deleted one at a time leave holes until the arena goes.
+//   The arrays' element storage is a std::vector and still comes
+//   from the heap; reserve() it up front to allocate it once.
+class SceneArena : public osg::Referenced
+{
+public:
+    SceneArena( unsigned int blockSize=DefaultBlockSize );
+
+    static const unsigned int DefaultBlockSize;
+
+    // Return size bytes, aligned for any scene graph object. Each
+    //   allocation holds a reference to the arena.
+    void* allocate( size_t size );
+    // Called when an object allocated from an arena is deleted.
+    static void deallocate( void* ptr );
+
+    unsigned int getNumBlocks() const;
+    unsigned int getNumAllocations() const;
+    // Bytes handed out, including per-object headers, and bytes
+    //   held in blocks.
+    size_t getBytesUsed() const;
+    size_t getBytesReserved() const;
+
+    // The arena that arenaNew() allocates from, or NULL for the
+    //   heap. Set it on the thread that builds the scene; it's
+    //   shared by all threads.
+    static void setCurrent( SceneArena* arena );
+    static SceneArena* getCurrent();
+
+protected:
+    virtual ~SceneArena();
+
+    const unsigned int _blockSize;
+    std::vector< char* > _blocks;
+    // Free space in the last block.
+    char* _next;
+    size_t _remaining;
+    unsigned int _numAllocations;
+    size_t _bytesUsed, _bytesReserved;
+    mutable OpenThreads::Mutex _mutex;
+};
+
+// Makes an arena current for the lifetime of the object, and then
+//   restores the previous one.
+class ScopedSceneArena
+{
+public:
+    ScopedSceneArena( SceneArena* arena )
+      : _previous( SceneArena::getCurrent() )
+    {
+        SceneArena::setCurrent( arena );
+    }
+    ~ScopedSceneArena()
+    {
+        SceneArena::setCurrent( _previous );
+    }
+
+protected:
+    SceneArena* _previous;
+};
+
+// An osg class whose objects live in a SceneArena. It adds nothing
+//   but class-specific operator new and delete, so it behaves, and
+//   reads and writes, as T.
+template< class T >
+class ArenaObject : public T
+{
+public:
+    ArenaObject() {}
+    template< class A1 >
+    explicit ArenaObject( const A1& a1 ) : T( a1 ) {}
+    template< class A1, class A2 >
+    ArenaObject( const A1& a1, const A2& a2 ) : T( a1, a2 ) {}
+    template< class A1, class A2, class A3 >
+    ArenaObject( const A1& a1, const A2& a2, const A3& a3 ) : T( a1, a2, a3 ) {}
+
+    static void* operator new( size_t size, SceneArena* arena )
+    {
+        return( arena->allocate( size ) );
+    }
+    // Only used if a constructor throws.
+    static void operator delete( void* ptr, SceneArena* )
+    {
+        SceneArena::deallocate( ptr );
+    }
+    static void operator delete( void* ptr )
+    {
+        SceneArena::deallocate( ptr );
+    }
+
+protected:
+    virtual ~ArenaObject() {}
+};
+
+// new T, from the current SceneArena if there is one, and from the
+//   heap otherwise.
+template< class T >
+T* arenaNew()
+{
+    SceneArena* arena = SceneArena::getCurrent();
+    if (arena == NULL)
+        return( new T );
+    return( new( arena ) ArenaObject< T > );
+}
+template< class T, class A1 >
+T* arenaNew( const A1& a1 )
+{
+    SceneArena* arena = SceneArena::getCurrent();
+    if (arena == NULL)
+        return( new T( a1 ) );
+    return( new( arena ) ArenaObject< T >( a1 ) );
+}
+template< class T, class A1, class A2 >
+T* arenaNew( const A1& a1, const A2& a2 )
+{
+    SceneArena* arena = SceneArena::getCurrent();
+    if (arena == NULL)
+        return( new T( a1, a2 ) );
+    return( new( arena ) ArenaObject< T >( a1, a2 ) );
+}
+template< class T, class A1, class A2, class A3 >
+T* arenaNew( const A1& a1, const A2& a2, const A3& a3 )
+{
+    SceneArena* arena = SceneArena::getCurrent();
+    if (arena == NULL)
+        return( new T( a1, a2, a3 ) );
+    return( new( arena ) ArenaObject< T >( a1, a2, a3 ) );
+}
+
+#endif
@@ -0,0 +1,119 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// Binary scene cache shared by the examples that load .osg models
+
+#include "SceneCache.h"
+#include "ChunkedOsgReader.h"
+#include <osgDB/ReadFile>
+#include <osgDB/WriteFile>
+#include <osgDB/FileUtils>
+#include <osgDB/FileNameUtils>
+#include <osg/Timer>
+#include <osg/Notify>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <cstdlib>
+#include <cstdio>
+
+
+// Return the file's modification time, or -1 if it doesn't exist.
+static double
+getModifiedTime( const std::string& fileName )
+{
+    struct stat s;
+    if (stat( fileName.c_str(), &s ) != 0)
+        return( -1. );
+    return( (double)( s.st_mtime ) );
+}
+
+// FNV-1a hash of the source path. Two models with the same base
+//   name in different directories get different cache entries.
+static unsigned int
+hashPath( const std::string& path )
+{
+    unsigned int h( 2166136261u );
+    std::string::const_iterator it;
+    for (it=path.begin(); it!=path.end(); it++)
+    {
+        h ^= (unsigned char)( *it );
+        h *= 16777619u;
+    }
+    return( h );
+}
+
+std::string
+getCacheFileName( const std::string& fullName, const std::string& extension )
+{
+    std::string cacheDir( "." );
+    const char* env = getenv( "OSGQSG_CACHE_DIR" );
+    if (env != NULL)
+        cacheDir = env;
+
+    char key[ 16 ];
+    sprintf( key, "%08x", hashPath( fullName ) );
+
+    return( cacheDir + "/" + osgDB::getStrippedName( fullName ) +
+        "-" + key + "." + extension );
+}
+
+bool
+isCacheCurrent( const std::string& cacheName, const std::string& fullName )
+{
+    const double cacheTime = getModifiedTime( cacheName );
+    return( (cacheTime >= 0.) && (cacheTime >= getModifiedTime( fullName )) );
+}
+
+std::string
+getSceneCacheFileName( const std::string& fileName )
+{
+    const std::string fullName = osgDB::findDataFile( fileName );
+    if (fullName.empty())
+        return( std::string( "" ) );
+    return( getCacheFileName( fullName, "ive" ) );
+}
+
+osg::Node*
+readCachedNodeFile( const std::string& fileName )
+{
+    const std::string cacheName = getSceneCacheFileName( fileName );
+    if (cacheName.empty())
+        // Let readNodeFile() report the missing file.
+        return( osgDB::readNodeFile( fileName ) );
+
+    const std::string fullName = osgDB::findDataFile( fileName );
+    osg::Timer_t start = osg::Timer::instance()->tick();
+
+    // Warm start: the cache is at least as new as the source.
+    if (isCacheCurrent( cacheName, fullName ))
+    {
+        osg::ref_ptr<osg::Node> node = osgDB::readNodeFile( cacheName );
+        if (node.valid())
+        {
+            osg::notify( osg::INFO ) << "Read \"" << fileName << "\" from cache \"" <<
+                cacheName << "\" in " << osg::Timer::instance()->delta_m(
+                start, osg::Timer::instance()->tick() ) << "ms." << std::endl;
+            return( node.release() );
+        }
+        osg::notify( osg::WARN ) << "Unable to read cache file \"" << cacheName <<
+            "\". Reading \"" << fullName << "\" instead." << std::endl;
+    }
+
+    // Cold start, or stale cache: parse the source and write a
+    //   new cache entry for next time. Large .osg files parse
+    //   faster in parallel chunks.
+    osg::ref_ptr<osg::Node> node = readChunkedNodeFile( fullName );
+    if (!node.valid())
+        return( NULL );
+    osg::notify( osg::INFO ) << "Parsed \"" << fullName << "\" in " <<
+        osg::Timer::instance()->delta_m( start, osg::Timer::instance()->tick() ) <<
+        "ms." << std::endl;
+
+    if (!osgDB::writeNodeFile( *node, cacheName ))
+        osg::notify( osg::WARN ) << "Unable to write cache file \"" <<
+            cacheName << "\"." << std::endl;
+    return( node.release() );
+}
@@ -0,0 +1,42 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// Binary scene cache shared by the examples that load .osg models
+
+#ifndef __SCENE_CACHE_H__
+#define __SCENE_CACHE_H__
+
+#include <osg/Node>
+#include <string>
+
+// Load a model file the same way osgDB::readNodeFile() does, but
+//   keep a binary .ive copy of the scene in a cache directory.
+//   The cache entry is keyed by the source file's full path and
+//   is used only while it is not older than the source file, so an
+//   edited .osg file is parsed again, with readChunkedNodeFile(),
+//   and re-cached on the next run. The scene is returned as the
+//   source file describes it; passes such as consolidateGeometry(),
+//   shareState() and installFastBounds() are up to the caller. The
+//   cache directory is the current directory, unless the
+//   OSGQSG_CACHE_DIR environment variable names another one.
+osg::Node* readCachedNodeFile( const std::string& fileName );
+
+// Return the cache file name that readCachedNodeFile() uses for
+//   the given source file, or an empty string if the source file
+//   can't be found in the data file path.
+std::string getSceneCacheFileName( const std::string& fileName );
+
+// The naming and freshness rules above, for other kinds of cache
+//   files. getCacheFileName() returns the cache file name for the
+//   source file fullName (a full path, as osgDB::findDataFile()
+//   returns) with the given extension. isCacheCurrent() is true if
+//   cacheName exists and is at least as new as fullName.
+std::string getCacheFileName( const std::string& fullName,
+    const std::string& extension );
+bool isCacheCurrent( const std::string& cacheName,
+    const std::string& fullName );
+
+#endif
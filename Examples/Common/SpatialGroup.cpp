@@ -0,0 +1,619 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// A Group that keeps its children in a loose octree for cull and pick
+
+#include "SpatialGroup.h"
+#include <osg/Transform>
+#include <osg/NodeVisitor>
+#include <osgUtil/CullVisitor>
+#include <osgUtil/IntersectionVisitor>
+#include <osgUtil/LineSegmentIntersector>
+#include <osgUtil/PolytopeIntersector>
+#include <algorithm>
+#include <cmath>
+
+
+// Entry::_cell for an entry not in the octree yet, and for one
+//   outside it.
+static const unsigned int NoCell( ~0u );
+static const unsigned int Unboxed( ~0u - 1 );
+
+// A cell splits when it holds more entries than this, unless it's
+//   already MaxDepth levels down.
+static const unsigned int MaxEntries( 32 );
+static const unsigned int MaxDepth( 20 );
+
+
+// The box around child's bound, or an empty box if child isn't
+//   positioned relative to its parent.
+static osg::BoundingBox
+getEntryBox( const osg::Node& child )
+{
+    osg::BoundingBox box;
+    const osg::Transform* transform = child.asTransform();
+    if ((transform != NULL) && (transform->getReferenceFrame() != osg::Transform::RELATIVE_RF))
+        return( box );
+    const osg::BoundingSphere& bs = child.getBound();
+    if (bs.valid())
+        box.expandBy( bs );
+    return( box );
+}
+
+static bool
+sameSphere( const osg::BoundingSphere& a, const osg::BoundingSphere& b )
+{
+    return( ( a._center == b._center ) && ( a._radius == b._radius ) );
+}
+
+static bool
+sameBox( const osg::BoundingBox& a, const osg::BoundingBox& b )
+{
+    return( ( a._min == b._min ) && ( a._max == b._max ) );
+}
+
+// Largest half extent of a valid box.
+static float
+getHalfSize( const osg::BoundingBox& box )
+{
+    return( .5f * std::max( box.xMax() - box.xMin(),
+        std::max( box.yMax() - box.yMin(), box.zMax() - box.zMin() ) ) );
+}
+
+
+// findChildren() queries. outside() is true if nothing in box can
+//   be in the query region.
+struct PlaneQuery
+{
+    PlaneQuery( const std::vector< osg::Plane >& planes ) : _planes( planes ) {}
+
+    bool outside( const osg::BoundingBox& box ) const
+    {
+        unsigned int idx;
+        for (idx=0; idx<_planes.size(); idx++)
+            if (_planes[ idx ].intersect( box ) < 0)
+                return( true );
+        return( false );
+    }
+
+    const std::vector< osg::Plane >& _planes;
+};
+
+struct SegmentQuery
+{
+    SegmentQuery( const osg::Vec3& start, const osg::Vec3& end )
+      : _start( start ), _delta( end - start ) {}
+
+    // Clip the segment to each slab of the box in turn.
+    bool outside( const osg::BoundingBox& box ) const
+    {
+        double tMin( 0. ), tMax( 1. );
+        unsigned int axis;
+        for (axis=0; axis<3; axis++)
+        {
+            const double s = _start[ axis ], d = _delta[ axis ];
+            const double lo = box._min[ axis ], hi = box._max[ axis ];
+            if (d == 0.)
+            {
+                if ((s < lo) || (s > hi))
+                    return( true );
+                continue;
+            }
+            double t0 = ( lo - s ) / d, t1 = ( hi - s ) / d;
+            if (t0 > t1)
+                std::swap( t0, t1 );
+            tMin = std::max( tMin, t0 );
+            tMax = std::min( tMax, t1 );
+            if (tMin > tMax)
+                return( true );
+        }
+        return( false );
+    }
+
+    const osg::Vec3 _start, _delta;
+};
+
+
+SpatialGroup::SpatialGroup()
+{
+}
+
+SpatialGroup::SpatialGroup( const SpatialGroup& sg, const osg::CopyOp& copyop )
+  : osg::Group( sg, copyop )
+{
+    // Group's constructor added the children before this class's
+    //   overrides were in place.
+    unsigned int idx;
+    for (idx=0; idx<getNumChildren(); idx++)
+        addEntry( getChild( idx ) );
+}
+
+bool
+SpatialGroup::addChild( osg::Node* child )
+{
+    return( insertChild( getNumChildren(), child ) );
+}
+
+bool
+SpatialGroup::insertChild( unsigned int index, osg::Node* child )
+{
+    if (!osg::Group::insertChild( index, child ))
+        return( false );
+    addEntry( child );
+    return( true );
+}
+
+bool
+SpatialGroup::removeChildren( unsigned int pos, unsigned int numChildrenToRemove )
+{
+    const unsigned int last = std::min( pos + numChildrenToRemove, getNumChildren() );
+    std::vector< osg::Node* > removed;
+    unsigned int idx;
+    for (idx=pos; idx<last; idx++)
+        removed.push_back( getChild( idx ) );
+    if (!osg::Group::removeChildren( pos, numChildrenToRemove ))
+        return( false );
+    // Only the pointers are needed; the nodes may be gone.
+    for (idx=0; idx<removed.size(); idx++)
+        removeEntry( removed[ idx ] );
+    return( true );
+}
+
+bool
+SpatialGroup::setChild( unsigned int i, osg::Node* node )
+{
+    if (i >= getNumChildren())
+        return( false );
+    osg::Node* old = getChild( i );
+    if (!osg::Group::setChild( i, node ))
+        return( false );
+    removeEntry( old );
+    addEntry( node );
+    return( true );
+}
+
+void
+SpatialGroup::dirtyChild( osg::Node* child )
+{
+    std::map< const osg::Node*, unsigned int >::const_iterator it = _entryOf.find( child );
+    if (it == _entryOf.end())
+        return;
+    queueEntry( it->second );
+    dirtyBound();
+}
+
+void
+SpatialGroup::addEntry( osg::Node* child )
+{
+    std::map< const osg::Node*, unsigned int >::iterator it = _entryOf.find( child );
+    if (it != _entryOf.end())
+    {
+        _entries[ it->second ]._count++;
+        return;
+    }
+
+    Entry e;
+    e._node = child;
+    e._count = 1;
+    e._cell = NoCell;
+    e._slot = 0;
+    e._queued = false;
+    const unsigned int idx = _entries.size();
+    _entries.push_back( e );
+    _entryOf[ child ] = idx;
+    queueEntry( idx );
+}
+
+void
+SpatialGroup::removeEntry( osg::Node* child )
+{
+    std::map< const osg::Node*, unsigned int >::iterator it = _entryOf.find( child );
+    if (it == _entryOf.end())
+        return;
+    const unsigned int idx = it->second;
+    if (--_entries[ idx ]._count > 0)
+        return;
+    unlink( idx );
+    _entryOf.erase( it );
+
+    // Move the last entry into the vacated slot, and point its cell
+    //   and the queue at the new index. Queue slots left pointing
+    //   elsewhere are skipped, as their entries aren't _queued.
+    const unsigned int last = _entries.size() - 1;
+    if (idx != last)
+    {
+        Entry& moved = _entries[ idx ];
+        moved = _entries[ last ];
+        _entryOf[ moved._node ] = idx;
+        if (moved._cell == Unboxed)
+            _unboxed[ moved._slot ] = idx;
+        else if (moved._cell != NoCell)
+            _cells[ moved._cell ]._entries[ moved._slot ] = idx;
+        if (moved._queued)
+            _queue.push_back( idx );
+    }
+    _entries.pop_back();
+}
+
+void
+SpatialGroup::queueEntry( unsigned int idx ) const
+{
+    if (_entries[ idx ]._queued)
+        return;
+    _entries[ idx ]._queued = true;
+    _queue.push_back( idx );
+}
+
+
+osg::BoundingSphere
+SpatialGroup::computeBound() const
+{
+    refit();
+    if (_cells.empty() || !_cells[ 0 ]._box.valid())
+        return( osg::BoundingSphere() );
+    // The sphere around the box of the children's spheres, which is a
+    //   little looser than Group's for a handful of children and
+    //   about the same for many.
+    const osg::BoundingBox& box = _cells[ 0 ]._box;
+    return( osg::BoundingSphere( box.center(), box.radius() ) );
+}
+
+void
+SpatialGroup::refit() const
+{
+    // Start over when there's no octree yet, or when most entries
+    //   are new, so the root cube fits them all.
+    if (_cells.empty() || ( _queue.size() * 2 > _entries.size() ))
+    {
+        rebuild();
+        return;
+    }
+
+    // This node's bound is only recomputed once it, or the bound of
+    //   anything below it, has been dirtied, so every child is checked
+    //   here; a clean child's getBound() just returns its cached
+    //   sphere. That catches a grandchild that moved under a child
+    //   that didn't.
+    unsigned int idx;
+    for (idx=0; idx<_entries.size(); idx++)
+    {
+        const Entry& e = _entries[ idx ];
+        if (!e._queued && !sameSphere( e._bound, e._node->getBound() ))
+            queueEntry( idx );
+    }
+    for (idx=0; idx<_queue.size(); idx++)
+    {
+        const unsigned int entry = _queue[ idx ];
+        if ((entry >= _entries.size()) || !_entries[ entry ]._queued)
+            continue;
+        Entry& e = _entries[ entry ];
+        e._queued = false;
+        e._bound = e._node->getBound();
+        place( entry, getEntryBox( *e._node ) );
+    }
+    _queue.clear();
+    refitCell( 0 );
+
+    // Entries that drifted out of the root's loose bounds stay in the
+    //   root, where every traversal tests them. Once any have, a new
+    //   root cube is due.
+    const Cell& root = _cells[ 0 ];
+    const float loose = 2.f * root._halfSize;
+    if (root._box.valid() &&
+            ( ( root._box.xMin() < root._center.x() - loose ) || ( root._box.xMax() > root._center.x() + loose ) ||
+              ( root._box.yMin() < root._center.y() - loose ) || ( root._box.yMax() > root._center.y() + loose ) ||
+              ( root._box.zMin() < root._center.z() - loose ) || ( root._box.zMax() > root._center.z() + loose ) ))
+        rebuild();
+}
+
+void
+SpatialGroup::rebuild() const
+{
+    _cells.clear();
+    _unboxed.clear();
+    _queue.clear();
+
+    osg::BoundingBox all;
+    unsigned int idx;
+    for (idx=0; idx<_entries.size(); idx++)
+    {
+        Entry& e = _entries[ idx ];
+        e._bound = e._node->getBound();
+        e._box = getEntryBox( *e._node );
+        e._cell = NoCell;
+        e._queued = false;
+        all.expandBy( e._box );
+    }
+
+    Cell root;
+    root._center = all.valid() ? all.center() : osg::Vec3( 0.f, 0.f, 0.f );
+    root._halfSize = all.valid() ? getHalfSize( all ) : 0.f;
+    if (root._halfSize <= 0.f)
+        root._halfSize = 1.f;
+    root._depth = 0;
+    root._parent = NoCell;
+    std::fill( root._children, root._children + 8, 0u );
+    root._split = false;
+    root._dirty = true;
+    _cells.push_back( root );
+
+    for (idx=0; idx<_entries.size(); idx++)
+        place( idx, _entries[ idx ]._box );
+    refitCell( 0 );
+}
+
+void
+SpatialGroup::place( unsigned int idx, const osg::BoundingBox& box ) const
+{
+    Entry& e = _entries[ idx ];
+    if ((e._cell != NoCell) && sameBox( e._box, box ))
+        return;
+    unlink( idx );
+    e._box = box;
+    if (!box.valid())
+    {
+        e._cell = Unboxed;
+        e._slot = _unboxed.size();
+        _unboxed.push_back( idx );
+        return;
+    }
+    insert( 0, idx );
+}
+
+// Descend from cell to the smallest existing or new cell that holds
+//   the entry loosely, and add it there. Cells below one that hasn't
+//   split aren't made until it does.
+void
+SpatialGroup::insert( unsigned int cell, unsigned int idx ) const
+{
+    const osg::BoundingBox& box = _entries[ idx ]._box;
+    const osg::Vec3 center = box.center();
+    const float halfSize = getHalfSize( box );
+    for (;;)
+    {
+        const Cell& c = _cells[ cell ];
+        const float childHalf = .5f * c._halfSize;
+        if (!c._split || (halfSize > childHalf))
+            break;
+        // Only the root can be reached by an entry centered outside
+        //   it.
+        if ((cell == 0) &&
+                ( ( fabs( center.x() - c._center.x() ) > c._halfSize ) ||
+                  ( fabs( center.y() - c._center.y() ) > c._halfSize ) ||
+                  ( fabs( center.z() - c._center.z() ) > c._halfSize ) ))
+            break;
+
+        const unsigned int octant = ( center.x() >= c._center.x() ? 1 : 0 ) |
+            ( center.y() >= c._center.y() ? 2 : 0 ) | ( center.z() >= c._center.z() ? 4 : 0 );
+        unsigned int child = c._children[ octant ];
+        if (child == 0)
+        {
+            Cell n;
+            n._center = c._center + osg::Vec3( ( octant & 1 ) ? childHalf : -childHalf,
+                ( octant & 2 ) ? childHalf : -childHalf, ( octant & 4 ) ? childHalf : -childHalf );
+            n._halfSize = childHalf;
+            n._depth = c._depth + 1;
+            n._parent = cell;
+            std::fill( n._children, n._children + 8, 0u );
+            n._split = false;
+            n._dirty = true;
+            child = _cells.size();
+            // c is invalid once _cells grows.
+            _cells[ cell ]._children[ octant ] = child;
+            _cells.push_back( n );
+        }
+        cell = child;
+    }
+
+    Entry& e = _entries[ idx ];
+    e._cell = cell;
+    e._slot = _cells[ cell ]._entries.size();
+    _cells[ cell ]._entries.push_back( idx );
+    _cells[ cell ]._boxes.push_back( e._box );
+    dirtyCell( cell );
+    if (!_cells[ cell ]._split && ( _cells[ cell ]._entries.size() > MaxEntries ) &&
+            ( _cells[ cell ]._depth < MaxDepth ))
+        split( cell );
+}
+
+void
+SpatialGroup::unlink( unsigned int idx ) const
+{
+    Entry& e = _entries[ idx ];
+    if (e._cell == NoCell)
+        return;
+    std::vector< unsigned int >& list =
+        ( e._cell == Unboxed ) ? _unboxed : _cells[ e._cell ]._entries;
+    const unsigned int moved = list.back();
+    list[ e._slot ] = moved;
+    _entries[ moved ]._slot = e._slot;
+    list.pop_back();
+    if (e._cell != Unboxed)
+    {
+        std::vector< osg::BoundingBox >& boxes = _cells[ e._cell ]._boxes;
+        boxes[ e._slot ] = boxes.back();
+        boxes.pop_back();
+        dirtyCell( e._cell );
+    }
+    e._cell = NoCell;
+}
+
+// Push each entry that fits a child cell down into it.
+void
+SpatialGroup::split( unsigned int cell ) const
+{
+    _cells[ cell ]._split = true;
+    std::vector< unsigned int > entries;
+    entries.swap( _cells[ cell ]._entries );
+    _cells[ cell ]._boxes.clear();
+    dirtyCell( cell );
+    unsigned int idx;
+    for (idx=0; idx<entries.size(); idx++)
+        insert( cell, entries[ idx ] );
+}
+
+// A dirty cell's ancestors are always dirty too.
+void
+SpatialGroup::dirtyCell( unsigned int cell ) const
+{
+    while ((cell != NoCell) && !_cells[ cell ]._dirty)
+    {
+        _cells[ cell ]._dirty = true;
+        cell = _cells[ cell ]._parent;
+    }
+}
+
+void
+SpatialGroup::refitCell( unsigned int cell ) const
+{
+    Cell& c = _cells[ cell ];
+    if (!c._dirty)
+        return;
+    c._box.init();
+    unsigned int idx;
+    for (idx=0; idx<c._entries.size(); idx++)
+        c._box.expandBy( c._boxes[ idx ] );
+    for (idx=0; idx<8; idx++)
+    {
+        if (c._children[ idx ] == 0)
+            continue;
+        refitCell( c._children[ idx ] );
+        c._box.expandBy( _cells[ c._children[ idx ] ]._box );
+    }
+    c._dirty = false;
+}
+
+
+void
+SpatialGroup::traverse( osg::NodeVisitor& nv )
+{
+    switch( nv.getVisitorType() )
+    {
+        case osg::NodeVisitor::CULL_VISITOR:
+            if ((dynamic_cast<osgUtil::CullVisitor*>( &nv ) != NULL) && getCullingActive())
+            {
+                // Bring the octree up to date if it isn't.
+                getBound();
+                unsigned int idx, count;
+                for (idx=0; idx<_unboxed.size(); idx++)
+                    for (count=0; count<_entries[ _unboxed[ idx ] ]._count; count++)
+                        _entries[ _unboxed[ idx ] ]._node->accept( nv );
+                if (!_cells.empty())
+                    cullCell( nv, 0 );
+                return;
+            }
+            break;
+
+        case osg::NodeVisitor::NODE_VISITOR:
+            if (intersect( nv ))
+                return;
+            break;
+
+        default:
+            break;
+    }
+    osg::Group::traverse( nv );
+}
+
+// Cull the cell's box, then traverse its entries and child cells
+//   with only the frustum planes the box straddles, the way
+//   CullVisitor::apply() handles a Group.
+void
+SpatialGroup::cullCell( osg::NodeVisitor& nv, unsigned int cell )
+{
+    osgUtil::CullVisitor* cv = static_cast<osgUtil::CullVisitor*>( &nv );
+    const Cell& c = _cells[ cell ];
+    if (!c._box.valid() || cv->isCulled( c._box ))
+        return;
+
+    cv->pushCurrentMask();
+    unsigned int idx, count;
+    for (idx=0; idx<c._entries.size(); idx++)
+    {
+        const Entry& e = _entries[ c._entries[ idx ] ];
+        for (count=0; count<e._count; count++)
+            e._node->accept( nv );
+    }
+    for (idx=0; idx<8; idx++)
+        if (c._children[ idx ] != 0)
+            cullCell( nv, c._children[ idx ] );
+    cv->popCurrentMask();
+}
+
+// Run an IntersectionVisitor's segment or polytope through the
+//   octree. Returns false for any other visitor or intersector.
+bool
+SpatialGroup::intersect( osg::NodeVisitor& nv )
+{
+    osgUtil::IntersectionVisitor* iv = dynamic_cast<osgUtil::IntersectionVisitor*>( &nv );
+    if ((iv == NULL) || (iv->getIntersector() == NULL))
+        return( false );
+    osgUtil::Intersector* intersector = iv->getIntersector();
+    osgUtil::LineSegmentIntersector* segment =
+        dynamic_cast<osgUtil::LineSegmentIntersector*>( intersector );
+    osgUtil::PolytopeIntersector* polytope =
+        dynamic_cast<osgUtil::PolytopeIntersector*>( intersector );
+    if ((segment == NULL) && (polytope == NULL))
+        return( false );
+
+    // The intersector is IntersectionVisitor's clone, already moved
+    //   into this node's coordinates at each Camera and Transform.
+    getBound();
+    std::vector< osg::Node* > children;
+    if (segment != NULL)
+        findChildren( segment->getStart(), segment->getEnd(), children );
+    else
+        findChildren( polytope->getPolytope().getPlaneList(), children );
+
+    unsigned int idx;
+    for (idx=0; idx<children.size(); idx++)
+        children[ idx ]->accept( nv );
+    return( true );
+}
+
+
+void
+SpatialGroup::findChildren( const std::vector< osg::Plane >& planes,
+    std::vector< osg::Node* >& children ) const
+{
+    findInCell( 0, PlaneQuery( planes ), children );
+}
+
+void
+SpatialGroup::findChildren( const osg::Vec3& start, const osg::Vec3& end,
+    std::vector< osg::Node* >& children ) const
+{
+    findInCell( 0, SegmentQuery( start, end ), children );
+}
+
+// Unboxed entries are found along with the root.
+template< class Query >
+void
+SpatialGroup::findInCell( unsigned int cell, const Query& query,
+    std::vector< osg::Node* >& children ) const
+{
+    unsigned int idx;
+    if (cell == 0)
+        for (idx=0; idx<_unboxed.size(); idx++)
+            children.insert( children.end(), _entries[ _unboxed[ idx ] ]._count,
+                _entries[ _unboxed[ idx ] ]._node );
+    if (_cells.empty())
+        return;
+
+    const Cell& c = _cells[ cell ];
+    if (!c._box.valid() || query.outside( c._box ))
+        return;
+    for (idx=0; idx<c._entries.size(); idx++)
+    {
+        if (query.outside( c._boxes[ idx ] ))
+            continue;
+        const Entry& e = _entries[ c._entries[ idx ] ];
+        children.insert( children.end(), e._count, e._node );
+    }
+    for (idx=0; idx<8; idx++)
+        if (c._children[ idx ] != 0)
+            findInCell( c._children[ idx ], query, children );
+}
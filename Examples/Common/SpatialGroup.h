@@ -0,0 +1,144 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// A Group that keeps its children in a loose octree for cull and pick
+
+#ifndef __SPATIAL_GROUP_H__
+#define __SPATIAL_GROUP_H__
+
+#include <osg/Group>
+#include <osg/BoundingBox>
+#include <osg/BoundingSphere>
+#include <osg/Plane>
+#include <map>
+#include <vector>
+
+// A Group for many children spread through space, such as a world
+//   of 10^5 or more MatrixTransforms. The children are kept in a
+//   loose octree: each goes in the smallest cell whose loose bounds
+//   (the cell grown by half its size on every side) hold it, and a
+//   cell splits once it holds more than a few dozen. Every cell
+//   also has the tight box around what it holds, refitted when its
+//   contents change, and the cull traversal, IntersectionVisitor
+//   and BVHPicker's picks skip whole cells whose boxes are outside.
+//
+// The index follows changes without a rebuild:
+//
+// - addChild(), insertChild(), removeChildren(), replaceChild() and
+//   setChild() update it in place.
+// - Moving a child, or anything below one, dirties this node's
+//   bound. When it's recomputed, each child whose bound has changed
+//   moves to the cell that now fits it. Every child's cached bound
+//   is compared, so this costs a pass over the children per frame
+//   in which anything below moved.
+// - Call dirtyChild() after changing a child's reference frame,
+//   which may leave its bound as it was.
+//
+// The update and event traversals visit every child, as for a Group.
+//   Other visitors do too, apart from an IntersectionVisitor with a
+//   LineSegmentIntersector or PolytopeIntersector.
+class SpatialGroup : public osg::Group
+{
+public:
+    SpatialGroup();
+    SpatialGroup( const SpatialGroup& sg,
+        const osg::CopyOp& copyop=osg::CopyOp::SHALLOW_COPY );
+
+    META_Node( osgQSG, SpatialGroup );
+
+    virtual bool addChild( osg::Node* child );
+    virtual bool insertChild( unsigned int index, osg::Node* child );
+    virtual bool removeChildren( unsigned int pos, unsigned int numChildrenToRemove );
+    // Group::replaceChild() calls setChild().
+    virtual bool setChild( unsigned int i, osg::Node* node );
+
+    // Queue child to be placed again at the next bound computation.
+    void dirtyChild( osg::Node* child );
+
+    // Append each child whose bound may be inside the convex region
+    //   bounded by planes (points with a non-negative plane distance
+    //   are inside), or may meet the segment from start to end, both
+    //   in this node's coordinates. A child appears as many times as
+    //   it's in the child list. Call getBound() first if children
+    //   may have moved; then several threads may query at once.
+    void findChildren( const std::vector< osg::Plane >& planes,
+        std::vector< osg::Node* >& children ) const;
+    void findChildren( const osg::Vec3& start, const osg::Vec3& end,
+        std::vector< osg::Node* >& children ) const;
+
+    unsigned int getNumCells() const { return( _cells.size() ); }
+
+    virtual void traverse( osg::NodeVisitor& nv );
+    virtual osg::BoundingSphere computeBound() const;
+
+protected:
+    virtual ~SpatialGroup() {}
+
+    // One distinct child, with its bound when it was last placed.
+    //   _cell is NoCell until the child is placed, and Unboxed for a
+    //   child with no bound in this node's coordinates, which every
+    //   traversal visits.
+    struct Entry
+    {
+        osg::Node* _node;
+        unsigned int _count;
+        osg::BoundingSphere _bound;
+        osg::BoundingBox _box;
+        unsigned int _cell;
+        unsigned int _slot;
+        bool _queued;
+    };
+    // A cube of the octree. _boxes are the boxes of _entries, kept
+    //   beside them so refitting doesn't chase entries through
+    //   memory. _box bounds the entries here and in the child cells,
+    //   and is recomputed when _dirty. Child cells are made on
+    //   demand; index 0, the root, means none.
+    struct Cell
+    {
+        osg::Vec3 _center;
+        float _halfSize;
+        unsigned int _depth;
+        unsigned int _parent;
+        unsigned int _children[ 8 ];
+        bool _split;
+        bool _dirty;
+        std::vector< unsigned int > _entries;
+        std::vector< osg::BoundingBox > _boxes;
+        osg::BoundingBox _box;
+    };
+
+    void addEntry( osg::Node* child );
+    void removeEntry( osg::Node* child );
+    void queueEntry( unsigned int idx ) const;
+
+    // Bring the octree up to date: place queued entries and ones
+    //   whose bound changed, and refit the dirty boxes.
+    void refit() const;
+    void rebuild() const;
+    void place( unsigned int idx, const osg::BoundingBox& box ) const;
+    void insert( unsigned int cell, unsigned int idx ) const;
+    void unlink( unsigned int idx ) const;
+    void split( unsigned int cell ) const;
+    void dirtyCell( unsigned int cell ) const;
+    void refitCell( unsigned int cell ) const;
+
+    void cullCell( osg::NodeVisitor& nv, unsigned int cell );
+    bool intersect( osg::NodeVisitor& nv );
+
+    template< class Query >
+    void findInCell( unsigned int cell, const Query& query,
+        std::vector< osg::Node* >& children ) const;
+
+    // The index is a cache of the child list, so it changes in
+    //   const computeBound().
+    mutable std::vector< Entry > _entries;
+    std::map< const osg::Node*, unsigned int > _entryOf;
+    mutable std::vector< Cell > _cells;
+    mutable std::vector< unsigned int > _unboxed;
+    mutable std::vector< unsigned int > _queue;
+};
+
+#endif
@@ -0,0 +1,646 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// Merges drawables that render with the same state into one Geometry
+
+#include "StateMerger.h"
+#include "GeometryConsolidator.h"
+#include <osg/NodeVisitor>
+#include <osg/Group>
+#include <osg/Geode>
+#include <osg/Geometry>
+#include <osg/StateSet>
+#include <cstring>
+#include <set>
+
+
+const DrawableRemap::Source*
+DrawableRemap::lookup( const osg::Drawable* drawable, unsigned int& triangle ) const
+{
+    std::map< const osg::Drawable*, Table >::const_iterator it = _tables.find( drawable );
+    if ( (it == _tables.end()) || (triangle >= it->second._source.size()) )
+        return( NULL );
+    const Table& table = it->second;
+    const Source* source = &( table._sources[ table._source[ triangle ] ] );
+    triangle = table._triangle[ triangle ];
+    return( source );
+}
+
+
+StateMergeReport::StateMergeReport()
+  : _geodesBefore( 0 ),
+    _geodesAfter( 0 ),
+    _drawablesBefore( 0 ),
+    _drawablesAfter( 0 ),
+    _stateGroups( 0 )
+{
+}
+
+
+// The array types merged Geometry can hold.
+static bool
+isMergeableArray( const osg::Array* array )
+{
+    if (array == NULL)
+        return( true );
+    switch( array->getType() )
+    {
+        case osg::Array::FloatArrayType:
+        case osg::Array::Vec2ArrayType:
+        case osg::Array::Vec3ArrayType:
+        case osg::Array::Vec4ArrayType:
+        case osg::Array::Vec4ubArrayType:
+            return( true );
+        default:
+            return( false );
+    }
+}
+
+template< class ArrayType >
+static void
+appendElements( osg::Array& dst, const osg::Array& src, bool overall,
+    unsigned int count )
+{
+    ArrayType& d = static_cast< ArrayType& >( dst );
+    const ArrayType& s = static_cast< const ArrayType& >( src );
+    if (overall)
+        d.insert( d.end(), count, s[ 0 ] );
+    else
+        d.insert( d.end(), s.begin(), s.begin() + count );
+}
+
+// Append count elements of src to dst, which has the same type.
+//   An overall array repeats its one element.
+static void
+appendArray( osg::Array& dst, const osg::Array& src, bool overall,
+    unsigned int count )
+{
+    switch( src.getType() )
+    {
+        case osg::Array::FloatArrayType:
+            appendElements< osg::FloatArray >( dst, src, overall, count );
+            break;
+        case osg::Array::Vec2ArrayType:
+            appendElements< osg::Vec2Array >( dst, src, overall, count );
+            break;
+        case osg::Array::Vec3ArrayType:
+            appendElements< osg::Vec3Array >( dst, src, overall, count );
+            break;
+        case osg::Array::Vec4ArrayType:
+            appendElements< osg::Vec4Array >( dst, src, overall, count );
+            break;
+        case osg::Array::Vec4ubArrayType:
+            appendElements< osg::Vec4ubArray >( dst, src, overall, count );
+            break;
+        default:
+            break;
+    }
+}
+
+// The attributes a merged Geometry combines: normals, colors, then
+//   one per texture unit. Vertices are handled separately.
+static unsigned int
+getNumAttributes( const osg::Geometry& geom )
+{
+    return( 2 + geom.getNumTexCoordArrays() );
+}
+
+static const osg::Array*
+getAttribute( const osg::Geometry& geom, unsigned int idx,
+    osg::Geometry::AttributeBinding& binding )
+{
+    if (idx == 0)
+    {
+        binding = geom.getNormalBinding();
+        return( (binding == osg::Geometry::BIND_OFF) ? NULL : geom.getNormalArray() );
+    }
+    if (idx == 1)
+    {
+        binding = geom.getColorBinding();
+        return( (binding == osg::Geometry::BIND_OFF) ? NULL : geom.getColorArray() );
+    }
+    binding = osg::Geometry::BIND_PER_VERTEX;
+    return( geom.getTexCoordArray( idx-2 ) );
+}
+
+// True if geom can be merged with others.
+static bool
+isMergeableGeometry( const osg::Geometry& geom )
+{
+    osg::Geometry& g = const_cast< osg::Geometry& >( geom );
+    if ( (strcmp( geom.className(), "Geometry" ) != 0) ||
+            (geom.getNumParents() != 1) ||
+            (g.getUpdateCallback() != NULL) ||
+            (g.getCullCallback() != NULL) ||
+            (g.getDrawCallback() != NULL) ||
+            (g.getEventCallback() != NULL) ||
+            (g.getUserData() != NULL) ||
+            g.getInitialBound().valid() )
+        return( false );
+    if ( (geom.getVertexIndices() != NULL) || (geom.getNormalIndices() != NULL) ||
+            (geom.getColorIndices() != NULL) ||
+            (g.getSecondaryColorArray() != NULL) || (g.getFogCoordArray() != NULL) ||
+            (g.getNumVertexAttribArrays() != 0) )
+        return( false );
+
+    const osg::Array* vertices = geom.getVertexArray();
+    if ( (vertices == NULL) || (vertices->getNumElements() == 0) ||
+            !isMergeableArray( vertices ) || (vertices->getType() == osg::Array::FloatArrayType) ||
+            (vertices->getType() == osg::Array::Vec4ubArrayType) )
+        return( false );
+    const unsigned int numVertices = vertices->getNumElements();
+
+    unsigned int idx;
+    for (idx=0; idx<getNumAttributes( geom ); idx++)
+    {
+        osg::Geometry::AttributeBinding binding;
+        const osg::Array* array = getAttribute( geom, idx, binding );
+        if (array == NULL)
+            continue;
+        if (!isMergeableArray( array ))
+            return( false );
+        if ( (binding == osg::Geometry::BIND_OVERALL) && (array->getNumElements() > 0) )
+            continue;
+        if (idx >= 2)
+        {
+            if (geom.getTexCoordIndices( idx-2 ) != NULL)
+                return( false );
+        }
+        if ( (binding != osg::Geometry::BIND_PER_VERTEX) ||
+                (array->getNumElements() < numVertices) )
+            return( false );
+    }
+
+    for (idx=0; idx<geom.getNumPrimitiveSets(); idx++)
+    {
+        const GLenum mode = geom.getPrimitiveSet( idx )->getMode();
+        if ( (mode == osg::PrimitiveSet::LINE_STRIP) ||
+                (mode == osg::PrimitiveSet::LINE_LOOP) )
+            return( false );
+    }
+    return( true );
+}
+
+// A summary of which arrays geom has and of what type. Geometry
+//   with different layouts isn't merged.
+static std::vector< int >
+getLayout( const osg::Geometry& geom )
+{
+    std::vector< int > layout;
+    layout.push_back( geom.getVertexArray()->getType() );
+    unsigned int idx;
+    for (idx=0; idx<getNumAttributes( geom ); idx++)
+    {
+        osg::Geometry::AttributeBinding binding;
+        const osg::Array* array = getAttribute( geom, idx, binding );
+        layout.push_back( (array == NULL) ? -1 : (int)array->getType() );
+    }
+    // Trailing empty texture units don't matter.
+    while (layout.back() == -1)
+        layout.pop_back();
+    return( layout );
+}
+
+static bool
+isPlainGroup( const osg::Group& grp )
+{
+    osg::Group& g = const_cast< osg::Group& >( grp );
+    return( (strcmp( grp.className(), "Group" ) == 0) &&
+        (grp.getNumParents() == 1) &&
+        (grp.getNodeMask() == ~0u) &&
+        grp.getCullingActive() &&
+        (grp.getDataVariance() != osg::Object::DYNAMIC) &&
+        (g.getUpdateCallback() == NULL) &&
+        (g.getEventCallback() == NULL) &&
+        (g.getCullCallback() == NULL) );
+}
+
+static bool
+isMergeableGeode( const osg::Geode& geode )
+{
+    osg::Geode& g = const_cast< osg::Geode& >( geode );
+    return( (strcmp( geode.className(), "Geode" ) == 0) &&
+        (geode.getNumParents() == 1) &&
+        (geode.getNodeMask() == ~0u) &&
+        geode.getCullingActive() &&
+        (geode.getDataVariance() != osg::Object::DYNAMIC) &&
+        (g.getUpdateCallback() == NULL) &&
+        (g.getEventCallback() == NULL) &&
+        (g.getCullCallback() == NULL) &&
+        (g.getUserData() == NULL) );
+}
+
+
+// Counts distinct Geodes and Drawables.
+class MergeCounter : public osg::NodeVisitor
+{
+public:
+    MergeCounter()
+      : osg::NodeVisitor( osg::NodeVisitor::TRAVERSE_ALL_CHILDREN ),
+        _numGeodes( 0 )
+    {
+    }
+
+    virtual void apply( osg::Node& node )
+    {
+        if (_visited.insert( &node ).second)
+            traverse( node );
+    }
+    virtual void apply( osg::Geode& geode )
+    {
+        if (!_visited.insert( &geode ).second)
+            return;
+        _numGeodes++;
+        unsigned int idx;
+        for (idx=0; idx<geode.getNumDrawables(); idx++)
+            _drawables.insert( geode.getDrawable( idx ) );
+    }
+
+    std::set< osg::Node* > _visited;
+    std::set< osg::Drawable* > _drawables;
+    unsigned int _numGeodes;
+};
+
+
+// Finds the merge scopes under a node and the mergeable Geometry
+//   in each, grouped by state and layout, then merges each group.
+class StateMerger : public osg::NodeVisitor
+{
+public:
+    StateMerger( DrawableRemap& remap )
+      : osg::NodeVisitor( osg::NodeVisitor::TRAVERSE_ALL_CHILDREN ),
+        _remap( remap ),
+        _scope( -1 )
+    {
+    }
+
+    virtual void apply( osg::Node& node )
+    {
+        if (!_visited.insert( &node ).second)
+            return;
+        osg::Group* grp = node.asGroup();
+        if (grp == NULL)
+        {
+            traverse( node );
+            return;
+        }
+
+        if ( (_scope >= 0) && isPlainGroup( *grp ) )
+        {
+            _path.push_back( grp->getStateSet() );
+            traverse( node );
+            _path.pop_back();
+            return;
+        }
+
+        // Start a new scope, with nothing inherited inside it yet.
+        //   Children of a Switch, LOD or Sequence are told apart by
+        //   their position, so none of them are merged and re-added;
+        //   Groups below them start scopes of their own.
+        const int parentScope = _scope;
+        std::vector< const osg::StateSet* > parentPath;
+        parentPath.swap( _path );
+        if (selectsChildren( *grp ))
+            _scope = -1;
+        else
+        {
+            _scope = _scopes.size();
+            _scopes.push_back( Scope() );
+            _scopes.back()._root = grp;
+        }
+
+        traverse( node );
+
+        _path.swap( parentPath );
+        _scope = parentScope;
+    }
+
+    virtual void apply( osg::Geode& geode )
+    {
+        if (!_visited.insert( &geode ).second)
+            return;
+        if ( (_scope < 0) || !isMergeableGeode( geode ) )
+            return;
+
+        unsigned int idx;
+        for (idx=0; idx<geode.getNumDrawables(); idx++)
+        {
+            osg::Geometry* geom = geode.getDrawable( idx )->asGeometry();
+            if ( (geom == NULL) || !isMergeableGeometry( *geom ) )
+                continue;
+
+            std::vector< const osg::StateSet* > states( _path );
+            states.push_back( geode.getStateSet() );
+            states.push_back( geom->getStateSet() );
+            add( *geom, geode, states );
+        }
+    }
+
+    // Merge every group of two or more Geometry objects, and
+    //   return the number of groups merged.
+    unsigned int merge()
+    {
+        unsigned int numMerged( 0 );
+        unsigned int sIdx;
+        for (sIdx=0; sIdx<_scopes.size(); sIdx++)
+        {
+            Scope& scope = _scopes[ sIdx ];
+            unsigned int bIdx;
+            for (bIdx=0; bIdx<scope._buckets.size(); bIdx++)
+            {
+                Bucket& bucket = scope._buckets[ bIdx ];
+                if (bucket._geoms.size() < 2)
+                    continue;
+                mergeBucket( *( scope._root ), bucket );
+                numMerged++;
+            }
+        }
+        return( numMerged );
+    }
+
+protected:
+    struct Bucket
+    {
+        // The combined state, or NULL if there is none.
+        osg::ref_ptr< osg::StateSet > _state;
+        std::vector< int > _layout;
+        std::vector< osg::ref_ptr< osg::Geometry > > _geoms;
+        std::vector< osg::ref_ptr< osg::Geode > > _geodes;
+    };
+    typedef std::pair< std::vector< const osg::StateSet* >, std::vector< int > > BucketKey;
+    struct Scope
+    {
+        osg::Group* _root;
+        std::vector< Bucket > _buckets;
+        // Finds the bucket for a list of StateSet objects without
+        //   combining and comparing them again.
+        std::map< BucketKey, unsigned int > _keys;
+    };
+
+    void add( osg::Geometry& geom, osg::Geode& geode,
+        const std::vector< const osg::StateSet* >& states )
+    {
+        Scope& scope = _scopes[ _scope ];
+        BucketKey key;
+        unsigned int idx;
+        for (idx=0; idx<states.size(); idx++)
+            if (states[ idx ] != NULL)
+                key.first.push_back( states[ idx ] );
+        key.second = getLayout( geom );
+
+        std::map< BucketKey, unsigned int >::iterator it = scope._keys.find( key );
+        if (it == scope._keys.end())
+        {
+            // Combine the states the way the cull traversal
+            //   inherits them, and look for a bucket with an equal
+            //   combined state.
+            osg::ref_ptr< osg::StateSet > state;
+            if (!key.first.empty())
+            {
+                state = new osg::StateSet;
+                for (idx=0; idx<key.first.size(); idx++)
+                    state->merge( *( key.first[ idx ] ) );
+            }
+            unsigned int bIdx;
+            for (bIdx=0; bIdx<scope._buckets.size(); bIdx++)
+            {
+                const Bucket& bucket = scope._buckets[ bIdx ];
+                if (bucket._layout != key.second)
+                    continue;
+                if (!state.valid() && !bucket._state.valid())
+                    break;
+                if ( state.valid() && bucket._state.valid() &&
+                        (state->compare( *( bucket._state ), true ) == 0) )
+                    break;
+            }
+            if (bIdx == scope._buckets.size())
+            {
+                scope._buckets.push_back( Bucket() );
+                scope._buckets.back()._state = state;
+                scope._buckets.back()._layout = key.second;
+            }
+            it = scope._keys.insert( std::make_pair( key, bIdx ) ).first;
+        }
+
+        Bucket& bucket = scope._buckets[ it->second ];
+        bucket._geoms.push_back( &geom );
+        bucket._geodes.push_back( &geode );
+    }
+
+    void mergeBucket( osg::Group& root, Bucket& bucket )
+    {
+        const osg::Geometry& first = *( bucket._geoms[ 0 ] );
+        const unsigned int numAttributes = bucket._layout.size() - 1;
+
+        // An overall attribute stays overall if every Geometry
+        //   shares the same array; otherwise it becomes per vertex.
+        std::vector< const osg::Array* > overall( numAttributes, NULL );
+        unsigned int aIdx, gIdx;
+        for (aIdx=0; aIdx<numAttributes; aIdx++)
+        {
+            osg::Geometry::AttributeBinding binding;
+            const osg::Array* array = getAttribute( first, aIdx, binding );
+            if (binding != osg::Geometry::BIND_OVERALL)
+                continue;
+            for (gIdx=1; gIdx<bucket._geoms.size(); gIdx++)
+            {
+                osg::Geometry::AttributeBinding b;
+                if ( (getAttribute( *( bucket._geoms[ gIdx ] ), aIdx, b ) != array) ||
+                        (b != osg::Geometry::BIND_OVERALL) )
+                    break;
+            }
+            if (gIdx == bucket._geoms.size())
+                overall[ aIdx ] = array;
+        }
+
+        osg::ref_ptr< osg::Geometry > merged = new osg::Geometry;
+        osg::ref_ptr< osg::Array > vertices = static_cast< osg::Array* >(
+                first.getVertexArray()->cloneType() );
+        std::vector< osg::ref_ptr< osg::Array > > attributes( numAttributes );
+        for (aIdx=0; aIdx<numAttributes; aIdx++)
+        {
+            osg::Geometry::AttributeBinding binding;
+            const osg::Array* array = getAttribute( first, aIdx, binding );
+            if (array == NULL)
+                continue;
+            if (overall[ aIdx ] != NULL)
+                attributes[ aIdx ] = const_cast< osg::Array* >( overall[ aIdx ] );
+            else
+                attributes[ aIdx ] = static_cast< osg::Array* >( array->cloneType() );
+        }
+
+        // Geometry that shares all of its arrays with an earlier one
+        //   shares its vertices in the merged arrays, too.
+        std::map< std::vector< const osg::Array* >, unsigned int > bases;
+        std::vector< unsigned int > tris, points, lines;
+        std::vector< unsigned int > source, number;
+        DrawableRemap::Table table;
+        for (gIdx=0; gIdx<bucket._geoms.size(); gIdx++)
+        {
+            osg::Geometry& geom = *( bucket._geoms[ gIdx ] );
+            const osg::Array* geomVertices = geom.getVertexArray();
+            const unsigned int numVertices = geomVertices->getNumElements();
+
+            std::vector< const osg::Array* > arrays;
+            arrays.push_back( geomVertices );
+            for (aIdx=0; aIdx<numAttributes; aIdx++)
+            {
+                osg::Geometry::AttributeBinding binding;
+                arrays.push_back( getAttribute( geom, aIdx, binding ) );
+            }
+            std::map< std::vector< const osg::Array* >, unsigned int >::iterator it =
+                    bases.find( arrays );
+            if (it == bases.end())
+            {
+                it = bases.insert( std::make_pair( arrays,
+                        vertices->getNumElements() ) ).first;
+                appendArray( *vertices, *geomVertices, false, numVertices );
+                for (aIdx=0; aIdx<numAttributes; aIdx++)
+                {
+                    if ( !attributes[ aIdx ].valid() || (overall[ aIdx ] != NULL) )
+                        continue;
+                    osg::Geometry::AttributeBinding binding;
+                    const osg::Array* array = getAttribute( geom, aIdx, binding );
+                    appendArray( *( attributes[ aIdx ] ), *array,
+                        binding == osg::Geometry::BIND_OVERALL, numVertices );
+                }
+            }
+            const unsigned int base = it->second;
+
+            DrawableRemap::Source s;
+            s._geodeName = bucket._geodes[ gIdx ]->getName();
+            s._drawableName = geom.getName();
+            table._sources.push_back( s );
+
+            std::vector< unsigned int > geomTris, geomNumbers, geomPoints, geomLines;
+            unsigned int numTriangles( 0 );
+            unsigned int pIdx;
+            for (pIdx=0; pIdx<geom.getNumPrimitiveSets(); pIdx++)
+            {
+                const osg::PrimitiveSet& ps = *( geom.getPrimitiveSet( pIdx ) );
+                if (ps.getMode() == osg::PrimitiveSet::POINTS)
+                    appendIndices( ps, geomPoints );
+                else if (ps.getMode() == osg::PrimitiveSet::LINES)
+                    appendIndices( ps, geomLines );
+                else
+                    numTriangles += appendTriangles( ps, geomTris,
+                            &geomNumbers, numTriangles );
+            }
+            unsigned int idx;
+            for (idx=0; idx<geomTris.size(); idx++)
+                tris.push_back( geomTris[ idx ] + base );
+            for (idx=0; idx<geomPoints.size(); idx++)
+                points.push_back( geomPoints[ idx ] + base );
+            for (idx=0; idx<geomLines.size(); idx++)
+                lines.push_back( geomLines[ idx ] + base );
+            for (idx=0; idx<geomNumbers.size(); idx++)
+            {
+                source.push_back( gIdx );
+                number.push_back( geomNumbers[ idx ] );
+            }
+        }
+
+        merged->setVertexArray( vertices.get() );
+        for (aIdx=0; aIdx<numAttributes; aIdx++)
+        {
+            if (!attributes[ aIdx ].valid())
+                continue;
+            const osg::Geometry::AttributeBinding binding = (overall[ aIdx ] != NULL) ?
+                    osg::Geometry::BIND_OVERALL : osg::Geometry::BIND_PER_VERTEX;
+            if (aIdx == 0)
+            {
+                merged->setNormalArray( attributes[ aIdx ].get() );
+                merged->setNormalBinding( binding );
+            }
+            else if (aIdx == 1)
+            {
+                merged->setColorArray( attributes[ aIdx ].get() );
+                merged->setColorBinding( binding );
+            }
+            else
+                merged->setTexCoordArray( aIdx-2, attributes[ aIdx ].get() );
+        }
+
+        if (!points.empty())
+            merged->addPrimitiveSet( createDrawElements( osg::PrimitiveSet::POINTS, points ) );
+        if (!lines.empty())
+            merged->addPrimitiveSet( createDrawElements( osg::PrimitiveSet::LINES, lines ) );
+        if (!tris.empty())
+        {
+            std::vector< unsigned int > order;
+            optimizeVertexCache( tris, vertices->getNumElements(), &order );
+            table._source.resize( order.size() );
+            table._triangle.resize( order.size() );
+            unsigned int idx;
+            for (idx=0; idx<order.size(); idx++)
+            {
+                table._source[ idx ] = source[ order[ idx ] ];
+                table._triangle[ idx ] = number[ order[ idx ] ];
+            }
+            merged->addPrimitiveSet( createDrawElements( osg::PrimitiveSet::TRIANGLES, tris ) );
+        }
+
+        osg::ref_ptr< osg::Geode > geode = new osg::Geode;
+        geode->addDrawable( merged.get() );
+        if (bucket._state.valid())
+            geode->setStateSet( bucket._state.get() );
+        root.addChild( geode.get() );
+
+        table._merged = merged.get();
+        _remap._tables[ merged.get() ] = table;
+
+        // Remove the originals, and the Geodes and plain Groups
+        //   they leave empty.
+        for (gIdx=0; gIdx<bucket._geoms.size(); gIdx++)
+        {
+            osg::Geode* g = bucket._geodes[ gIdx ].get();
+            g->removeDrawable( bucket._geoms[ gIdx ].get() );
+            if (g->getNumDrawables() > 0)
+                continue;
+            osg::Node* node = g;
+            while ( (node != &root) && (node->getNumParents() == 1) )
+            {
+                osg::Group* parent = node->getParent( 0 );
+                parent->removeChild( node );
+                if ( (parent == &root) || (parent->getNumChildren() > 0) ||
+                        !isPlainGroup( *parent ) || !parent->getName().empty() )
+                    break;
+                node = parent;
+            }
+        }
+    }
+
+    DrawableRemap& _remap;
+    std::set< osg::Node* > _visited;
+    std::vector< Scope > _scopes;
+    int _scope;
+    std::vector< const osg::StateSet* > _path;
+};
+
+
+StateMergeReport
+mergeByState( osg::Node* root )
+{
+    StateMergeReport report;
+    report._remap = new DrawableRemap;
+    if (root == NULL)
+        return( report );
+
+    MergeCounter before;
+    root->accept( before );
+    report._geodesBefore = before._numGeodes;
+    report._drawablesBefore = before._drawables.size();
+
+    StateMerger merger( *( report._remap ) );
+    root->accept( merger );
+    report._stateGroups = merger.merge();
+
+    MergeCounter after;
+    root->accept( after );
+    report._geodesAfter = after._numGeodes;
+    report._drawablesAfter = after._drawables.size();
+    return( report );
+}
@@ -0,0 +1,91 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// Merges drawables that render with the same state into one Geometry
+
+#ifndef __STATE_MERGER_H__
+#define __STATE_MERGER_H__
+
+#include <osg/Referenced>
+#include <osg/ref_ptr>
+#include <osg/Node>
+#include <osg/Drawable>
+#include <map>
+#include <string>
+#include <vector>
+
+// Records where each triangle of a merged Geometry came from, so
+//   that a pick on merged geometry can still name the original
+//   Geode and Drawable.
+class DrawableRemap : public osg::Referenced
+{
+public:
+    struct Source
+    {
+        std::string _geodeName;
+        std::string _drawableName;
+    };
+
+    // If drawable is a merged Geometry, return the Source of its
+    //   triangle number triangle, and change triangle to the number
+    //   that triangle had in the original Drawable. Returns NULL for
+    //   any other Drawable.
+    const Source* lookup( const osg::Drawable* drawable,
+        unsigned int& triangle ) const;
+
+    unsigned int getNumMergedDrawables() const { return( _tables.size() ); }
+
+protected:
+    virtual ~DrawableRemap() {}
+
+    friend class StateMerger;
+
+    struct Table
+    {
+        osg::ref_ptr< const osg::Drawable > _merged;
+        std::vector< Source > _sources;
+        // Per merged triangle: index into _sources, and the
+        //   triangle's number in that source.
+        std::vector< unsigned int > _source;
+        std::vector< unsigned int > _triangle;
+    };
+    std::map< const osg::Drawable*, Table > _tables;
+};
+
+struct StateMergeReport
+{
+    StateMergeReport();
+
+    unsigned int _geodesBefore, _geodesAfter;
+    unsigned int _drawablesBefore, _drawablesAfter;
+    // Distinct states that two or more drawables were merged under.
+    unsigned int _stateGroups;
+    osg::ref_ptr< DrawableRemap > _remap;
+};
+
+// Group the Geometry under root by the state it renders with, and
+//   merge each group into one Geometry with combined vertex and
+//   index arrays, in a new Geode that carries the group's state.
+//
+// Merging stops at Transforms, Switches, LODs and anything else that
+//   isn't a plain Group, since drawables under different transforms
+//   can't share vertices; each of those starts its own set of
+//   groups. The direct children of a Switch, LOD or Sequence are
+//   never merged, as that would change which of them are drawn.
+//   Within a set, a drawable's state is the StateSets of the
+//   plain Groups, the Geode and the Drawable, combined the way the
+//   cull traversal inherits them, so drawables with equal StateSets
+//   on different Geodes merge even if the StateSet objects differ.
+//   Geodes and plain Groups left empty are removed.
+//
+// Only Geometry that uses per-vertex or overall bindings, no index
+//   arrays, callbacks or user data, and draws triangles, points or
+//   lines takes part. Run consolidateGeometry() before this, not
+//   after: it reorders triangles, which would make the remap
+//   table stale.
+StateMergeReport mergeByState( osg::Node* root );
+
+#endif
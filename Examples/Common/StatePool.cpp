@@ -0,0 +1,501 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// Sharing of equal StateSets and StateAttributes
+
+#include "StatePool.h"
+#include <osg/Geode>
+#include <osg/Drawable>
+#include <osg/NodeVisitor>
+#include <osg/Material>
+#include <osg/ShadeModel>
+#include <osg/CullFace>
+#include <osg/PolygonMode>
+#include <osg/LineWidth>
+#include <osg/AlphaFunc>
+#include <osg/BlendFunc>
+#include <osg/Texture>
+#include <osg/Texture2D>
+#include <OpenThreads/ScopedLock>
+#include <cstring>
+#include <set>
+
+
+// FNV-1a, a word at a time.
+static const unsigned int HashBasis( 2166136261u );
+
+static unsigned int
+hashWord( unsigned int h, unsigned int word )
+{
+    unsigned int idx;
+    for (idx=0; idx<4; idx++)
+    {
+        h ^= ( word >> (idx*8) ) & 0xff;
+        h *= 16777619u;
+    }
+    return( h );
+}
+
+static unsigned int
+hashFloat( unsigned int h, float f )
+{
+    // Adding zero turns -0 into 0, which compare() finds equal.
+    f += 0.f;
+    unsigned int bits;
+    memcpy( &bits, &f, sizeof( bits ) );
+    return( hashWord( h, bits ) );
+}
+
+static unsigned int
+hashVec4( unsigned int h, const osg::Vec4& v )
+{
+    unsigned int idx;
+    for (idx=0; idx<4; idx++)
+        h = hashFloat( h, v[ idx ] );
+    return( h );
+}
+
+static unsigned int
+hashPointer( unsigned int h, const void* p )
+{
+    const size_t value = (size_t)p;
+    h = hashWord( h, (unsigned int)value );
+    // The high word on 64-bit platforms; zero elsewhere.
+    return( hashWord( h, (unsigned int)( (value >> 16) >> 16 ) ) );
+}
+
+static unsigned int
+hashString( unsigned int h, const std::string& s )
+{
+    unsigned int idx;
+    for (idx=0; idx<s.size(); idx++)
+    {
+        h ^= (unsigned char)s[ idx ];
+        h *= 16777619u;
+    }
+    return( hashWord( h, s.size() ) );
+}
+
+// A structural hash of an attribute. The attribute types the
+//   examples and common model files use hash their contents; others
+//   hash only their type, and compare() tells them apart.
+static unsigned int
+hashAttribute( const osg::StateAttribute& attr )
+{
+    unsigned int h = hashWord( HashBasis, attr.getType() );
+    h = hashWord( h, attr.getMember() );
+    h = hashString( h, attr.className() );
+
+    if (const osg::Material* mat = dynamic_cast< const osg::Material* >( &attr ))
+    {
+        h = hashWord( h, mat->getColorMode() );
+        const osg::Material::Face faces[ 2 ] = { osg::Material::FRONT, osg::Material::BACK };
+        unsigned int idx;
+        for (idx=0; idx<2; idx++)
+        {
+            h = hashVec4( h, mat->getAmbient( faces[ idx ] ) );
+            h = hashVec4( h, mat->getDiffuse( faces[ idx ] ) );
+            h = hashVec4( h, mat->getSpecular( faces[ idx ] ) );
+            h = hashVec4( h, mat->getEmission( faces[ idx ] ) );
+            h = hashFloat( h, mat->getShininess( faces[ idx ] ) );
+        }
+    }
+    else if (const osg::ShadeModel* sm = dynamic_cast< const osg::ShadeModel* >( &attr ))
+        h = hashWord( h, sm->getMode() );
+    else if (const osg::CullFace* cf = dynamic_cast< const osg::CullFace* >( &attr ))
+        h = hashWord( h, cf->getMode() );
+    else if (const osg::PolygonMode* pm = dynamic_cast< const osg::PolygonMode* >( &attr ))
+    {
+        h = hashWord( h, pm->getMode( osg::PolygonMode::FRONT ) );
+        h = hashWord( h, pm->getMode( osg::PolygonMode::BACK ) );
+    }
+    else if (const osg::LineWidth* lw = dynamic_cast< const osg::LineWidth* >( &attr ))
+        h = hashFloat( h, lw->getWidth() );
+    else if (const osg::AlphaFunc* af = dynamic_cast< const osg::AlphaFunc* >( &attr ))
+    {
+        h = hashWord( h, af->getFunction() );
+        h = hashFloat( h, af->getReferenceValue() );
+    }
+    else if (const osg::BlendFunc* bf = dynamic_cast< const osg::BlendFunc* >( &attr ))
+    {
+        h = hashWord( h, bf->getSource() );
+        h = hashWord( h, bf->getDestination() );
+        h = hashWord( h, bf->getSourceAlpha() );
+        h = hashWord( h, bf->getDestinationAlpha() );
+    }
+    else if (const osg::Texture* tex = dynamic_cast< const osg::Texture* >( &attr ))
+    {
+        // Textures are equal only if they use the same Image objects.
+        unsigned int idx;
+        for (idx=0; idx<tex->getNumImages(); idx++)
+            h = hashPointer( h, tex->getImage( idx ) );
+        h = hashWord( h, tex->getFilter( osg::Texture::MIN_FILTER ) );
+        h = hashWord( h, tex->getFilter( osg::Texture::MAG_FILTER ) );
+        h = hashWord( h, tex->getWrap( osg::Texture::WRAP_S ) );
+        h = hashWord( h, tex->getWrap( osg::Texture::WRAP_T ) );
+        h = hashWord( h, tex->getWrap( osg::Texture::WRAP_R ) );
+    }
+    return( h );
+}
+
+static unsigned int
+hashModes( unsigned int h, const osg::StateSet::ModeList& modes )
+{
+    osg::StateSet::ModeList::const_iterator it;
+    for (it=modes.begin(); it!=modes.end(); it++)
+    {
+        h = hashWord( h, it->first );
+        h = hashWord( h, it->second );
+    }
+    return( hashWord( h, modes.size() ) );
+}
+
+// Attributes hash by pointer: by now they're interned.
+static unsigned int
+hashAttributes( unsigned int h, const osg::StateSet::AttributeList& attrs )
+{
+    osg::StateSet::AttributeList::const_iterator it;
+    for (it=attrs.begin(); it!=attrs.end(); it++)
+    {
+        h = hashWord( h, it->first.first );
+        h = hashWord( h, it->first.second );
+        h = hashPointer( h, it->second.first.get() );
+        h = hashWord( h, it->second.second );
+    }
+    return( hashWord( h, attrs.size() ) );
+}
+
+static unsigned int
+hashStateSet( const osg::StateSet& ss )
+{
+    unsigned int h = hashWord( HashBasis, ss.getRenderingHint() );
+    h = hashWord( h, ss.getRenderBinMode() );
+    h = hashWord( h, ss.getBinNumber() );
+    h = hashString( h, ss.getBinName() );
+    h = hashModes( h, ss.getModeList() );
+    h = hashAttributes( h, ss.getAttributeList() );
+
+    unsigned int unit;
+    for (unit=0; unit<ss.getTextureModeList().size(); unit++)
+        h = hashModes( hashWord( h, unit ), ss.getTextureModeList()[ unit ] );
+    for (unit=0; unit<ss.getTextureAttributeList().size(); unit++)
+        h = hashAttributes( hashWord( h, unit ), ss.getTextureAttributeList()[ unit ] );
+
+    const osg::StateSet::UniformList& uniforms = ss.getUniformList();
+    osg::StateSet::UniformList::const_iterator it;
+    for (it=uniforms.begin(); it!=uniforms.end(); it++)
+    {
+        h = hashString( h, it->first );
+        h = hashPointer( h, it->second.first.get() );
+        h = hashWord( h, it->second.second );
+    }
+    return( h );
+}
+
+// StateSet::compare() leaves out the rendering hint and uniforms,
+//   so check them too.
+static bool
+equalStateSets( const osg::StateSet& lhs, const osg::StateSet& rhs )
+{
+    return( (lhs.compare( rhs, false ) == 0) &&
+        (lhs.getRenderingHint() == rhs.getRenderingHint()) &&
+        (lhs.getUniformList() == rhs.getUniformList()) );
+}
+
+// Objects that something means to change aren't shared.
+static bool
+isPoolable( const osg::StateAttribute& attr )
+{
+    return( (attr.getDataVariance() != osg::Object::DYNAMIC) &&
+        (attr.getUpdateCallback() == NULL) && (attr.getEventCallback() == NULL) );
+}
+
+static bool
+isPoolable( const osg::StateSet& ss )
+{
+    return( (ss.getDataVariance() != osg::Object::DYNAMIC) &&
+        (ss.getUpdateCallback() == NULL) && (ss.getEventCallback() == NULL) );
+}
+
+
+StatePool::StatePool()
+{
+}
+
+osg::StateAttribute*
+StatePool::internAttribute( osg::StateAttribute* attr )
+{
+    if ( (attr == NULL) || !isPoolable( *attr ) )
+        return( attr );
+
+    const unsigned int h = hashAttribute( *attr );
+    std::pair< AttributeMap::const_iterator, AttributeMap::const_iterator > range =
+        _attributes.equal_range( h );
+    AttributeMap::const_iterator it;
+    for (it=range.first; it!=range.second; it++)
+        if ( (it->second.get() == attr) || (it->second->compare( *attr ) == 0) )
+            return( it->second.get() );
+
+    _attributes.insert( AttributeMap::value_type( h, attr ) );
+    return( attr );
+}
+
+osg::StateAttribute*
+StatePool::intern( osg::StateAttribute* attr )
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _mutex );
+    return( internAttribute( attr ) );
+}
+
+osg::StateSet*
+StatePool::intern( osg::StateSet* stateSet )
+{
+    if (stateSet == NULL)
+        return( NULL );
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _mutex );
+
+    // Intern the attributes first, so that equal StateSets hold the
+    //   same attribute objects. Iterate over copies of the lists,
+    //   since setAttribute() changes them.
+    const osg::StateSet::AttributeList attrs = stateSet->getAttributeList();
+    osg::StateSet::AttributeList::const_iterator it;
+    for (it=attrs.begin(); it!=attrs.end(); it++)
+    {
+        osg::StateAttribute* attr = it->second.first.get();
+        osg::StateAttribute* pooled = internAttribute( attr );
+        if (pooled != attr)
+            stateSet->setAttribute( pooled, it->second.second );
+    }
+    const osg::StateSet::TextureAttributeList texAttrs = stateSet->getTextureAttributeList();
+    unsigned int unit;
+    for (unit=0; unit<texAttrs.size(); unit++)
+    {
+        for (it=texAttrs[ unit ].begin(); it!=texAttrs[ unit ].end(); it++)
+        {
+            osg::StateAttribute* attr = it->second.first.get();
+            osg::StateAttribute* pooled = internAttribute( attr );
+            if (pooled != attr)
+                stateSet->setTextureAttribute( unit, pooled, it->second.second );
+        }
+    }
+
+    if (!isPoolable( *stateSet ))
+        return( stateSet );
+
+    const unsigned int h = hashStateSet( *stateSet );
+    std::pair< StateSetMap::const_iterator, StateSetMap::const_iterator > range =
+        _stateSets.equal_range( h );
+    StateSetMap::const_iterator sit;
+    for (sit=range.first; sit!=range.second; sit++)
+        if ( (sit->second.get() == stateSet) || equalStateSets( *( sit->second ), *stateSet ) )
+            return( sit->second.get() );
+
+    _stateSets.insert( StateSetMap::value_type( h, stateSet ) );
+    return( stateSet );
+}
+
+unsigned int
+StatePool::getNumAttributes() const
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _mutex );
+    return( _attributes.size() );
+}
+
+unsigned int
+StatePool::getNumStateSets() const
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _mutex );
+    return( _stateSets.size() );
+}
+
+void
+StatePool::clear()
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _mutex );
+    _attributes.clear();
+    _stateSets.clear();
+}
+
+
+StateShareReport::StateShareReport()
+  : _stateSetsBefore( 0 ),
+    _stateSetsAfter( 0 ),
+    _attributesBefore( 0 ),
+    _attributesAfter( 0 ),
+    _bytesBefore( 0 ),
+    _bytesAfter( 0 )
+{
+}
+
+// Rough per-entry overhead of a std::map node: three links and a
+//   color, beyond the value itself.
+static const unsigned int MapNodeOverhead( 4 * sizeof( void* ) );
+
+static unsigned int
+attributeBytes( const osg::StateAttribute& attr )
+{
+    if (dynamic_cast< const osg::Material* >( &attr ) != NULL)
+        return( sizeof( osg::Material ) );
+    if (dynamic_cast< const osg::Texture2D* >( &attr ) != NULL)
+        return( sizeof( osg::Texture2D ) );
+    if (dynamic_cast< const osg::PolygonMode* >( &attr ) != NULL)
+        return( sizeof( osg::PolygonMode ) );
+    if (dynamic_cast< const osg::BlendFunc* >( &attr ) != NULL)
+        return( sizeof( osg::BlendFunc ) );
+    if (dynamic_cast< const osg::AlphaFunc* >( &attr ) != NULL)
+        return( sizeof( osg::AlphaFunc ) );
+    if (dynamic_cast< const osg::LineWidth* >( &attr ) != NULL)
+        return( sizeof( osg::LineWidth ) );
+    if (dynamic_cast< const osg::CullFace* >( &attr ) != NULL)
+        return( sizeof( osg::CullFace ) );
+    if (dynamic_cast< const osg::ShadeModel* >( &attr ) != NULL)
+        return( sizeof( osg::ShadeModel ) );
+    return( sizeof( osg::StateAttribute ) );
+}
+
+static unsigned int
+stateSetBytes( const osg::StateSet& ss )
+{
+    const unsigned int modeBytes = sizeof( osg::StateSet::ModeList::value_type ) + MapNodeOverhead;
+    const unsigned int attrBytes = sizeof( osg::StateSet::AttributeList::value_type ) + MapNodeOverhead;
+    unsigned int bytes = sizeof( osg::StateSet ) +
+        ss.getModeList().size() * modeBytes +
+        ss.getAttributeList().size() * attrBytes;
+    unsigned int unit;
+    for (unit=0; unit<ss.getTextureModeList().size(); unit++)
+        bytes += sizeof( osg::StateSet::ModeList ) +
+            ss.getTextureModeList()[ unit ].size() * modeBytes;
+    for (unit=0; unit<ss.getTextureAttributeList().size(); unit++)
+        bytes += sizeof( osg::StateSet::AttributeList ) +
+            ss.getTextureAttributeList()[ unit ].size() * attrBytes;
+    return( bytes );
+}
+
+// Counts the distinct StateSets and attributes a scene references.
+class StateCounter : public osg::NodeVisitor
+{
+public:
+    StateCounter()
+      : osg::NodeVisitor( osg::NodeVisitor::TRAVERSE_ALL_CHILDREN ),
+        _bytes( 0 )
+    {}
+
+    virtual void apply( osg::Node& node )
+    {
+        count( node.getStateSet() );
+        traverse( node );
+    }
+    virtual void apply( osg::Geode& geode )
+    {
+        count( geode.getStateSet() );
+        unsigned int idx;
+        for (idx=0; idx<geode.getNumDrawables(); idx++)
+            count( geode.getDrawable( idx )->getStateSet() );
+        traverse( geode );
+    }
+
+    std::set< const osg::StateSet* > _stateSets;
+    std::set< const osg::StateAttribute* > _attributes;
+    unsigned int _bytes;
+
+protected:
+    void count( const osg::StateSet* ss )
+    {
+        if ( (ss == NULL) || !_stateSets.insert( ss ).second )
+            return;
+        _bytes += stateSetBytes( *ss );
+        count( ss->getAttributeList() );
+        unsigned int unit;
+        for (unit=0; unit<ss->getTextureAttributeList().size(); unit++)
+            count( ss->getTextureAttributeList()[ unit ] );
+    }
+    void count( const osg::StateSet::AttributeList& attrs )
+    {
+        osg::StateSet::AttributeList::const_iterator it;
+        for (it=attrs.begin(); it!=attrs.end(); it++)
+        {
+            const osg::StateAttribute* attr = it->second.first.get();
+            if ( (attr != NULL) && _attributes.insert( attr ).second )
+                _bytes += attributeBytes( *attr );
+        }
+    }
+};
+
+// Replaces StateSets with their pooled equals.
+class StateSharer : public osg::NodeVisitor
+{
+public:
+    StateSharer( StatePool* pool )
+      : osg::NodeVisitor( osg::NodeVisitor::TRAVERSE_ALL_CHILDREN ),
+        _pool( pool )
+    {}
+
+    virtual void apply( osg::Node& node )
+    {
+        share( node );
+        traverse( node );
+    }
+    virtual void apply( osg::Geode& geode )
+    {
+        share( geode );
+        unsigned int idx;
+        for (idx=0; idx<geode.getNumDrawables(); idx++)
+        {
+            osg::Drawable* drawable = geode.getDrawable( idx );
+            osg::StateSet* ss = drawable->getStateSet();
+            if (ss == NULL)
+                continue;
+            osg::StateSet* pooled = _pool->intern( ss );
+            if (pooled != ss)
+                drawable->setStateSet( pooled );
+        }
+        traverse( geode );
+    }
+
+protected:
+    void share( osg::Node& node )
+    {
+        osg::StateSet* ss = node.getStateSet();
+        if (ss == NULL)
+            return;
+        osg::StateSet* pooled = _pool->intern( ss );
+        if (pooled != ss)
+            node.setStateSet( pooled );
+    }
+
+    StatePool* _pool;
+};
+
+StateShareReport
+shareState( osg::Node* root, StatePool* pool )
+{
+    StateShareReport report;
+    if (root == NULL)
+        return( report );
+    osg::ref_ptr< StatePool > local;
+    if (pool == NULL)
+    {
+        local = new StatePool;
+        pool = local.get();
+    }
+
+    StateCounter before;
+    root->accept( before );
+    report._stateSetsBefore = before._stateSets.size();
+    report._attributesBefore = before._attributes.size();
+    report._bytesBefore = before._bytes;
+
+    StateSharer sharer( pool );
+    root->accept( sharer );
+
+    StateCounter after;
+    root->accept( after );
+    report._stateSetsAfter = after._stateSets.size();
+    report._attributesAfter = after._attributes.size();
+    report._bytesAfter = after._bytes;
+
+    return( report );
+}
@@ -0,0 +1,93 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// Sharing of equal StateSets and StateAttributes
+
+#ifndef __STATE_POOL_H__
+#define __STATE_POOL_H__
+
+#include <osg/Referenced>
+#include <osg/ref_ptr>
+#include <osg/Node>
+#include <osg/StateSet>
+#include <osg/StateAttribute>
+#include <OpenThreads/Mutex>
+#include <map>
+
+// Holds one StateAttribute or StateSet for each distinct state it
+//   has been given (hash-consing). intern() returns the pooled
+//   object equal to its argument, so code that interns all of its
+//   state ends up with one object per distinct state, and can test
+//   two states for equality by comparing pointers. The cull
+//   traversal builds its state graph by StateSet pointer, so shared
+//   StateSets also sort together without comparing contents.
+//
+// Objects are found by a structural hash of their contents, and
+//   then confirmed with StateAttribute::compare() or, once a
+//   StateSet's attributes are interned, StateSet::compare() without
+//   comparing attribute contents.
+//
+// Pooled objects are shared by everything that interned an equal
+//   state, so don't change them in place; clone one, change the
+//   clone, and intern that. Objects that are DYNAMIC, or have update
+//   or event callbacks, are never pooled, since something means to
+//   change them.
+//
+// The pool references everything it holds, so there's no global
+//   one: whoever shares state across scenes makes a pool, and drops
+//   it, or clear()s it, once no more scenes will be added.
+class StatePool : public osg::Referenced
+{
+public:
+    StatePool();
+
+    // Return the pooled attribute equal to attr, adding attr to the
+    //   pool if there's none yet.
+    osg::StateAttribute* intern( osg::StateAttribute* attr );
+
+    // Intern stateSet's attributes and texture attributes in place,
+    //   then return the pooled StateSet equal to it, adding stateSet
+    //   to the pool if there's none yet.
+    osg::StateSet* intern( osg::StateSet* stateSet );
+
+    unsigned int getNumAttributes() const;
+    unsigned int getNumStateSets() const;
+
+    void clear();
+
+protected:
+    virtual ~StatePool() {}
+
+    osg::StateAttribute* internAttribute( osg::StateAttribute* attr );
+
+    typedef std::multimap< unsigned int, osg::ref_ptr< osg::StateAttribute > > AttributeMap;
+    typedef std::multimap< unsigned int, osg::ref_ptr< osg::StateSet > > StateSetMap;
+    AttributeMap _attributes;
+    StateSetMap _stateSets;
+
+    mutable OpenThreads::Mutex _mutex;
+};
+
+// What shareState() changed. Counts are of distinct objects the
+//   scene references. Memory is an estimate of the StateSets and
+//   attributes themselves, not of texture images, which sharing
+//   doesn't change.
+struct StateShareReport
+{
+    StateShareReport();
+
+    unsigned int _stateSetsBefore, _stateSetsAfter;
+    unsigned int _attributesBefore, _attributesAfter;
+    unsigned int _bytesBefore, _bytesAfter;
+};
+
+// Replace every StateSet on the nodes and drawables under root with
+//   its pooled equal, interning its attributes along the way. If
+//   pool is NULL, a pool that lasts for this call shares state
+//   within root only.
+StateShareReport shareState( osg::Node* root, StatePool* pool=NULL );
+
+#endif
@@ -0,0 +1,306 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// Draws many osgText labels from one shared vertex and index buffer
+
+#include "TextBatch.h"
+#include <osg/Geode>
+#include <osg/NodeVisitor>
+#include <osg/State>
+#include <osg/RenderInfo>
+#include <map>
+
+
+// The point of a label's glyph quads that its position refers to,
+//   as osgText::Text::computePositions() finds it.
+static osg::Vec2
+getAlignmentOffset( osgText::Text::AlignmentType alignment, const osg::BoundingBox& bb )
+{
+    const float xCenter = ( bb.xMin() + bb.xMax() ) * .5f;
+    const float yCenter = ( bb.yMin() + bb.yMax() ) * .5f;
+    switch (alignment)
+    {
+    case osgText::Text::LEFT_TOP: return( osg::Vec2( bb.xMin(), bb.yMax() ) );
+    case osgText::Text::LEFT_CENTER: return( osg::Vec2( bb.xMin(), yCenter ) );
+    case osgText::Text::LEFT_BOTTOM: return( osg::Vec2( bb.xMin(), bb.yMin() ) );
+    case osgText::Text::CENTER_TOP: return( osg::Vec2( xCenter, bb.yMax() ) );
+    case osgText::Text::CENTER_CENTER: return( osg::Vec2( xCenter, yCenter ) );
+    case osgText::Text::CENTER_BOTTOM: return( osg::Vec2( xCenter, bb.yMin() ) );
+    case osgText::Text::RIGHT_TOP: return( osg::Vec2( bb.xMax(), bb.yMax() ) );
+    case osgText::Text::RIGHT_CENTER: return( osg::Vec2( bb.xMax(), yCenter ) );
+    case osgText::Text::RIGHT_BOTTOM: return( osg::Vec2( bb.xMax(), bb.yMin() ) );
+    case osgText::Text::CENTER_BASE_LINE: return( osg::Vec2( xCenter, 0.f ) );
+    case osgText::Text::RIGHT_BASE_LINE: return( osg::Vec2( bb.xMax(), 0.f ) );
+    default: return( osg::Vec2( 0.f, 0.f ) );
+    }
+}
+
+
+TextBatch::TextBatch()
+  : _numTexts( 0 )
+{
+    // Glyph textures subload new glyphs as they're applied, and
+    //   SCREEN aligned labels change every frame.
+    setSupportsDisplayList( false );
+}
+
+TextBatch::TextBatch( const TextBatch& tb, const osg::CopyOp& copyop )
+  : osg::Drawable( tb, copyop ),
+    _vertices( tb._vertices ),
+    _texCoords( tb._texCoords ),
+    _colors( tb._colors ),
+    _textureBatches( tb._textureBatches ),
+    _numTexts( tb._numTexts ),
+    _screenIndices( tb._screenIndices ),
+    _screenAnchors( tb._screenAnchors ),
+    _screenOffsets( tb._screenOffsets )
+{
+}
+
+bool
+TextBatch::canBatch( const osgText::Text& text )
+{
+    if ( (text.getUpdateCallback() != NULL) || (text.getCullCallback() != NULL) ||
+            (text.getDrawCallback() != NULL) )
+        return( false );
+    if ( (text.getDrawMode() != osgText::Text::TEXT) ||
+            (text.getBackdropType() != osgText::Text::NONE) ||
+            (text.getColorGradientMode() != osgText::Text::SOLID) ||
+            (text.getCharacterSizeMode() != osgText::Text::OBJECT_COORDS) )
+        return( false );
+    const osgText::Text::AlignmentType alignment = text.getAlignment();
+    return( (alignment != osgText::Text::LEFT_BOTTOM_BASE_LINE) &&
+        (alignment != osgText::Text::CENTER_BOTTOM_BASE_LINE) &&
+        (alignment != osgText::Text::RIGHT_BOTTOM_BASE_LINE) );
+}
+
+TextBatch::TextureBatch&
+TextBatch::getTextureBatch( osg::Texture* texture )
+{
+    unsigned int idx;
+    for (idx=0; idx<_textureBatches.size(); idx++)
+        if (_textureBatches[ idx ]._texture.get() == texture)
+            return( _textureBatches[ idx ] );
+    _textureBatches.push_back( TextureBatch() );
+    _textureBatches.back()._texture = texture;
+    return( _textureBatches.back() );
+}
+
+bool
+TextBatch::addText( const osgText::Text& text )
+{
+    if (!canBatch( text ))
+        return( false );
+    _numTexts++;
+
+    const osgText::Text::TextureGlyphQuadMap& quadMap = text.getTextureGlyphQuadMap();
+    osgText::Text::TextureGlyphQuadMap::const_iterator it;
+    osg::BoundingBox bb;
+    for (it=quadMap.begin(); it!=quadMap.end(); it++)
+    {
+        const osgText::Text::GlyphQuads::Coords2& coords = it->second.getCoords();
+        unsigned int idx;
+        for (idx=0; idx<coords.size(); idx++)
+            bb.expandBy( coords[ idx ].x(), coords[ idx ].y(), 0.f );
+    }
+    if (!bb.valid())
+        // No glyphs, such as an empty string.
+        return( true );
+
+    // The glyph quad coordinates are in object units, relative to
+    //   the start of the first line. Text's own matrix moves the
+    //   alignment point to the origin, rotates into the plane the
+    //   axis alignment picked, and moves to the label's position.
+    const osg::Vec2 offset = getAlignmentOffset( text.getAlignment(), bb );
+    const bool screen = (text.getAxisAlignment() == osgText::Text::SCREEN);
+    const osg::Matrix matrix = osg::Matrix::rotate( text.getRotation() ) *
+        osg::Matrix::translate( text.getPosition() );
+    const osg::Vec4& color = text.getColor();
+
+    for (it=quadMap.begin(); it!=quadMap.end(); it++)
+    {
+        TextureBatch& tb = getTextureBatch( it->first.get() );
+        const osgText::Text::GlyphQuads::Coords2& coords = it->second.getCoords();
+        const osgText::Text::GlyphQuads::TexCoords& texCoords = it->second.getTexCoords();
+        if (texCoords.size() != coords.size())
+            continue;
+
+        // Four corners per glyph: upper left, lower left, lower
+        //   right, upper right.
+        unsigned int idx;
+        for (idx=0; idx+3<coords.size(); idx+=4)
+        {
+            const GLuint base = _vertices.size();
+            unsigned int corner;
+            for (corner=0; corner<4; corner++)
+            {
+                const osg::Vec2& c = coords[ idx+corner ];
+                const osg::Vec3 local( c.x() - offset.x(), c.y() - offset.y(), 0.f );
+                if (screen)
+                {
+                    _screenIndices.push_back( _vertices.size() );
+                    _screenAnchors.push_back( text.getPosition() );
+                    _screenOffsets.push_back( local );
+                    _vertices.push_back( text.getPosition() + local );
+                }
+                else
+                    _vertices.push_back( local * matrix );
+                _texCoords.push_back( texCoords[ idx+corner ] );
+                _colors.push_back( color );
+            }
+            tb._indices.push_back( base );
+            tb._indices.push_back( base+1 );
+            tb._indices.push_back( base+2 );
+            tb._indices.push_back( base );
+            tb._indices.push_back( base+2 );
+            tb._indices.push_back( base+3 );
+        }
+    }
+
+    dirtyBound();
+    return( true );
+}
+
+osg::BoundingBox
+TextBatch::computeBound() const
+{
+    osg::BoundingBox bb;
+    unsigned int idx;
+    unsigned int screenIdx( 0 );
+    for (idx=0; idx<_vertices.size(); idx++)
+    {
+        if ( (screenIdx < _screenIndices.size()) && (_screenIndices[ screenIdx ] == idx) )
+        {
+            // Any rotation about the label's position.
+            bb.expandBy( osg::BoundingSphere( _screenAnchors[ screenIdx ],
+                _screenOffsets[ screenIdx ].length() ) );
+            screenIdx++;
+        }
+        else
+            bb.expandBy( _vertices[ idx ] );
+    }
+    return( bb );
+}
+
+void
+TextBatch::drawImplementation( osg::RenderInfo& renderInfo ) const
+{
+    if (_vertices.empty())
+        return;
+    osg::State& state = *renderInfo.getState();
+
+    const osg::Vec3* vertices = &( _vertices[ 0 ] );
+    if (!_screenIndices.empty())
+    {
+        // Turn SCREEN aligned labels to face the eye, as Text does,
+        //   with the inverse of the model-view rotation. Only when
+        //   it has changed since this context last drew.
+        ContextVertices& cv = _contextVertices[ state.getContextID() ];
+        osg::Matrix rotation( state.getModelViewMatrix() );
+        rotation.setTrans( 0., 0., 0. );
+        rotation = osg::Matrix::inverse( rotation );
+        if (!cv._valid || (cv._rotation != rotation) ||
+            (cv._vertices.size() != _vertices.size()))
+        {
+            cv._vertices = _vertices;
+            unsigned int idx;
+            for (idx=0; idx<_screenIndices.size(); idx++)
+                cv._vertices[ _screenIndices[ idx ] ] = _screenAnchors[ idx ] +
+                    osg::Matrix::transform3x3( _screenOffsets[ idx ], rotation );
+            cv._rotation = rotation;
+            cv._valid = true;
+        }
+        vertices = &( cv._vertices[ 0 ] );
+    }
+
+    state.disableAllVertexArrays();
+    state.applyTextureMode( 0, GL_TEXTURE_2D, true );
+    state.setVertexPointer( 3, GL_FLOAT, 0, vertices );
+    state.setTexCoordPointer( 0, 2, GL_FLOAT, 0, &( _texCoords[ 0 ] ) );
+    state.setColorPointer( 4, GL_FLOAT, 0, &( _colors[ 0 ] ) );
+
+    unsigned int idx;
+    for (idx=0; idx<_textureBatches.size(); idx++)
+    {
+        const TextureBatch& tb = _textureBatches[ idx ];
+        if (tb._indices.empty())
+            continue;
+        state.applyTextureAttribute( 0, tb._texture.get() );
+        glDrawElements( GL_TRIANGLES, tb._indices.size(), GL_UNSIGNED_INT,
+            &( tb._indices[ 0 ] ) );
+    }
+}
+
+void
+TextBatch::accept( osg::Drawable::PrimitiveFunctor& functor ) const
+{
+    if (_vertices.empty())
+        return;
+    functor.setVertexArray( _vertices.size(), &( _vertices[ 0 ] ) );
+    unsigned int idx;
+    for (idx=0; idx<_textureBatches.size(); idx++)
+    {
+        const TextureBatch& tb = _textureBatches[ idx ];
+        if (!tb._indices.empty())
+            functor.drawElements( GL_TRIANGLES, tb._indices.size(), &( tb._indices[ 0 ] ) );
+    }
+}
+
+
+// Finds the batchable labels in each Geode and replaces them.
+class TextBatcher : public osg::NodeVisitor
+{
+public:
+    TextBatcher()
+      : osg::NodeVisitor( osg::NodeVisitor::TRAVERSE_ALL_CHILDREN ),
+        _numBatched( 0 )
+    {}
+
+    virtual void apply( osg::Geode& geode )
+    {
+        // Labels sharing a StateSet (normally their font's) can
+        //   share a batch.
+        typedef std::vector< osg::ref_ptr<osgText::Text> > TextList;
+        typedef std::map< osg::StateSet*, TextList > StateTextMap;
+        StateTextMap texts;
+        unsigned int idx;
+        for (idx=0; idx<geode.getNumDrawables(); idx++)
+        {
+            osgText::Text* text = dynamic_cast< osgText::Text* >( geode.getDrawable( idx ) );
+            if ( (text != NULL) && TextBatch::canBatch( *text ) )
+                texts[ text->getStateSet() ].push_back( text );
+        }
+
+        StateTextMap::const_iterator it;
+        for (it=texts.begin(); it!=texts.end(); it++)
+        {
+            const TextList& textList = it->second;
+            if (textList.size() < 2)
+                continue;
+            osg::ref_ptr< TextBatch > batch = new TextBatch;
+            batch->setStateSet( it->first );
+            for (idx=0; idx<textList.size(); idx++)
+            {
+                batch->addText( *( textList[ idx ] ) );
+                geode.removeDrawable( textList[ idx ].get() );
+            }
+            geode.addDrawable( batch.get() );
+            _numBatched += textList.size();
+        }
+    }
+
+    unsigned int _numBatched;
+};
+
+unsigned int
+batchText( osg::Node* root )
+{
+    if (root == NULL)
+        return( 0 );
+    TextBatcher tb;
+    root->accept( tb );
+    return( tb._numBatched );
+}
@@ -0,0 +1,106 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// Draws many osgText labels from one shared vertex and index buffer
+
+#ifndef __TEXT_BATCH_H__
+#define __TEXT_BATCH_H__
+
+#include <osg/Drawable>
+#include <osg/Texture>
+#include <osg/Matrix>
+#include <osg/buffered_value>
+#include <osgText/Text>
+#include <vector>
+
+// A Drawable holding the laid-out glyph quads of any number of
+//   osgText::Text labels, as triangles in one vertex array with one
+//   index list per glyph texture. Drawing it costs one
+//   glDrawElements() per glyph texture, instead of a Drawable, a
+//   matrix computation and a glDrawArrays() per label and texture.
+//
+// The labels are copied as they are when added; changing a Text
+//   afterwards doesn't change the batch. All labels in a batch are
+//   drawn with the batch's StateSet, which batchText() sets to the
+//   StateSet the labels share.
+class TextBatch : public osg::Drawable
+{
+public:
+    TextBatch();
+    TextBatch( const TextBatch& tb,
+        const osg::CopyOp& copyop=osg::CopyOp::SHALLOW_COPY );
+
+    META_Object( osgQSG, TextBatch );
+
+    // True if addText() can lay out the label: plain, solid-color
+    //   text (no backdrop, gradient, bounding box or alignment
+    //   marker, and no callbacks), sized in object coordinates,
+    //   with any axis alignment and any alignment except the
+    //   *_BOTTOM_BASE_LINE ones.
+    static bool canBatch( const osgText::Text& text );
+
+    // Append a label's glyphs. Returns false, and adds nothing, if
+    //   canBatch() is false.
+    bool addText( const osgText::Text& text );
+
+    unsigned int getNumTexts() const { return( _numTexts ); }
+    unsigned int getNumGlyphs() const { return( _vertices.size() / 4 ); }
+
+    virtual osg::BoundingBox computeBound() const;
+    virtual void drawImplementation( osg::RenderInfo& renderInfo ) const;
+
+    // Intersection and other functors see SCREEN aligned labels
+    //   unrotated, in the XY plane at their positions.
+    virtual bool supports( const osg::Drawable::PrimitiveFunctor& ) const { return( true ); }
+    virtual void accept( osg::Drawable::PrimitiveFunctor& functor ) const;
+
+protected:
+    virtual ~TextBatch() {}
+
+    // Indices of the triangles that use one glyph texture.
+    struct TextureBatch
+    {
+        osg::ref_ptr< osg::Texture > _texture;
+        std::vector< GLuint > _indices;
+    };
+    TextureBatch& getTextureBatch( osg::Texture* texture );
+
+    // Final vertices for labels with a fixed orientation. SCREEN
+    //   aligned labels turn to face the eye every frame, so their
+    //   vertices here are placeholders, made in each context from
+    //   _screenAnchors and _screenOffsets.
+    std::vector< osg::Vec3 > _vertices;
+    std::vector< osg::Vec2 > _texCoords;
+    std::vector< osg::Vec4 > _colors;
+    std::vector< TextureBatch > _textureBatches;
+    unsigned int _numTexts;
+
+    // Per SCREEN aligned vertex: its index in _vertices, its label's
+    //   position, and its offset from it in the label's plane.
+    std::vector< unsigned int > _screenIndices;
+    std::vector< osg::Vec3 > _screenAnchors;
+    std::vector< osg::Vec3 > _screenOffsets;
+
+    // The vertices one context last drew SCREEN aligned labels with,
+    //   and the rotation they were made with.
+    struct ContextVertices
+    {
+        ContextVertices() : _valid( false ) {}
+
+        bool _valid;
+        osg::Matrix _rotation;
+        std::vector< osg::Vec3 > _vertices;
+    };
+    mutable osg::buffered_object< ContextVertices > _contextVertices;
+};
+
+// Replace the osgText::Text drawables in each Geode below root with
+//   TextBatches, one per Geode and StateSet, where at least two
+//   labels share them and canBatch() is true. Returns the number of
+//   Text drawables replaced.
+unsigned int batchText( osg::Node* root );
+
+#endif
@@ -0,0 +1,157 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// Timing summaries and CSV/JSON reports for the benchmark utilities
+
+#include "TimingStats.h"
+#include <osgDB/FileNameUtils>
+#include <osg/Notify>
+#include <algorithm>
+#include <fstream>
+
+
+TimingSummary::TimingSummary()
+  : _count( 0 ),
+    _mean( 0. ), _min( 0. ), _p50( 0. ), _p90( 0. ),
+    _p95( 0. ), _p99( 0. ), _max( 0. )
+{
+}
+
+double
+percentile( const std::vector< double >& sorted, double p )
+{
+    if (sorted.empty())
+        return( 0. );
+    const double pos = p * ( sorted.size() - 1 );
+    const unsigned int lo = (unsigned int)pos;
+    if (lo + 1 >= sorted.size())
+        return( sorted.back() );
+    const double frac = pos - lo;
+    return( sorted[ lo ] + ( sorted[ lo+1 ] - sorted[ lo ] ) * frac );
+}
+
+TimingSummary
+summarizeTimings( const std::vector< double >& samples )
+{
+    TimingSummary s;
+    if (samples.empty())
+        return( s );
+
+    std::vector< double > sorted( samples );
+    std::sort( sorted.begin(), sorted.end() );
+
+    double sum( 0. );
+    unsigned int idx;
+    for (idx=0; idx<sorted.size(); idx++)
+        sum += sorted[ idx ];
+
+    s._count = sorted.size();
+    s._mean = sum / sorted.size();
+    s._min = sorted.front();
+    s._p50 = percentile( sorted, .5 );
+    s._p90 = percentile( sorted, .9 );
+    s._p95 = percentile( sorted, .95 );
+    s._p99 = percentile( sorted, .99 );
+    s._max = sorted.back();
+    return( s );
+}
+
+
+TimingReport::TimingReport( const std::vector< std::string >& keyNames )
+  : _keyNames( keyNames )
+{
+}
+
+void
+TimingReport::addRow( const std::vector< std::string >& keys,
+    const TimingSummary& summary )
+{
+    Row row;
+    row._keys = keys;
+    row._keys.resize( _keyNames.size() );
+    row._summary = summary;
+    _rows.push_back( row );
+}
+
+bool
+TimingReport::write( const std::string& fileName ) const
+{
+    std::ofstream out( fileName.c_str() );
+    if (!out)
+    {
+        osg::notify( osg::WARN ) << "Can't write \"" << fileName << "\"." << std::endl;
+        return( false );
+    }
+    if (osgDB::getLowerCaseFileExtension( fileName ) == "json")
+        writeJSON( out );
+    else
+        writeCSV( out );
+    return( out.good() );
+}
+
+// Names of the summary columns, in output order.
+static const char* s_columns[] =
+{
+    "count", "mean_ms", "min_ms", "p50_ms", "p90_ms", "p95_ms", "p99_ms", "max_ms"
+};
+
+static void
+summaryValues( const TimingSummary& s, double values[ 8 ] )
+{
+    values[ 0 ] = s._count;
+    values[ 1 ] = s._mean;
+    values[ 2 ] = s._min;
+    values[ 3 ] = s._p50;
+    values[ 4 ] = s._p90;
+    values[ 5 ] = s._p95;
+    values[ 6 ] = s._p99;
+    values[ 7 ] = s._max;
+}
+
+void
+TimingReport::writeCSV( std::ostream& out ) const
+{
+    unsigned int idx, cIdx;
+    for (idx=0; idx<_keyNames.size(); idx++)
+        out << _keyNames[ idx ] << ",";
+    for (cIdx=0; cIdx<8; cIdx++)
+        out << s_columns[ cIdx ] << ( (cIdx < 7) ? "," : "\n" );
+
+    for (idx=0; idx<_rows.size(); idx++)
+    {
+        const Row& row = _rows[ idx ];
+        unsigned int kIdx;
+        for (kIdx=0; kIdx<row._keys.size(); kIdx++)
+            out << row._keys[ kIdx ] << ",";
+        double values[ 8 ];
+        summaryValues( row._summary, values );
+        for (cIdx=0; cIdx<8; cIdx++)
+            out << values[ cIdx ] << ( (cIdx < 7) ? "," : "\n" );
+    }
+}
+
+void
+TimingReport::writeJSON( std::ostream& out ) const
+{
+    out << "[\n";
+    unsigned int idx;
+    for (idx=0; idx<_rows.size(); idx++)
+    {
+        const Row& row = _rows[ idx ];
+        out << "  { ";
+        unsigned int kIdx;
+        for (kIdx=0; kIdx<row._keys.size(); kIdx++)
+            out << "\"" << _keyNames[ kIdx ] << "\": \"" << row._keys[ kIdx ] << "\", ";
+        double values[ 8 ];
+        summaryValues( row._summary, values );
+        unsigned int cIdx;
+        for (cIdx=0; cIdx<8; cIdx++)
+            out << "\"" << s_columns[ cIdx ] << "\": " << values[ cIdx ] <<
+                ( (cIdx < 7) ? ", " : " }" );
+        out << ( (idx+1 < _rows.size()) ? ",\n" : "\n" );
+    }
+    out << "]\n";
+}
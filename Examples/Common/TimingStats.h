@@ -0,0 +1,61 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// Timing summaries and CSV/JSON reports for the benchmark utilities
+
+#ifndef __TIMING_STATS_H__
+#define __TIMING_STATS_H__
+
+#include <string>
+#include <vector>
+#include <ostream>
+
+// Summary of a set of timing samples. All times are in
+//   milliseconds. Percentiles interpolate between the two nearest
+//   samples.
+struct TimingSummary
+{
+    TimingSummary();
+
+    unsigned int _count;
+    double _mean, _min, _p50, _p90, _p95, _p99, _max;
+};
+
+TimingSummary summarizeTimings( const std::vector< double >& samples );
+
+// Value at fraction p (0 to 1) of the way through sorted samples.
+double percentile( const std::vector< double >& sorted, double p );
+
+// A table of TimingSummary rows, each identified by a few key
+//   columns (for example scene, instance count and phase), that
+//   can be written as CSV or JSON.
+class TimingReport
+{
+public:
+    TimingReport( const std::vector< std::string >& keyNames );
+
+    void addRow( const std::vector< std::string >& keys,
+        const TimingSummary& summary );
+
+    unsigned int getNumRows() const { return( _rows.size() ); }
+
+    // Write JSON if fileName ends in .json, and CSV otherwise.
+    bool write( const std::string& fileName ) const;
+    void writeCSV( std::ostream& out ) const;
+    void writeJSON( std::ostream& out ) const;
+
+protected:
+    struct Row
+    {
+        std::vector< std::string > _keys;
+        TimingSummary _summary;
+    };
+
+    std::vector< std::string > _keyNames;
+    std::vector< Row > _rows;
+};
+
+#endif
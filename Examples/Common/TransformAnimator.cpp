@@ -0,0 +1,225 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// Batched rotation animation for many MatrixTransforms
+
+#include "TransformAnimator.h"
+#include "ParallelLoop.h"
+#include <osg/NodeVisitor>
+#include <osg/FrameStamp>
+#include <algorithm>
+
+
+// Below this many targets, threads cost more than they save.
+static const unsigned int ParallelThreshold( 8192 );
+// Targets per work item when running in parallel.
+static const unsigned int BlockSize( 2048 );
+
+static const float Pi( 3.14159265358979f );
+static const float TwoPi( 6.28318530717959f );
+
+// Sine of x in [-pi,pi]. Folding to [-pi/2,pi/2] and evaluating
+//   an odd polynomial keeps the loops below free of calls and
+//   branches, so the compiler can vectorize them. The error is
+//   about 2e-7, the precision of a float.
+static inline float
+sinPoly( float x )
+{
+    x = (x > .5f*Pi) ? Pi - x : x;
+    x = (x < -.5f*Pi) ? -Pi - x : x;
+    const float x2 = x * x;
+    return( x * ( 1.f + x2 * ( -1.f/6.f + x2 * ( 1.f/120.f +
+        x2 * ( -1.f/5040.f + x2 * ( 1.f/362880.f +
+        x2 * ( -1.f/39916800.f ) ) ) ) ) ) );
+}
+
+
+class AnimateTask : public ParallelTask
+{
+public:
+    AnimateTask( TransformAnimator& animator, unsigned int count )
+      : _animator( animator ), _count( count ) {}
+
+    virtual void operator()( unsigned int index )
+    {
+        const unsigned int first = index * BlockSize;
+        _animator.compute( first, std::min( first + BlockSize, _count ) );
+    }
+
+protected:
+    TransformAnimator& _animator;
+    const unsigned int _count;
+};
+
+
+TransformAnimator::TransformAnimator()
+  : _lastFrame( -1 ),
+    _timingScope( FrameRecorder::instance()->getScope( "TransformAnimator" ) ),
+    _updateBounds( true ),
+    _boundsStale( false )
+{
+}
+
+void
+TransformAnimator::add( osg::MatrixTransform* mt, const osg::Vec3& axis,
+    float rate, const osg::Vec3& translation, float angle )
+{
+    osg::Vec3 n( axis );
+    n.normalize();
+
+    // The matrix changes every frame. Mark it so that passes which
+    //   fold static transforms leave it alone.
+    mt->setDataVariance( osg::Object::DYNAMIC );
+
+    _targets.push_back( mt );
+    _angle.push_back( angle );
+    _rate.push_back( rate );
+    _axisX.push_back( n.x() );
+    _axisY.push_back( n.y() );
+    _axisZ.push_back( n.z() );
+    _transX.push_back( translation.x() );
+    _transY.push_back( translation.y() );
+    _transZ.push_back( translation.z() );
+    _matrices.push_back( osg::Matrix::identity() );
+    _boundsStale = true;
+}
+
+bool
+TransformAnimator::remove( osg::MatrixTransform* mt )
+{
+    unsigned int idx;
+    for (idx=0; idx<_targets.size(); idx++)
+        if (_targets[ idx ].get() == mt)
+            break;
+    if (idx == _targets.size())
+        return( false );
+
+    // Move the last target into the vacated slot.
+    const unsigned int last = _targets.size() - 1;
+    _targets[ idx ] = _targets[ last ];
+    _angle[ idx ] = _angle[ last ];
+    _rate[ idx ] = _rate[ last ];
+    _axisX[ idx ] = _axisX[ last ];
+    _axisY[ idx ] = _axisY[ last ];
+    _axisZ[ idx ] = _axisZ[ last ];
+    _transX[ idx ] = _transX[ last ];
+    _transY[ idx ] = _transY[ last ];
+    _transZ[ idx ] = _transZ[ last ];
+
+    _targets.pop_back();
+    _angle.pop_back();
+    _rate.pop_back();
+    _axisX.pop_back();
+    _axisY.pop_back();
+    _axisZ.pop_back();
+    _transX.pop_back();
+    _transY.pop_back();
+    _transZ.pop_back();
+    _matrices.pop_back();
+    _boundsStale = true;
+    return( true );
+}
+
+// Compute the matrices for targets [first,last).
+void
+TransformAnimator::compute( unsigned int first, unsigned int last )
+{
+    const unsigned int count = last - first;
+    float* angle = &_angle[ first ];
+    const float* rate = &_rate[ first ];
+
+    // Advance and wrap the angles, then take their sines and
+    //   cosines. cos(a) is sin(a+pi/2), wrapped back into range.
+    float s[ BlockSize ], c[ BlockSize ];
+    unsigned int idx;
+    for (idx=0; idx<count; idx++)
+    {
+        float a = angle[ idx ] + rate[ idx ];
+        a = (a > Pi) ? a - TwoPi : a;
+        a = (a < -Pi) ? a + TwoPi : a;
+        angle[ idx ] = a;
+        s[ idx ] = sinPoly( a );
+        float b = a + .5f * Pi;
+        b = (b > Pi) ? b - TwoPi : b;
+        c[ idx ] = sinPoly( b );
+    }
+
+    // Rotation about a unit axis, in OSG's row-vector convention,
+    //   followed by the translation in the bottom row.
+    const float* ux = &_axisX[ first ];
+    const float* uy = &_axisY[ first ];
+    const float* uz = &_axisZ[ first ];
+    const float* tx = &_transX[ first ];
+    const float* ty = &_transY[ first ];
+    const float* tz = &_transZ[ first ];
+    osg::Matrix* m = &_matrices[ first ];
+    for (idx=0; idx<count; idx++)
+    {
+        const float x = ux[ idx ], y = uy[ idx ], z = uz[ idx ];
+        const float si = s[ idx ], co = c[ idx ], t = 1.f - co;
+        m[ idx ].set(
+            t*x*x + co,   t*x*y + si*z, t*x*z - si*y, 0.f,
+            t*x*y - si*z, t*y*y + co,   t*y*z + si*x, 0.f,
+            t*x*z + si*y, t*y*z - si*x, t*z*z + co,   0.f,
+            tx[ idx ],    ty[ idx ],    tz[ idx ],    1.f );
+    }
+}
+
+void
+TransformAnimator::advance()
+{
+    const unsigned int count = _targets.size();
+    if (count == 0)
+        return;
+
+    AnimateTask task( *this, count );
+    const unsigned int numBlocks = ( count + BlockSize - 1 ) / BlockSize;
+    if (count < ParallelThreshold)
+    {
+        unsigned int idx;
+        for (idx=0; idx<numBlocks; idx++)
+            task( idx );
+    }
+    else
+        runParallel( task, numBlocks );
+
+    // setMatrix() dirties bounds up the parent chain, which isn't
+    //   safe to do from several threads, so write back serially.
+    unsigned int idx;
+    for (idx=0; idx<count; idx++)
+        _targets[ idx ]->setMatrix( _matrices[ idx ] );
+
+    if (!_updateBounds)
+        return;
+    if (_boundsStale)
+    {
+        std::vector< osg::Node* > nodes( count );
+        for (idx=0; idx<count; idx++)
+            nodes[ idx ] = _targets[ idx ].get();
+        _bounds.setNodes( nodes );
+        _boundsStale = false;
+    }
+    _bounds.update();
+}
+
+void
+TransformAnimator::operator()( osg::Node* node, osg::NodeVisitor* nv )
+{
+    // Shared parents can bring the traversal here more than once
+    //   per frame; animate only on the first visit.
+    const osg::FrameStamp* fs = nv->getFrameStamp();
+    const int frame = (fs != NULL) ? fs->getFrameNumber() : _lastFrame + 1;
+    if (frame != _lastFrame)
+    {
+        _lastFrame = frame;
+        ScopedFrameTimer timer( FrameRecorder::instance(), _timingScope );
+        advance();
+    }
+
+    // Continue traversing so that OSG can process
+    //   any other nodes with callbacks.
+    traverse( node, nv );
+}
@@ -0,0 +1,89 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// Batched rotation animation for many MatrixTransforms
+
+#ifndef __TRANSFORM_ANIMATOR_H__
+#define __TRANSFORM_ANIMATOR_H__
+
+#include <osg/NodeCallback>
+#include <osg/MatrixTransform>
+#include <osg/ref_ptr>
+#include "FastBounds.h"
+#include "FrameRecorder.h"
+#include <vector>
+
+// An update callback that spins any number of MatrixTransforms.
+//   Each transform's matrix is a rotation of angle radians about
+//   an axis followed by a translation, and angle advances by a
+//   fixed rate each frame.
+//
+// Attach one TransformAnimator to a node that the update traversal
+//   reaches, usually the scene root. It replaces one callback per
+//   animated node: the parameters are stored as parallel arrays,
+//   the angles and rotation matrices are computed for all of them
+//   in one pass (split across threads for large counts), and then
+//   the matrices are written back. Parents' bounds are dirtied by
+//   the first write below them, so the remaining writes stop at
+//   the first ancestor that is already dirty. Then, unless
+//   setUpdateBounds( false ) is called, a BoundUpdater recomputes
+//   the targets' bounds and their ancestors' once each, level by
+//   level and in parallel for large counts, rather than leaving
+//   them to the cull traversal to recompute on one thread.
+class TransformAnimator : public osg::NodeCallback
+{
+public:
+    TransformAnimator();
+
+    // Start animating mt. rate is in radians per frame.
+    void add( osg::MatrixTransform* mt, const osg::Vec3& axis, float rate,
+        const osg::Vec3& translation=osg::Vec3( 0.f, 0.f, 0.f ),
+        float angle=0.f );
+    // Stop animating mt, leaving its current matrix in place.
+    //   Returns false if mt isn't animated.
+    bool remove( osg::MatrixTransform* mt );
+
+    unsigned int getNumTransforms() const { return( _targets.size() ); }
+
+    // Whether advance() brings bounds up to date. On by default.
+    void setUpdateBounds( bool updateBounds ) { _updateBounds = updateBounds; }
+    bool getUpdateBounds() const { return( _updateBounds ); }
+
+    // Advance every angle by one step and write every matrix.
+    //   operator() calls this once per frame, however many times
+    //   the update traversal reaches the animator's node, and
+    //   records the time it takes to the "TransformAnimator" scope
+    //   of FrameRecorder::instance().
+    void advance();
+
+    virtual void operator()( osg::Node* node, osg::NodeVisitor* nv );
+
+protected:
+    virtual ~TransformAnimator() {}
+
+    friend class AnimateTask;
+    void compute( unsigned int first, unsigned int last );
+
+    std::vector< osg::ref_ptr<osg::MatrixTransform> > _targets;
+
+    // Parameters, one entry per target.
+    std::vector< float > _angle, _rate;
+    std::vector< float > _axisX, _axisY, _axisZ;
+    std::vector< float > _transX, _transY, _transZ;
+
+    // Results of compute(), one entry per target.
+    std::vector< osg::Matrix > _matrices;
+
+    int _lastFrame;
+    const unsigned int _timingScope;
+
+    bool _updateBounds;
+    // Set when targets are added or removed.
+    bool _boundsStale;
+    BoundUpdater _bounds;
+};
+
+#endif
@@ -0,0 +1,449 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// Cost-driven flattening of static transforms
+
+#include "TransformFlattener.h"
+#include "InstanceGroup.h"
+#include <osg/MatrixTransform>
+#include <osg/Geode>
+#include <osg/Geometry>
+#include <osg/NodeVisitor>
+#include <algorithm>
+#include <map>
+#include <set>
+#include <cstring>
+
+
+FlattenCostModel::FlattenCostModel()
+  : _transformCullCost( 150.f ),
+    _instanceCullCost( 40.f ),
+    _maxBakedVertices( 4096 ),
+    _memoryBudget( 4 << 20 ),
+    _minInstances( 2 )
+{
+}
+
+FlattenDecision::FlattenDecision()
+  : _outcome( KEEP ),
+    _sharers( 0 ),
+    _instanceable( 0 ),
+    _vertices( 0 ),
+    _cullSaving( 0.f ),
+    _bytesAdded( 0 )
+{
+}
+
+FlattenReport::FlattenReport()
+  : _transformsBefore( 0 ),
+    _transformsAfter( 0 ),
+    _baked( 0 ),
+    _instanced( 0 ),
+    _kept( 0 ),
+    _instanceGroups( 0 ),
+    _bytesAdded( 0 ),
+    _cullSaving( 0.f )
+{
+}
+
+
+// Return node as a MatrixTransform that can be flattened, or NULL.
+//   Same rules as instancing, since either may replace it.
+static osg::MatrixTransform*
+flattenableTransform( osg::Node* node )
+{
+    osg::Transform* t = node->asTransform();
+    osg::MatrixTransform* mt = ( t != NULL ) ? t->asMatrixTransform() : NULL;
+    // Subclasses might do more than apply a matrix.
+    if ( (mt == NULL) || (strcmp( mt->className(), "MatrixTransform" ) != 0) )
+        return( NULL );
+
+    if ( (mt->getNumChildren() != 1) ||
+            (mt->getNumParents() != 1) ||
+            !mt->getName().empty() ||
+            (mt->getDataVariance() == osg::Object::DYNAMIC) ||
+            (mt->getReferenceFrame() != osg::Transform::RELATIVE_RF) ||
+            (mt->getNodeMask() != ~0u) ||
+            !mt->getCullingActive() ||
+            (mt->getUpdateCallback() != NULL) ||
+            (mt->getEventCallback() != NULL) ||
+            (mt->getCullCallback() != NULL) ||
+            (mt->getUserData() != NULL) )
+        return( NULL );
+    return( mt );
+}
+
+// Counts distinct Transforms, and collects the flattenable ones
+//   with the Group they're under.
+class TransformCollector : public osg::NodeVisitor
+{
+public:
+    TransformCollector()
+      : osg::NodeVisitor( osg::NodeVisitor::TRAVERSE_ALL_CHILDREN ),
+        _numTransforms( 0 )
+    {
+    }
+
+    virtual void apply( osg::Node& node )
+    {
+        if (!_visited.insert( &node ).second)
+            return;
+        if (node.asTransform() != NULL)
+            _numTransforms++;
+
+        osg::Group* group = node.asGroup();
+        if (group != NULL)
+        {
+            unsigned int idx;
+            for (idx=0; idx<group->getNumChildren(); idx++)
+            {
+                osg::MatrixTransform* mt = flattenableTransform( group->getChild( idx ) );
+                if (mt != NULL)
+                {
+                    _parents.push_back( group );
+                    _transforms.push_back( mt );
+                }
+            }
+        }
+        traverse( node );
+    }
+
+    std::set< osg::Node* > _visited;
+    unsigned int _numTransforms;
+    std::vector< osg::ref_ptr<osg::Group> > _parents;
+    std::vector< osg::ref_ptr<osg::MatrixTransform> > _transforms;
+};
+
+// Decides whether a subgraph can be baked, and counts its vertices
+//   and the bytes a transformed copy adds.
+class BakeableVisitor : public osg::NodeVisitor
+{
+public:
+    BakeableVisitor()
+      : osg::NodeVisitor( osg::NodeVisitor::TRAVERSE_ALL_CHILDREN ),
+        _bakeable( true ),
+        _vertices( 0 ),
+        _bytes( 0 )
+    {
+    }
+
+    virtual void apply( osg::Node& node )
+    {
+        const std::string className( node.className() );
+        if ( ( (className != "Group") && (className != "Geode") ) ||
+                (node.getDataVariance() == osg::Object::DYNAMIC) ||
+                (node.getUpdateCallback() != NULL) ||
+                (node.getEventCallback() != NULL) ||
+                (node.getCullCallback() != NULL) )
+        {
+            _bakeable = false;
+            return;
+        }
+        traverse( node );
+    }
+    virtual void apply( osg::Geode& geode )
+    {
+        unsigned int idx;
+        for (idx=0; idx<geode.getNumDrawables(); idx++)
+            addDrawable( geode.getDrawable( idx ) );
+        apply( (osg::Node&)geode );
+    }
+
+    bool _bakeable;
+    unsigned int _vertices;
+    unsigned int _bytes;
+
+protected:
+    void addDrawable( osg::Drawable* drawable )
+    {
+        osg::Geometry* geom = drawable->asGeometry();
+        if ( (geom == NULL) || (strcmp( geom->className(), "Geometry" ) != 0) ||
+                (geom->getDataVariance() == osg::Object::DYNAMIC) ||
+                (geom->getUpdateCallback() != NULL) ||
+                (geom->getCullCallback() != NULL) ||
+                (geom->getDrawCallback() != NULL) ||
+                (geom->getVertexIndices() != NULL) ||
+                (geom->getNormalIndices() != NULL) )
+        {
+            _bakeable = false;
+            return;
+        }
+        const osg::Vec3Array* v = dynamic_cast<const osg::Vec3Array*>( geom->getVertexArray() );
+        const osg::Array* n = geom->getNormalArray();
+        if ( (v == NULL) || ( (n != NULL) && (dynamic_cast<const osg::Vec3Array*>( n ) == NULL) ) )
+        {
+            _bakeable = false;
+            return;
+        }
+        _vertices += v->size();
+        _bytes += v->getTotalDataSize();
+        if (n != NULL)
+            _bytes += n->getTotalDataSize();
+    }
+};
+
+// Transforms the vertices and normals of a freshly copied subgraph,
+//   replacing the arrays it shares with the original.
+class BakeVisitor : public osg::NodeVisitor
+{
+public:
+    BakeVisitor( const osg::Matrix& m )
+      : osg::NodeVisitor( osg::NodeVisitor::TRAVERSE_ALL_CHILDREN ),
+        _m( m )
+    {
+        _inverse.invert( m );
+    }
+
+    virtual void apply( osg::Node& node )
+    {
+        node.dirtyBound();
+        traverse( node );
+    }
+    virtual void apply( osg::Geode& geode )
+    {
+        unsigned int idx;
+        for (idx=0; idx<geode.getNumDrawables(); idx++)
+            bake( geode.getDrawable( idx )->asGeometry() );
+        apply( (osg::Node&)geode );
+    }
+
+protected:
+    void bake( osg::Geometry* geom )
+    {
+        const osg::Vec3Array* v = static_cast<const osg::Vec3Array*>( geom->getVertexArray() );
+        osg::ref_ptr<osg::Vec3Array> bakedV = new osg::Vec3Array( *v );
+        osg::Vec3Array::iterator it;
+        for (it=bakedV->begin(); it!=bakedV->end(); it++)
+            *it = *it * _m;
+        geom->setVertexArray( bakedV.get() );
+
+        // Normals take the inverse transpose, and are renormalized
+        //   in case the matrix scales.
+        const osg::Vec3Array* n = static_cast<const osg::Vec3Array*>( geom->getNormalArray() );
+        if (n != NULL)
+        {
+            osg::ref_ptr<osg::Vec3Array> bakedN = new osg::Vec3Array( *n );
+            for (it=bakedN->begin(); it!=bakedN->end(); it++)
+            {
+                osg::Vec3 normal = osg::Matrix::transform3x3( _inverse, *it );
+                normal.normalize();
+                *it = normal;
+            }
+            geom->setNormalArray( bakedN.get() );
+        }
+        geom->dirtyDisplayList();
+        geom->dirtyBound();
+    }
+
+    const osg::Matrix _m;
+    osg::Matrix _inverse;
+};
+
+// Determinant of the matrix's upper 3x3. Baking under a negative
+//   one would turn front faces into back faces.
+static double
+determinant3x3( const osg::Matrix& m )
+{
+    return( m( 0, 0 ) * ( m( 1, 1 ) * m( 2, 2 ) - m( 1, 2 ) * m( 2, 1 ) ) -
+        m( 0, 1 ) * ( m( 1, 0 ) * m( 2, 2 ) - m( 1, 2 ) * m( 2, 0 ) ) +
+        m( 0, 2 ) * ( m( 1, 0 ) * m( 2, 1 ) - m( 1, 1 ) * m( 2, 0 ) ) );
+}
+
+// Replace mt, under parent, with a baked copy of its child.
+static void
+bakeTransform( osg::Group* parent, osg::MatrixTransform* mt )
+{
+    osg::Node* shared = mt->getChild( 0 );
+    osg::ref_ptr<osg::Node> baked = static_cast<osg::Node*>( shared->clone(
+        osg::CopyOp( osg::CopyOp::DEEP_COPY_NODES | osg::CopyOp::DEEP_COPY_DRAWABLES ) ) );
+    BakeVisitor bv( mt->getMatrix() );
+    baked->accept( bv );
+
+    osg::ref_ptr<osg::Node> replacement = baked;
+    osg::StateSet* state = mt->getStateSet();
+    if (state != NULL)
+    {
+        if (baked->getStateSet() == NULL)
+            baked->setStateSet( state );
+        else
+        {
+            // Keep the transform's state above the subgraph's own.
+            osg::ref_ptr<osg::Group> group = new osg::Group;
+            group->setDataVariance( osg::Object::STATIC );
+            group->setStateSet( state );
+            group->addChild( baked.get() );
+            replacement = group;
+        }
+    }
+    parent->replaceChild( mt, replacement.get() );
+}
+
+// The flattenable transforms above one subgraph.
+struct SharedSubgraph
+{
+    osg::Node* _shared;
+    std::vector< unsigned int > _transforms;
+    FlattenDecision _decision;
+    bool _bakeable;
+};
+
+// Orders subgraphs by cull time saved over instancing per byte
+//   that baking adds, best first.
+struct BakeOrder
+{
+    BakeOrder( const std::vector< SharedSubgraph >& subgraphs, const FlattenCostModel& model )
+      : _subgraphs( subgraphs ), _model( model ) {}
+
+    float density( unsigned int idx ) const
+    {
+        const FlattenDecision& d = _subgraphs[ idx ]._decision;
+        const float gain = d._sharers * _model._transformCullCost -
+            d._instanceable * ( _model._transformCullCost - _model._instanceCullCost );
+        return( gain / (float)( d._bytesAdded + 1 ) );
+    }
+    bool operator()( unsigned int lhs, unsigned int rhs ) const
+    {
+        return( density( lhs ) > density( rhs ) );
+    }
+
+    const std::vector< SharedSubgraph >& _subgraphs;
+    const FlattenCostModel& _model;
+};
+
+FlattenReport
+flattenStaticTransforms( osg::Node* root, const FlattenCostModel& model )
+{
+    FlattenReport report;
+    if (root == NULL)
+        return( report );
+
+    TransformCollector collector;
+    root->accept( collector );
+    report._transformsBefore = collector._numTransforms;
+
+    // Group the transforms by the subgraph they share.
+    std::vector< SharedSubgraph > subgraphs;
+    std::map< osg::Node*, unsigned int > subgraphIndex;
+    unsigned int idx;
+    for (idx=0; idx<collector._transforms.size(); idx++)
+    {
+        osg::Node* shared = collector._transforms[ idx ]->getChild( 0 );
+        std::map< osg::Node*, unsigned int >::iterator it = subgraphIndex.find( shared );
+        if (it == subgraphIndex.end())
+        {
+            it = subgraphIndex.insert( std::make_pair( shared, subgraphs.size() ) ).first;
+            subgraphs.push_back( SharedSubgraph() );
+            subgraphs.back()._shared = shared;
+        }
+        subgraphs[ it->second ]._transforms.push_back( idx );
+    }
+
+    // Fill in each subgraph's costs.
+    const float transformCost = model._transformCullCost;
+    const float instanceCost = model._instanceCullCost;
+    std::vector< unsigned int > bakeCandidates;
+    unsigned int sIdx;
+    for (sIdx=0; sIdx<subgraphs.size(); sIdx++)
+    {
+        SharedSubgraph& sg = subgraphs[ sIdx ];
+        FlattenDecision& d = sg._decision;
+        d._name = sg._shared->getName().empty() ?
+            std::string( sg._shared->className() ) : sg._shared->getName();
+        d._sharers = sg._transforms.size();
+
+        // Transforms under a parent with enough of them to instance.
+        std::map< osg::Group*, unsigned int > perParent;
+        for (idx=0; idx<sg._transforms.size(); idx++)
+            perParent[ collector._parents[ sg._transforms[ idx ] ].get() ]++;
+        std::map< osg::Group*, unsigned int >::const_iterator pit;
+        for (pit=perParent.begin(); pit!=perParent.end(); pit++)
+        {
+            if (pit->second >= model._minInstances)
+                d._instanceable += pit->second;
+        }
+
+        BakeableVisitor bv;
+        sg._shared->accept( bv );
+        sg._bakeable = bv._bakeable && (bv._vertices <= model._maxBakedVertices);
+        for (idx=0; sg._bakeable && (idx<sg._transforms.size()); idx++)
+        {
+            if (determinant3x3( collector._transforms[ sg._transforms[ idx ] ]->getMatrix() ) <= 0.)
+                sg._bakeable = false;
+        }
+        d._vertices = bv._vertices;
+
+        // If the transforms are all that use the subgraph, the original
+        //   goes away, and one copy is free.
+        const unsigned int copies = ( sg._shared->getNumParents() == sg._transforms.size() ) ?
+            d._sharers - 1 : d._sharers;
+        d._bytesAdded = copies * bv._bytes;
+
+        if (sg._bakeable)
+            bakeCandidates.push_back( sIdx );
+    }
+
+    // Spend the memory budget on the subgraphs that gain the most
+    //   cull time per byte.
+    std::sort( bakeCandidates.begin(), bakeCandidates.end(), BakeOrder( subgraphs, model ) );
+    unsigned int budget = model._memoryBudget;
+    for (idx=0; idx<bakeCandidates.size(); idx++)
+    {
+        SharedSubgraph& sg = subgraphs[ bakeCandidates[ idx ] ];
+        if (sg._decision._bytesAdded > budget)
+            continue;
+        budget -= sg._decision._bytesAdded;
+        sg._decision._outcome = FlattenDecision::BAKE;
+    }
+
+    bool instance( false );
+    for (sIdx=0; sIdx<subgraphs.size(); sIdx++)
+    {
+        SharedSubgraph& sg = subgraphs[ sIdx ];
+        FlattenDecision& d = sg._decision;
+        if (d._outcome == FlattenDecision::BAKE)
+        {
+            for (idx=0; idx<sg._transforms.size(); idx++)
+            {
+                const unsigned int tIdx = sg._transforms[ idx ];
+                bakeTransform( collector._parents[ tIdx ].get(), collector._transforms[ tIdx ].get() );
+            }
+            d._cullSaving = d._sharers * transformCost;
+            d._instanceable = 0;
+            report._baked += d._sharers;
+            report._bytesAdded += d._bytesAdded;
+        }
+        else
+        {
+            d._bytesAdded = 0;
+            if (d._instanceable > 0)
+            {
+                d._outcome = FlattenDecision::INSTANCE;
+                d._cullSaving = d._instanceable * ( transformCost - instanceCost );
+                instance = true;
+            }
+        }
+        report._decisions.push_back( d );
+    }
+
+    // What's left of the shared subgraphs under several transforms
+    //   of one parent becomes InstanceGroups.
+    if (instance)
+    {
+        const InstancingReport ir = instanceSubgraphs( root, model._minInstances );
+        report._instanced = ir._instances;
+        report._instanceGroups = ir._instanceGroups;
+    }
+    const unsigned int flattened = report._baked + report._instanced;
+    report._kept = ( collector._transforms.size() > flattened ) ?
+        collector._transforms.size() - flattened : 0;
+    report._cullSaving = ( report._baked * transformCost +
+        report._instanced * ( transformCost - instanceCost ) ) / 1000.f;
+
+    TransformCollector after;
+    root->accept( after );
+    report._transformsAfter = after._numTransforms;
+    return( report );
+}
@@ -0,0 +1,99 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// Cost-driven flattening of static transforms
+
+#ifndef __TRANSFORM_FLATTENER_H__
+#define __TRANSFORM_FLATTENER_H__
+
+#include <osg/Node>
+#include <string>
+#include <vector>
+
+// The costs flattenStaticTransforms() weighs. Cull costs are per
+//   transform per cull traversal, in nanoseconds; the defaults are
+//   typical of a desktop CPU and only their ratio matters much.
+struct FlattenCostModel
+{
+    FlattenCostModel();
+
+    // Culling below a MatrixTransform: multiplying and pushing the
+    //   model-view matrix, and transforming the child's bound.
+    float _transformCullCost;
+    // Culling one InstanceGroup instance, tested in a batch.
+    float _instanceCullCost;
+    // A subgraph with more vertices than this is never duplicated,
+    //   however much it's shared.
+    unsigned int _maxBakedVertices;
+    // Bytes of transformed vertex and normal data that baking may
+    //   add in all.
+    unsigned int _memoryBudget;
+    // Transforms of one parent that must share a subgraph before
+    //   they become an InstanceGroup.
+    unsigned int _minInstances;
+};
+
+// What flattenStaticTransforms() chose for one shared subgraph.
+struct FlattenDecision
+{
+    enum Outcome { BAKE, INSTANCE, KEEP };
+
+    FlattenDecision();
+
+    // The subgraph's name, or its class name.
+    std::string _name;
+    Outcome _outcome;
+    // Transforms above the subgraph that can be flattened, and
+    //   how many of those can become instances.
+    unsigned int _sharers, _instanceable;
+    unsigned int _vertices;
+    // Estimated cull time saved, and vertex bytes added.
+    float _cullSaving;
+    unsigned int _bytesAdded;
+};
+
+// What flattenStaticTransforms() changed. Cull saving is the cost
+//   model's estimate, in microseconds per cull traversal; measure
+//   the real change with the Benchmark example.
+struct FlattenReport
+{
+    FlattenReport();
+
+    unsigned int _transformsBefore, _transformsAfter;
+    unsigned int _baked, _instanced, _kept;
+    unsigned int _instanceGroups;
+    unsigned int _bytesAdded;
+    float _cullSaving;
+    std::vector< FlattenDecision > _decisions;
+};
+
+// Remove STATIC MatrixTransforms with constant matrices from the
+//   cull traversal. Each subgraph under such transforms is either
+//   baked, instanced or kept:
+//
+//   Baked: every transform is replaced by a copy of the subgraph
+//     whose vertices and normals are transformed by its matrix. The
+//     copies share primitive sets and every other array, and the
+//     transform's StateSet moves to the copy.
+//   Instanced: the transforms of each parent become one
+//     InstanceGroup, as instanceSubgraphs() does.
+//   Kept: the transforms stay.
+//
+// Baking removes all cull cost of the transforms but duplicates the
+//   vertex data, so subgraphs are baked in order of cull time saved
+//   over instancing per byte added, until model._memoryBudget is
+//   spent. A subgraph that only one transform uses costs nothing to
+//   bake. Only subgraphs of plain Groups and Geodes with Geometry
+//   (Vec3Array vertices, and normals if any) and no callbacks can
+//   be baked, and only under matrices that don't mirror.
+//
+// The stock .osg writer has no InstanceGroup wrapper and drops
+//   instanced subgraphs, so write a flattened scene as .qsgb, or
+//   flatten after writing.
+FlattenReport flattenStaticTransforms( osg::Node* root,
+    const FlattenCostModel& model=FlattenCostModel() );
+
+#endif
@@ -4,7 +4,7 @@
 // http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
 //
 
-// FindNode Example, Simple NodeVisitor-derived class for finding a named Node
+// FindNode Example, Looking up a named Node through a NodeNameIndex
 
 #include <osgViewer/Viewer>
 #include <osgGA/TrackballManipulator>
@@ -12,38 +12,9 @@
 #include <osg/StateSet>
 #include <osg/ShadeModel>
 #include <osgDB/ReadFile>
+#include "NodeNameIndex.h"
 #include <string>
 
-// Derive a class from NodeVisitor to find a node with a
-//   specific name.
-class FindNamedNode : public osg::NodeVisitor
-{
-public:
-    FindNamedNode( const std::string& name )
-      : osg::NodeVisitor( // Traverse all children.
-                osg::NodeVisitor::TRAVERSE_ALL_CHILDREN ),
-        _name( name ) {}
-
-    // This method gets called for every node in the scene
-    //   graph. Check each node to see if its name matches
-    //   out target. If so, save the node's address.
-    virtual void apply( osg::Node& node )
-    {
-        if (node.getName() == _name)
-            _node = &node;
-
-        // Keep traversing the rest of the scene graph.
-        traverse( node );
-    }
-
-    osg::Node* getNode() { return _node.get(); }
-
-protected:
-    std::string _name;
-    osg::ref_ptr<osg::Node> _node;
-};
-
-
 int
 main( int, char ** )
 {
@@ -55,14 +26,18 @@ main( int, char ** )
         return( 1 );
     }
 
+    // Index the scene graph's node names. This is the only
+    //   traversal; after it, finding a node by name is a hash
+    //   lookup, and edits made through the index keep it current.
+    NodeNameIndex index( sg.get() );
+
     // Find the node who's name is "Flat".
-    FindNamedNode fnn( "Flat" );
-    sg->accept( fnn );
-    if (fnn.getNode() != NULL)
+    osg::Node* flat = index.findFirst( "Flat" );
+    if (flat != NULL)
     {
         // We found the node. Get the ShadeModel attribute
         //   from its StateSet and set it to SMOOTH shading.
-        osg::StateSet* ss = fnn.getNode()->getOrCreateStateSet();
+        osg::StateSet* ss = flat->getOrCreateStateSet();
         osg::ShadeModel* sm = dynamic_cast<osg::ShadeModel*>(
                 ss->getAttribute(
                         osg::StateAttribute::SHADEMODEL ) );
@@ -7,6 +7,10 @@
 // Lighting Example, Basic light and material control
 
 #include <osgDB/ReadFile>
+#include "SceneCache.h"
+#include "GeometryConsolidator.h"
+#include "StatePool.h"
+#include "SceneArena.h"
 #include <osg/MatrixTransform>
 #include <osg/Geode>
 #include <osg/Geometry>
@@ -55,10 +59,12 @@ createLightPoint()
 osg::Drawable*
 createPlane()
 {
-    osg::ref_ptr<osg::Geometry> geom = new osg::Geometry;
+    osg::ref_ptr<osg::Geometry> geom = arenaNew<osg::Geometry>();
 
-    osg::ref_ptr<osg::Vec3Array> v = new osg::Vec3Array;
+    // 21x21 vertices; reserve them so push_back() never reallocates.
+    osg::ref_ptr<osg::Vec3Array> v = arenaNew<osg::Vec3Array>();
     geom->setVertexArray( v.get() );
+    v->reserve( 21*21 );
     int x, y;
     for (y=-10; y<=10; y++)
     {
@@ -66,12 +72,12 @@ createPlane()
             v->push_back( osg::Vec3( (float)x*.5f, (float)y*.5f, 0.f ) );
     }
 
-    osg::ref_ptr<osg::Vec3Array> n = new osg::Vec3Array;
+    osg::ref_ptr<osg::Vec3Array> n = arenaNew<osg::Vec3Array>();
     geom->setNormalArray( n.get() );
     geom->setNormalBinding( osg::Geometry::BIND_OVERALL );
     n->push_back( osg::Vec3( 0.f, 0.f, 1.f ) );
 
-    osg::ref_ptr<osg::Vec4Array> c = new osg::Vec4Array;
+    osg::ref_ptr<osg::Vec4Array> c = arenaNew<osg::Vec4Array>();
     geom->setColorArray( c.get() );
     geom->setColorBinding( osg::Geometry::BIND_OVERALL );
     c->push_back( osg::Vec4( 1.f, 1.f, 1.f, 1.f ) );
@@ -89,7 +95,7 @@ createPlane()
             indices[2*vert+1] = idx;
             vert++; idx++;
         }
-        geom->addPrimitiveSet( new osg::DrawElementsUShort(
+        geom->addPrimitiveSet( arenaNew<osg::DrawElementsUShort>(
             osg::PrimitiveSet::QUAD_STRIP, len+len, indices ) );
     }
 
@@ -156,12 +162,14 @@ createSceneGraph()
     // Create a single instance of the lozenge geometry (read from disk).
     // Multiply parent it to six MatrixTransform nodes, each with their
     //   own StateSet to change the material properties of the lozenge.
-    osg::ref_ptr<osg::Node> lozenge = osgDB::readNodeFile( "lozenge.osg" );
+    osg::ref_ptr<osg::Node> lozenge = readCachedNodeFile( "lozenge.osg" );
     if (!lozenge.valid())
     {
         osg::notify( osg::FATAL ) << "Unable to load data file. Exiting." << std::endl;
         return( NULL );
     }
+    // Merge the model's fragmented primitive sets.
+    consolidateGeometry( lozenge.get() );
     {
         osg::ref_ptr<osg::MatrixTransform> mt = new osg::MatrixTransform;
         osg::Matrix m;
@@ -292,5 +300,12 @@ createSceneGraph()
     root->addChild( planeGeode.get() );
 
 
+    // Share equal StateSets and attributes across the scene, the
+    //   loaded models' state included.
+    const StateShareReport report = shareState( root.get() );
+    osg::notify( osg::INFO ) << "Shared state: " << report._stateSetsBefore <<
+        " -> " << report._stateSetsAfter << " StateSets, " << report._attributesBefore <<
+        " -> " << report._attributesAfter << " attributes." << std::endl;
+
     return( root.release() );
 }
@@ -0,0 +1,180 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// MipmapBenchmark, Compares generateMipmaps() configurations against the naive path
+
+#include <osgDB/ReadFile>
+#include <osg/ArgumentParser>
+#include <osg/Image>
+#include <osg/Timer>
+#include <osg/Notify>
+#include "MipmapGenerator.h"
+#include "ParallelLoop.h"
+#include "TimingStats.h"
+#include <sstream>
+#include <vector>
+#include <string>
+
+using std::endl;
+
+
+// Fresh, unmipmapped copies of the source images, numCopies of each.
+static void
+copyImages( const std::vector< osg::ref_ptr<osg::Image> >& sources,
+    unsigned int numCopies, std::vector< osg::ref_ptr<osg::Image> >& copies )
+{
+    copies.clear();
+    unsigned int idx, jdx;
+    for (idx=0; idx<sources.size(); idx++)
+        for (jdx=0; jdx<numCopies; jdx++)
+            copies.push_back( new osg::Image( *( sources[ idx ] ),
+                osg::CopyOp::DEEP_COPY_ALL ) );
+}
+
+// Time one configuration over numRuns batches, and add a row to
+//   the report. Returns the mean time.
+static double
+runConfiguration( const std::string& name, const MipmapOptions& options,
+    bool batch, const std::vector< osg::ref_ptr<osg::Image> >& sources,
+    unsigned int numCopies, unsigned int numRuns, TimingReport& report )
+{
+    osg::Timer* timer = osg::Timer::instance();
+    std::vector< double > samples;
+    unsigned int numImages( 0 );
+    unsigned int run;
+    for (run=0; run<numRuns; run++)
+    {
+        // Copying isn't part of the stage being measured.
+        std::vector< osg::ref_ptr<osg::Image> > copies;
+        copyImages( sources, numCopies, copies );
+        std::vector< osg::Image* > images;
+        unsigned int idx;
+        for (idx=0; idx<copies.size(); idx++)
+            images.push_back( copies[ idx ].get() );
+
+        osg::Timer_t start = timer->tick();
+        if (batch)
+            numImages = generateMipmaps( images, options );
+        else
+        {
+            numImages = 0;
+            for (idx=0; idx<images.size(); idx++)
+                if (generateMipmaps( *( images[ idx ] ), options ))
+                    numImages++;
+        }
+        samples.push_back( timer->delta_m( start, timer->tick() ) );
+    }
+
+    const TimingSummary summary = summarizeTimings( samples );
+    std::ostringstream threads;
+    threads << ( (options._numThreads == 0) ? getDefaultThreadCount() : options._numThreads );
+    std::vector< std::string > keys;
+    keys.push_back( name );
+    keys.push_back( threads.str() );
+    report.addRow( keys, summary );
+
+    osg::notify( osg::ALWAYS ) << name << ", " << threads.str() << " thread(s): " <<
+        summary._mean << " ms mean, " << summary._p50 << " ms median, " <<
+        numImages * 1000. / summary._mean << " images/s" << endl;
+    return( summary._mean );
+}
+
+int
+main( int argc, char** argv )
+{
+    osg::ArgumentParser arguments( &argc, argv );
+
+    // Usage: MipmapBenchmark [--copies n] [--runs n] [--threads n]
+    //   [--out file.csv|file.json] [image file]...
+    unsigned int numCopies( 64 );
+    arguments.read( "--copies", numCopies );
+    unsigned int numRuns( 5 );
+    arguments.read( "--runs", numRuns );
+    unsigned int maxThreads = getDefaultThreadCount();
+    arguments.read( "--threads", maxThreads );
+    std::string out( "MipmapBenchmark.csv" );
+    arguments.read( "--out", out );
+
+    std::vector< std::string > fileNames;
+    int arg;
+    for (arg=1; arg<arguments.argc(); arg++)
+        fileNames.push_back( arguments[ arg ] );
+    if (fileNames.empty())
+    {
+        // The images the examples use.
+        fileNames.push_back( "Picea_pungens__blue_spruce15_256.png" );
+        fileNames.push_back( "Images/reflect.rgb" );
+    }
+
+    std::vector< osg::ref_ptr<osg::Image> > sources;
+    unsigned int idx;
+    for (idx=0; idx<fileNames.size(); idx++)
+    {
+        osg::ref_ptr<osg::Image> image = osgDB::readImageFile( fileNames[ idx ] );
+        if (!image.valid() || !canGenerateMipmaps( *image ))
+        {
+            osg::notify( osg::WARN ) << "Skipping \"" << fileNames[ idx ] <<
+                "\": unreadable, or not an 8-bit format generateMipmaps() handles." << endl;
+            continue;
+        }
+        osg::notify( osg::ALWAYS ) << "\"" << fileNames[ idx ] << "\": " <<
+            image->s() << "x" << image->t() << ", " <<
+            osg::Image::computeNumComponents( image->getPixelFormat() ) << " components" << endl;
+        sources.push_back( image );
+    }
+    if (sources.empty())
+    {
+        osg::notify( osg::FATAL ) << "No images to process. Exiting." << endl;
+        return( 1 );
+    }
+    osg::notify( osg::ALWAYS ) << numCopies << " copies of each, " << numRuns << " runs." << endl;
+
+    std::vector< std::string > keyNames;
+    keyNames.push_back( "configuration" );
+    keyNames.push_back( "threads" );
+    TimingReport report( keyNames );
+
+    // The naive path, then one change at a time on one thread, then
+    //   the full pipeline (gamma-correct, SIMD) across threads.
+    const double naive = runConfiguration( "naive", getNaiveMipmapOptions(),
+        false, sources, numCopies, numRuns, report );
+
+    MipmapOptions options = getNaiveMipmapOptions();
+    options._simd = true;
+    runConfiguration( "simd", options, false, sources, numCopies, numRuns, report );
+
+    options = getNaiveMipmapOptions();
+    options._gammaCorrect = true;
+    runConfiguration( "gamma", options, false, sources, numCopies, numRuns, report );
+
+    options._simd = true;
+    runConfiguration( "gamma+simd", options, false, sources, numCopies, numRuns, report );
+
+    options._alphaCutoff = .05f;
+    runConfiguration( "gamma+simd+coverage", options, false, sources, numCopies, numRuns, report );
+
+    options._alphaCutoff = 0.f;
+    unsigned int threads( 1 );
+    while (true)
+    {
+        options._numThreads = threads;
+        const double t = runConfiguration( "gamma+simd batch", options, true,
+            sources, numCopies, numRuns, report );
+        osg::notify( osg::ALWAYS ) << "  " << naive / t << "x the naive path" << endl;
+
+        if (threads >= maxThreads)
+            break;
+        threads = (threads*2 > maxThreads) ? maxThreads : threads*2;
+    }
+
+    if (!report.write( out ))
+    {
+        osg::notify( osg::FATAL ) << "Unable to write \"" << out << "\"." << endl;
+        return( 1 );
+    }
+    osg::notify( osg::ALWAYS ) << "Wrote \"" << out << "\"." << endl;
+    return( 0 );
+}
@@ -0,0 +1,211 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// ParseBenchmark, Compares readChunkedNodeFile() against the stock .osg reader
+
+#include <osgDB/ReadFile>
+#include <osgDB/FileUtils>
+#include <osg/ArgumentParser>
+#include <osg/Geode>
+#include <osg/Geometry>
+#include <osg/NodeVisitor>
+#include <osg/Timer>
+#include <osg/Notify>
+#include "ChunkedOsgReader.h"
+#include "ParallelLoop.h"
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <set>
+#include <cmath>
+
+using std::endl;
+
+
+// Append copy number 'n' of the source text, renaming UniqueID and
+//   Use references so the copies don't share objects.
+void
+appendCopy( std::ostream& out, const std::string& src, unsigned int n )
+{
+    std::ostringstream suffix;
+    suffix << "_r" << n;
+
+    std::string::size_type pos( 0 );
+    while (true)
+    {
+        std::string::size_type u = src.find( "UniqueID ", pos );
+        std::string::size_type s = src.find( "Use ", pos );
+        std::string::size_type hit = (u < s) ? u : s;
+        if (hit == std::string::npos)
+            break;
+        hit += (hit == u) ? 9 : 4;
+        std::string::size_type tokEnd = src.find_first_of( " \t\r\n", hit );
+        if (tokEnd == std::string::npos)
+            tokEnd = src.size();
+        out.write( src.data() + pos, tokEnd - pos );
+        out << suffix.str();
+        pos = tokEnd;
+    }
+    out.write( src.data() + pos, src.size() - pos );
+}
+
+// Write a Group that holds enough copies of the source file to reach
+//   the requested size. Returns the number of copies.
+unsigned int
+writeReplicatedFile( const std::string& srcName, const std::string& outName,
+    double megabytes )
+{
+    std::ifstream in( srcName.c_str(), std::ios::in | std::ios::binary );
+    std::ostringstream ss;
+    ss << in.rdbuf();
+    const std::string src = ss.str();
+    if (src.empty())
+        return( 0 );
+
+    unsigned int copies = (unsigned int)( megabytes * 1024. * 1024. / src.size() );
+    if (copies < 1)
+        copies = 1;
+
+    std::ofstream out( outName.c_str(), std::ios::out | std::ios::binary );
+    out << "Group {\n  DataVariance STATIC\n  num_children " << copies << "\n";
+    unsigned int idx;
+    for (idx=0; idx<copies; idx++)
+        appendCopy( out, src, idx );
+    out << "}\n";
+    return( out.good() ? copies : 0 );
+}
+
+// Gather every Geometry's vertex array, in traversal order.
+class CollectVertices : public osg::NodeVisitor
+{
+public:
+    CollectVertices()
+      : osg::NodeVisitor( osg::NodeVisitor::TRAVERSE_ALL_CHILDREN ) {}
+
+    virtual void apply( osg::Geode& geode )
+    {
+        unsigned int idx;
+        for (idx=0; idx<geode.getNumDrawables(); idx++)
+        {
+            osg::Geometry* geom = geode.getDrawable( idx )->asGeometry();
+            if ((geom != NULL) && _seen.insert( geom ).second)
+                _vertices.push_back(
+                    dynamic_cast< osg::Vec3Array* >( geom->getVertexArray() ) );
+        }
+        traverse( geode );
+    }
+
+    std::vector< osg::Vec3Array* > _vertices;
+
+protected:
+    std::set< osg::Geometry* > _seen;
+};
+
+// Return the largest vertex difference between two scenes, or -1 if
+//   their Geometry and vertex counts don't match.
+double
+compareScenes( osg::Node* a, osg::Node* b )
+{
+    CollectVertices ca, cb;
+    a->accept( ca );
+    b->accept( cb );
+    if (ca._vertices.size() != cb._vertices.size())
+        return( -1. );
+
+    double maxDiff( 0. );
+    unsigned int idx, jdx;
+    for (idx=0; idx<ca._vertices.size(); idx++)
+    {
+        const osg::Vec3Array* va = ca._vertices[ idx ];
+        const osg::Vec3Array* vb = cb._vertices[ idx ];
+        if ((va == NULL) || (vb == NULL))
+        {
+            if (va != vb)
+                return( -1. );
+            continue;
+        }
+        if (va->size() != vb->size())
+            return( -1. );
+        for (jdx=0; jdx<va->size(); jdx++)
+        {
+            const double d = ( (*va)[ jdx ] - (*vb)[ jdx ] ).length();
+            if (d > maxDiff)
+                maxDiff = d;
+        }
+    }
+    return( maxDiff );
+}
+
+int
+main( int argc, char** argv )
+{
+    osg::ArgumentParser arguments( &argc, argv );
+    double megabytes( 256. );
+    arguments.read( "--size", megabytes );
+    unsigned int maxThreads = getDefaultThreadCount();
+    arguments.read( "--threads", maxThreads );
+    std::string out( "ParseBenchmark.osg" );
+    arguments.read( "--out", out );
+
+    std::string srcName( "cow.osg" );
+    if (arguments.argc() > 1)
+        srcName = arguments[ 1 ];
+    const std::string fullName = osgDB::findDataFile( srcName );
+    if (fullName.empty())
+    {
+        osg::notify( osg::FATAL ) << "Unable to find \"" << srcName << "\". Exiting." << endl;
+        return( 1 );
+    }
+
+    const unsigned int copies = writeReplicatedFile( fullName, out, megabytes );
+    if (copies == 0)
+    {
+        osg::notify( osg::FATAL ) << "Unable to write \"" << out << "\". Exiting." << endl;
+        return( 1 );
+    }
+    osg::notify( osg::ALWAYS ) << "Wrote " << copies << " copies of \"" << fullName <<
+        "\" to \"" << out << "\" (" << megabytes << " MB)." << endl;
+
+    osg::Timer* timer = osg::Timer::instance();
+
+    // The stock reader. Timings include file I/O; the file was just
+    //   written, so it's normally still in the OS file cache.
+    osg::Timer_t start = timer->tick();
+    osg::ref_ptr<osg::Node> stock = osgDB::readNodeFile( out );
+    const double stockTime = timer->delta_m( start, timer->tick() );
+    if (!stock.valid())
+    {
+        osg::notify( osg::FATAL ) << "osgDB::readNodeFile() failed. Exiting." << endl;
+        return( 1 );
+    }
+    osg::notify( osg::ALWAYS ) << "osgDB::readNodeFile:  " << stockTime << " ms" << endl;
+
+    unsigned int threads( 1 );
+    while (true)
+    {
+        start = timer->tick();
+        osg::ref_ptr<osg::Node> chunked = readChunkedNodeFile( out, threads );
+        const double chunkedTime = timer->delta_m( start, timer->tick() );
+        if (!chunked.valid())
+        {
+            osg::notify( osg::FATAL ) << "readChunkedNodeFile() failed. Exiting." << endl;
+            return( 1 );
+        }
+        const double diff = compareScenes( stock.get(), chunked.get() );
+        osg::notify( osg::ALWAYS ) << "readChunkedNodeFile, " << threads << " thread(s): " <<
+            chunkedTime << " ms, speedup " << stockTime / chunkedTime << "x, ";
+        if (diff < 0.)
+            osg::notify( osg::ALWAYS ) << "scenes DIFFER." << endl;
+        else
+            osg::notify( osg::ALWAYS ) << "max vertex difference " << diff << endl;
+
+        if (threads >= maxThreads)
+            break;
+        threads = (threads*2 > maxThreads) ? maxThreads : threads*2;
+    }
+
+    return( 0 );
+}
@@ -13,111 +13,36 @@
 // Simple example of use of osgViewer::GraphicsWindow + SimpleViewer
 // example that provides the user with control over view position with basic picking.
 
-#include <osgDB/ReadFile>
+#include "BVHPicker.h"
+#include "TransformAnimator.h"
+#include "StateMerger.h"
+#include "ImageCache.h"
+#include "FrameRecorder.h"
+#include "EventRecorder.h"
 #include <osgViewer/Viewer>
-#include <osgUtil/PolytopeIntersector>
 #include <osg/Camera>
-#include <osg/NodeCallback>
 #include <osg/Group>
 #include <osg/MatrixTransform>
 #include <iostream>
 #include <osg/Notify>
+#include <osg/Timer>
+#include <osg/ArgumentParser>
+#include <csignal>
+#include <vector>
 
 
-osg::ref_ptr<osg::Node> _selectedNode;
+osg::ref_ptr<osg::MatrixTransform> _selectedNode;
 
-// Derive a class from NodeCallback to manipulate a
-//   MatrixTransform object's matrix.
-class RotateCB : public osg::NodeCallback
-{
-public:
-    RotateCB() : _angle( 0. ) {}
+// Spins the selected MatrixTransform. It's the scene root's update
+//   callback, so selecting a node only adds it to the animator's
+//   list rather than attaching a callback to the node itself.
+osg::ref_ptr<TransformAnimator> _animator;
 
-    virtual void operator()( osg::Node* node,
-            osg::NodeVisitor* nv )
-    {
-        // Normally, check to make sure we have an update
-        //   visitor, not necessary in this simple example.
-        osg::MatrixTransform* mt =
-                dynamic_cast<osg::MatrixTransform*>( node );
-        osg::Matrix m;
-        m.makeRotate( _angle, osg::Vec3( 0., 0., 1. ) );
-        mt->setMatrix( m );
-
-        // Increment the angle for the next from.
-        _angle += 0.01;
-
-        // Continue traversing so that OSG can process
-        //   any other nodes with callbacks.
-        traverse( node, nv );
-    }
+// Maps picks on Geometry that mergeByState() combined back to the
+//   original Geode and Drawable.
+osg::ref_ptr<DrawableRemap> _remap;
 
-protected:
-    double _angle;
-};
-
-// Create the scene graph. This is a Group root node with two
-//   MatrixTransform children, which multiply parent a single
-//   Geode loaded from the cow.osg model file.
-osg::Node*
-createScene()
-{
-    // Load the cow model.
-    osg::ref_ptr<osg::Node> cow = osgDB::readNodeFile( "cow.osg" );
-    if (!cow.valid())
-    {
-        osg::notify( osg::FATAL ) << "Unable to load data file. Exiting." << std::endl;
-        return( NULL );
-    }
-    // Data variance is STATIC because we won't modify it.
-    cow->setDataVariance( osg::Object::STATIC );
-
-    // Create a MatrixTransform to display the cow on the left.
-    osg::ref_ptr<osg::MatrixTransform> mtLeft =
-            new osg::MatrixTransform;
-    mtLeft->setName( "Left Cow" );
-    mtLeft->setDataVariance( osg::Object::STATIC );
-    osg::Matrix m;
-    m.makeTranslate( -6.f, 0.f, 0.f );
-    mtLeft->setMatrix( m );
-
-    osg::ref_ptr<osg::MatrixTransform> mt =
-            new osg::MatrixTransform;
-    mt->setName( "Left Rotation" );
-    mt->setDataVariance( osg::Object::STATIC );
-    m.makeIdentity();
-    mt->setMatrix( m );
-
-    mtLeft->addChild( mt.get() );
-    mt->addChild( cow.get() );
-
-    // Create a MatrixTransform to display the cow on the right.
-    osg::ref_ptr<osg::MatrixTransform> mtRight =
-            new osg::MatrixTransform;
-    mtRight->setName( "Right Cow" );
-    mtRight->setDataVariance( osg::Object::STATIC );
-    m.makeTranslate( 6.f, 0.f, 0.f );
-    mtRight->setMatrix( m );
-
-    mt = new osg::MatrixTransform;
-    mt->setName( "Right Rotation" );
-    mt->setDataVariance( osg::Object::STATIC );
-    m.makeIdentity();
-    mt->setMatrix( m );
-
-    mtRight->addChild( mt.get() );
-    mt->addChild( cow.get() );
-
-    // Create the Group root node.
-    osg::ref_ptr<osg::Group> root = new osg::Group;
-    root->setName( "Root Node" );
-    // Data variance is STATIC because we won't modify it.
-    root->setDataVariance( osg::Object::STATIC );
-    root->addChild( mtLeft.get() );
-    root->addChild( mtRight.get() );
-
-    return( root.release() );
-}
+osg::Node* createSceneGraph();
 
 
 // PickHandler -- A GUIEventHandler that implements picking.
@@ -125,7 +50,9 @@ class PickHandler : public osgGA::GUIEventHandler
 {
 public: 
 
-    PickHandler() : _mX( 0. ),_mY( 0. ) {}
+    PickHandler()
+      : _mX( 0. ),_mY( 0. ),
+        _pickScope( FrameRecorder::instance()->getScope( "PickHandler::pick" ) ) {}
     bool handle( const osgGA::GUIEventAdapter& ea,
             osgGA::GUIActionAdapter& aa )
     {
@@ -160,6 +87,14 @@ public:
                 return( false );
             }    
 
+            case osgGA::GUIEventAdapter::KEYDOWN:
+            {
+                if (ea.getKey() != 'p')
+                    return( false );
+                probe( viewer );
+                return( true );
+            }
+
             default:
                 return( false );
         }
@@ -168,6 +103,8 @@ public:
 protected:
     // Store mouse xy location for button press & move events.
     float _mX, _mY;
+    // FrameRecorder channel for the time pick() takes.
+    const unsigned int _pickScope;
 
     // Perform a pick operation.
     bool pick( const double x, const double y,
@@ -176,26 +113,32 @@ protected:
         if (!viewer->getSceneData())
             // Nothing to pick.
             return( false );
+        ScopedFrameTimer timer( FrameRecorder::instance(), _pickScope );
 
+        // Pick with the same rectangle a PolytopeIntersector in
+        //   the PROJECTION frame would use. pickPolytope() tests
+        //   each Geometry through a bounding volume hierarchy
+        //   cached on the Geometry, so both cows share one.
         double w( .05 ), h( .05 );
-        osgUtil::PolytopeIntersector* picker =
-                new osgUtil::PolytopeIntersector(
-                    osgUtil::Intersector::PROJECTION,
-                        x-w, y-h, x+w, y+h );
-
-        osgUtil::IntersectionVisitor iv( picker );
-        viewer->getCamera()->accept( iv );
-
-        if (picker->containsIntersections())
+        PickResult result;
+        if (pickPolytope( viewer->getCamera(), viewer->getSceneData(),
+                x-w, y-h, x+w, y+h, result ))
         {
-            const osg::NodePath& nodePath =
-                    picker->getFirstIntersection().nodePath;
+            unsigned int triangle = result._primitiveIndex;
+            const DrawableRemap::Source* source = _remap.valid() ?
+                    _remap->lookup( result._drawable.get(), triangle ) : NULL;
+            if (source != NULL)
+                osg::notify( osg::INFO ) << "Picked triangle " << triangle <<
+                    " of \"" << source->_drawableName << "\" in Geode \"" <<
+                    source->_geodeName << "\"." << std::endl;
+
+            const osg::NodePath& nodePath = result._nodePath;
             unsigned int idx = nodePath.size();
             while (idx--)
             {
                 // Find the LAST MatrixTransform in the node
                 //   path; this will be the MatrixTransform
-                //   to attach our callback to.
+                //   to spin.
                 osg::MatrixTransform* mt =
                         dynamic_cast<osg::MatrixTransform*>(
                             nodePath[ idx ] );
@@ -206,12 +149,12 @@ protected:
                 //   MatrixTransform in the nodePath.
 
                 if (_selectedNode.valid())
-                    // Clear the previous selected node's
-                    //   callback to make it stop spinning.
-                    _selectedNode->setUpdateCallback( NULL );
+                    // Remove the previous selected node from
+                    //   the animator to make it stop spinning.
+                    _animator->remove( _selectedNode.get() );
 
                 _selectedNode = mt;
-                _selectedNode->setUpdateCallback( new RotateCB );
+                _animator->add( mt, osg::Vec3( 0., 0., 1. ), 0.01f );
                 break;
             }
             if (!_selectedNode.valid())
@@ -219,25 +162,131 @@ protected:
         }
         else if (_selectedNode.valid())
         {
-            _selectedNode->setUpdateCallback( NULL );
+            _animator->remove( _selectedNode.get() );
             _selectedNode = NULL;
         }
         return( _selectedNode.valid() );
     }
+
+    // Cover the window with a grid of small pick rectangles, like
+    //   an overlay's visibility probes, and run them as one batch
+    //   across all processors.
+    void probe( osgViewer::Viewer* viewer )
+    {
+        if (!viewer->getSceneData())
+            return;
+
+        const unsigned int n( 64 );
+        const double w( 1. / n );
+        std::vector< PickQuery > queries;
+        unsigned int xIdx, yIdx;
+        for (yIdx=0; yIdx<n; yIdx++)
+        {
+            for (xIdx=0; xIdx<n; xIdx++)
+            {
+                const double x = -1. + ( 2 * xIdx + 1 ) * w;
+                const double y = -1. + ( 2 * yIdx + 1 ) * w;
+                queries.push_back( PickQuery::rectangle(
+                        x-w, y-w, x+w, y+w ) );
+            }
+        }
+
+        osg::Timer_t start = osg::Timer::instance()->tick();
+        std::vector< PickResult > results;
+        const unsigned int numHits = pickBatch( viewer->getCamera(),
+                viewer->getSceneData(), queries, results );
+        osg::Timer_t end = osg::Timer::instance()->tick();
+
+        osg::notify( osg::ALWAYS ) << numHits << " of " << queries.size() <<
+            " probes hit, in " <<
+            osg::Timer::instance()->delta_m( start, end ) << " ms." << std::endl;
+    }
 };
 
 int
 main( int argc, char **argv )
 {
+    // Usage: Picking [--frame-stats file.csv|file.json]
+    //   [--record events.txt]
+    //   [--replay events.txt [--out file.csv|file.json]]
+    // Event, update, cull and draw times, and the time spent in
+    //   TransformAnimator and PickHandler::pick(), are always
+    //   recorded. With --frame-stats, their percentiles are written
+    //   to the file on exit, and on SIGUSR1 while running.
+    // --record saves the session's input events and camera matrices.
+    //   --replay feeds a saved session to the same handlers and
+    //   traversals without opening a window, and reports the time
+    //   each kind of event takes.
+    osg::ArgumentParser arguments( &argc, argv );
+    std::string frameStats, recordFile, replayFile;
+    arguments.read( "--frame-stats", frameStats );
+    arguments.read( "--record", recordFile );
+    arguments.read( "--replay", replayFile );
+    std::string out( "PickingReplay.csv" );
+    arguments.read( "--out", out );
+
+    // Read the images models load, such as cow.osg's reflect.rgb,
+    //   through the decoded image cache.
+    osgDB::Registry::instance()->setReadFileCallback( new CachedImageReadCallback );
+
     // create the view of the scene.
     osgViewer::Viewer viewer;
-    viewer.setSceneData( createScene() );
+    viewer.setSceneData( createSceneGraph() );
+
+    // Merge drawables that share state; picks still report the
+    //   drawables they came from.
+    _remap = mergeByState( viewer.getSceneData() )._remap;
+
+    _animator = new TransformAnimator;
+    if (viewer.getSceneData())
+        viewer.getSceneData()->setUpdateCallback( _animator.get() );
 
     viewer.getCamera()->setClearColor( osg::Vec4( 1., 1., 1., 1. ) );
 
+    // Record ahead of the pick handler, so each event is saved
+    //   before a pick acts on it.
+    osg::ref_ptr<EventRecordHandler> eventRecorder;
+    if (!recordFile.empty())
+    {
+        eventRecorder = new EventRecordHandler;
+        viewer.addEventHandler( eventRecorder.get() );
+    }
+
     // add the pick handler
     viewer.addEventHandler( new PickHandler );
 
-    return( viewer.run() );
-}
+    if (!replayFile.empty())
+    {
+        EventRecording events;
+        if (!readEventRecording( replayFile, events ) && events.empty())
+            return( 1 );
+        std::vector< std::string > keyNames;
+        keyNames.push_back( "event" );
+        TimingReport report( keyNames );
+        const unsigned int count = replayEvents( events, viewer, report );
+        osg::notify( osg::ALWAYS ) << "Replayed " << count << " events from \"" <<
+            replayFile << "\"." << std::endl;
+        if (!report.write( out ))
+            return( 1 );
+        osg::notify( osg::ALWAYS ) << "Wrote \"" << out << "\"." << std::endl;
+        return( 0 );
+    }
 
+    FrameRecorder* recorder = FrameRecorder::instance();
+    if (!frameStats.empty())
+        recorder->setOutputFile( frameStats );
+    recorder->attach( viewer );
+#ifdef SIGUSR1
+    if (!frameStats.empty())
+        FrameRecorder::writeOnSignal( SIGUSR1 );
+#endif
+
+    const int result = viewer.run();
+    if (!frameStats.empty())
+        recorder->write();
+    if (eventRecorder.valid() &&
+            writeEventRecording( eventRecorder->getRecording(), recordFile ))
+        osg::notify( osg::ALWAYS ) << "Recorded " << eventRecorder->getRecording().size() <<
+            " events to \"" << recordFile << "\"." << std::endl;
+    return( result );
+}
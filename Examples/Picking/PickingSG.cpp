@@ -0,0 +1,85 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// Picking Example, Using the osgUtil Intersection classes and osgGA NodeKit
+
+#include <osg/Group>
+#include <osg/MatrixTransform>
+#include "SpatialGroup.h"
+#include "SceneCache.h"
+#include "GeometryConsolidator.h"
+#include "FastBounds.h"
+#include <osg/Notify>
+
+// Create the scene graph. This is a Group root node with two
+//   MatrixTransform children, which multiply parent a single
+//   Geode loaded from the cow.osg model file.
+osg::Node*
+createSceneGraph()
+{
+    // Load the cow model. readCachedNodeFile() reads a binary
+    //   copy of cow.osg when one is cached and up to date.
+    osg::ref_ptr<osg::Node> cow = readCachedNodeFile( "cow.osg" );
+    if (!cow.valid())
+    {
+        osg::notify( osg::FATAL ) << "Unable to load data file. Exiting." << std::endl;
+        return( NULL );
+    }
+    // Merge the model's fragmented primitive sets, and give its
+    //   large Geometry SIMD bounds.
+    consolidateGeometry( cow.get() );
+    installFastBounds( cow.get() );
+    // Data variance is STATIC because we won't modify it.
+    cow->setDataVariance( osg::Object::STATIC );
+
+    // Create a MatrixTransform to display the cow on the left.
+    osg::ref_ptr<osg::MatrixTransform> mtLeft =
+            new osg::MatrixTransform;
+    mtLeft->setName( "Left Cow" );
+    mtLeft->setDataVariance( osg::Object::STATIC );
+    osg::Matrix m;
+    m.makeTranslate( -6.f, 0.f, 0.f );
+    mtLeft->setMatrix( m );
+
+    osg::ref_ptr<osg::MatrixTransform> mt =
+            new osg::MatrixTransform;
+    mt->setName( "Left Rotation" );
+    mt->setDataVariance( osg::Object::STATIC );
+    m.makeIdentity();
+    mt->setMatrix( m );
+
+    mtLeft->addChild( mt.get() );
+    mt->addChild( cow.get() );
+
+    // Create a MatrixTransform to display the cow on the right.
+    osg::ref_ptr<osg::MatrixTransform> mtRight =
+            new osg::MatrixTransform;
+    mtRight->setName( "Right Cow" );
+    mtRight->setDataVariance( osg::Object::STATIC );
+    m.makeTranslate( 6.f, 0.f, 0.f );
+    mtRight->setMatrix( m );
+
+    mt = new osg::MatrixTransform;
+    mt->setName( "Right Rotation" );
+    mt->setDataVariance( osg::Object::STATIC );
+    m.makeIdentity();
+    mt->setMatrix( m );
+
+    mtRight->addChild( mt.get() );
+    mt->addChild( cow.get() );
+
+    // Create the root node. A SpatialGroup is a Group that keeps
+    //   its children in an octree, so cull and picking skip the
+    //   ones out of view however many there are.
+    osg::ref_ptr<SpatialGroup> root = new SpatialGroup;
+    root->setName( "Root Node" );
+    // Data variance is STATIC because we won't modify it.
+    root->setDataVariance( osg::Object::STATIC );
+    root->addChild( mtLeft.get() );
+    root->addChild( mtRight.get() );
+
+    return( root.release() );
+}
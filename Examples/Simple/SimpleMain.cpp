@@ -7,9 +7,13 @@
 // Simple Example, Basic Geode and Geometry class usage
 
 #include <osg/ref_ptr>
+#include <osg/ArgumentParser>
 #include <osgDB/Registry>
 #include <osgDB/WriteFile>
+#include <osgDB/FileNameUtils>
 #include <osg/Notify>
+#include "BinaryScene.h"
+#include "SceneArena.h"
 #include <iostream>
 
 using std::endl;
@@ -19,19 +23,33 @@ osg::Node* createSceneGraph();
 int
 main( int argc, char** argv )
 {
-    osg::ref_ptr<osg::Node> root = createSceneGraph();
+    // Build the scene graph in an arena. Its memory is released at
+    //   once, when root and arena both go out of scope.
+    osg::ref_ptr<SceneArena> arena = new SceneArena;
+    osg::ref_ptr<osg::Node> root;
+    {
+        ScopedSceneArena scope( arena.get() );
+        root = createSceneGraph();
+    }
     if (!root.valid())
     {
         osg::notify(osg::FATAL) << "Failed in createSceneGraph()." << endl;
         return( 1 );
     }
 
+    // Usage: Simple [--out file.osg|file.qsgb]
+    // A .qsgb file is compact binary; see BinaryScene.h.
+    osg::ArgumentParser arguments( &argc, argv );
     std::string out( "Simple.osg" );
+    arguments.read( "--out", out );
     if ( !(osgDB::writeNodeFile( *(root.get()), out )) )
     {
         osg::notify(osg::FATAL) << "Failed in osgDB::writeNodeFile()." << endl;
         return( 1 );
     }
 
-    osg::notify(osg::ALWAYS) << "Successfully wrote \"" << out << "\". Execute \"osgviewer " << out << "\" to view." << endl;
+    if (osgDB::getLowerCaseFileExtension( out ) == "qsgb")
+        osg::notify(osg::ALWAYS) << "Successfully wrote \"" << out << "\". Read it back with readBinarySceneFile()." << endl;
+    else
+        osg::notify(osg::ALWAYS) << "Successfully wrote \"" << out << "\". Execute \"osgviewer " << out << "\" to view." << endl;
 }
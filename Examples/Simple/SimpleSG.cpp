@@ -8,25 +8,28 @@
 
 #include <osg/Geode>
 #include <osg/Geometry>
+#include "SceneArena.h"
 
 osg::Node*
 createSceneGraph()
 {
-    // Create an object to store geometry in.
-    osg::ref_ptr<osg::Geometry> geom = new osg::Geometry;
+    // Create an object to store geometry in. arenaNew() allocates
+    //   from the current SceneArena, if SimpleMain set one.
+    osg::ref_ptr<osg::Geometry> geom = arenaNew<osg::Geometry>();
 
     // Create an array of four vertices.
 #if 1
-    // Using the push_back interface
-    osg::ref_ptr<osg::Vec3Array> v = new osg::Vec3Array;
+    // Using the push_back interface, after reserving room for all four.
+    osg::ref_ptr<osg::Vec3Array> v = arenaNew<osg::Vec3Array>();
     geom->setVertexArray( v.get() );
+    v->reserve( 4 );
     v->push_back( osg::Vec3( -1.f, 0.f, -1.f ) );
     v->push_back( osg::Vec3( 1.f, 0.f, -1.f ) );
     v->push_back( osg::Vec3( 1.f, 0.f, 1.f ) );
     v->push_back( osg::Vec3( -1.f, 0.f, 1.f ) );
 #else
     // Using resize() and operator[]().
-    osg::ref_ptr<osg::Vec3Array> v = new osg::Vec3Array;
+    osg::ref_ptr<osg::Vec3Array> v = arenaNew<osg::Vec3Array>();
     geom->setVertexArray( v.get() );
     v->resize( 4 );
     (*v)[ 0 ] = osg::Vec3( -1.f, 0.f, -1.f );
@@ -36,26 +39,27 @@ createSceneGraph()
 #endif
 
     // Create an array of four colors.
-    osg::ref_ptr<osg::Vec4Array> c = new osg::Vec4Array;
+    osg::ref_ptr<osg::Vec4Array> c = arenaNew<osg::Vec4Array>();
     geom->setColorArray( c.get() );
     geom->setColorBinding( osg::Geometry::BIND_PER_VERTEX );
+    c->reserve( 4 );
     c->push_back( osg::Vec4( 1.f, 0.f, 0.f, 1.f ) );
     c->push_back( osg::Vec4( 0.f, 1.f, 0.f, 1.f ) );
     c->push_back( osg::Vec4( 0.f, 0.f, 1.f, 1.f ) );
     c->push_back( osg::Vec4( 1.f, 1.f, 1.f, 1.f ) );
 
     // Create an array for the single normal.
-    osg::ref_ptr<osg::Vec3Array> n = new osg::Vec3Array;
+    osg::ref_ptr<osg::Vec3Array> n = arenaNew<osg::Vec3Array>();
     geom->setNormalArray( n.get() );
     geom->setNormalBinding( osg::Geometry::BIND_OVERALL );
     n->push_back( osg::Vec3( 0.f, -1.f, 0.f ) );
 
     // Draw a four-vertex quad from the stored data.
     geom->addPrimitiveSet(
-        new osg::DrawArrays( osg::PrimitiveSet::QUADS, 0, 4 ) );
+        arenaNew<osg::DrawArrays>( osg::PrimitiveSet::QUADS, 0, 4 ) );
 
     // Add the Geometry (Drawable) to a Geode and return the Geode.
-    osg::ref_ptr<osg::Geode> geode = new osg::Geode;
+    osg::ref_ptr<osg::Geode> geode = arenaNew<osg::Geode>();
     geode->addDrawable( geom.get() );
     return( geode.release() );
 }
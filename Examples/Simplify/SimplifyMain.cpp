@@ -0,0 +1,62 @@
+//
+// OpenSceneGraph Quick Start Guide
+// http://www.lulu.com/content/767629
+// http://www.openscenegraph.com/osgwiki/pmwiki.php/Documentation/QuickStartGuide
+//
+
+// Simplify, Builds LOD chains for a model offline and writes the result
+
+#include <osgDB/ReadFile>
+#include <osgDB/WriteFile>
+#include <osg/ArgumentParser>
+#include <osg/Notify>
+#include "LodGenerator.h"
+#include <string>
+
+using std::endl;
+
+
+int
+main( int argc, char** argv )
+{
+    osg::ArgumentParser arguments( &argc, argv );
+
+    // Usage: Simplify [--levels n] [--ratio r] [--pixel-error e]
+    //   [--min-triangles n] [--screen-height pixels] [--fov degrees]
+    //   [--threads n] in.osg out.ive
+    LodSettings settings;
+    arguments.read( "--levels", settings._levels );
+    arguments.read( "--ratio", settings._ratio );
+    arguments.read( "--pixel-error", settings._pixelError );
+    arguments.read( "--min-triangles", settings._minTriangles );
+    arguments.read( "--screen-height", settings._screenHeight );
+    arguments.read( "--fov", settings._fieldOfView );
+    arguments.read( "--threads", settings._numThreads );
+    if (arguments.argc() != 3)
+    {
+        osg::notify( osg::FATAL ) << "Usage: " << arguments.getApplicationName() <<
+            " [--levels n] [--ratio r] [--pixel-error e] [--min-triangles n]"
+            " [--screen-height pixels] [--fov degrees] [--threads n] in out" << endl;
+        return 1;
+    }
+    const std::string inName( arguments[ 1 ] );
+    const std::string outName( arguments[ 2 ] );
+
+    osg::ref_ptr< osg::Node > root = osgDB::readNodeFile( inName );
+    if (!root.valid())
+    {
+        osg::notify( osg::FATAL ) << "Unable to load \"" << inName << "\". Exiting." << endl;
+        return 1;
+    }
+
+    LodReport report;
+    root = generateLods( root.get(), settings, report );
+    writeLodReport( osg::notify( osg::ALWAYS ), report );
+
+    if (!osgDB::writeNodeFile( *root, outName ))
+    {
+        osg::notify( osg::FATAL ) << "Unable to write \"" << outName << "\"." << endl;
+        return 1;
+    }
+    return 0;
+}
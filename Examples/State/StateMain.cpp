@@ -7,9 +7,12 @@
 // State Example, Modifying state attributes and modes
 
 #include <osg/ref_ptr>
+#include <osg/ArgumentParser>
 #include <osgDB/Registry>
 #include <osgDB/WriteFile>
+#include <osgDB/FileNameUtils>
 #include <osg/Notify>
+#include "BinaryScene.h"
 #include <iostream>
 
 using std::endl;
@@ -26,12 +29,19 @@ main( int argc, char** argv )
         return( 1 );
     }
 
+    // Usage: State [--out file.osg|file.qsgb]
+    // A .qsgb file is compact binary; see BinaryScene.h.
+    osg::ArgumentParser arguments( &argc, argv );
     std::string out( "State.osg" );
+    arguments.read( "--out", out );
     if ( !(osgDB::writeNodeFile( *(root.get()), out )) )
     {
         osg::notify(osg::FATAL) << "Failed in osgDB::writeNodeFile()." << endl;
         return( 1 );
     }
 
-    osg::notify(osg::ALWAYS) << "Successfully wrote \"" << out << "\". Execute \"osgviewer " << out << "\" to view." << endl;
+    if (osgDB::getLowerCaseFileExtension( out ) == "qsgb")
+        osg::notify(osg::ALWAYS) << "Successfully wrote \"" << out << "\". Read it back with readBinarySceneFile()." << endl;
+    else
+        osg::notify(osg::ALWAYS) << "Successfully wrote \"" << out << "\". Execute \"osgviewer " << out << "\" to view." << endl;
 }
@@ -6,6 +6,7 @@
 
 // State Example, Modifying state attributes and modes
 
+#include "StatePool.h"
 #include <osg/Group>
 #include <osg/MatrixTransform>
 #include <osg/Geode>
@@ -16,6 +17,7 @@
 #include <osg/CullFace>
 #include <osg/PolygonMode>
 #include <osg/LineWidth>
+#include <osg/Notify>
 
 // Create a pair of quadrilateral primitives with color
 //   per vertex and return them as a single Drawable.
@@ -125,5 +127,12 @@ createSceneGraph()
         state->setAttribute( lw );
     }
 
+    // Share equal StateSets and attributes across the scene, the
+    //   loaded models' state included.
+    const StateShareReport report = shareState( root.get() );
+    osg::notify( osg::INFO ) << "Shared state: " << report._stateSetsBefore <<
+        " -> " << report._stateSetsAfter << " StateSets, " << report._attributesBefore <<
+        " -> " << report._attributesAfter << " attributes." << std::endl;
+
     return( root.release() );
 }
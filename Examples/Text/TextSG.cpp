@@ -6,6 +6,7 @@
 
 // Text Example, NodeKits and using the osgText library
 
+#include "GlyphCache.h"
 #include <osg/Geode>
 #include <osg/Geometry>
 #include <osgText/Font>
@@ -51,7 +52,8 @@ createSceneGraph()
 
     geode->addDrawable( createBase() );
 
-    osg::ref_ptr<osgText::Font> font = osgText::readFontFile( "fonts/arial.ttf" );
+    // Glyphs rasterized on an earlier run come from the glyph cache.
+    osg::ref_ptr<osgText::Font> font = readCachedFontFile( "fonts/arial.ttf" );
 
     osg::Vec4 white( 1.f, 1.f, 1.f, 1.f );
 
@@ -88,5 +90,8 @@ createSceneGraph()
         geode->addDrawable( text.get() );
     }
 
+    // Setting the text rasterized any glyphs the cache didn't have.
+    writeGlyphCache( font.get() );
+
     return( geode.release() );
 }
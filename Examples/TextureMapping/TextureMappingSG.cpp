@@ -6,7 +6,7 @@
 
 // Texture Mapping Example, Texture mapped tree, blending, alpha test
 
-#include <osgDB/ReadFile>
+#include "ImageCache.h"
 #include <osg/Geode>
 #include <osg/Geometry>
 #include <osg/StateSet>
@@ -117,6 +117,16 @@ createGeodes()
 osg::Node*
 createSceneGraph()
 {
+    // Start decoding the texture image on a decode thread, and
+    //   build the geometry while it loads.
+    //   Image courtesy Virtual Terrain Project (http://vterrain.org/)
+    std::string fileName( "Picea_pungens__blue_spruce15_256.png" );
+    //   Its mipmaps keep the alpha coverage the alpha test below
+    //   sees, so the tree doesn't thin out with distance.
+    osg::ref_ptr<osgDB::ReaderWriter::Options> options =
+        new osgDB::ReaderWriter::Options( "mipmapAlphaCutoff=0.05" );
+    osg::ref_ptr<ImageRequest> request = readImageFileAsync( fileName, options.get() );
+
     osg::ref_ptr<osg::Node> node = createGeodes();
 
     osg::StateSet* state = node->getOrCreateStateSet();
@@ -124,10 +134,9 @@ createSceneGraph()
         osg::StateAttribute::PROTECTED );
     state->setRenderingHint( osg::StateSet::TRANSPARENT_BIN );
 
-    // Load the texture image
-    //   Image courtesy Virtual Terrain Project (http://vterrain.org/)
-    std::string fileName( "Picea_pungens__blue_spruce15_256.png" );
-    osg::ref_ptr<osg::Image> image = osgDB::readImageFile( fileName );
+    // Wait for the texture image. After the first run, it comes
+    //   from the decoded image cache, mipmaps included.
+    osg::ref_ptr<osg::Image> image = request->getImage();
     if (!image.valid())
     {
         osg::notify( osg::FATAL ) << "Unable to load data file. Exiting." << std::endl;
@@ -8,20 +8,56 @@
 
 #include <osgViewer/Viewer>
 #include <osgDB/ReadFile>
+#include "SceneCache.h"
+#include "GeometryConsolidator.h"
+#include "FastBounds.h"
+#include "ImageCache.h"
+#include "FrameRecorder.h"
+#include "LodGenerator.h"
+#include <osg/ArgumentParser>
+#include <csignal>
 
 int
-main( int, char ** )
+main( int argc, char** argv )
 {
     // Create a Viewer.
     osgViewer::Viewer viewer;
 
-    // Load a model and add it to the Viewer.
-    viewer.setSceneData( osgDB::readNodeFile( "cow.osg" ) );
-    if (!viewer.getSceneData())
+    // Read the images models load, such as cow.osg's reflect.rgb,
+    //   through the decoded image cache.
+    osgDB::Registry::instance()->setReadFileCallback( new CachedImageReadCallback );
+
+    // Usage: Viewer [--frame-stats file.csv|file.json]
+    //   [--lod [--lod-levels n] [--lod-ratio r] [--lod-pixel-error e]]
+    osg::ArgumentParser arguments( &argc, argv );
+
+    // Load a model and add it to the Viewer. After the first run,
+    //   this reads a cached binary copy instead of parsing cow.osg.
+    osg::ref_ptr< osg::Node > scene = readCachedNodeFile( "cow.osg" );
+    if (!scene.valid())
     {
         osg::notify( osg::FATAL ) << "Unable to load data file. Exiting." << std::endl;
         return 1;
     }
+    // Merge the model's fragmented primitive sets, and give its
+    //   large Geometry SIMD bounds.
+    consolidateGeometry( scene.get() );
+    installFastBounds( scene.get() );
+
+    // With --lod, each mesh becomes an LOD of simplified copies,
+    //   switching where the coarser copy's error drops below the
+    //   pixel error on screen.
+    if (arguments.read( "--lod" ))
+    {
+        LodSettings settings;
+        arguments.read( "--lod-levels", settings._levels );
+        arguments.read( "--lod-ratio", settings._ratio );
+        arguments.read( "--lod-pixel-error", settings._pixelError );
+        LodReport report;
+        scene = generateLods( scene.get(), settings, report );
+        writeLodReport( osg::notify( osg::NOTICE ), report );
+    }
+    viewer.setSceneData( scene.get() );
 
     // TBD. Waiting for this file to get a permanent location after
     //   the dimain name shuffle. THis is a better example than the
@@ -29,6 +65,22 @@ main( int, char ** )
     //viewer.setSceneData( osgDB::readNodeFile(
     //    "http://www.openscenegraph.org/downloads/data/Earth/model.ive" ) );
 
+    // Event, update, cull and draw times are always recorded. With
+    //   --frame-stats, their percentiles are written to the file on
+    //   exit, and on SIGUSR1 while running.
+    FrameRecorder* recorder = FrameRecorder::instance();
+    std::string frameStats;
+    if (arguments.read( "--frame-stats", frameStats ))
+        recorder->setOutputFile( frameStats );
+    recorder->attach( viewer );
+#ifdef SIGUSR1
+    if (!frameStats.empty())
+        FrameRecorder::writeOnSignal( SIGUSR1 );
+#endif
+
     // Display, and main loop.
-    return viewer.run();
+    const int result = viewer.run();
+    if (!frameStats.empty())
+        recorder->write();
+    return( result );
 }